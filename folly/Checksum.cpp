@@ -19,6 +19,7 @@
 #include <folly/CpuId.h>
 #include <folly/detail/ChecksumDetail.h>
 #include <algorithm>
+#include <array>
 #include <stdexcept>
 
 #if FOLLY_SSE_PREREQ(4, 2)
@@ -109,6 +110,42 @@ uint32_t crc_sw(const uint8_t* data, size_t nbytes, uint32_t startingChecksum) {
   return sum.checksum();
 }
 
+// Multiply two polynomials modulo the CRC polynomial, all of them in the
+// bit-reflected form the CRCs here use (the top bit is x^0).
+uint32_t gf_multiply(uint32_t a, uint32_t b, uint32_t reflectedPolynomial) {
+  uint32_t product = 0;
+  for (int i = 0; i < 32; ++i) {
+    product ^= (0 - (a >> 31)) & b;
+    a <<= 1;
+    b = (b >> 1) ^ ((0 - (b & 1)) & reflectedPolynomial);
+  }
+  return product;
+}
+
+template <uint32_t REFLECTED_POLYNOMIAL>
+uint32_t crc_combine(uint32_t crc1, uint32_t crc2, size_t crc2len) {
+  // powers[i] is x^(8 * 2^i), which appends 2^i zero bytes.
+  static const auto powers = [] {
+    std::array<uint32_t, 64> result;
+    result[0] = 1U << (31 - 8);
+    for (size_t i = 1; i < result.size(); ++i) {
+      result[i] =
+          gf_multiply(result[i - 1], result[i - 1], REFLECTED_POLYNOMIAL);
+    }
+    return result;
+  }();
+
+  // CRCs are linear, so crc(A . B) is crc2 with the part contributed by the
+  // starting checksum replaced by that of crc1, shifted past B.
+  crc1 ^= ~0U;
+  for (size_t i = 0; crc2len != 0; ++i, crc2len >>= 1) {
+    if (crc2len & 1) {
+      crc1 = gf_multiply(crc1, powers[i], REFLECTED_POLYNOMIAL);
+    }
+  }
+  return crc1 ^ crc2;
+}
+
 uint32_t
 crc32c_sw(const uint8_t* data, size_t nbytes, uint32_t startingChecksum) {
   constexpr uint32_t CRC32C_POLYNOMIAL = 0x1EDC6F41;
@@ -145,4 +182,14 @@ crc32_type(const uint8_t* data, size_t nbytes, uint32_t startingChecksum) {
   return ~crc32(data, nbytes, startingChecksum);
 }
 
+uint32_t crc32c_combine(uint32_t crc1, uint32_t crc2, size_t crc2len) {
+  constexpr uint32_t CRC32C_REFLECTED_POLYNOMIAL = 0x82F63B78;
+  return detail::crc_combine<CRC32C_REFLECTED_POLYNOMIAL>(crc1, crc2, crc2len);
+}
+
+uint32_t crc32_combine(uint32_t crc1, uint32_t crc2, size_t crc2len) {
+  constexpr uint32_t CRC32_REFLECTED_POLYNOMIAL = 0xEDB88320;
+  return detail::crc_combine<CRC32_REFLECTED_POLYNOMIAL>(crc1, crc2, crc2len);
+}
+
 } // namespace folly
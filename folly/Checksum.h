@@ -57,4 +57,20 @@ crc32(const uint8_t* data, size_t nbytes, uint32_t startingChecksum = ~0U);
 uint32_t
 crc32_type(const uint8_t* data, size_t nbytes, uint32_t startingChecksum = ~0U);
 
+/**
+ * Given the CRC-32C checksums of two buffers A and B, return the checksum
+ * of A followed by B, without touching the data.  crc2len is the length of
+ * B in bytes.
+ *
+ * Both checksums must have been computed with the default
+ * startingChecksum.  This lets parts of a large buffer, or of an IOBuf
+ * chain, be checksummed on different threads.
+ */
+uint32_t crc32c_combine(uint32_t crc1, uint32_t crc2, size_t crc2len);
+
+/**
+ * Like crc32c_combine(), for checksums from crc32().
+ */
+uint32_t crc32_combine(uint32_t crc1, uint32_t crc2, size_t crc2len);
+
 } // namespace folly
@@ -0,0 +1,73 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <folly/Indestructible.h>
+#include <folly/Likely.h>
+#include <folly/Portability.h>
+#include <folly/ThreadLocal.h>
+
+namespace folly {
+namespace detail {
+
+/**
+ * A T per thread, created on first use, for per-thread caches that may be
+ * used from other thread locals' destructors.
+ *
+ * get() returns nullptr once the calling thread has started destroying its
+ * T, rather than creating a new one that would never be destroyed or
+ * handing out the one being destroyed; callers do without the cache then.
+ * T's destructor runs after that point, so it sees nullptr too.
+ */
+template <class T>
+class ThreadLocalUntilExit {
+ public:
+  static T* get() {
+    if (UNLIKELY(tlsObject_ == nullptr) && !tlsExiting_) {
+      static Indestructible<ThreadLocal<Holder>> holders;
+      holders->get();
+    }
+    return tlsObject_;
+  }
+
+ private:
+  ThreadLocalUntilExit() = delete;
+
+  struct Holder {
+    Holder() {
+      tlsObject_ = &object;
+    }
+
+    ~Holder() {
+      tlsObject_ = nullptr;
+      tlsExiting_ = true;
+    }
+
+    T object;
+  };
+
+  static FOLLY_TLS T* tlsObject_;
+  static FOLLY_TLS bool tlsExiting_;
+};
+
+template <class T>
+FOLLY_TLS T* ThreadLocalUntilExit<T>::tlsObject_ = nullptr;
+template <class T>
+FOLLY_TLS bool ThreadLocalUntilExit<T>::tlsExiting_ = false;
+
+} // namespace detail
+} // namespace folly
@@ -0,0 +1,243 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/executors/CPUThreadPoolExecutor.h>
+
+#include <algorithm>
+#include <exception>
+#include <functional>
+#include <typeinfo>
+
+#include <glog/logging.h>
+
+#include <folly/Likely.h>
+#include <folly/small_vector.h>
+
+namespace folly {
+
+namespace {
+
+// The pool (if any) owning the current thread, and that thread's own deque.
+thread_local CPUThreadPoolExecutor* currentPool = nullptr;
+thread_local size_t currentHome = 0;
+
+// Round-robin cursor for adds from threads outside the pool. Seeded from the
+// thread id so that unrelated producers start on different deques.
+size_t nextExternalQueue() {
+  thread_local size_t cursor =
+      std::hash<std::thread::id>()(std::this_thread::get_id());
+  return cursor++;
+}
+
+} // namespace
+
+constexpr size_t CPUThreadPoolExecutor::kMaxStealBatch;
+
+CPUThreadPoolExecutor::CPUThreadPoolExecutor(
+    size_t numThreads,
+    std::shared_ptr<ThreadFactory> threadFactory)
+    : ThreadPoolExecutor(numThreads, std::move(threadFactory)),
+      numQueues_(std::max<size_t>(numThreads, 1)),
+      queues_(new CachelinePadded<WorkQueue>[numQueues_]) {
+  setNumThreads(numThreads);
+}
+
+CPUThreadPoolExecutor::~CPUThreadPoolExecutor() {
+  stop();
+  CHECK_EQ(0, threadsToStop_.load());
+}
+
+void CPUThreadPoolExecutor::add(Func func) {
+  const auto index = currentPool == this
+      ? currentHome
+      : nextExternalQueue() % numQueues_;
+  push(index, std::move(func));
+  wakeIdleThread();
+}
+
+uint64_t CPUThreadPoolExecutor::getPendingTaskCount() {
+  uint64_t count = 0;
+  for (size_t i = 0; i < numQueues_; ++i) {
+    count += queues_[i]->size.load(std::memory_order_relaxed);
+  }
+  return count;
+}
+
+ThreadPoolExecutor::ThreadPtr CPUThreadPoolExecutor::makeThread() {
+  return std::make_shared<CPUThread>(
+      this, nextHome_.fetch_add(1, std::memory_order_relaxed) % numQueues_);
+}
+
+void CPUThreadPoolExecutor::push(size_t index, Func func) {
+  auto& queue = *queues_[index];
+  SpinLockGuard g(queue.lock);
+  queue.tasks.push_back(std::move(func));
+  queue.size.store(queue.tasks.size(), std::memory_order_relaxed);
+}
+
+bool CPUThreadPoolExecutor::pop(size_t index, Func& task) {
+  auto& queue = *queues_[index];
+  if (queue.size.load(std::memory_order_relaxed) == 0) {
+    return false;
+  }
+  SpinLockGuard g(queue.lock);
+  if (queue.tasks.empty()) {
+    return false;
+  }
+  task = std::move(queue.tasks.front());
+  queue.tasks.pop_front();
+  queue.size.store(queue.tasks.size(), std::memory_order_relaxed);
+  return true;
+}
+
+bool CPUThreadPoolExecutor::steal(size_t home, Func& task) {
+  for (size_t i = 1; i < numQueues_; ++i) {
+    auto& victim = *queues_[(home + i) % numQueues_];
+    if (victim.size.load(std::memory_order_relaxed) == 0) {
+      continue;
+    }
+
+    // Take half of the victim's backlog: one task to run now, the rest moved
+    // to our own deque so that we don't come back for each of them.
+    small_vector<Func, kMaxStealBatch> batch;
+    {
+      SpinLockGuard g(victim.lock);
+      if (victim.tasks.empty()) {
+        continue;
+      }
+      const auto n = std::min(kMaxStealBatch, (victim.tasks.size() + 1) / 2);
+      task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      for (size_t j = 1; j < n; ++j) {
+        batch.push_back(std::move(victim.tasks.front()));
+        victim.tasks.pop_front();
+      }
+      victim.size.store(victim.tasks.size(), std::memory_order_relaxed);
+    }
+
+    if (!batch.empty()) {
+      auto& queue = *queues_[home];
+      SpinLockGuard g(queue.lock);
+      for (auto& func : batch) {
+        queue.tasks.push_back(std::move(func));
+      }
+      queue.size.store(queue.tasks.size(), std::memory_order_relaxed);
+    }
+    stealCount_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+  return false;
+}
+
+bool CPUThreadPoolExecutor::takeTask(size_t home, Func& task) {
+  return pop(home, task) || steal(home, task);
+}
+
+void CPUThreadPoolExecutor::runTask(const ThreadPtr& thread, Func& task) {
+  thread->idle.store(false, std::memory_order_relaxed);
+  try {
+    task();
+  } catch (const std::exception& e) {
+    LOG(ERROR) << "CPUThreadPoolExecutor: func threw unhandled "
+               << typeid(e).name() << " exception: " << e.what();
+  } catch (...) {
+    LOG(ERROR) << "CPUThreadPoolExecutor: func threw unhandled non-exception "
+                  "object";
+  }
+  // Release whatever the task captured before we go looking for more work.
+  task = nullptr;
+  thread->idle.store(true, std::memory_order_relaxed);
+}
+
+void CPUThreadPoolExecutor::wakeIdleThread() {
+  // Pairs with the fence in threadRun(): either the parking thread sees the
+  // task we just pushed, or we see it counted in idleThreads_.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (idleThreads_.load(std::memory_order_relaxed) > 0) {
+    sem_.post();
+  }
+}
+
+bool CPUThreadPoolExecutor::tryClaimStop() {
+  auto n = threadsToStop_.load(std::memory_order_relaxed);
+  while (n > 0) {
+    if (threadsToStop_.compare_exchange_weak(n, n - 1)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void CPUThreadPoolExecutor::threadRun(ThreadPtr thread) {
+  const auto home = static_cast<CPUThread&>(*thread).home;
+  currentPool = this;
+  currentHome = home;
+  thread->startupBaton.post();
+
+  Func task;
+  while (true) {
+    // stop() and shrinking leave at the next task boundary; whatever is left
+    // in our deque gets stolen by the remaining threads.
+    if (UNLIKELY(threadsToStop_.load(std::memory_order_relaxed) > 0) &&
+        !isJoin_.load(std::memory_order_relaxed) && tryClaimStop()) {
+      break;
+    }
+    if (takeTask(home, task)) {
+      runTask(thread, task);
+      continue;
+    }
+    // join() leaves only once there is nothing left to run.
+    if (threadsToStop_.load(std::memory_order_relaxed) > 0 && tryClaimStop()) {
+      break;
+    }
+
+    // Announce that we are about to park, then look once more so that a
+    // task pushed before the announcement became visible isn't missed.
+    idleThreads_.fetch_add(1, std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (takeTask(home, task)) {
+      idleThreads_.fetch_sub(1, std::memory_order_relaxed);
+      runTask(thread, task);
+      continue;
+    }
+    sem_.wait();
+    idleThreads_.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  currentPool = nullptr;
+  stoppedThreads_.add(thread);
+}
+
+// threadListLock_ is writelocked
+void CPUThreadPoolExecutor::stopThreads(size_t n) {
+  if (!isJoin_ && n == threadList_.size()) {
+    // stop(): nothing queued gets to run. Destroy the tasks outside of the
+    // queue locks, since their destructors may add() more work.
+    for (size_t i = 0; i < numQueues_; ++i) {
+      auto& queue = *queues_[i];
+      std::deque<Func> discarded;
+      {
+        SpinLockGuard g(queue.lock);
+        discarded.swap(queue.tasks);
+        queue.size.store(0, std::memory_order_relaxed);
+      }
+    }
+  }
+  threadsToStop_.fetch_add(n, std::memory_order_seq_cst);
+  sem_.post(n);
+}
+
+} // namespace folly
@@ -0,0 +1,109 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <memory>
+
+#include <folly/CachelinePadded.h>
+#include <folly/LifoSem.h>
+#include <folly/SpinLock.h>
+#include <folly/executors/NamedThreadFactory.h>
+#include <folly/executors/ThreadPoolExecutor.h>
+
+namespace folly {
+
+/**
+ * A thread pool for CPU bound work, with one task deque per worker.
+ *
+ * Tasks added from a pool thread go to that thread's own deque; tasks added
+ * from anywhere else are spread round-robin over the deques, so producers
+ * and consumers don't all contend on a single queue. A worker whose deque is
+ * empty steals a batch of tasks from the front of another worker's deque.
+ * Workers with nothing to run or steal park on a LifoSem, so the most
+ * recently active (cache-warm) thread is the first one woken, and add() only
+ * touches the semaphore when some worker is actually parked.
+ *
+ * Tasks from a single producer normally run in FIFO order, but nothing is
+ * guaranteed once stealing kicks in.
+ *
+ * The number of deques is fixed at construction to the initial thread count.
+ * Threads added later share deques; deques left without a thread after the
+ * pool shrinks are drained by stealing.
+ */
+class CPUThreadPoolExecutor : public ThreadPoolExecutor {
+ public:
+  explicit CPUThreadPoolExecutor(
+      size_t numThreads,
+      std::shared_ptr<ThreadFactory> threadFactory =
+          std::make_shared<NamedThreadFactory>("CPUThreadPool"));
+
+  ~CPUThreadPoolExecutor() override;
+
+  void add(Func func) override;
+
+  uint64_t getPendingTaskCount() override;
+
+  /// Number of times a worker took tasks from another worker's deque.
+  uint64_t getStealCount() const {
+    return stealCount_.load(std::memory_order_relaxed);
+  }
+
+  /// Maximum number of tasks moved by a single steal.
+  static constexpr size_t kMaxStealBatch = 16;
+
+ protected:
+  ThreadPtr makeThread() override;
+  void threadRun(ThreadPtr thread) override;
+  void stopThreads(size_t n) override;
+
+ private:
+  struct WorkQueue {
+    SpinLock lock;
+    std::deque<Func> tasks;
+    // tasks.size(), readable without the lock for scans and stats
+    std::atomic<size_t> size{0};
+  };
+
+  struct CPUThread : public Thread {
+    CPUThread(ThreadPoolExecutor* pool, size_t home)
+        : Thread(pool), home(home) {}
+    const size_t home;
+  };
+
+  void push(size_t index, Func func);
+  bool pop(size_t index, Func& task);
+  bool steal(size_t home, Func& task);
+  bool takeTask(size_t home, Func& task);
+  void runTask(const ThreadPtr& thread, Func& task);
+  void wakeIdleThread();
+  bool tryClaimStop();
+
+  const size_t numQueues_;
+  std::unique_ptr<CachelinePadded<WorkQueue>[]> queues_;
+  std::atomic<size_t> nextHome_{0};
+
+  LifoSem sem_;
+  // Threads that are parked on sem_ or about to be. Each parking thread
+  // maintains its own contribution, so this never drifts.
+  std::atomic<size_t> idleThreads_{0};
+  std::atomic<size_t> threadsToStop_{0};
+  std::atomic<uint64_t> stealCount_{0};
+};
+
+} // namespace folly
@@ -0,0 +1,35 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <folly/Executor.h>
+
+namespace folly {
+
+class EventBase;
+
+/**
+ * An Executor which can also hand out the EventBases it runs tasks on, so
+ * that sockets and other IO objects can be attached to them.
+ */
+class IOExecutor : public virtual Executor {
+ public:
+  ~IOExecutor() override = default;
+  virtual EventBase* getEventBase() = 0;
+};
+
+} // namespace folly
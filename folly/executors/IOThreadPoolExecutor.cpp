@@ -0,0 +1,191 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/executors/IOThreadPoolExecutor.h>
+
+#include <cmath>
+#include <exception>
+#include <stdexcept>
+#include <typeinfo>
+
+#include <glog/logging.h>
+
+namespace folly {
+
+thread_local IOThreadPoolExecutor* IOThreadPoolExecutor::currentPool_ =
+    nullptr;
+thread_local IOThreadPoolExecutor::IOThread*
+    IOThreadPoolExecutor::currentThread_ = nullptr;
+
+constexpr double IOThreadPoolExecutor::kBusyWeight;
+constexpr double IOThreadPoolExecutor::kBusyWindowUsec;
+
+/**
+ * Keeps IOThread::busyFraction up to date from every loop iteration, and
+ * forwards samples to whichever observer the EventBase had before.
+ */
+class IOThreadPoolExecutor::LoadObserver : public EventBaseObserver {
+ public:
+  LoadObserver(IOThread& thread, std::shared_ptr<EventBaseObserver> next)
+      : thread_(thread), next_(std::move(next)) {}
+
+  uint32_t getSampleRate() const override {
+    return 0;
+  }
+
+  void loopSample(int64_t busyTime, int64_t idleTime) override {
+    const auto total = busyTime + idleTime;
+    if (total > 0) {
+      // Weigh each sample by the wall time it covers, so that many short
+      // iterations and a few long ones move the average alike.
+      const auto weight = 1.0 - std::exp(-double(total) / kBusyWindowUsec);
+      value_ += weight * (double(busyTime) / double(total) - value_);
+      thread_.busyFraction.store(value_, std::memory_order_relaxed);
+    }
+    if (next_ && nextSampleCount_++ == next_->getSampleRate()) {
+      nextSampleCount_ = 0;
+      next_->loopSample(busyTime, idleTime);
+    }
+  }
+
+ private:
+  IOThread& thread_;
+  std::shared_ptr<EventBaseObserver> next_;
+  uint32_t nextSampleCount_{0};
+  double value_{0.0};
+};
+
+IOThreadPoolExecutor::IOThreadPoolExecutor(
+    size_t numThreads,
+    std::shared_ptr<ThreadFactory> threadFactory,
+    EventBaseManager* ebm)
+    : ThreadPoolExecutor(numThreads, std::move(threadFactory)),
+      eventBaseManager_(ebm) {
+  setNumThreads(numThreads);
+}
+
+IOThreadPoolExecutor::~IOThreadPoolExecutor() {
+  stop();
+}
+
+void IOThreadPoolExecutor::add(Func func) {
+  // Pool threads keep to their own loop and don't need the lock, which also
+  // lets tasks call add() while the pool is being resized or joined.
+  SharedMutex::ReadHolder r{currentPool_ == this ? nullptr : &threadListLock_};
+  auto& thread = pickThread();
+  auto evb = thread.eventBase.load(std::memory_order_relaxed);
+  thread.pendingTasks.fetch_add(1, std::memory_order_relaxed);
+  evb->runInEventBaseThread([&thread, func = std::move(func) ]() mutable {
+    try {
+      func();
+    } catch (const std::exception& e) {
+      LOG(ERROR) << "IOThreadPoolExecutor: func threw unhandled "
+                 << typeid(e).name() << " exception: " << e.what();
+    } catch (...) {
+      LOG(ERROR) << "IOThreadPoolExecutor: func threw unhandled non-exception "
+                    "object";
+    }
+    thread.pendingTasks.fetch_sub(1, std::memory_order_relaxed);
+  });
+}
+
+EventBase* IOThreadPoolExecutor::getEventBase() {
+  SharedMutex::ReadHolder r{currentPool_ == this ? nullptr : &threadListLock_};
+  return pickThread().eventBase.load(std::memory_order_relaxed);
+}
+
+uint64_t IOThreadPoolExecutor::getPendingTaskCount() {
+  uint64_t count = 0;
+  SharedMutex::ReadHolder r{&threadListLock_};
+  for (const auto& thread : threadList_) {
+    count += static_cast<IOThread&>(*thread).pendingTasks.load(
+        std::memory_order_relaxed);
+  }
+  return count;
+}
+
+ThreadPoolExecutor::ThreadPtr IOThreadPoolExecutor::makeThread() {
+  return std::make_shared<IOThread>(this);
+}
+
+size_t IOThreadPoolExecutor::loadOf(IOThread& thread) {
+  auto evb = thread.eventBase.load(std::memory_order_relaxed);
+  return evb->getNotificationQueueSize() +
+      size_t(kBusyWeight * thread.busyFraction.load(std::memory_order_relaxed));
+}
+
+// threadListLock_ is readlocked, unless called from a pool thread
+IOThreadPoolExecutor::IOThread& IOThreadPoolExecutor::pickThread() {
+  if (currentPool_ == this) {
+    return *currentThread_;
+  }
+
+  const auto n = threadList_.size();
+  if (n == 0) {
+    throw std::runtime_error("No threads available");
+  }
+  // Scan starting after the previous pick so that ties rotate.
+  const auto start = nextThread_.fetch_add(1, std::memory_order_relaxed);
+  auto best = &static_cast<IOThread&>(*threadList_[start % n]);
+  auto bestLoad = loadOf(*best);
+  for (size_t i = 1; i < n && bestLoad > 0; ++i) {
+    auto& candidate = static_cast<IOThread&>(*threadList_[(start + i) % n]);
+    const auto load = loadOf(candidate);
+    if (load < bestLoad) {
+      best = &candidate;
+      bestLoad = load;
+    }
+  }
+  return *best;
+}
+
+void IOThreadPoolExecutor::threadRun(ThreadPtr thread) {
+  auto& ioThread = static_cast<IOThread&>(*thread);
+  auto evb = eventBaseManager_->getEventBase();
+  evb->setObserver(
+      std::make_shared<LoadObserver>(ioThread, evb->getObserver()));
+  ioThread.eventBase.store(evb, std::memory_order_relaxed);
+  currentPool_ = this;
+  currentThread_ = &ioThread;
+  thread->startupBaton.post();
+
+  while (ioThread.shouldRun.load(std::memory_order_relaxed)) {
+    evb->loopForever();
+  }
+  if (isJoin_) {
+    while (ioThread.pendingTasks.load(std::memory_order_relaxed) > 0) {
+      evb->loopOnce();
+    }
+  }
+
+  currentPool_ = nullptr;
+  currentThread_ = nullptr;
+  ioThread.eventBase.store(nullptr, std::memory_order_relaxed);
+  eventBaseManager_->clearEventBase();
+  stoppedThreads_.add(thread);
+}
+
+// threadListLock_ is writelocked
+void IOThreadPoolExecutor::stopThreads(size_t n) {
+  // Stop the most recently added threads first.
+  for (size_t i = threadList_.size() - n; i < threadList_.size(); ++i) {
+    auto& ioThread = static_cast<IOThread&>(*threadList_[i]);
+    ioThread.shouldRun.store(false, std::memory_order_relaxed);
+    ioThread.eventBase.load(std::memory_order_relaxed)->terminateLoopSoon();
+  }
+}
+
+} // namespace folly
@@ -0,0 +1,105 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+#include <folly/executors/IOExecutor.h>
+#include <folly/executors/NamedThreadFactory.h>
+#include <folly/executors/ThreadPoolExecutor.h>
+#include <folly/io/async/EventBaseManager.h>
+
+namespace folly {
+
+/**
+ * A thread pool where every thread runs an EventBase loop.
+ *
+ * getEventBase() and add() pick the least loaded loop rather than going
+ * round-robin. A loop's load is the number of functions waiting in its
+ * runInEventBaseThread() queue plus kBusyWeight times the fraction of time
+ * it has recently spent busy (as opposed to blocked waiting for events),
+ * rounded down. Ties go to the loop after the previous pick, so loops that
+ * are all (nearly) idle are still handed out round-robin. When called from
+ * one of the pool's own threads, getEventBase() and add() stick to that
+ * thread's loop.
+ *
+ * Each loop is registered with the given EventBaseManager for its thread,
+ * so EventBaseManager::get()->getEventBase() works from tasks and callbacks.
+ * The pool installs an EventBaseObserver on each loop to measure busy time;
+ * an observer set by the EventBaseManager is still sampled, but replacing
+ * the pool's observer with setObserver() disables load tracking.
+ *
+ * When a thread is stopped its EventBase is destroyed, so everything
+ * attached to it must be detached first.
+ */
+class IOThreadPoolExecutor : public ThreadPoolExecutor, public IOExecutor {
+ public:
+  explicit IOThreadPoolExecutor(
+      size_t numThreads,
+      std::shared_ptr<ThreadFactory> threadFactory =
+          std::make_shared<NamedThreadFactory>("IOThreadPool"),
+      EventBaseManager* ebm = folly::EventBaseManager::get());
+
+  ~IOThreadPoolExecutor() override;
+
+  void add(Func func) override;
+
+  EventBase* getEventBase() override;
+
+  EventBaseManager* getEventBaseManager() {
+    return eventBaseManager_;
+  }
+
+  uint64_t getPendingTaskCount() override;
+
+  /// How many queued functions a fully busy loop is worth.
+  static constexpr double kBusyWeight = 64.0;
+
+  /// Time constant (in microseconds) of the busy fraction's moving average.
+  static constexpr double kBusyWindowUsec = 100000.0;
+
+ private:
+  class LoadObserver;
+
+  struct FOLLY_ALIGN_TO_AVOID_FALSE_SHARING IOThread : public Thread {
+    explicit IOThread(IOThreadPoolExecutor* pool)
+        : Thread(pool), shouldRun(true), pendingTasks(0), busyFraction(0.0) {}
+
+    std::atomic<bool> shouldRun;
+    // Tasks queued through add() which haven't run yet.
+    std::atomic<size_t> pendingTasks;
+    // Written by the loop thread, read by whoever picks a loop.
+    std::atomic<double> busyFraction;
+    std::atomic<EventBase*> eventBase{nullptr};
+  };
+
+  ThreadPtr makeThread() override;
+  IOThread& pickThread();
+  static size_t loadOf(IOThread& thread);
+  void threadRun(ThreadPtr thread) override;
+  void stopThreads(size_t n) override;
+
+  // The pool and thread (if any) the current thread belongs to.
+  static thread_local IOThreadPoolExecutor* currentPool_;
+  static thread_local IOThread* currentThread_;
+
+  std::atomic<size_t> nextThread_{0};
+  EventBaseManager* eventBaseManager_;
+};
+
+} // namespace folly
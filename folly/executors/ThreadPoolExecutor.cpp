@@ -0,0 +1,151 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/executors/ThreadPoolExecutor.h>
+
+#include <algorithm>
+#include <exception>
+
+#include <glog/logging.h>
+
+namespace folly {
+
+std::atomic<uint64_t> ThreadPoolExecutor::Thread::nextId(0);
+
+ThreadPoolExecutor::ThreadPoolExecutor(
+    size_t /* numThreads */,
+    std::shared_ptr<ThreadFactory> threadFactory)
+    : threadFactory_(std::move(threadFactory)), isJoin_(false) {}
+
+ThreadPoolExecutor::~ThreadPoolExecutor() {
+  CHECK_EQ(0, threadList_.size());
+}
+
+size_t ThreadPoolExecutor::numThreads() {
+  SharedMutex::ReadHolder r{&threadListLock_};
+  return threadList_.size();
+}
+
+void ThreadPoolExecutor::setNumThreads(size_t n) {
+  SharedMutex::WriteHolder w{&threadListLock_};
+  const auto current = threadList_.size();
+  if (n > current) {
+    addThreads(n - current);
+  } else if (n < current) {
+    removeThreads(current - n, false);
+  }
+  CHECK_EQ(n, threadList_.size());
+}
+
+// threadListLock_ is writelocked
+void ThreadPoolExecutor::addThreads(size_t n) {
+  std::vector<ThreadPtr> newThreads;
+  newThreads.reserve(n);
+  for (size_t i = 0; i < n; i++) {
+    newThreads.push_back(makeThread());
+  }
+  // If a thread can't be created, newThread() throws (std::system_error for
+  // std::thread).  The threads started before it are stopped and joined
+  // again before the exception propagates: when we're called from a derived
+  // class's constructor, its destructor won't run to do that.
+  size_t started = 0;
+  std::exception_ptr error;
+  for (auto& thread : newThreads) {
+    try {
+      thread->handle = threadFactory_->newThread(
+          std::bind(&ThreadPoolExecutor::threadRun, this, thread));
+    } catch (...) {
+      error = std::current_exception();
+      break;
+    }
+    threadList_.push_back(thread);
+    ++started;
+  }
+  for (size_t i = 0; i < started; i++) {
+    newThreads[i]->startupBaton.wait();
+  }
+  if (error) {
+    removeThreads(started, false);
+    std::rethrow_exception(error);
+  }
+}
+
+// threadListLock_ is writelocked
+void ThreadPoolExecutor::removeThreads(size_t n, bool isJoin) {
+  CHECK_LE(n, threadList_.size());
+  isJoin_ = isJoin;
+  stopThreads(n);
+  for (size_t i = 0; i < n; i++) {
+    auto thread = stoppedThreads_.take();
+    thread->handle.join();
+    auto it = std::find(threadList_.begin(), threadList_.end(), thread);
+    CHECK(it != threadList_.end());
+    threadList_.erase(it);
+  }
+  isJoin_ = false;
+}
+
+void ThreadPoolExecutor::stop() {
+  stopAndJoinAllThreads(false);
+}
+
+void ThreadPoolExecutor::join() {
+  stopAndJoinAllThreads(true);
+}
+
+void ThreadPoolExecutor::stopAndJoinAllThreads(bool isJoin) {
+  SharedMutex::WriteHolder w{&threadListLock_};
+  removeThreads(threadList_.size(), isJoin);
+}
+
+ThreadPoolExecutor::PoolStats ThreadPoolExecutor::getPoolStats() {
+  ThreadPoolExecutor::PoolStats stats;
+  {
+    SharedMutex::ReadHolder r{&threadListLock_};
+    for (const auto& thread : threadList_) {
+      if (thread->idle.load(std::memory_order_relaxed)) {
+        stats.idleThreadCount++;
+      } else {
+        stats.activeThreadCount++;
+      }
+    }
+    stats.threadCount = threadList_.size();
+  }
+  stats.pendingTaskCount = getPendingTaskCount();
+  return stats;
+}
+
+ThreadPoolExecutor::ThreadPtr ThreadPoolExecutor::makeThread() {
+  return std::make_shared<Thread>(this);
+}
+
+void ThreadPoolExecutor::StoppedThreadQueue::add(ThreadPtr thread) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_.push(std::move(thread));
+  }
+  cv_.notify_one();
+}
+
+ThreadPoolExecutor::ThreadPtr ThreadPoolExecutor::StoppedThreadQueue::take() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  cv_.wait(lock, [&] { return !queue_.empty(); });
+  auto thread = std::move(queue_.front());
+  queue_.pop();
+  return thread;
+}
+
+} // namespace folly
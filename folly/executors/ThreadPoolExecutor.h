@@ -0,0 +1,154 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include <folly/Baton.h>
+#include <folly/Executor.h>
+#include <folly/SharedMutex.h>
+#include <folly/concurrency/CacheLocality.h>
+#include <folly/executors/ThreadFactory.h>
+
+namespace folly {
+
+/**
+ * Base class for executors which run tasks on a pool of threads that they
+ * own. It handles the thread bookkeeping (creating threads through a
+ * ThreadFactory, growing and shrinking the pool, stop() and join()); the
+ * subclass decides how tasks are queued and what each thread runs.
+ *
+ * Subclasses must call stop() or join() from their destructor, since the
+ * threads use subclass state until they exit.
+ *
+ * Resizing, stop() and join() wait for threads to exit, so they must not be
+ * called from a task running on the same pool.
+ */
+class ThreadPoolExecutor : public virtual Executor {
+ public:
+  explicit ThreadPoolExecutor(
+      size_t numThreads,
+      std::shared_ptr<ThreadFactory> threadFactory);
+
+  ~ThreadPoolExecutor() override;
+
+  void add(Func func) override = 0;
+
+  void setThreadFactory(std::shared_ptr<ThreadFactory> threadFactory) {
+    CHECK(numThreads() == 0);
+    threadFactory_ = std::move(threadFactory);
+  }
+
+  std::shared_ptr<ThreadFactory> getThreadFactory() {
+    return threadFactory_;
+  }
+
+  size_t numThreads();
+  void setNumThreads(size_t numThreads);
+
+  /**
+   * Stops all threads. Tasks which are already running are allowed to
+   * finish; tasks still waiting in the queue are discarded.
+   */
+  void stop();
+
+  /**
+   * Runs every task that is already queued (including tasks those tasks
+   * enqueue), then stops all threads.
+   */
+  void join();
+
+  struct PoolStats {
+    PoolStats()
+        : threadCount(0),
+          idleThreadCount(0),
+          activeThreadCount(0),
+          pendingTaskCount(0) {}
+    size_t threadCount, idleThreadCount, activeThreadCount;
+    uint64_t pendingTaskCount;
+  };
+
+  PoolStats getPoolStats();
+
+  virtual uint64_t getPendingTaskCount() = 0;
+
+ protected:
+  struct FOLLY_ALIGN_TO_AVOID_FALSE_SHARING Thread {
+    explicit Thread(ThreadPoolExecutor* pool)
+        : id(nextId++), handle(), idle(true), pool(pool) {}
+
+    virtual ~Thread() = default;
+
+    static std::atomic<uint64_t> nextId;
+    uint64_t id;
+    std::thread handle;
+    std::atomic<bool> idle;
+    Baton<> startupBaton;
+    ThreadPoolExecutor* pool;
+  };
+
+  typedef std::shared_ptr<Thread> ThreadPtr;
+
+  // Prerequisite: threadListLock_ writelocked
+  void addThreads(size_t n);
+  // Prerequisite: threadListLock_ writelocked
+  void removeThreads(size_t n, bool isJoin);
+
+  // Create a suitable Thread struct
+  virtual ThreadPtr makeThread();
+
+  // Body of each pool thread. Must post thread->startupBaton once running,
+  // and hand the thread to stoppedThreads_ right before returning.
+  virtual void threadRun(ThreadPtr thread) = 0;
+
+  // Make n threads leave threadRun(). isJoin_ says whether they should
+  // finish the remaining work first.
+  // Prerequisite: threadListLock_ writelocked
+  virtual void stopThreads(size_t n) = 0;
+
+  void stopAndJoinAllThreads(bool isJoin);
+
+  // Threads which have left threadRun() and are waiting to be joined.
+  class StoppedThreadQueue {
+   public:
+    void add(ThreadPtr thread);
+    ThreadPtr take();
+
+   private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::queue<ThreadPtr> queue_;
+  };
+
+  std::shared_ptr<ThreadFactory> threadFactory_;
+
+  SharedMutex threadListLock_;
+  std::vector<ThreadPtr> threadList_;
+  StoppedThreadQueue stoppedThreads_;
+  std::atomic<bool> isJoin_; // whether the current downsizing is a join
+};
+
+} // namespace folly
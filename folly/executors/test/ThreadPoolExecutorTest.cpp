@@ -0,0 +1,261 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <set>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <folly/Baton.h>
+#include <folly/executors/CPUThreadPoolExecutor.h>
+#include <folly/executors/IOThreadPoolExecutor.h>
+#include <folly/futures/Future.h>
+#include <folly/portability/GTest.h>
+
+using namespace folly;
+using namespace std::chrono;
+
+TEST(CPUThreadPoolExecutor, runsAllTasks) {
+  CPUThreadPoolExecutor tpe(4);
+  std::atomic<int> completed(0);
+  for (int i = 0; i < 1000; i++) {
+    tpe.add([&] { completed++; });
+  }
+  tpe.join();
+  EXPECT_EQ(1000, completed);
+  EXPECT_EQ(0, tpe.numThreads());
+}
+
+TEST(CPUThreadPoolExecutor, joinRunsNestedTasks) {
+  CPUThreadPoolExecutor tpe(4);
+  std::atomic<int> completed(0);
+  for (int i = 0; i < 100; i++) {
+    tpe.add([&] {
+      for (int j = 0; j < 10; j++) {
+        tpe.add([&] { completed++; });
+      }
+    });
+  }
+  tpe.join();
+  EXPECT_EQ(1000, completed);
+}
+
+TEST(CPUThreadPoolExecutor, stopDiscardsPendingTasks) {
+  CPUThreadPoolExecutor tpe(1);
+  Baton<> started;
+  Baton<> release;
+  std::atomic<int> completed(0);
+  tpe.add([&] {
+    started.post();
+    release.wait();
+    completed++;
+  });
+  started.wait();
+  for (int i = 0; i < 10; i++) {
+    tpe.add([&] { completed++; });
+  }
+  std::thread stopper([&] { tpe.stop(); });
+  /* sleep override */ std::this_thread::sleep_for(milliseconds(10));
+  release.post();
+  stopper.join();
+  EXPECT_EQ(1, completed);
+  EXPECT_EQ(0, tpe.getPendingTaskCount());
+}
+
+TEST(CPUThreadPoolExecutor, idleThreadsSteal) {
+  CPUThreadPoolExecutor tpe(2);
+  Baton<> release;
+  std::atomic<int> completed(0);
+  // Occupy one worker and pile its children on its own deque; the other
+  // worker has to steal them.
+  tpe.add([&] {
+    for (int i = 0; i < 100; i++) {
+      tpe.add([&] { completed++; });
+    }
+    release.wait();
+  });
+  while (completed < 100) {
+    std::this_thread::yield();
+  }
+  EXPECT_GT(tpe.getStealCount(), 0);
+  release.post();
+  tpe.join();
+}
+
+namespace {
+
+// Fails to create any thread after the first limit.
+class FailingThreadFactory : public ThreadFactory {
+ public:
+  explicit FailingThreadFactory(size_t limit) : limit_(limit) {}
+
+  std::thread newThread(Func&& func) override {
+    if (created_ == limit_) {
+      throw std::system_error(
+          std::make_error_code(std::errc::resource_unavailable_try_again));
+    }
+    ++created_;
+    return std::thread(std::move(func));
+  }
+
+ private:
+  size_t limit_;
+  size_t created_{0};
+};
+
+} // namespace
+
+TEST(CPUThreadPoolExecutor, threadCreationFailsInConstructor) {
+  EXPECT_THROW(
+      CPUThreadPoolExecutor(4, std::make_shared<FailingThreadFactory>(2)),
+      std::system_error);
+}
+
+TEST(CPUThreadPoolExecutor, threadCreationFailsOnResize) {
+  CPUThreadPoolExecutor tpe(2, std::make_shared<FailingThreadFactory>(3));
+  EXPECT_THROW(tpe.setNumThreads(4), std::system_error);
+  EXPECT_EQ(2, tpe.numThreads());
+  auto f = via(&tpe).then([] { return 42; });
+  EXPECT_EQ(42, f.get());
+}
+
+TEST(CPUThreadPoolExecutor, resize) {
+  CPUThreadPoolExecutor tpe(2);
+  EXPECT_EQ(2, tpe.numThreads());
+  tpe.setNumThreads(8);
+  EXPECT_EQ(8, tpe.numThreads());
+  tpe.setNumThreads(1);
+  EXPECT_EQ(1, tpe.numThreads());
+
+  std::atomic<int> completed(0);
+  for (int i = 0; i < 100; i++) {
+    tpe.add([&] { completed++; });
+  }
+  tpe.join();
+  EXPECT_EQ(100, completed);
+}
+
+TEST(CPUThreadPoolExecutor, poolStats) {
+  CPUThreadPoolExecutor tpe(2);
+  Baton<> started;
+  Baton<> release;
+  tpe.add([&] {
+    started.post();
+    release.wait();
+  });
+  started.wait();
+  auto stats = tpe.getPoolStats();
+  EXPECT_EQ(2, stats.threadCount);
+  EXPECT_EQ(1, stats.activeThreadCount);
+  EXPECT_EQ(1, stats.idleThreadCount);
+  release.post();
+  tpe.join();
+}
+
+TEST(CPUThreadPoolExecutor, exceptionsDontKillThreads) {
+  CPUThreadPoolExecutor tpe(1);
+  std::atomic<int> completed(0);
+  tpe.add([] { throw std::runtime_error("oops"); });
+  tpe.add([&] { completed++; });
+  tpe.join();
+  EXPECT_EQ(1, completed);
+}
+
+TEST(CPUThreadPoolExecutor, futureVia) {
+  CPUThreadPoolExecutor tpe(4);
+  std::vector<Future<int>> futures;
+  for (int i = 0; i < 100; i++) {
+    futures.push_back(via(&tpe).then([i] { return i; }));
+  }
+  auto sum = collect(futures).get();
+  for (int i = 0; i < 100; i++) {
+    EXPECT_EQ(i, sum[i]);
+  }
+  tpe.join();
+}
+
+TEST(IOThreadPoolExecutor, runsAllTasks) {
+  IOThreadPoolExecutor tpe(4);
+  std::atomic<int> completed(0);
+  for (int i = 0; i < 1000; i++) {
+    tpe.add([&] { completed++; });
+  }
+  tpe.join();
+  EXPECT_EQ(1000, completed);
+  EXPECT_EQ(0, tpe.numThreads());
+}
+
+TEST(IOThreadPoolExecutor, tasksRunOnPoolEventBases) {
+  IOThreadPoolExecutor tpe(2);
+  std::atomic<int> matched(0);
+  for (int i = 0; i < 100; i++) {
+    tpe.add([&] {
+      auto evb = EventBaseManager::get()->getExistingEventBase();
+      if (evb && evb->isInEventBaseThread() && tpe.getEventBase() == evb) {
+        matched++;
+      }
+    });
+  }
+  tpe.join();
+  EXPECT_EQ(100, matched);
+}
+
+TEST(IOThreadPoolExecutor, idlePoolRoundRobins) {
+  IOThreadPoolExecutor tpe(3);
+  std::set<EventBase*> evbs;
+  for (int i = 0; i < 3; i++) {
+    evbs.insert(tpe.getEventBase());
+  }
+  EXPECT_EQ(3, evbs.size());
+}
+
+TEST(IOThreadPoolExecutor, avoidsBackedUpLoop) {
+  IOThreadPoolExecutor tpe(2);
+  auto blocked = tpe.getEventBase();
+  Baton<> started;
+  Baton<> release;
+  blocked->runInEventBaseThread([&] {
+    started.post();
+    release.wait();
+  });
+  started.wait();
+  for (int i = 0; i < 10; i++) {
+    blocked->runInEventBaseThread([] {});
+  }
+  for (int i = 0; i < 10; i++) {
+    EXPECT_NE(blocked, tpe.getEventBase());
+  }
+  release.post();
+  tpe.join();
+}
+
+TEST(IOThreadPoolExecutor, threadCreationFailsInConstructor) {
+  EXPECT_THROW(
+      IOThreadPoolExecutor(4, std::make_shared<FailingThreadFactory>(2)),
+      std::system_error);
+}
+
+TEST(IOThreadPoolExecutor, resize) {
+  IOThreadPoolExecutor tpe(1);
+  tpe.setNumThreads(4);
+  EXPECT_EQ(4, tpe.numThreads());
+  tpe.setNumThreads(2);
+  EXPECT_EQ(2, tpe.numThreads());
+  auto f = via(&tpe).then([] { return 42; });
+  EXPECT_EQ(42, f.get());
+}
@@ -0,0 +1,438 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/experimental/io/EpollBackend.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <stdexcept>
+
+#include <glog/logging.h>
+
+#include <folly/Exception.h>
+#include <folly/Likely.h>
+#include <folly/String.h>
+#include <folly/io/async/EventUtil.h>
+#include <folly/portability/Unistd.h>
+
+namespace folly {
+
+namespace {
+
+// Errors and hangups wake up both readers and writers, as with libevent.
+short toLibeventEvents(uint32_t revents) {
+  short events = 0;
+  if (revents & (EPOLLERR | EPOLLHUP)) {
+    events |= EV_READ | EV_WRITE;
+  }
+  if (revents & (EPOLLIN | EPOLLPRI | EPOLLRDHUP)) {
+    events |= EV_READ;
+  }
+  if (revents & EPOLLOUT) {
+    events |= EV_WRITE;
+  }
+  return events;
+}
+
+} // namespace
+
+EpollBackend::EpollBackend(Options options) : options_(options) {
+  if (options_.maxEvents == 0) {
+    throw std::invalid_argument("EpollBackend: invalid options");
+  }
+
+  epollFd_ = ::epoll_create1(EPOLL_CLOEXEC);
+  if (epollFd_ < 0) {
+    throwSystemError("EpollBackend: epoll_create1() failed");
+  }
+
+  // EventHandler and AsyncTimeout attach their events to an event_base
+  // with event_base_set(), so keep one around even though it never runs.
+  evb_ = event_base_new();
+  if (UNLIKELY(evb_ == nullptr)) {
+    cleanup();
+    throwSystemError("EpollBackend: event_base_new() failed");
+  }
+
+  ready_.resize(options_.maxEvents);
+}
+
+EpollBackend::~EpollBackend() {
+  cleanup();
+}
+
+void EpollBackend::cleanup() {
+  for (auto& entry : fds_) {
+    for (auto record : entry.records) {
+      delete record;
+    }
+  }
+  fds_.clear();
+  for (auto& it : timerEvents_) {
+    delete it.second;
+  }
+  timerEvents_.clear();
+  timers_.clear();
+
+  if (epollFd_ >= 0) {
+    ::close(epollFd_);
+    epollFd_ = -1;
+  }
+  if (evb_) {
+    event_base_free(evb_);
+    evb_ = nullptr;
+  }
+}
+
+int EpollBackend::eb_event_base_loop(int flags) {
+  loopBreak_.store(false, std::memory_order_relaxed);
+
+  while (true) {
+    if (numEvents_ == 0) {
+      return 1;
+    }
+
+    if (readyIndex_ == numReady_) {
+      int ret = ::epoll_wait(
+          epollFd_, ready_.data(), int(ready_.size()), waitTimeout(flags));
+      if (ret < 0) {
+        if (errno != EINTR) {
+          LOG(ERROR) << "EpollBackend: epoll_wait() failed: "
+                     << errnoStr(errno);
+          return -1;
+        }
+        ret = 0;
+      }
+      readyIndex_ = 0;
+      numReady_ = size_t(ret);
+    }
+
+    size_t processed = processReady();
+    processed += processTimers();
+
+    if (loopBreak_.load(std::memory_order_relaxed) ||
+        (flags & EVLOOP_NONBLOCK) || ((flags & EVLOOP_ONCE) && processed)) {
+      break;
+    }
+  }
+
+  return 0;
+}
+
+int EpollBackend::eb_event_base_loopbreak() {
+  loopBreak_.store(true, std::memory_order_relaxed);
+  return 0;
+}
+
+int EpollBackend::waitTimeout(int flags) const {
+  if (flags & EVLOOP_NONBLOCK) {
+    return 0;
+  }
+  if (timers_.empty()) {
+    return -1;
+  }
+  auto wait = std::chrono::duration_cast<std::chrono::microseconds>(
+      timers_.begin()->first - std::chrono::steady_clock::now());
+  if (wait.count() <= 0) {
+    return 0;
+  }
+  // Round up, or the timer would be found not quite due yet.
+  auto ms = (wait.count() + 999) / 1000;
+  return int(std::min<decltype(ms)>(ms, INT_MAX));
+}
+
+size_t EpollBackend::processReady() {
+  size_t processed = 0;
+  while (readyIndex_ < numReady_ &&
+         !loopBreak_.load(std::memory_order_relaxed)) {
+    auto& ready = ready_[readyIndex_++];
+    handleReady(ready.data.fd, ready.events);
+    ++processed;
+  }
+  return processed;
+}
+
+void EpollBackend::handleReady(int fd, uint32_t revents) {
+  // The fd may have been unregistered (and even reused) by a callback that
+  // ran earlier in this batch; at worst that is a spurious wakeup.
+  if (size_t(fd) >= fds_.size() || fds_[fd].records.empty()) {
+    return;
+  }
+  short what = toLibeventEvents(revents);
+
+  auto dispatchRecord = [&](EventRecord* record) {
+    short recordWhat = what & record->events;
+    if (!recordWhat) {
+      return;
+    }
+    auto ev = record->ev;
+    if (!record->persist) {
+      removeEvent(record);
+    }
+    dispatch(ev, recordWhat);
+  };
+
+  if (fds_[fd].records.size() == 1) {
+    dispatchRecord(fds_[fd].records[0]);
+    return;
+  }
+
+  // Any callback may remove the other events on this fd.
+  auto records = fds_[fd].records;
+  for (auto record : records) {
+    auto& current = fds_[fd].records;
+    if (std::find(current.begin(), current.end(), record) != current.end()) {
+      dispatchRecord(record);
+    }
+  }
+}
+
+size_t EpollBackend::processTimers() {
+  size_t processed = 0;
+  auto now = std::chrono::steady_clock::now();
+
+  while (!timers_.empty() && !loopBreak_.load(std::memory_order_relaxed)) {
+    auto it = timers_.begin();
+    if (it->first > now) {
+      break;
+    }
+    auto record = it->second;
+    auto ev = record->ev;
+    timers_.erase(it);
+    record->hasTimer = false;
+    event_ref_flags(ev) &= ~EVLIST_TIMEOUT;
+
+    if (record->persist) {
+      addTimer(record);
+    } else {
+      removeEvent(record);
+    }
+    dispatch(ev, EV_TIMEOUT);
+    ++processed;
+  }
+
+  return processed;
+}
+
+void EpollBackend::dispatch(struct event* ev, short what) {
+  event_get_callback(ev)(event_get_fd(ev), what, event_get_callback_arg(ev));
+}
+
+EpollBackend::EventRecord* EpollBackend::findRecord(struct event* ev) {
+  auto fd = event_get_fd(ev);
+  if (fd < 0) {
+    auto it = timerEvents_.find(ev);
+    return it == timerEvents_.end() ? nullptr : it->second;
+  }
+  if (size_t(fd) >= fds_.size()) {
+    return nullptr;
+  }
+  for (auto record : fds_[fd].records) {
+    if (record->ev == ev) {
+      return record;
+    }
+  }
+  return nullptr;
+}
+
+void EpollBackend::setEvents(EventRecord* record, short events) {
+  record->events = events & (EV_READ | EV_WRITE);
+#ifdef EV_ET
+  record->edge = events & EV_ET;
+#endif
+  record->persist = events & EV_PERSIST;
+}
+
+int EpollBackend::updateFd(int fd, bool rearm) {
+  auto& entry = fds_[fd];
+  uint32_t mask = 0;
+  bool edge = true;
+  for (auto record : entry.records) {
+    if (!record->events) {
+      continue;
+    }
+    if (record->events & EV_READ) {
+      mask |= EPOLLIN;
+    }
+    if (record->events & EV_WRITE) {
+      mask |= EPOLLOUT;
+    }
+    edge = edge && record->edge;
+  }
+  // Edge-triggered fds stay registered for both directions, and
+  // handleReady() only reports what the handlers are interested in.
+  if (mask && edge) {
+    mask = EPOLLIN | EPOLLOUT | EPOLLET;
+  }
+
+  // Readiness that was reported while nobody was interested is gone for an
+  // edge-triggered fd, so re-arm it when interest grows: EPOLL_CTL_MOD
+  // reports the current state again.
+  if (mask == entry.mask && !(rearm && (mask & EPOLLET))) {
+    return 0;
+  }
+
+  if (!mask) {
+    // Failure means the fd has already been closed, which removed it from
+    // the epoll set.
+    epollCtl(EPOLL_CTL_DEL, fd, 0);
+    entry.mask = 0;
+    return 0;
+  }
+
+  int ret;
+  if (entry.mask) {
+    ret = epollCtl(EPOLL_CTL_MOD, fd, mask);
+    if (ret < 0 && errno == ENOENT) {
+      // closed and reopened behind our back
+      ret = epollCtl(EPOLL_CTL_ADD, fd, mask);
+    }
+  } else {
+    ret = epollCtl(EPOLL_CTL_ADD, fd, mask);
+    if (ret < 0 && errno == EEXIST) {
+      ret = epollCtl(EPOLL_CTL_MOD, fd, mask);
+    }
+  }
+  if (ret < 0) {
+    return -1;
+  }
+  entry.mask = mask;
+  return 0;
+}
+
+int EpollBackend::epollCtl(int op, int fd, uint32_t mask) {
+  struct epoll_event event = {};
+  event.events = mask;
+  event.data.fd = fd;
+  ++numEpollCtls_;
+  return ::epoll_ctl(epollFd_, op, fd, &event);
+}
+
+int EpollBackend::eb_event_add(
+    struct event& event,
+    const struct timeval* timeout) {
+  auto events = event_get_events(&event);
+  if (events & EV_SIGNAL) {
+    errno = ENOTSUP;
+    return -1;
+  }
+
+  short& flags = event_ref_flags(&event);
+  auto record = findRecord(&event);
+  if (record) {
+    // Like libevent, adding a pending event again only updates its timeout.
+    if (timeout && record->hasTimer) {
+      timers_.erase(record->timerIt);
+      record->hasTimer = false;
+    }
+  } else {
+    auto fd = event_get_fd(&event);
+    bool io = events & (EV_READ | EV_WRITE);
+    if (!io && !timeout) {
+      return 0;
+    }
+    if (io && fd < 0) {
+      errno = EBADF;
+      return -1;
+    }
+
+    record = new EventRecord();
+    record->ev = &event;
+    record->fd = fd;
+    record->internal = flags & EVLIST_INTERNAL;
+    setEvents(record, events);
+    if (fd >= 0) {
+      if (size_t(fd) >= fds_.size()) {
+        fds_.resize(std::max(size_t(fd) + 1, 2 * fds_.size()));
+      }
+      auto& records = fds_[fd].records;
+      records.push_back(record);
+      if (updateFd(fd, true) < 0) {
+        records.pop_back();
+        delete record;
+        return -1;
+      }
+    } else {
+      timerEvents_.emplace(&event, record);
+    }
+    if (!record->internal) {
+      ++numEvents_;
+    }
+    if (io) {
+      flags |= EVLIST_INSERTED;
+    }
+  }
+
+  if (timeout) {
+    record->timeout = std::chrono::seconds(timeout->tv_sec) +
+        std::chrono::microseconds(timeout->tv_usec);
+    addTimer(record);
+    flags |= EVLIST_TIMEOUT;
+  }
+
+  return 0;
+}
+
+int EpollBackend::eb_event_del(struct event& event) {
+  auto record = findRecord(&event);
+  if (record) {
+    removeEvent(record);
+  }
+  return 0;
+}
+
+int EpollBackend::eb_event_modify(struct event& event, short events) {
+  auto record = findRecord(&event);
+  // A timeout would be dropped by the del / add this stands in for.
+  if (!record || record->fd < 0 || record->hasTimer ||
+      (events & EV_SIGNAL) || !(events & (EV_READ | EV_WRITE))) {
+    return -1;
+  }
+
+  bool grows = events & (EV_READ | EV_WRITE) & ~record->events;
+  event.ev_events = events;
+  setEvents(record, events);
+  return updateFd(record->fd, grows);
+}
+
+void EpollBackend::addTimer(EventRecord* record) {
+  record->timerIt = timers_.emplace(
+      std::chrono::steady_clock::now() + record->timeout, record);
+  record->hasTimer = true;
+}
+
+void EpollBackend::removeEvent(EventRecord* record) {
+  auto ev = record->ev;
+  if (!record->internal) {
+    --numEvents_;
+  }
+  event_ref_flags(ev) &= ~(EVLIST_INSERTED | EVLIST_TIMEOUT);
+  if (record->hasTimer) {
+    timers_.erase(record->timerIt);
+  }
+
+  if (record->fd >= 0) {
+    auto& records = fds_[record->fd].records;
+    records.erase(std::find(records.begin(), records.end(), record));
+    updateFd(record->fd, false);
+  } else {
+    timerEvents_.erase(ev);
+  }
+  delete record;
+}
+
+} // namespace folly
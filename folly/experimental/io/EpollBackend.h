@@ -0,0 +1,167 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <sys/epoll.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include <folly/io/async/EventBaseBackendBase.h>
+
+namespace folly {
+
+/**
+ * An EventBase backend that drives epoll directly instead of going through
+ * libevent.
+ *
+ *   EventBase evb(std::make_unique<EpollBackend>(EpollBackend::Options()));
+ *
+ * Registered events are kept in a table indexed by fd, and epoll reports
+ * the fd itself, so a readiness event goes straight to its handlers without
+ * libevent's per-event bookkeeping and active queue. Each loop iteration is
+ * a single epoll_wait() for up to Options::maxEvents fds, whose timeout is
+ * the deadline of the earliest AsyncTimeout (and so of every HHWheelTimer
+ * on the EventBase). Registration changes are applied to the kernel right
+ * away, since the fd may be closed as soon as the handler is unregistered.
+ *
+ * With Options::edgeTriggeredSockets, AsyncSocket registers edge-triggered
+ * and reads until the socket is drained. Its fds then stay registered for
+ * both directions, and turning write (or read) interest off doesn't need an
+ * epoll_ctl() at all. Everything else (AsyncServerSocket, NotificationQueue,
+ * ...) stays level-triggered.
+ *
+ * Like libevent's epoll backend, timeouts have millisecond resolution and
+ * regular files can't be registered. Signal events (EV_SIGNAL) are not
+ * supported: AsyncSignalHandler needs the libevent backend.
+ */
+class EpollBackend : public EventBaseBackendBase {
+ public:
+  struct Options {
+    Options() {}
+
+    Options& setMaxEvents(size_t v) {
+      maxEvents = v;
+      return *this;
+    }
+    Options& setEdgeTriggeredSockets(bool v) {
+      edgeTriggeredSockets = v;
+      return *this;
+    }
+
+    // Maximum number of fds reported by one epoll_wait().
+    size_t maxEvents{256};
+    bool edgeTriggeredSockets{true};
+  };
+
+  /**
+   * Throws std::system_error if epoll can't be set up.
+   */
+  explicit EpollBackend(Options options);
+  ~EpollBackend() override;
+
+  event_base* getEventBase() override {
+    return evb_;
+  }
+
+  int eb_event_base_loop(int flags) override;
+  int eb_event_base_loopbreak() override;
+
+  int eb_event_add(struct event& event, const struct timeval* timeout)
+      override;
+  int eb_event_del(struct event& event) override;
+  int eb_event_modify(struct event& event, short events) override;
+
+  bool preferEdgeTriggered() const override {
+    return options_.edgeTriggeredSockets;
+  }
+
+  /**
+   * Number of epoll_ctl() calls made so far.
+   */
+  size_t getNumEpollCtls() const {
+    return numEpollCtls_;
+  }
+
+ private:
+  struct EventRecord;
+  using TimerMap =
+      std::multimap<std::chrono::steady_clock::time_point, EventRecord*>;
+
+  struct EventRecord : private boost::noncopyable {
+    struct event* ev;
+    int fd;
+    // EV_READ / EV_WRITE interest
+    short events{0};
+    bool edge{false};
+    bool persist{false};
+    bool internal{false};
+    bool hasTimer{false};
+    std::chrono::microseconds timeout{0};
+    TimerMap::iterator timerIt;
+  };
+
+  struct FdEntry {
+    std::vector<EventRecord*> records;
+    // what the fd is registered with in the kernel, 0 if it isn't
+    uint32_t mask{0};
+  };
+
+  void cleanup();
+
+  EventRecord* findRecord(struct event* ev);
+  void setEvents(EventRecord* record, short events);
+  int updateFd(int fd, bool rearm);
+  int epollCtl(int op, int fd, uint32_t mask);
+
+  size_t processReady();
+  void handleReady(int fd, uint32_t revents);
+  void dispatch(struct event* ev, short what);
+  size_t processTimers();
+  int waitTimeout(int flags) const;
+
+  void addTimer(EventRecord* record);
+  void removeEvent(EventRecord* record);
+
+  Options options_;
+  event_base* evb_{nullptr};
+  int epollFd_{-1};
+  std::atomic<bool> loopBreak_{false};
+
+  std::vector<FdEntry> fds_;
+  // events without an fd (AsyncTimeout)
+  std::unordered_map<struct event*, EventRecord*> timerEvents_;
+  TimerMap timers_;
+  // non-internal registered events
+  size_t numEvents_{0};
+
+  std::vector<struct epoll_event> ready_;
+  // ready_[readyIndex_, numReady_) are still to be dispatched, left over by
+  // loopbreak; an edge-triggered wakeup can't be dropped.
+  size_t readyIndex_{0};
+  size_t numReady_{0};
+
+  size_t numEpollCtls_{0};
+};
+
+} // namespace folly
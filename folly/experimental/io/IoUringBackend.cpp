@@ -0,0 +1,829 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/experimental/io/IoUringBackend.h>
+
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <glog/logging.h>
+
+#include <folly/Bits.h>
+#include <folly/Exception.h>
+#include <folly/Likely.h>
+#include <folly/String.h>
+#include <folly/io/async/EventUtil.h>
+#include <folly/portability/Unistd.h>
+
+namespace folly {
+
+namespace {
+
+int ioUringSetup(unsigned entries, struct io_uring_params* p) {
+  return int(::syscall(__NR_io_uring_setup, entries, p));
+}
+
+int ioUringEnter(
+    int fd,
+    unsigned toSubmit,
+    unsigned minComplete,
+    unsigned flags,
+    const void* arg,
+    size_t argSize) {
+  return int(::syscall(
+      __NR_io_uring_enter, fd, toSubmit, minComplete, flags, arg, argSize));
+}
+
+int ioUringRegister(int fd, unsigned opcode, void* arg, unsigned nrArgs) {
+  return int(::syscall(__NR_io_uring_register, fd, opcode, arg, nrArgs));
+}
+
+// The rings are shared with the kernel, which reads and writes the
+// head / tail indices concurrently with us.
+template <class T>
+T loadAcquire(const T* p) {
+  return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+template <class T>
+void storeRelease(T* p, T v) {
+  __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+// Translate poll(2) revents into libevent events the way libevent's epoll
+// backend does: errors and hangups wake up both readers and writers.
+short toLibeventEvents(uint32_t revents) {
+  short events = 0;
+  if (revents & (POLLERR | POLLHUP)) {
+    events |= EV_READ | EV_WRITE;
+  }
+  if (revents & (POLLIN | POLLPRI | POLLRDHUP)) {
+    events |= EV_READ;
+  }
+  if (revents & POLLOUT) {
+    events |= EV_WRITE;
+  }
+  return events;
+}
+
+// user_data of requests whose completion is of no interest (cancellations)
+constexpr uint64_t kIgnoreCompletion = 0;
+constexpr uint16_t kBufferGroup = 0;
+// IORING_REGISTER_PBUF_RING limit
+constexpr size_t kMaxProvidedBuffers = 1 << 15;
+
+} // namespace
+
+IoUringBackend::IoUringBackend(Options options) : options_(options) {
+  if (options_.capacity == 0 || options_.maxGet == 0) {
+    throw std::invalid_argument("IoUringBackend: invalid options");
+  }
+
+  try {
+    try {
+      setupRing(IORING_SETUP_COOP_TASKRUN | IORING_SETUP_TASKRUN_FLAG);
+    } catch (const std::system_error& ex) {
+      // Cooperative task running needs 5.19; fall back to IPIs.
+      if (ex.code().value() != EINVAL) {
+        throw;
+      }
+      setupRing(0);
+    }
+
+    if (options_.numProvidedBuffers > 0) {
+      setupProvidedBuffers();
+    }
+
+    // EventHandler and AsyncTimeout attach their events to an event_base
+    // with event_base_set(), so keep one around even though it never runs.
+    evb_ = event_base_new();
+    if (UNLIKELY(evb_ == nullptr)) {
+      throwSystemError("IoUringBackend: event_base_new() failed");
+    }
+  } catch (...) {
+    cleanup();
+    throw;
+  }
+}
+
+IoUringBackend::~IoUringBackend() {
+  cleanup();
+}
+
+void IoUringBackend::cleanup() {
+  // Closing the ring cancels everything still in flight, so after this no
+  // record is referenced by the kernel.
+  if (ringFd_ >= 0) {
+    ::close(ringFd_);
+    ringFd_ = -1;
+  }
+  if (sqRing_) {
+    ::munmap(sqRing_, sqRingSize_);
+  }
+  if (cqRing_ && cqRing_ != sqRing_) {
+    ::munmap(cqRing_, cqRingSize_);
+  }
+  sqRing_ = cqRing_ = nullptr;
+  if (sqes_) {
+    ::munmap(sqes_, sqesSize_);
+    sqes_ = nullptr;
+  }
+  if (bufRing_) {
+    ::munmap(bufRing_, bufRingSize_);
+    bufRing_ = nullptr;
+  }
+
+  while (!records_.empty()) {
+    delete &records_.front();
+  }
+  retired_.clear();
+  events_.clear();
+  ops_.clear();
+  timers_.clear();
+
+  if (evb_) {
+    event_base_free(evb_);
+    evb_ = nullptr;
+  }
+}
+
+bool IoUringBackend::isAvailable() {
+  static const bool available = [] {
+    try {
+      IoUringBackend backend(Options().setCapacity(4));
+      return true;
+    } catch (const NotAvailable&) {
+      return false;
+    } catch (const std::exception& ex) {
+      LOG(ERROR) << "IoUringBackend::isAvailable(): " << ex.what();
+      return false;
+    }
+  }();
+  return available;
+}
+
+void IoUringBackend::setupRing(unsigned flags) {
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  params.flags = flags;
+
+  ringFd_ = ioUringSetup(unsigned(options_.capacity), &params);
+  if (ringFd_ < 0) {
+    if (errno == ENOSYS || errno == EPERM) {
+      throw NotAvailable("IoUringBackend: io_uring is not available");
+    }
+    throwSystemError("IoUringBackend: io_uring_setup() failed");
+  }
+
+  // SINGLE_MMAP and NODROP are implied by EXT_ARG (5.11); we need the latter
+  // to wait for completions with a timeout.
+  if (!(params.features & IORING_FEAT_EXT_ARG) ||
+      !(params.features & IORING_FEAT_SINGLE_MMAP) ||
+      !(params.features & IORING_FEAT_NODROP)) {
+    ::close(ringFd_);
+    ringFd_ = -1;
+    throw NotAvailable("IoUringBackend: io_uring is too old");
+  }
+
+  sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cqRingSize_ =
+      params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+
+  sqRing_ = ::mmap(
+      nullptr,
+      sqRingSize_,
+      PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE,
+      ringFd_,
+      IORING_OFF_SQ_RING);
+  if (sqRing_ == MAP_FAILED) {
+    sqRing_ = nullptr;
+    throwSystemError("IoUringBackend: mmap(IORING_OFF_SQ_RING) failed");
+  }
+  cqRing_ = sqRing_;
+
+  sqesSize_ = params.sq_entries * sizeof(struct io_uring_sqe);
+  auto sqes = ::mmap(
+      nullptr,
+      sqesSize_,
+      PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE,
+      ringFd_,
+      IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    throwSystemError("IoUringBackend: mmap(IORING_OFF_SQES) failed");
+  }
+  sqes_ = static_cast<struct io_uring_sqe*>(sqes);
+
+  auto sq = static_cast<uint8_t*>(sqRing_);
+  sqHead_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+  sqTail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+  sqFlags_ = reinterpret_cast<unsigned*>(sq + params.sq_off.flags);
+  sqArray_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+  sqMask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+  sqEntries_ = params.sq_entries;
+  sqTailLocal_ = sqSubmitted_ = *sqTail_;
+  // SQEs are always used in ring order
+  for (unsigned i = 0; i < sqEntries_; ++i) {
+    sqArray_[i] = i;
+  }
+
+  auto cq = static_cast<uint8_t*>(cqRing_);
+  cqHead_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+  cqTail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+  cqMask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+  cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+}
+
+void IoUringBackend::setupProvidedBuffers() {
+  bufEntries_ = unsigned(nextPowTwo(
+      std::min(options_.numProvidedBuffers, kMaxProvidedBuffers)));
+  bufRingSize_ = bufEntries_ * sizeof(struct io_uring_buf);
+  auto ring = ::mmap(
+      nullptr,
+      bufRingSize_,
+      PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS,
+      -1,
+      0);
+  if (ring == MAP_FAILED) {
+    throwSystemError("IoUringBackend: mmap(provided buffer ring) failed");
+  }
+  bufRing_ = ring;
+  bufMemory_.reset(new uint8_t[bufEntries_ * options_.providedBufferSize]);
+
+  struct io_uring_buf_reg reg;
+  memset(&reg, 0, sizeof(reg));
+  reg.ring_addr = reinterpret_cast<uint64_t>(bufRing_);
+  reg.ring_entries = bufEntries_;
+  reg.bgid = kBufferGroup;
+  if (ioUringRegister(ringFd_, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+    LOG(WARNING) << "IoUringBackend: provided buffer rings are not supported: "
+                 << errnoStr(errno);
+    ::munmap(bufRing_, bufRingSize_);
+    bufRing_ = nullptr;
+    bufMemory_.reset();
+    bufEntries_ = 0;
+    return;
+  }
+
+  for (unsigned i = 0; i < bufEntries_; ++i) {
+    recycleBuffer(uint16_t(i));
+  }
+}
+
+IoUringBackend::IoRecord*
+IoUringBackend::newRecord(IoRecord::Type type, void* owner, int fd) {
+  auto record = new IoRecord();
+  record->type = type;
+  record->owner = owner;
+  record->fd = fd;
+  records_.push_back(*record);
+  return record;
+}
+
+void IoUringBackend::retire(IoRecord* record) {
+  DCHECK(!record->armed);
+  retired_.push_back(record);
+}
+
+struct io_uring_sqe* IoUringBackend::getSqe() {
+  if (sqTailLocal_ - loadAcquire(sqHead_) >= sqEntries_) {
+    submitPending();
+    if (sqTailLocal_ - loadAcquire(sqHead_) >= sqEntries_) {
+      throwSystemErrorExplicit(
+          EBUSY, "IoUringBackend: submission queue is full");
+    }
+  }
+  auto sqe = &sqes_[sqTailLocal_ & sqMask_];
+  memset(sqe, 0, sizeof(*sqe));
+  ++sqTailLocal_;
+  return sqe;
+}
+
+void IoUringBackend::submitPending() {
+  auto toSubmit = sqTailLocal_ - sqSubmitted_;
+  if (toSubmit == 0) {
+    return;
+  }
+  storeRelease(sqTail_, sqTailLocal_);
+  int ret;
+  do {
+    ret = ioUringEnter(ringFd_, toSubmit, 0, 0, nullptr, 0);
+  } while (ret < 0 && errno == EINTR);
+  sqSubmitted_ = loadAcquire(sqHead_);
+  if (ret < 0) {
+    LOG(ERROR) << "IoUringBackend: io_uring_enter() failed: "
+               << errnoStr(errno);
+  }
+}
+
+int IoUringBackend::submitAndWait(bool block) {
+  auto toSubmit = sqTailLocal_ - sqSubmitted_;
+  unsigned minComplete = 0;
+
+  struct __kernel_timespec ts;
+  struct io_uring_getevents_arg arg;
+  memset(&arg, 0, sizeof(arg));
+
+  if (block && loadAcquire(cqTail_) == *cqHead_) {
+    minComplete = 1;
+    if (!timers_.empty()) {
+      auto wait = timers_.begin()->first - std::chrono::steady_clock::now();
+      if (wait.count() <= 0) {
+        minComplete = 0;
+      } else {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(wait);
+        ts.tv_sec = ns.count() / 1000000000;
+        ts.tv_nsec = ns.count() % 1000000000;
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+      }
+    }
+  }
+
+  // Nothing to submit or wait for: only enter the kernel if it has
+  // completions for us that it hasn't posted yet.
+  if (toSubmit == 0 && minComplete == 0 &&
+      !(loadAcquire(sqFlags_) & IORING_SQ_TASKRUN)) {
+    return 0;
+  }
+
+  storeRelease(sqTail_, sqTailLocal_);
+  int ret = ioUringEnter(
+      ringFd_,
+      toSubmit,
+      minComplete,
+      IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+      &arg,
+      sizeof(arg));
+  sqSubmitted_ = loadAcquire(sqHead_);
+  if (sqSubmitted_ == sqTailLocal_) {
+    for (auto record : retired_) {
+      delete record;
+    }
+    retired_.clear();
+  }
+
+  if (ret < 0) {
+    switch (errno) {
+      case EINTR:
+      case ETIME:
+      case EAGAIN:
+      case EBUSY:
+        return 0;
+      default:
+        LOG(ERROR) << "IoUringBackend: io_uring_enter() failed: "
+                   << errnoStr(errno);
+        return -1;
+    }
+  }
+  return 0;
+}
+
+int IoUringBackend::eb_event_base_loop(int flags) {
+  loopBreak_.store(false, std::memory_order_relaxed);
+
+  while (true) {
+    if (!hasPendingWork()) {
+      submitPending();
+      return 1;
+    }
+
+    if (submitAndWait(!(flags & EVLOOP_NONBLOCK)) < 0) {
+      return -1;
+    }
+
+    size_t processed = processCompletions();
+    processed += processTimers();
+
+    if (loopBreak_.load(std::memory_order_relaxed) ||
+        (flags & EVLOOP_NONBLOCK) || ((flags & EVLOOP_ONCE) && processed)) {
+      break;
+    }
+  }
+
+  return 0;
+}
+
+int IoUringBackend::eb_event_base_loopbreak() {
+  loopBreak_.store(true, std::memory_order_relaxed);
+  return 0;
+}
+
+size_t IoUringBackend::processCompletions() {
+  size_t processed = 0;
+  unsigned head = *cqHead_;
+  unsigned tail = loadAcquire(cqTail_);
+
+  // Completions left behind by loopbreak stay in the ring for the next
+  // iteration.
+  while (head != tail && processed < options_.maxGet &&
+         !loopBreak_.load(std::memory_order_relaxed)) {
+    auto cqe = &cqes_[head & cqMask_];
+    auto data = cqe->user_data;
+    auto res = cqe->res;
+    auto cqeFlags = cqe->flags;
+    // Hand the slot back before running callbacks, which may submit more.
+    storeRelease(cqHead_, ++head);
+
+    if (data == kIgnoreCompletion) {
+      continue;
+    }
+    ++processed;
+
+    auto record = reinterpret_cast<IoRecord*>(data);
+    switch (record->type) {
+      case IoRecord::Type::EVENT:
+        handleEvent(record, res, cqeFlags);
+        break;
+      case IoRecord::Type::ACCEPT:
+        handleAccept(record, res, cqeFlags);
+        break;
+      case IoRecord::Type::RECV:
+        handleRecv(record, res, cqeFlags);
+        break;
+    }
+  }
+
+  return processed;
+}
+
+size_t IoUringBackend::processTimers() {
+  size_t processed = 0;
+  auto now = std::chrono::steady_clock::now();
+
+  while (!timers_.empty() && !loopBreak_.load(std::memory_order_relaxed)) {
+    auto it = timers_.begin();
+    if (it->first > now) {
+      break;
+    }
+    auto record = it->second;
+    auto ev = static_cast<struct event*>(record->owner);
+    timers_.erase(it);
+    record->hasTimer = false;
+    event_ref_flags(ev) &= ~EVLIST_TIMEOUT;
+
+    if (record->persist) {
+      addTimer(record);
+    } else {
+      removeEvent(record);
+    }
+    dispatch(ev, EV_TIMEOUT);
+    ++processed;
+  }
+
+  return processed;
+}
+
+void IoUringBackend::dispatch(struct event* ev, short what) {
+  event_get_callback(ev)(event_get_fd(ev), what, event_get_callback_arg(ev));
+}
+
+int IoUringBackend::eb_event_add(
+    struct event& event,
+    const struct timeval* timeout) {
+  auto events = event_get_events(&event);
+  if (events & EV_SIGNAL) {
+    errno = ENOTSUP;
+    return -1;
+  }
+
+  short& flags = event_ref_flags(&event);
+  IoRecord* record;
+  auto it = events_.find(&event);
+  if (it != events_.end()) {
+    // Like libevent, adding a pending event again only updates its timeout.
+    record = it->second;
+    if (timeout && record->hasTimer) {
+      timers_.erase(record->timerIt);
+      record->hasTimer = false;
+    }
+  } else {
+    uint32_t pollMask = 0;
+    if (events & EV_READ) {
+      pollMask |= POLLIN;
+    }
+    if (events & EV_WRITE) {
+      pollMask |= POLLOUT;
+    }
+    if (!pollMask && !timeout) {
+      return 0;
+    }
+
+    record = newRecord(IoRecord::Type::EVENT, &event, event_get_fd(&event));
+    record->pollMask = pollMask;
+    record->persist = events & EV_PERSIST;
+    record->internal = flags & EVLIST_INTERNAL;
+    events_.emplace(&event, record);
+    if (!record->internal) {
+      ++numEvents_;
+    }
+    if (pollMask) {
+      armPoll(record);
+      flags |= EVLIST_INSERTED;
+    }
+  }
+
+  if (timeout) {
+    record->timeout = std::chrono::seconds(timeout->tv_sec) +
+        std::chrono::microseconds(timeout->tv_usec);
+    addTimer(record);
+    flags |= EVLIST_TIMEOUT;
+  }
+
+  return 0;
+}
+
+int IoUringBackend::eb_event_del(struct event& event) {
+  auto it = events_.find(&event);
+  if (it != events_.end()) {
+    removeEvent(it->second);
+  }
+  return 0;
+}
+
+void IoUringBackend::addTimer(IoRecord* record) {
+  record->timerIt = timers_.emplace(
+      std::chrono::steady_clock::now() + record->timeout, record);
+  record->hasTimer = true;
+}
+
+void IoUringBackend::removeEvent(IoRecord* record) {
+  auto ev = static_cast<struct event*>(record->owner);
+  events_.erase(ev);
+  if (!record->internal) {
+    --numEvents_;
+  }
+  event_ref_flags(ev) &= ~(EVLIST_INSERTED | EVLIST_TIMEOUT);
+  if (record->hasTimer) {
+    timers_.erase(record->timerIt);
+    record->hasTimer = false;
+  }
+
+  record->owner = nullptr;
+  if (record->armed) {
+    cancelRequest(record);
+  } else {
+    retire(record);
+  }
+}
+
+void IoUringBackend::armPoll(IoRecord* record) {
+  auto sqe = getSqe();
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = record->fd;
+  sqe->poll32_events = record->pollMask;
+  sqe->user_data = reinterpret_cast<uint64_t>(record);
+  record->multishot =
+      record->persist && options_.multishotPoll && multishotPollSupported_;
+  if (record->multishot) {
+    sqe->len = IORING_POLL_ADD_MULTI;
+  }
+  record->armed = true;
+}
+
+void IoUringBackend::armAccept(IoRecord* record) {
+  auto sqe = getSqe();
+  sqe->opcode = IORING_OP_ACCEPT;
+  sqe->fd = record->fd;
+  sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+  sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+  sqe->user_data = reinterpret_cast<uint64_t>(record);
+  record->multishot = true;
+  record->armed = true;
+}
+
+void IoUringBackend::armRecv(IoRecord* record) {
+  auto sqe = getSqe();
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = record->fd;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = kBufferGroup;
+  sqe->user_data = reinterpret_cast<uint64_t>(record);
+  record->multishot = true;
+  record->armed = true;
+}
+
+void IoUringBackend::cancelRequest(IoRecord* record) {
+  // The record stays alive until the request's final completion, and that
+  // completion is what retires it.
+  auto sqe = getSqe();
+  sqe->opcode = record->type == IoRecord::Type::EVENT
+      ? IORING_OP_POLL_REMOVE
+      : IORING_OP_ASYNC_CANCEL;
+  sqe->fd = -1;
+  sqe->addr = reinterpret_cast<uint64_t>(record);
+  sqe->user_data = kIgnoreCompletion;
+}
+
+void IoUringBackend::handleEvent(IoRecord* record, int res, uint32_t cqeFlags) {
+  if (!(cqeFlags & IORING_CQE_F_MORE)) {
+    record->armed = false;
+  }
+  auto ev = static_cast<struct event*>(record->owner);
+  if (!ev) {
+    if (!record->armed) {
+      retire(record);
+    }
+    return;
+  }
+
+  short what;
+  if (res >= 0) {
+    what = toLibeventEvents(uint32_t(res));
+  } else if (res == -EINVAL && record->multishot) {
+    LOG(WARNING) << "IoUringBackend: multishot poll is not supported";
+    multishotPollSupported_ = false;
+    what = 0;
+  } else if (res == -ECANCELED) {
+    what = 0;
+  } else {
+    // Let the handler find out about the error from its next read or write.
+    LOG(ERROR) << "IoUringBackend: poll on fd " << record->fd
+               << " failed: " << errnoStr(-res);
+    what = EV_READ | EV_WRITE;
+  }
+  what &= event_get_events(ev) & (EV_READ | EV_WRITE);
+
+  if (what) {
+    if (!record->persist) {
+      removeEvent(record);
+    }
+    dispatch(ev, what);
+  }
+
+  // The callback may have removed the event, possibly registering it again
+  // with a fresh record.
+  if (record->owner && !record->armed) {
+    armPoll(record);
+  }
+}
+
+void IoUringBackend::handleAccept(
+    IoRecord* record,
+    int res,
+    uint32_t cqeFlags) {
+  if (!(cqeFlags & IORING_CQE_F_MORE)) {
+    record->armed = false;
+  }
+  auto callback = static_cast<AcceptCallback*>(record->owner);
+  if (!callback) {
+    if (res >= 0) {
+      ::close(res);
+    }
+    if (!record->armed) {
+      retire(record);
+    }
+    return;
+  }
+
+  if (res >= 0) {
+    callback->acceptSuccess(res);
+    if (record->owner && !record->armed) {
+      armAccept(record);
+    }
+    return;
+  }
+
+  ops_.erase(callback);
+  record->owner = nullptr;
+  if (record->armed) {
+    cancelRequest(record);
+  } else {
+    retire(record);
+  }
+  callback->acceptError(res);
+}
+
+void IoUringBackend::handleRecv(IoRecord* record, int res, uint32_t cqeFlags) {
+  if (!(cqeFlags & IORING_CQE_F_MORE)) {
+    record->armed = false;
+  }
+  auto callback = static_cast<RecvCallback*>(record->owner);
+
+  std::unique_ptr<IOBuf> data;
+  if (cqeFlags & IORING_CQE_F_BUFFER) {
+    auto bid = uint16_t(cqeFlags >> IORING_CQE_BUFFER_SHIFT);
+    if (callback && res > 0) {
+      // Copy out so that the buffer can go straight back to the kernel and
+      // the IOBuf is no larger than the data.
+      data = IOBuf::copyBuffer(
+          bufMemory_.get() + size_t(bid) * options_.providedBufferSize,
+          size_t(res));
+    }
+    recycleBuffer(bid);
+  }
+
+  if (!callback) {
+    if (!record->armed) {
+      retire(record);
+    }
+    return;
+  }
+
+  if (res > 0 || res == -ENOBUFS) {
+    // -ENOBUFS: the provided buffers ran out for a moment; they have all been
+    // recycled by now.
+    if (data) {
+      callback->recvSuccess(std::move(data));
+    }
+    if (record->owner && !record->armed) {
+      armRecv(record);
+    }
+    return;
+  }
+
+  ops_.erase(callback);
+  record->owner = nullptr;
+  if (record->armed) {
+    cancelRequest(record);
+  } else {
+    retire(record);
+  }
+  if (res == 0) {
+    callback->recvEOF();
+  } else {
+    callback->recvError(res);
+  }
+}
+
+void IoUringBackend::recycleBuffer(uint16_t bid) {
+  // Don't go through struct io_uring_buf_ring: its flexible array member
+  // lands at a different offset when compiled as C++. The ring is a plain
+  // array of io_uring_buf whose first resv field doubles as the tail.
+  auto bufs = static_cast<struct io_uring_buf*>(bufRing_);
+  auto& buf = bufs[bufTail_ & (bufEntries_ - 1)];
+  buf.addr = reinterpret_cast<uint64_t>(
+      bufMemory_.get() + size_t(bid) * options_.providedBufferSize);
+  buf.len = uint32_t(options_.providedBufferSize);
+  buf.bid = bid;
+  ++bufTail_;
+  storeRelease(&bufs[0].resv, uint16_t(bufTail_));
+}
+
+void IoUringBackend::acceptMultishot(int fd, AcceptCallback* callback) {
+  CHECK(ops_.find(callback) == ops_.end())
+      << "IoUringBackend: accept callback is already installed";
+  auto record = newRecord(IoRecord::Type::ACCEPT, callback, fd);
+  ops_.emplace(callback, record);
+  armAccept(record);
+}
+
+void IoUringBackend::cancelAccept(AcceptCallback* callback) {
+  cancelOp(callback);
+}
+
+void IoUringBackend::cancelOp(void* owner) {
+  auto it = ops_.find(owner);
+  if (it == ops_.end()) {
+    return;
+  }
+  auto record = it->second;
+  ops_.erase(it);
+  record->owner = nullptr;
+  if (record->armed) {
+    cancelRequest(record);
+  } else {
+    retire(record);
+  }
+}
+
+void IoUringBackend::recvMultishot(int fd, RecvCallback* callback) {
+  if (bufEntries_ == 0) {
+    callback->recvError(-EOPNOTSUPP);
+    return;
+  }
+  CHECK(ops_.find(callback) == ops_.end())
+      << "IoUringBackend: recv callback is already installed";
+  auto record = newRecord(IoRecord::Type::RECV, callback, fd);
+  ops_.emplace(callback, record);
+  armRecv(record);
+}
+
+void IoUringBackend::cancelRecv(RecvCallback* callback) {
+  cancelOp(callback);
+}
+
+} // namespace folly
@@ -0,0 +1,282 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/intrusive/list.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <folly/io/IOBuf.h>
+#include <folly/io/async/EventBaseBackendBase.h>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace folly {
+
+/**
+ * An EventBase backend that talks to the kernel through io_uring instead of
+ * epoll.
+ *
+ *   EventBase evb(std::make_unique<IoUringBackend>(IoUringBackend::Options()));
+ *
+ * Readiness events registered by EventHandler (and therefore AsyncSocket,
+ * AsyncServerSocket, AsyncUDPSocket, NotificationQueue...) become POLL_ADD
+ * requests, and AsyncTimeouts are kept in a deadline-ordered map whose head
+ * is handed to the kernel as the wait timeout. Requests are not submitted
+ * one syscall at a time: they are queued in the submission ring and flushed
+ * together with the wait for completions, so one loop iteration costs a
+ * single io_uring_enter() however many handlers it (re)arms.
+ *
+ * Persistent events are re-armed with a one-shot poll after every dispatch,
+ * which keeps libevent's level-triggered semantics that AsyncSocket relies
+ * on when it stops reading after maxReadsPerEvent. Options::multishotPoll
+ * arms them once with a multishot poll instead; the kernel then only reports
+ * new wakeups, so it should only be used when every handler drains its fd.
+ *
+ * On top of the readiness model the backend offers completion-based
+ * multishot accept and multishot recv. Received data lands in a ring of
+ * kernel-selected provided buffers and is handed out as right-sized IOBufs,
+ * so idle connections don't pin a read buffer each.
+ *
+ * Signal events (EV_SIGNAL) are not supported: AsyncSignalHandler needs the
+ * libevent backend.
+ *
+ * Requires Linux 5.11 (IORING_FEAT_EXT_ARG); multishot accept and recv need
+ * 5.19 and are reported through the callbacks' error methods otherwise.
+ */
+class IoUringBackend : public EventBaseBackendBase {
+ public:
+  class NotAvailable : public std::runtime_error {
+   public:
+    using std::runtime_error::runtime_error;
+  };
+
+  struct Options {
+    Options() {}
+
+    Options& setCapacity(size_t v) {
+      capacity = v;
+      return *this;
+    }
+    Options& setMaxGet(size_t v) {
+      maxGet = v;
+      return *this;
+    }
+    Options& setMultishotPoll(bool v) {
+      multishotPoll = v;
+      return *this;
+    }
+    Options& setProvidedBuffers(size_t num, size_t size) {
+      numProvidedBuffers = num;
+      providedBufferSize = size;
+      return *this;
+    }
+
+    // Submission queue entries; the completion queue is twice as large.
+    size_t capacity{256};
+    // Maximum number of completions dispatched per loop iteration.
+    size_t maxGet{256};
+    bool multishotPoll{false};
+    // Provided buffers for recvMultishot(), rounded up to a power of two.
+    // 0 disables recvMultishot().
+    size_t numProvidedBuffers{0};
+    size_t providedBufferSize{16 * 1024};
+  };
+
+  class AcceptCallback {
+   public:
+    virtual ~AcceptCallback() = default;
+    // Ownership of fd passes to the callback.
+    virtual void acceptSuccess(int fd) noexcept = 0;
+    // -errno; the callback is no longer installed when this is called.
+    virtual void acceptError(int err) noexcept = 0;
+  };
+
+  class RecvCallback {
+   public:
+    virtual ~RecvCallback() = default;
+    virtual void recvSuccess(std::unique_ptr<IOBuf> data) noexcept = 0;
+    // The callback is no longer installed when either of these is called.
+    virtual void recvEOF() noexcept = 0;
+    virtual void recvError(int err) noexcept = 0;
+  };
+
+  /**
+   * Throws NotAvailable if io_uring can't be set up, and std::system_error
+   * for other failures.
+   */
+  explicit IoUringBackend(Options options);
+  ~IoUringBackend() override;
+
+  /**
+   * Whether this kernel supports everything the backend needs.
+   */
+  static bool isAvailable();
+
+  event_base* getEventBase() override {
+    return evb_;
+  }
+
+  int eb_event_base_loop(int flags) override;
+  int eb_event_base_loopbreak() override;
+
+  int eb_event_add(struct event& event, const struct timeval* timeout)
+      override;
+  int eb_event_del(struct event& event) override;
+
+  /**
+   * Accept connections on the listening socket fd until cancelAccept() is
+   * called or an error is reported. Must be called from the loop thread.
+   */
+  void acceptMultishot(int fd, AcceptCallback* callback);
+  void cancelAccept(AcceptCallback* callback);
+
+  /**
+   * Receive from the connected socket fd until cancelRecv() is called, EOF
+   * or an error. Requires Options::numProvidedBuffers. Must be called from
+   * the loop thread.
+   */
+  void recvMultishot(int fd, RecvCallback* callback);
+  void cancelRecv(RecvCallback* callback);
+
+  size_t getNumPendingSubmissions() const {
+    return sqTailLocal_ - sqSubmitted_;
+  }
+
+ private:
+  struct IoRecord;
+  using TimerMap =
+      std::multimap<std::chrono::steady_clock::time_point, IoRecord*>;
+
+  struct IoRecord
+      : public boost::intrusive::list_base_hook<
+            boost::intrusive::link_mode<boost::intrusive::auto_unlink>>,
+        private boost::noncopyable {
+    enum class Type : uint8_t { EVENT, ACCEPT, RECV };
+
+    Type type;
+    // event*, AcceptCallback* or RecvCallback*; nullptr once removed while
+    // a request is still in flight
+    void* owner{nullptr};
+    int fd{-1};
+    // a request for this record is queued or in the kernel
+    bool armed{false};
+    bool multishot{false};
+
+    // EVENT only
+    uint32_t pollMask{0};
+    bool persist{false};
+    bool internal{false};
+    bool hasTimer{false};
+    std::chrono::microseconds timeout{0};
+    TimerMap::iterator timerIt;
+  };
+
+  using RecordList = boost::intrusive::list<
+      IoRecord,
+      boost::intrusive::constant_time_size<false>>;
+
+  IoRecord* newRecord(IoRecord::Type type, void* owner, int fd);
+  void cleanup();
+  void setupRing(unsigned flags);
+  void setupProvidedBuffers();
+
+  struct io_uring_sqe* getSqe();
+  void submitPending();
+  int submitAndWait(bool block);
+  size_t processCompletions();
+  void dispatch(struct event* ev, short what);
+  size_t processTimers();
+
+  void armPoll(IoRecord* record);
+  void armAccept(IoRecord* record);
+  void armRecv(IoRecord* record);
+  void cancelRequest(IoRecord* record);
+  void cancelOp(void* owner);
+  void retire(IoRecord* record);
+
+  void addTimer(IoRecord* record);
+  void removeEvent(IoRecord* record);
+
+  void handleEvent(IoRecord* record, int res, uint32_t cqeFlags);
+  void handleAccept(IoRecord* record, int res, uint32_t cqeFlags);
+  void handleRecv(IoRecord* record, int res, uint32_t cqeFlags);
+  void recycleBuffer(uint16_t bid);
+
+  bool hasPendingWork() const {
+    return numEvents_ > 0 || !ops_.empty();
+  }
+
+  Options options_;
+  event_base* evb_{nullptr};
+  std::atomic<bool> loopBreak_{false};
+
+  int ringFd_{-1};
+  void* sqRing_{nullptr};
+  size_t sqRingSize_{0};
+  void* cqRing_{nullptr};
+  size_t cqRingSize_{0};
+  struct io_uring_sqe* sqes_{nullptr};
+  size_t sqesSize_{0};
+
+  unsigned* sqHead_{nullptr};
+  unsigned* sqTail_{nullptr};
+  unsigned* sqFlags_{nullptr};
+  unsigned* sqArray_{nullptr};
+  unsigned sqMask_{0};
+  unsigned sqEntries_{0};
+  // entries queued so far, and how many of them the kernel has consumed
+  unsigned sqTailLocal_{0};
+  unsigned sqSubmitted_{0};
+
+  unsigned* cqHead_{nullptr};
+  unsigned* cqTail_{nullptr};
+  unsigned cqMask_{0};
+  struct io_uring_cqe* cqes_{nullptr};
+
+  // Provided buffer ring for recvMultishot()
+  void* bufRing_{nullptr};
+  size_t bufRingSize_{0};
+  std::unique_ptr<uint8_t[]> bufMemory_;
+  unsigned bufEntries_{0};
+  unsigned bufTail_{0};
+
+  // every record, including those only waiting for their final completion
+  RecordList records_;
+  std::unordered_map<struct event*, IoRecord*> events_;
+  std::unordered_map<void*, IoRecord*> ops_;
+  TimerMap timers_;
+  // non-internal registered events
+  size_t numEvents_{0};
+  // Records that are gone but whose address may still be named by a queued
+  // cancellation; freed once the submission queue has been flushed.
+  std::vector<IoRecord*> retired_;
+  bool multishotPollSupported_{true};
+};
+
+} // namespace folly
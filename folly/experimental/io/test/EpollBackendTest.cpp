@@ -0,0 +1,367 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/experimental/io/EpollBackend.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <folly/io/async/AsyncServerSocket.h>
+#include <folly/io/async/AsyncSocket.h>
+#include <folly/io/async/AsyncTimeout.h>
+#include <folly/io/async/EventBase.h>
+#include <folly/io/async/EventHandler.h>
+#include <folly/io/async/HHWheelTimer.h>
+#include <folly/portability/GTest.h>
+#include <folly/portability/Sockets.h>
+#include <folly/portability/Unistd.h>
+
+using namespace folly;
+
+namespace {
+
+std::unique_ptr<EventBase> makeEventBase(
+    EpollBackend::Options options = EpollBackend::Options()) {
+  return std::make_unique<EventBase>(std::make_unique<EpollBackend>(options));
+}
+
+class PipeHandler : public EventHandler {
+ public:
+  PipeHandler(EventBase* evb, int fd) : EventHandler(evb, fd), fd_(fd) {}
+
+  void handlerReady(uint16_t events) noexcept override {
+    ASSERT_TRUE(events & READ);
+    char buf[4];
+    // Only read part of what's there: the backend must keep reporting the
+    // fd as readable until it's drained.
+    auto n = ::read(fd_, buf, sizeof(buf));
+    if (n > 0) {
+      data.append(buf, size_t(n));
+    } else {
+      unregisterHandler();
+    }
+  }
+
+  std::string data;
+
+ private:
+  int fd_;
+};
+
+class EchoSession : public AsyncTransportWrapper::ReadCallback {
+ public:
+  explicit EchoSession(AsyncSocket::UniquePtr sock) : sock_(std::move(sock)) {
+    // Leave data in the socket after every wakeup.
+    sock_->setMaxReadsPerEvent(1);
+    sock_->setReadCB(this);
+  }
+
+  void getReadBuffer(void** bufReturn, size_t* lenReturn) override {
+    *bufReturn = buf_;
+    *lenReturn = sizeof(buf_);
+  }
+  void readDataAvailable(size_t len) noexcept override {
+    sock_->write(nullptr, buf_, len);
+  }
+  void readEOF() noexcept override {
+    sock_->close();
+  }
+  void readErr(const AsyncSocketException&) noexcept override {
+    sock_->close();
+  }
+
+ private:
+  AsyncSocket::UniquePtr sock_;
+  char buf_[1024];
+};
+
+class EchoServer : public AsyncServerSocket::AcceptCallback {
+ public:
+  explicit EchoServer(EventBase* evb) : evb_(evb) {}
+
+  void connectionAccepted(int fd, const SocketAddress&) noexcept override {
+    sessions_.emplace_back(std::make_unique<EchoSession>(
+        AsyncSocket::UniquePtr(new AsyncSocket(evb_, fd))));
+  }
+  void acceptError(const std::exception& ex) noexcept override {
+    FAIL() << ex.what();
+  }
+
+ private:
+  EventBase* evb_;
+  std::vector<std::unique_ptr<EchoSession>> sessions_;
+};
+
+class EchoClient : public AsyncSocket::ConnectCallback,
+                   public AsyncTransportWrapper::ReadCallback {
+ public:
+  EchoClient(EventBase* evb, const SocketAddress& addr, std::string message)
+      : sock_(new AsyncSocket(evb)), message_(std::move(message)) {
+    sock_->connect(this, addr);
+  }
+
+  void connectSuccess() noexcept override {
+    sock_->setReadCB(this);
+    sock_->write(nullptr, message_.data(), message_.size());
+  }
+  void connectErr(const AsyncSocketException& ex) noexcept override {
+    FAIL() << ex.what();
+  }
+
+  void getReadBuffer(void** bufReturn, size_t* lenReturn) override {
+    *bufReturn = buf_;
+    *lenReturn = sizeof(buf_);
+  }
+  void readDataAvailable(size_t len) noexcept override {
+    received.append(buf_, len);
+    if (received.size() == message_.size()) {
+      sock_->close();
+    }
+  }
+  void readEOF() noexcept override {}
+  void readErr(const AsyncSocketException& ex) noexcept override {
+    FAIL() << ex.what();
+  }
+
+  std::string received;
+
+ private:
+  AsyncSocket::UniquePtr sock_;
+  std::string message_;
+  char buf_[1024];
+};
+
+void runEcho(EventBase* evb, size_t numClients, size_t messageSize) {
+  EchoServer server(evb);
+  auto serverSocket = AsyncServerSocket::newSocket(evb);
+  serverSocket->bind(SocketAddress("127.0.0.1", 0));
+  serverSocket->listen(16);
+  serverSocket->addAcceptCallback(&server, evb);
+  serverSocket->startAccepting();
+
+  std::vector<std::unique_ptr<EchoClient>> clients;
+  for (size_t i = 0; i < numClients; ++i) {
+    clients.emplace_back(std::make_unique<EchoClient>(
+        evb,
+        serverSocket->getAddress(),
+        std::string(messageSize * (i + 1), char('a' + i))));
+  }
+
+  auto stop = AsyncTimeout::make(*evb, [&]() noexcept {
+    serverSocket->stopAccepting();
+  });
+  stop->scheduleTimeout(1000);
+  evb->loop();
+
+  for (size_t i = 0; i < numClients; ++i) {
+    EXPECT_EQ(
+        std::string(messageSize * (i + 1), char('a' + i)),
+        clients[i]->received);
+  }
+}
+
+} // namespace
+
+TEST(EpollBackendTest, LoopReturnsWithoutEvents) {
+  auto evb = makeEventBase();
+  EXPECT_TRUE(evb->loop());
+}
+
+TEST(EpollBackendTest, Timeouts) {
+  auto evb = makeEventBase();
+
+  std::vector<int> fired;
+  auto t1 = AsyncTimeout::make(*evb, [&]() noexcept { fired.push_back(1); });
+  auto t2 = AsyncTimeout::make(*evb, [&]() noexcept { fired.push_back(2); });
+  auto t3 = AsyncTimeout::make(*evb, [&]() noexcept { fired.push_back(3); });
+  t2->scheduleTimeout(20);
+  t1->scheduleTimeout(10);
+  t3->scheduleTimeout(30);
+  EXPECT_TRUE(t3->isScheduled());
+  t3->cancelTimeout();
+  EXPECT_FALSE(t3->isScheduled());
+
+  auto start = std::chrono::steady_clock::now();
+  evb->loop();
+  auto elapsed = std::chrono::steady_clock::now() - start;
+
+  EXPECT_EQ((std::vector<int>{1, 2}), fired);
+  EXPECT_GE(elapsed, std::chrono::milliseconds(20));
+  EXPECT_FALSE(t1->isScheduled());
+}
+
+TEST(EpollBackendTest, RescheduleTimeout) {
+  auto evb = makeEventBase();
+
+  int fired = 0;
+  auto t = AsyncTimeout::make(*evb, [&]() noexcept { ++fired; });
+  t->scheduleTimeout(1000);
+  t->scheduleTimeout(1);
+  evb->loop();
+  EXPECT_EQ(1, fired);
+}
+
+TEST(EpollBackendTest, WheelTimer) {
+  auto evb = makeEventBase();
+  auto timer = HHWheelTimer::newTimer(
+      evb.get(),
+      std::chrono::milliseconds(1),
+      AsyncTimeout::InternalEnum::NORMAL,
+      std::chrono::milliseconds(100));
+
+  std::vector<int> fired;
+  struct Callback : HHWheelTimer::Callback {
+    Callback(std::vector<int>& fired, int id) : fired_(fired), id_(id) {}
+    void timeoutExpired() noexcept override {
+      fired_.push_back(id_);
+    }
+    std::vector<int>& fired_;
+    int id_;
+  };
+  Callback c1(fired, 1);
+  Callback c2(fired, 2);
+  timer->scheduleTimeout(&c2, std::chrono::milliseconds(30));
+  timer->scheduleTimeout(&c1, std::chrono::milliseconds(10));
+
+  auto start = std::chrono::steady_clock::now();
+  evb->loop();
+  auto elapsed = std::chrono::steady_clock::now() - start;
+
+  EXPECT_EQ((std::vector<int>{1, 2}), fired);
+  EXPECT_GE(elapsed, std::chrono::milliseconds(30));
+}
+
+TEST(EpollBackendTest, LevelTriggeredRead) {
+  auto evb = makeEventBase();
+
+  int fds[2];
+  ASSERT_EQ(0, ::pipe(fds));
+  PipeHandler handler(evb.get(), fds[0]);
+  ASSERT_TRUE(
+      handler.registerHandler(EventHandler::READ | EventHandler::PERSIST));
+
+  const std::string message = "hello epoll";
+  ASSERT_EQ(
+      ssize_t(message.size()),
+      ::write(fds[1], message.data(), message.size()));
+  ::close(fds[1]);
+
+  evb->loop();
+  EXPECT_EQ(message, handler.data);
+  EXPECT_FALSE(handler.isHandlerRegistered());
+  ::close(fds[0]);
+}
+
+TEST(EpollBackendTest, ReregisterHandler) {
+  auto evb = makeEventBase();
+
+  int fds[2];
+  ASSERT_EQ(0, ::socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  PipeHandler handler(evb.get(), fds[0]);
+  ASSERT_TRUE(handler.registerHandler(EventHandler::WRITE));
+  // Replaces the write registration; only a read may be reported now.
+  ASSERT_TRUE(
+      handler.registerHandler(EventHandler::READ | EventHandler::PERSIST));
+
+  ASSERT_EQ(1, ::write(fds[1], "x", 1));
+  ::shutdown(fds[1], SHUT_WR);
+  evb->loop();
+  EXPECT_EQ("x", handler.data);
+  ::close(fds[0]);
+  ::close(fds[1]);
+}
+
+TEST(EpollBackendTest, EdgeTriggeredInterestChanges) {
+  auto backend = std::make_unique<EpollBackend>(EpollBackend::Options());
+  auto epoll = backend.get();
+  EventBase evb(std::move(backend));
+
+  int fds[2];
+  ASSERT_EQ(0, ::socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  struct Handler : EventHandler {
+    using EventHandler::EventHandler;
+    void handlerReady(uint16_t events) noexcept override {
+      seen |= events;
+      ++calls;
+    }
+    uint16_t seen{0};
+    int calls{0};
+  } handler(&evb, fds[0]);
+
+  const uint16_t kEdge = EventHandler::EDGE | EventHandler::PERSIST;
+  ASSERT_TRUE(handler.registerHandler(EventHandler::READ_WRITE | kEdge));
+  auto ctls = epoll->getNumEpollCtls();
+  // Dropping interest costs nothing.
+  ASSERT_TRUE(handler.registerHandler(EventHandler::READ | kEdge));
+  EXPECT_EQ(ctls, epoll->getNumEpollCtls());
+
+  // The fd stayed writable but that's not reported any more.
+  evb.loopOnce(EVLOOP_NONBLOCK);
+  EXPECT_EQ(0, handler.calls);
+
+  // Turning write interest back on re-arms the fd, so the writability that
+  // was dropped above is reported again.
+  ASSERT_TRUE(handler.registerHandler(EventHandler::READ_WRITE | kEdge));
+  EXPECT_EQ(ctls + 1, epoll->getNumEpollCtls());
+  evb.loopOnce(EVLOOP_NONBLOCK);
+  EXPECT_EQ(1, handler.calls);
+  EXPECT_EQ(EventHandler::WRITE, handler.seen);
+
+  // Edge-triggered: not reported again until something changes.
+  evb.loopOnce(EVLOOP_NONBLOCK);
+  EXPECT_EQ(1, handler.calls);
+  ASSERT_EQ(1, ::write(fds[1], "x", 1));
+  evb.loopOnce(EVLOOP_NONBLOCK);
+  EXPECT_EQ(2, handler.calls);
+  EXPECT_EQ(EventHandler::READ_WRITE, handler.seen);
+
+  handler.unregisterHandler();
+  ::close(fds[0]);
+  ::close(fds[1]);
+}
+
+TEST(EpollBackendTest, RunInEventBaseThread) {
+  auto evb = makeEventBase();
+
+  std::thread loop([&] { evb->loopForever(); });
+
+  std::atomic<int> count{0};
+  for (int i = 0; i < 1000; ++i) {
+    evb->runInEventBaseThread([&] { ++count; });
+  }
+  evb->runInEventBaseThreadAndWait([] {});
+  EXPECT_EQ(1000, count.load());
+
+  evb->terminateLoopSoon();
+  loop.join();
+}
+
+TEST(EpollBackendTest, AsyncSocketEcho) {
+  // Far more than the echo sessions read per wakeup, so that edge-triggered
+  // sockets have to pick up where they left off.
+  auto evb = makeEventBase();
+  runEcho(evb.get(), 8, 64 * 1024);
+}
+
+TEST(EpollBackendTest, AsyncSocketEchoLevelTriggered) {
+  auto evb = makeEventBase(
+      EpollBackend::Options().setEdgeTriggeredSockets(false).setMaxEvents(2));
+  runEcho(evb.get(), 8, 64 * 1024);
+}
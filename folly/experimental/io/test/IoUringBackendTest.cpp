@@ -0,0 +1,413 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/experimental/io/IoUringBackend.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include <folly/io/async/AsyncServerSocket.h>
+#include <folly/io/async/AsyncSocket.h>
+#include <folly/io/async/AsyncTimeout.h>
+#include <folly/io/async/EventBase.h>
+#include <folly/io/async/EventHandler.h>
+#include <folly/portability/GTest.h>
+#include <folly/portability/Sockets.h>
+#include <folly/portability/Unistd.h>
+
+using namespace folly;
+
+namespace {
+
+std::unique_ptr<EventBase> makeEventBase(
+    IoUringBackend::Options options = IoUringBackend::Options()) {
+  return std::make_unique<EventBase>(
+      std::make_unique<IoUringBackend>(options));
+}
+
+#define SKIP_IF_UNAVAILABLE()                            \
+  do {                                                   \
+    if (!IoUringBackend::isAvailable()) {                \
+      LOG(WARNING) << "io_uring not available, skipping"; \
+      return;                                            \
+    }                                                    \
+  } while (0)
+
+class PipeHandler : public EventHandler {
+ public:
+  PipeHandler(EventBase* evb, int fd) : EventHandler(evb, fd), fd_(fd) {}
+
+  void handlerReady(uint16_t events) noexcept override {
+    ASSERT_TRUE(events & READ);
+    char buf[4];
+    // Only read part of what's there: the backend must keep reporting the
+    // fd as readable until it's drained.
+    auto n = ::read(fd_, buf, sizeof(buf));
+    if (n > 0) {
+      data.append(buf, size_t(n));
+    } else {
+      unregisterHandler();
+    }
+  }
+
+  std::string data;
+
+ private:
+  int fd_;
+};
+
+class EchoSession : public AsyncTransportWrapper::ReadCallback {
+ public:
+  explicit EchoSession(AsyncSocket::UniquePtr sock) : sock_(std::move(sock)) {
+    sock_->setReadCB(this);
+  }
+
+  void getReadBuffer(void** bufReturn, size_t* lenReturn) override {
+    *bufReturn = buf_;
+    *lenReturn = sizeof(buf_);
+  }
+  void readDataAvailable(size_t len) noexcept override {
+    sock_->write(nullptr, buf_, len);
+  }
+  void readEOF() noexcept override {
+    sock_->close();
+  }
+  void readErr(const AsyncSocketException&) noexcept override {
+    sock_->close();
+  }
+
+ private:
+  AsyncSocket::UniquePtr sock_;
+  char buf_[1024];
+};
+
+class EchoServer : public AsyncServerSocket::AcceptCallback {
+ public:
+  explicit EchoServer(EventBase* evb) : evb_(evb) {}
+
+  void connectionAccepted(int fd, const SocketAddress&) noexcept override {
+    sessions_.emplace_back(std::make_unique<EchoSession>(
+        AsyncSocket::UniquePtr(new AsyncSocket(evb_, fd))));
+  }
+  void acceptError(const std::exception& ex) noexcept override {
+    FAIL() << ex.what();
+  }
+
+ private:
+  EventBase* evb_;
+  std::vector<std::unique_ptr<EchoSession>> sessions_;
+};
+
+class EchoClient : public AsyncSocket::ConnectCallback,
+                   public AsyncTransportWrapper::ReadCallback {
+ public:
+  EchoClient(EventBase* evb, const SocketAddress& addr, std::string message)
+      : sock_(new AsyncSocket(evb)), message_(std::move(message)) {
+    sock_->connect(this, addr);
+  }
+
+  void connectSuccess() noexcept override {
+    sock_->setReadCB(this);
+    sock_->write(nullptr, message_.data(), message_.size());
+  }
+  void connectErr(const AsyncSocketException& ex) noexcept override {
+    FAIL() << ex.what();
+  }
+
+  void getReadBuffer(void** bufReturn, size_t* lenReturn) override {
+    *bufReturn = buf_;
+    *lenReturn = sizeof(buf_);
+  }
+  void readDataAvailable(size_t len) noexcept override {
+    received.append(buf_, len);
+    if (received.size() == message_.size()) {
+      sock_->close();
+    }
+  }
+  void readEOF() noexcept override {}
+  void readErr(const AsyncSocketException& ex) noexcept override {
+    FAIL() << ex.what();
+  }
+
+  std::string received;
+
+ private:
+  AsyncSocket::UniquePtr sock_;
+  std::string message_;
+  char buf_[1024];
+};
+
+} // namespace
+
+TEST(IoUringBackendTest, LoopReturnsWithoutEvents) {
+  SKIP_IF_UNAVAILABLE();
+  auto evb = makeEventBase();
+  EXPECT_TRUE(evb->loop());
+}
+
+TEST(IoUringBackendTest, Timeouts) {
+  SKIP_IF_UNAVAILABLE();
+  auto evb = makeEventBase();
+
+  std::vector<int> fired;
+  auto t1 = AsyncTimeout::make(*evb, [&]() noexcept { fired.push_back(1); });
+  auto t2 = AsyncTimeout::make(*evb, [&]() noexcept { fired.push_back(2); });
+  auto t3 = AsyncTimeout::make(*evb, [&]() noexcept { fired.push_back(3); });
+  t2->scheduleTimeout(20);
+  t1->scheduleTimeout(10);
+  t3->scheduleTimeout(30);
+  EXPECT_TRUE(t3->isScheduled());
+  t3->cancelTimeout();
+  EXPECT_FALSE(t3->isScheduled());
+
+  auto start = std::chrono::steady_clock::now();
+  evb->loop();
+  auto elapsed = std::chrono::steady_clock::now() - start;
+
+  EXPECT_EQ((std::vector<int>{1, 2}), fired);
+  EXPECT_GE(elapsed, std::chrono::milliseconds(20));
+  EXPECT_FALSE(t1->isScheduled());
+}
+
+TEST(IoUringBackendTest, RescheduleTimeout) {
+  SKIP_IF_UNAVAILABLE();
+  auto evb = makeEventBase();
+
+  int fired = 0;
+  auto t = AsyncTimeout::make(*evb, [&]() noexcept { ++fired; });
+  t->scheduleTimeout(1000);
+  t->scheduleTimeout(1);
+  evb->loop();
+  EXPECT_EQ(1, fired);
+}
+
+TEST(IoUringBackendTest, LevelTriggeredRead) {
+  SKIP_IF_UNAVAILABLE();
+  auto evb = makeEventBase();
+
+  int fds[2];
+  ASSERT_EQ(0, ::pipe(fds));
+  PipeHandler handler(evb.get(), fds[0]);
+  ASSERT_TRUE(
+      handler.registerHandler(EventHandler::READ | EventHandler::PERSIST));
+
+  const std::string message = "hello io_uring";
+  ASSERT_EQ(ssize_t(message.size()), ::write(fds[1], message.data(), 14));
+  ::close(fds[1]);
+
+  evb->loop();
+  EXPECT_EQ(message, handler.data);
+  EXPECT_FALSE(handler.isHandlerRegistered());
+  ::close(fds[0]);
+}
+
+TEST(IoUringBackendTest, ReregisterHandler) {
+  SKIP_IF_UNAVAILABLE();
+  auto evb = makeEventBase();
+
+  int fds[2];
+  ASSERT_EQ(0, ::socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  PipeHandler handler(evb.get(), fds[0]);
+  ASSERT_TRUE(handler.registerHandler(EventHandler::WRITE));
+  // Replaces the write registration; only a read may be reported now.
+  ASSERT_TRUE(
+      handler.registerHandler(EventHandler::READ | EventHandler::PERSIST));
+
+  ASSERT_EQ(1, ::write(fds[1], "x", 1));
+  ::shutdown(fds[1], SHUT_WR);
+  evb->loop();
+  EXPECT_EQ("x", handler.data);
+  ::close(fds[0]);
+  ::close(fds[1]);
+}
+
+TEST(IoUringBackendTest, RunInEventBaseThread) {
+  SKIP_IF_UNAVAILABLE();
+  auto evb = makeEventBase();
+
+  std::thread loop([&] { evb->loopForever(); });
+
+  std::atomic<int> count{0};
+  for (int i = 0; i < 1000; ++i) {
+    evb->runInEventBaseThread([&] { ++count; });
+  }
+  evb->runInEventBaseThreadAndWait([] {});
+  EXPECT_EQ(1000, count.load());
+
+  evb->terminateLoopSoon();
+  loop.join();
+}
+
+TEST(IoUringBackendTest, AsyncSocketEcho) {
+  SKIP_IF_UNAVAILABLE();
+  auto evb = makeEventBase();
+
+  EchoServer server(evb.get());
+  auto serverSocket = AsyncServerSocket::newSocket(evb.get());
+  serverSocket->bind(SocketAddress("127.0.0.1", 0));
+  serverSocket->listen(16);
+  serverSocket->addAcceptCallback(&server, evb.get());
+  serverSocket->startAccepting();
+
+  std::vector<std::unique_ptr<EchoClient>> clients;
+  for (int i = 0; i < 8; ++i) {
+    clients.emplace_back(std::make_unique<EchoClient>(
+        evb.get(),
+        serverSocket->getAddress(),
+        std::string(1000 * (i + 1), char('a' + i))));
+  }
+
+  auto stop = AsyncTimeout::make(*evb, [&]() noexcept {
+    serverSocket->stopAccepting();
+  });
+  stop->scheduleTimeout(500);
+  evb->loop();
+
+  for (int i = 0; i < 8; ++i) {
+    EXPECT_EQ(std::string(1000 * (i + 1), char('a' + i)), clients[i]->received);
+  }
+}
+
+TEST(IoUringBackendTest, MultishotAcceptAndRecv) {
+  SKIP_IF_UNAVAILABLE();
+  auto backend = std::make_unique<IoUringBackend>(
+      IoUringBackend::Options().setProvidedBuffers(4, 64));
+  auto uring = backend.get();
+  EventBase evb(std::move(backend));
+
+  struct Receiver : IoUringBackend::RecvCallback {
+    void recvSuccess(std::unique_ptr<IOBuf> data) noexcept override {
+      EXPECT_LE(data->length(), 64);
+      EXPECT_EQ(data->length(), data->capacity());
+      received += data->moveToFbString().toStdString();
+    }
+    void recvEOF() noexcept override {
+      eof = true;
+    }
+    void recvError(int err) noexcept override {
+      error = err;
+    }
+    std::string received;
+    bool eof{false};
+    int error{0};
+  };
+
+  struct Acceptor : IoUringBackend::AcceptCallback {
+    explicit Acceptor(IoUringBackend* backend) : backend_(backend) {}
+    void acceptSuccess(int fd) noexcept override {
+      fds.push_back(fd);
+      receivers.emplace_back(std::make_unique<Receiver>());
+      backend_->recvMultishot(fd, receivers.back().get());
+      if (fds.size() == 2) {
+        backend_->cancelAccept(this);
+      }
+    }
+    void acceptError(int err) noexcept override {
+      error = err;
+    }
+    IoUringBackend* backend_;
+    std::vector<int> fds;
+    std::vector<std::unique_ptr<Receiver>> receivers;
+    int error{0};
+  };
+
+  auto listener = AsyncServerSocket::newSocket(&evb);
+  listener->bind(SocketAddress("127.0.0.1", 0));
+  listener->listen(16);
+  auto addr = listener->getAddress();
+
+  Acceptor acceptor(uring);
+  uring->acceptMultishot(listener->getSocket(), &acceptor);
+
+  // Far more data than the provided buffers hold at once.
+  const std::string message(64 * 1024, 'z');
+  std::vector<std::thread> clients;
+  for (int i = 0; i < 2; ++i) {
+    clients.emplace_back([&] {
+      int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+      sockaddr_storage ss;
+      auto len = addr.getAddress(&ss);
+      ASSERT_EQ(0, ::connect(fd, reinterpret_cast<sockaddr*>(&ss), len));
+      size_t written = 0;
+      while (written < message.size()) {
+        auto n =
+            ::write(fd, message.data() + written, message.size() - written);
+        ASSERT_GT(n, 0);
+        written += size_t(n);
+      }
+      ::close(fd);
+    });
+  }
+
+  evb.loop();
+  for (auto& t : clients) {
+    t.join();
+  }
+
+  if (acceptor.error == -EINVAL) {
+    LOG(WARNING) << "multishot accept not supported, skipping";
+    return;
+  }
+  ASSERT_EQ(2, acceptor.fds.size());
+  for (auto& receiver : acceptor.receivers) {
+    if (receiver->error == -EINVAL) {
+      continue;
+    }
+    EXPECT_EQ(0, receiver->error);
+    EXPECT_TRUE(receiver->eof);
+    EXPECT_EQ(message, receiver->received);
+  }
+  for (auto fd : acceptor.fds) {
+    ::close(fd);
+  }
+}
+
+TEST(IoUringBackendTest, CancelRecv) {
+  SKIP_IF_UNAVAILABLE();
+  auto backend = std::make_unique<IoUringBackend>(
+      IoUringBackend::Options().setProvidedBuffers(4, 64));
+  auto uring = backend.get();
+  EventBase evb(std::move(backend));
+
+  struct Receiver : IoUringBackend::RecvCallback {
+    void recvSuccess(std::unique_ptr<IOBuf>) noexcept override {
+      ADD_FAILURE();
+    }
+    void recvEOF() noexcept override {
+      ADD_FAILURE();
+    }
+    void recvError(int) noexcept override {
+      ADD_FAILURE();
+    }
+  } receiver;
+
+  int fds[2];
+  ASSERT_EQ(0, ::socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  uring->recvMultishot(fds[0], &receiver);
+  evb.loopOnce(EVLOOP_NONBLOCK);
+  uring->cancelRecv(&receiver);
+  ASSERT_EQ(1, ::write(fds[1], "x", 1));
+  // Nothing is pending any more, so this returns straight away.
+  EXPECT_TRUE(evb.loop());
+  ::close(fds[0]);
+  ::close(fds[1]);
+}
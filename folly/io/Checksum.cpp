@@ -0,0 +1,74 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/io/Checksum.h>
+
+#include <algorithm>
+
+#include <folly/Checksum.h>
+#include <folly/portability/BitsFunctexcept.h>
+
+namespace folly {
+namespace io {
+
+namespace {
+
+using ChecksumFn = uint32_t (*)(const uint8_t*, size_t, uint32_t);
+
+uint32_t checksumChain(ChecksumFn fn, const IOBuf& buf, uint32_t sum) {
+  for (auto range : buf) {
+    if (!range.empty()) {
+      sum = fn(range.data(), range.size(), sum);
+    }
+  }
+  return sum;
+}
+
+uint32_t
+checksumCursor(ChecksumFn fn, Cursor& cursor, size_t len, uint32_t sum) {
+  while (len > 0) {
+    auto range = cursor.peekBytes();
+    if (range.empty()) {
+      std::__throw_out_of_range("underflow");
+    }
+    auto n = std::min(len, range.size());
+    sum = fn(range.data(), n, sum);
+    cursor.skip(n);
+    len -= n;
+  }
+  return sum;
+}
+
+} // namespace
+
+uint32_t crc32c(const IOBuf& buf, uint32_t startingChecksum) {
+  return checksumChain(folly::crc32c, buf, startingChecksum);
+}
+
+uint32_t crc32c(Cursor& cursor, size_t len, uint32_t startingChecksum) {
+  return checksumCursor(folly::crc32c, cursor, len, startingChecksum);
+}
+
+uint32_t crc32(const IOBuf& buf, uint32_t startingChecksum) {
+  return checksumChain(folly::crc32, buf, startingChecksum);
+}
+
+uint32_t crc32(Cursor& cursor, size_t len, uint32_t startingChecksum) {
+  return checksumCursor(folly::crc32, cursor, len, startingChecksum);
+}
+
+} // namespace io
+} // namespace folly
@@ -0,0 +1,59 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <folly/io/Cursor.h>
+#include <folly/io/IOBuf.h>
+
+/*
+ * Checksums over IOBuf chains, with the same results as the functions in
+ * folly/Checksum.h over the same bytes in a single buffer.
+ */
+
+namespace folly {
+namespace io {
+
+/**
+ * Compute the CRC-32C checksum of all the data in an IOBuf chain.
+ */
+uint32_t crc32c(const IOBuf& buf, uint32_t startingChecksum = ~0U);
+
+/**
+ * Compute the CRC-32C checksum of the next len bytes after cursor, and
+ * advance it past them.
+ *
+ * Throws std::out_of_range if fewer than len bytes are left, in which case
+ * the cursor ends up at the end of the chain.
+ */
+uint32_t crc32c(Cursor& cursor, size_t len, uint32_t startingChecksum = ~0U);
+
+/**
+ * Compute the CRC-32 checksum of all the data in an IOBuf chain.
+ */
+uint32_t crc32(const IOBuf& buf, uint32_t startingChecksum = ~0U);
+
+/**
+ * Compute the CRC-32 checksum of the next len bytes after cursor, and
+ * advance it past them.
+ */
+uint32_t crc32(Cursor& cursor, size_t len, uint32_t startingChecksum = ~0U);
+
+} // namespace io
+} // namespace folly
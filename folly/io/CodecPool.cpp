@@ -0,0 +1,128 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/io/CodecPool.h>
+
+#include <utility>
+#include <vector>
+
+#include <folly/detail/ThreadLocalUntilExit.h>
+
+namespace folly {
+namespace io {
+
+namespace {
+
+struct Entry {
+  detail::CodecPoolKey key;
+  std::unique_ptr<Codec> codec;
+};
+
+struct Cache {
+  // Least recently given back first.
+  std::vector<Entry> entries;
+};
+
+Cache* localCache() {
+  return folly::detail::ThreadLocalUntilExit<Cache>::get();
+}
+
+std::unique_ptr<Codec> takeCached(const detail::CodecPoolKey& key) {
+  auto cache = localCache();
+  if (!cache) {
+    return nullptr;
+  }
+  auto& entries = cache->entries;
+  for (auto it = entries.rbegin(); it != entries.rend(); ++it) {
+    if (it->key == key) {
+      auto codec = std::move(it->codec);
+      entries.erase(std::next(it).base());
+      return codec;
+    }
+  }
+  return nullptr;
+}
+
+template <class T, class Create>
+std::unique_ptr<T, detail::CodecReleaser> getPooled(
+    const detail::CodecPoolKey& key,
+    Create&& create) {
+  std::unique_ptr<T> codec(static_cast<T*>(takeCached(key).release()));
+  if (!codec) {
+    codec = create();
+  }
+  return std::unique_ptr<T, detail::CodecReleaser>(
+      codec.release(), detail::CodecReleaser(key));
+}
+
+} // namespace
+
+namespace detail {
+
+void CodecReleaser::operator()(Codec* codec) const {
+  std::unique_ptr<Codec> owned(codec);
+  auto cache = localCache();
+  if (!cache) {
+    return;
+  }
+  auto& entries = cache->entries;
+  if (entries.size() >= kMaxPooledCodecs) {
+    entries.erase(entries.begin());
+  }
+  entries.push_back(Entry{key_, std::move(owned)});
+}
+
+} // namespace detail
+
+PooledCodec getPooledCodec(CodecType type, int level) {
+  return getPooled<Codec>(
+      {type, level, nullptr, false}, [&] { return getCodec(type, level); });
+}
+
+PooledStreamCodec getPooledStreamCodec(CodecType type, int level) {
+  auto codec = getPooled<StreamCodec>({type, level, nullptr, true}, [&] {
+    return getStreamCodec(type, level);
+  });
+  codec->resetStream();
+  return codec;
+}
+
+PooledCodec getPooledCodec(
+    std::shared_ptr<const CompressionDictionary> dictionary) {
+  detail::CodecPoolKey key{
+      dictionary->type(), dictionary->level(), dictionary.get(), false};
+  return getPooled<Codec>(
+      key, [&] { return getCodec(std::move(dictionary)); });
+}
+
+PooledStreamCodec getPooledStreamCodec(
+    std::shared_ptr<const CompressionDictionary> dictionary) {
+  detail::CodecPoolKey key{
+      dictionary->type(), dictionary->level(), dictionary.get(), true};
+  auto codec = getPooled<StreamCodec>(
+      key, [&] { return getStreamCodec(std::move(dictionary)); });
+  codec->resetStream();
+  return codec;
+}
+
+void clearPooledCodecs() {
+  if (auto cache = localCache()) {
+    cache->entries.clear();
+  }
+}
+
+} // namespace io
+} // namespace folly
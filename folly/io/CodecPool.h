@@ -0,0 +1,101 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+
+#include <folly/io/Compression.h>
+
+/**
+ * Per-thread caches of ready-to-use codecs.
+ *
+ * Creating a codec is cheap, but the first use of a zlib, zstd or lzma
+ * codec allocates and initializes compression state of tens to hundreds of
+ * KB (more at high levels), which can cost more than compressing a small
+ * message.  The codecs keep that state and reset it in place between uses,
+ * so a codec from getPooledCodec() that was used before compresses without
+ * allocating any of it again.
+ *
+ * A pooled codec goes back to the cache of the thread that destroys the
+ * handle, which need not be the thread that got it.  Each thread keeps the
+ * kMaxPooledCodecs codecs it gave back most recently; older ones are freed.
+ *
+ * A codec for a dictionary holds a reference to it, so every thread that
+ * gave one back keeps the dictionary alive until the codec is evicted,
+ * clearPooledCodecs() is called on that thread, or the thread exits.
+ */
+
+namespace folly {
+namespace io {
+
+constexpr size_t kMaxPooledCodecs = 16;
+
+namespace detail {
+
+struct CodecPoolKey {
+  CodecType type;
+  int level;
+  // Only compared; the pooled codec keeps the dictionary alive.
+  const CompressionDictionary* dictionary;
+  bool stream;
+
+  bool operator==(const CodecPoolKey& other) const {
+    return type == other.type && level == other.level &&
+        dictionary == other.dictionary && stream == other.stream;
+  }
+};
+
+class CodecReleaser {
+ public:
+  CodecReleaser() = default;
+  explicit CodecReleaser(const CodecPoolKey& key) : key_(key) {}
+
+  void operator()(Codec* codec) const;
+
+ private:
+  CodecPoolKey key_{};
+};
+
+} // namespace detail
+
+using PooledCodec = std::unique_ptr<Codec, detail::CodecReleaser>;
+using PooledStreamCodec = std::unique_ptr<StreamCodec, detail::CodecReleaser>;
+
+/**
+ * Like getCodec() and getStreamCodec(), but reuse a codec from this thread's
+ * cache when there is one for the same arguments.  Stream codecs are handed
+ * out after resetStream().
+ */
+PooledCodec getPooledCodec(
+    CodecType type,
+    int level = COMPRESSION_LEVEL_DEFAULT);
+PooledStreamCodec getPooledStreamCodec(
+    CodecType type,
+    int level = COMPRESSION_LEVEL_DEFAULT);
+PooledCodec getPooledCodec(
+    std::shared_ptr<const CompressionDictionary> dictionary);
+PooledStreamCodec getPooledStreamCodec(
+    std::shared_ptr<const CompressionDictionary> dictionary);
+
+/**
+ * Free the codecs cached by the calling thread.
+ */
+void clearPooledCodecs();
+
+} // namespace io
+} // namespace folly
@@ -41,6 +41,7 @@
 
 #if FOLLY_HAVE_LIBZSTD
 #define ZSTD_STATIC_LINKING_ONLY
+#include <zdict.h>
 #include <zstd.h>
 #endif
 
@@ -552,13 +553,48 @@ prefixToStringLE(T prefix, uint64_t n = sizeof(T)) {
 
 #if FOLLY_HAVE_LIBLZ4
 
+/**
+ * An LZ4 stream with the dictionary loaded.  Codecs copy it into their own
+ * stream before compressing each input, instead of loading the dictionary
+ * every time.
+ */
+class LZ4Dictionary final : public CompressionDictionary {
+ public:
+  LZ4Dictionary(CodecType type, int level, ByteRange data);
+
+  const LZ4_stream_t& stream() const {
+    return stream_;
+  }
+
+ private:
+  LZ4_stream_t stream_;
+};
+
+LZ4Dictionary::LZ4Dictionary(CodecType type, int level, ByteRange data)
+    : CompressionDictionary(type, 1, data, 0) {
+  DCHECK(type == CodecType::LZ4 || type == CodecType::LZ4_VARINT_SIZE);
+  if (level != COMPRESSION_LEVEL_FASTEST &&
+      level != COMPRESSION_LEVEL_DEFAULT && level != 1) {
+    throw std::invalid_argument(to<std::string>(
+        "LZ4Codec: invalid level for a dictionary: ", level));
+  }
+  // Only the last 64KiB are used, and LZ4_loadDict() skips the rest.
+  auto dict = this->data();
+  LZ4_resetStream(&stream_);
+  LZ4_loadDict(
+      &stream_, reinterpret_cast<const char*>(dict.data()), int(dict.size()));
+}
+
 /**
  * LZ4 compression
  */
 class LZ4Codec final : public Codec {
  public:
   static std::unique_ptr<Codec> create(int level, CodecType type);
-  explicit LZ4Codec(int level, CodecType type);
+  explicit LZ4Codec(
+      int level,
+      CodecType type,
+      std::shared_ptr<const LZ4Dictionary> dictionary = nullptr);
 
  private:
   bool doNeedsUncompressedLength() const override;
@@ -573,13 +609,20 @@ class LZ4Codec final : public Codec {
       Optional<uint64_t> uncompressedLength) override;
 
   bool highCompression_;
+  std::shared_ptr<const LZ4Dictionary> dictionary_;
+  // Scratch copy of the dictionary's stream.
+  std::unique_ptr<LZ4_stream_t> stream_;
 };
 
 std::unique_ptr<Codec> LZ4Codec::create(int level, CodecType type) {
   return std::make_unique<LZ4Codec>(level, type);
 }
 
-LZ4Codec::LZ4Codec(int level, CodecType type) : Codec(type) {
+LZ4Codec::LZ4Codec(
+    int level,
+    CodecType type,
+    std::shared_ptr<const LZ4Dictionary> dictionary)
+    : Codec(type), dictionary_(std::move(dictionary)) {
   DCHECK(type == CodecType::LZ4 || type == CodecType::LZ4_VARINT_SIZE);
 
   switch (level) {
@@ -636,7 +679,14 @@ std::unique_ptr<IOBuf> LZ4Codec::doCompress(const IOBuf* data) {
   auto output = reinterpret_cast<char*>(out->writableTail());
   const auto inputLength = data->length();
 #if LZ4_VERSION_NUMBER >= 10700
-  if (highCompression_) {
+  if (dictionary_) {
+    if (!stream_) {
+      stream_ = std::make_unique<LZ4_stream_t>();
+    }
+    *stream_ = dictionary_->stream();
+    n = LZ4_compress_fast_continue(
+        stream_.get(), input, output, inputLength, out->tailroom(), 1);
+  } else if (highCompression_) {
     n = LZ4_compress_HC(input, output, inputLength, out->tailroom(), 0);
   } else {
     n = LZ4_compress_default(input, output, inputLength, out->tailroom());
@@ -682,11 +732,26 @@ std::unique_ptr<IOBuf> LZ4Codec::doUncompress(
 
   auto sp = StringPiece{cursor.peekBytes()};
   auto out = IOBuf::create(actualUncompressedLength);
-  int n = LZ4_decompress_safe(
-      sp.data(),
-      reinterpret_cast<char*>(out->writableTail()),
-      sp.size(),
-      actualUncompressedLength);
+  int n;
+#if LZ4_VERSION_NUMBER >= 10700
+  if (dictionary_) {
+    auto dict = StringPiece{dictionary_->data()};
+    n = LZ4_decompress_safe_usingDict(
+        sp.data(),
+        reinterpret_cast<char*>(out->writableTail()),
+        sp.size(),
+        actualUncompressedLength,
+        dict.data(),
+        dict.size());
+  } else
+#endif
+  {
+    n = LZ4_decompress_safe(
+        sp.data(),
+        reinterpret_cast<char*>(out->writableTail()),
+        sp.size(),
+        actualUncompressedLength);
+  }
 
   if (n < 0 || uint64_t(n) != actualUncompressedLength) {
     throw std::runtime_error(to<std::string>(
@@ -1308,6 +1373,7 @@ class LZMA2Codec final : public Codec {
  public:
   static std::unique_ptr<Codec> create(int level, CodecType type);
   explicit LZMA2Codec(int level, CodecType type);
+  ~LZMA2Codec() override;
 
   std::vector<std::string> validPrefixes() const override;
   bool canUncompress(const IOBuf* data, Optional<uint64_t> uncompressedLength)
@@ -1328,7 +1394,14 @@ class LZMA2Codec final : public Codec {
   std::unique_ptr<IOBuf> addOutputBuffer(lzma_stream* stream, size_t length);
   bool doInflate(lzma_stream* stream, IOBuf* head, size_t bufferLength);
 
+  // Forget the buffers from the last use of one of the streams below.  The
+  // streams are kept for the codec's lifetime, so that reinitializing them
+  // reuses their memory.
+  static void clearBuffers(lzma_stream& stream);
+
   int level_;
+  lzma_stream encodeStream_ = LZMA_STREAM_INIT;
+  lzma_stream decodeStream_ = LZMA_STREAM_INIT;
 };
 
 static constexpr uint64_t kLZMA2MagicLE = 0x005A587A37FD;
@@ -1374,6 +1447,19 @@ LZMA2Codec::LZMA2Codec(int level, CodecType type) : Codec(type) {
   level_ = level;
 }
 
+LZMA2Codec::~LZMA2Codec() {
+  lzma_end(&encodeStream_);
+  lzma_end(&decodeStream_);
+}
+
+void LZMA2Codec::clearBuffers(lzma_stream& stream) {
+  // The initialization functions reset everything else.
+  stream.next_in = nullptr;
+  stream.avail_in = 0;
+  stream.next_out = nullptr;
+  stream.avail_out = 0;
+}
+
 bool LZMA2Codec::doNeedsUncompressedLength() const {
   return false;
 }
@@ -1405,7 +1491,8 @@ std::unique_ptr<IOBuf> LZMA2Codec::addOutputBuffer(
 
 std::unique_ptr<IOBuf> LZMA2Codec::doCompress(const IOBuf* data) {
   lzma_ret rc;
-  lzma_stream stream = LZMA_STREAM_INIT;
+  auto& stream = encodeStream_;
+  clearBuffers(stream);
 
   rc = lzma_easy_encoder(&stream, level_, LZMA_CHECK_NONE);
   if (rc != LZMA_OK) {
@@ -1413,8 +1500,6 @@ std::unique_ptr<IOBuf> LZMA2Codec::doCompress(const IOBuf* data) {
       "LZMA2Codec: lzma_easy_encoder error: ", rc));
   }
 
-  SCOPE_EXIT { lzma_end(&stream); };
-
   uint64_t uncompressedLength = data->computeChainDataLength();
   uint64_t maxCompressedLength = lzma_stream_buffer_bound(uncompressedLength);
 
@@ -1501,7 +1586,8 @@ std::unique_ptr<IOBuf> LZMA2Codec::doUncompress(
     const IOBuf* data,
     Optional<uint64_t> uncompressedLength) {
   lzma_ret rc;
-  lzma_stream stream = LZMA_STREAM_INIT;
+  auto& stream = decodeStream_;
+  clearBuffers(stream);
 
   rc = lzma_auto_decoder(&stream, std::numeric_limits<uint64_t>::max(), 0);
   if (rc != LZMA_OK) {
@@ -1509,8 +1595,6 @@ std::unique_ptr<IOBuf> LZMA2Codec::doUncompress(
       "LZMA2Codec: lzma_auto_decoder error: ", rc));
   }
 
-  SCOPE_EXIT { lzma_end(&stream); };
-
   // Max 64MiB in one go
   constexpr uint32_t maxSingleStepLength = uint32_t(64) << 20; // 64MiB
   constexpr uint32_t defaultBufferLength = uint32_t(256) << 10; // 256 KiB
@@ -1575,6 +1659,88 @@ void zstdFreeCStream(ZSTD_CStream* zcs) {
 void zstdFreeDStream(ZSTD_DStream* zds) {
   ZSTD_freeDStream(zds);
 }
+
+void zstdFreeCCtx(ZSTD_CCtx* cctx) {
+  ZSTD_freeCCtx(cctx);
+}
+
+void zstdFreeDCtx(ZSTD_DCtx* dctx) {
+  ZSTD_freeDCtx(dctx);
+}
+
+void zstdFreeCDict(ZSTD_CDict* cdict) {
+  ZSTD_freeCDict(cdict);
+}
+
+void zstdFreeDDict(ZSTD_DDict* ddict) {
+  ZSTD_freeDDict(ddict);
+}
+
+int zstdConvertLevel(int level) {
+  switch (level) {
+    case COMPRESSION_LEVEL_FASTEST:
+      level = 1;
+      break;
+    case COMPRESSION_LEVEL_DEFAULT:
+      level = 1;
+      break;
+    case COMPRESSION_LEVEL_BEST:
+      level = 19;
+      break;
+  }
+  if (level < 1 || level > ZSTD_maxCLevel()) {
+    throw std::invalid_argument(
+        to<std::string>("ZSTD: invalid level: ", level));
+  }
+  return level;
+}
+
+void zstdThrowIfError(size_t rc) {
+  if (!ZSTD_isError(rc)) {
+    return;
+  }
+  throw std::runtime_error(
+      to<std::string>("ZSTD returned an error: ", ZSTD_getErrorName(rc)));
+}
+}
+
+/**
+ * A ZSTD dictionary, digested for compression at one level and for
+ * decompression.
+ */
+class ZSTDDictionary final : public CompressionDictionary {
+ public:
+  ZSTDDictionary(int level, ByteRange data);
+
+  const ZSTD_CDict* cdict() const {
+    return cdict_.get();
+  }
+  const ZSTD_DDict* ddict() const {
+    return ddict_.get();
+  }
+
+ private:
+  std::unique_ptr<
+      ZSTD_CDict,
+      folly::static_function_deleter<ZSTD_CDict, &zstdFreeCDict>>
+      cdict_;
+  std::unique_ptr<
+      ZSTD_DDict,
+      folly::static_function_deleter<ZSTD_DDict, &zstdFreeDDict>>
+      ddict_;
+};
+
+ZSTDDictionary::ZSTDDictionary(int level, ByteRange data)
+    : CompressionDictionary(
+          CodecType::ZSTD,
+          level,
+          data,
+          ZSTD_getDictID_fromDict(data.data(), data.size())) {
+  cdict_.reset(ZSTD_createCDict(data.data(), data.size(), level));
+  ddict_.reset(ZSTD_createDDict(data.data(), data.size()));
+  if (!cdict_ || !ddict_) {
+    throw std::runtime_error("ZSTD: failed to load the dictionary");
+  }
 }
 
 /**
@@ -1584,7 +1750,10 @@ class ZSTDStreamCodec final : public StreamCodec {
  public:
   static std::unique_ptr<Codec> createCodec(int level, CodecType);
   static std::unique_ptr<StreamCodec> createStream(int level, CodecType);
-  explicit ZSTDStreamCodec(int level, CodecType type);
+  explicit ZSTDStreamCodec(
+      int level,
+      CodecType type,
+      std::shared_ptr<const ZSTDDictionary> dictionary = nullptr);
 
   std::vector<std::string> validPrefixes() const override;
   bool canUncompress(const IOBuf* data, Optional<uint64_t> uncompressedLength)
@@ -1610,11 +1779,22 @@ class ZSTDStreamCodec final : public StreamCodec {
   void resetCStream();
   void resetDStream();
 
-  bool tryBlockCompress(ByteRange& input, MutableByteRange& output) const;
-  bool tryBlockUncompress(ByteRange& input, MutableByteRange& output) const;
+  bool tryBlockCompress(ByteRange& input, MutableByteRange& output);
+  bool tryBlockUncompress(ByteRange& input, MutableByteRange& output);
+  void checkDictionaryID(ByteRange input) const;
 
   int level_;
   bool needReset_{true};
+  std::shared_ptr<const ZSTDDictionary> dictionary_;
+  // Used for block (de)compression.
+  std::unique_ptr<
+      ZSTD_CCtx,
+      folly::static_function_deleter<ZSTD_CCtx, &zstdFreeCCtx>>
+      cctx_{nullptr};
+  std::unique_ptr<
+      ZSTD_DCtx,
+      folly::static_function_deleter<ZSTD_DCtx, &zstdFreeDCtx>>
+      dctx_{nullptr};
   std::unique_ptr<
       ZSTD_CStream,
       folly::static_function_deleter<ZSTD_CStream, &zstdFreeCStream>>
@@ -1646,25 +1826,14 @@ std::unique_ptr<StreamCodec> ZSTDStreamCodec::createStream(
   return make_unique<ZSTDStreamCodec>(level, type);
 }
 
-ZSTDStreamCodec::ZSTDStreamCodec(int level, CodecType type)
-    : StreamCodec(type) {
+ZSTDStreamCodec::ZSTDStreamCodec(
+    int level,
+    CodecType type,
+    std::shared_ptr<const ZSTDDictionary> dictionary)
+    : StreamCodec(type),
+      level_(zstdConvertLevel(level)),
+      dictionary_(std::move(dictionary)) {
   DCHECK(type == CodecType::ZSTD);
-  switch (level) {
-    case COMPRESSION_LEVEL_FASTEST:
-      level = 1;
-      break;
-    case COMPRESSION_LEVEL_DEFAULT:
-      level = 1;
-      break;
-    case COMPRESSION_LEVEL_BEST:
-      level = 19;
-      break;
-  }
-  if (level < 1 || level > ZSTD_maxCLevel()) {
-    throw std::invalid_argument(
-        to<std::string>("ZSTD: invalid level: ", level));
-  }
-  level_ = level;
 }
 
 bool ZSTDStreamCodec::doNeedsUncompressedLength() const {
@@ -1676,14 +1845,6 @@ uint64_t ZSTDStreamCodec::doMaxCompressedLength(
   return ZSTD_compressBound(uncompressedLength);
 }
 
-void zstdThrowIfError(size_t rc) {
-  if (!ZSTD_isError(rc)) {
-    return;
-  }
-  throw std::runtime_error(
-      to<std::string>("ZSTD returned an error: ", ZSTD_getErrorName(rc)));
-}
-
 Optional<uint64_t> ZSTDStreamCodec::doGetUncompressedLength(
     IOBuf const* data,
     Optional<uint64_t> uncompressedLength) const {
@@ -1705,14 +1866,37 @@ void ZSTDStreamCodec::doResetStream() {
 
 bool ZSTDStreamCodec::tryBlockCompress(
     ByteRange& input,
-    MutableByteRange& output) const {
+    MutableByteRange& output) {
   DCHECK(needReset_);
   // We need to know that we have enough output space to use block compression
   if (output.size() < ZSTD_compressBound(input.size())) {
     return false;
   }
-  size_t const length = ZSTD_compress(
-      output.data(), output.size(), input.data(), input.size(), level_);
+  // Keep the context around, so a reused codec doesn't allocate.
+  if (!cctx_) {
+    cctx_.reset(ZSTD_createCCtx());
+    if (!cctx_) {
+      throw std::bad_alloc{};
+    }
+  }
+  size_t length;
+  if (dictionary_) {
+    length = ZSTD_compress_usingCDict(
+        cctx_.get(),
+        output.data(),
+        output.size(),
+        input.data(),
+        input.size(),
+        dictionary_->cdict());
+  } else {
+    length = ZSTD_compressCCtx(
+        cctx_.get(),
+        output.data(),
+        output.size(),
+        input.data(),
+        input.size(),
+        level_);
+  }
   zstdThrowIfError(length);
   input.uncheckedAdvance(input.size());
   output.uncheckedAdvance(length);
@@ -1726,6 +1910,15 @@ void ZSTDStreamCodec::resetCStream() {
       throw std::bad_alloc{};
     }
   }
+  if (dictionary_) {
+    // The dictionary sets contentSizeFlag, and a pledged size of 0 means
+    // unknown here.
+    zstdThrowIfError(
+        ZSTD_initCStream_usingCDict(cstream_.get(), dictionary_->cdict()));
+    zstdThrowIfError(ZSTD_resetCStream(
+        cstream_.get(), uncompressedLength().value_or(0)));
+    return;
+  }
   // Advanced API usage works for all supported versions of zstd.
   // Required to set contentSizeFlag.
   auto params = ZSTD_getParams(level_, uncompressedLength().value_or(0), 0);
@@ -1778,7 +1971,7 @@ bool ZSTDStreamCodec::doCompressStream(
 
 bool ZSTDStreamCodec::tryBlockUncompress(
     ByteRange& input,
-    MutableByteRange& output) const {
+    MutableByteRange& output) {
   DCHECK(needReset_);
 #if ZSTD_VERSION_NUMBER < 10104
   // We require ZSTD_findFrameCompressedSize() to perform this optimization.
@@ -1791,8 +1984,29 @@ bool ZSTDStreamCodec::tryBlockUncompress(
   size_t const compressedLength =
       ZSTD_findFrameCompressedSize(input.data(), input.size());
   zstdThrowIfError(compressedLength);
-  size_t const length = ZSTD_decompress(
-      output.data(), *uncompressedLength(), input.data(), compressedLength);
+  if (!dctx_) {
+    dctx_.reset(ZSTD_createDCtx());
+    if (!dctx_) {
+      throw std::bad_alloc{};
+    }
+  }
+  size_t length;
+  if (dictionary_) {
+    length = ZSTD_decompress_usingDDict(
+        dctx_.get(),
+        output.data(),
+        *uncompressedLength(),
+        input.data(),
+        compressedLength,
+        dictionary_->ddict());
+  } else {
+    length = ZSTD_decompressDCtx(
+        dctx_.get(),
+        output.data(),
+        *uncompressedLength(),
+        input.data(),
+        compressedLength);
+  }
   zstdThrowIfError(length);
   if (length != *uncompressedLength()) {
     throw std::runtime_error("ZSTDStreamCodec: Incorrect uncompressed length");
@@ -1810,7 +2024,28 @@ void ZSTDStreamCodec::resetDStream() {
       throw std::bad_alloc{};
     }
   }
-  zstdThrowIfError(ZSTD_initDStream(dstream_.get()));
+  if (dictionary_) {
+    zstdThrowIfError(
+        ZSTD_initDStream_usingDDict(dstream_.get(), dictionary_->ddict()));
+  } else {
+    zstdThrowIfError(ZSTD_initDStream(dstream_.get()));
+  }
+}
+
+void ZSTDStreamCodec::checkDictionaryID(ByteRange input) const {
+  if (!dictionary_) {
+    return;
+  }
+  // 0 if the frame doesn't name a dictionary, or its header isn't all here
+  // yet; zstd itself catches a missing dictionary.
+  auto const id = ZSTD_getDictID_fromFrame(input.data(), input.size());
+  if (id != 0 && id != dictionary_->id()) {
+    throw std::runtime_error(to<std::string>(
+        "ZSTD: data needs dictionary ",
+        id,
+        ", but the codec has dictionary ",
+        dictionary_->id()));
+  }
 }
 
 bool ZSTDStreamCodec::doUncompressStream(
@@ -1818,6 +2053,7 @@ bool ZSTDStreamCodec::doUncompressStream(
     MutableByteRange& output,
     StreamCodec::FlushOp flushOp) {
   if (needReset_) {
+    checkDictionaryID(input);
     // If we are given all the input in one chunk try to use block uncompression
     if (flushOp == StreamCodec::FlushOp::END &&
         tryBlockUncompress(input, output)) {
@@ -2324,5 +2560,103 @@ std::unique_ptr<Codec> getAutoUncompressionCodec(
     std::vector<std::unique_ptr<Codec>> customCodecs) {
   return AutomaticCodec::create(std::move(customCodecs));
 }
+
+std::string trainCompressionDictionary(
+    const std::vector<const IOBuf*>& samples,
+    size_t maxSize) {
+#if FOLLY_HAVE_LIBZSTD
+  // ZDICT wants the samples back to back.
+  std::string buffer;
+  std::vector<size_t> sizes;
+  sizes.reserve(samples.size());
+  for (auto sample : samples) {
+    auto size = buffer.size();
+    for (auto range : *sample) {
+      buffer.append(reinterpret_cast<const char*>(range.data()), range.size());
+    }
+    sizes.push_back(buffer.size() - size);
+  }
+
+  std::string dictionary;
+  dictionary.resize(maxSize);
+  auto const rc = ZDICT_trainFromBuffer(
+      &dictionary[0],
+      dictionary.size(),
+      buffer.data(),
+      sizes.data(),
+      unsigned(sizes.size()));
+  if (ZDICT_isError(rc)) {
+    throw std::runtime_error(to<std::string>(
+        "ZSTD: dictionary training failed: ", ZDICT_getErrorName(rc)));
+  }
+  dictionary.resize(rc);
+  return dictionary;
+#else
+  (void)samples;
+  (void)maxSize;
+  throw std::invalid_argument("ZSTD: not supported");
+#endif
+}
+
+std::shared_ptr<const CompressionDictionary> createCompressionDictionary(
+    CodecType type,
+    ByteRange data,
+    int level) {
+  switch (type) {
+#if FOLLY_HAVE_LIBZSTD
+    case CodecType::ZSTD:
+      return std::make_shared<ZSTDDictionary>(zstdConvertLevel(level), data);
+#endif
+#if (FOLLY_HAVE_LIBLZ4 && LZ4_VERSION_NUMBER >= 10700)
+    case CodecType::LZ4:
+    case CodecType::LZ4_VARINT_SIZE:
+      return std::make_shared<LZ4Dictionary>(type, level, data);
+#endif
+    default:
+      throw std::invalid_argument(to<std::string>(
+          "Compression type ", type, " doesn't support dictionaries"));
+  }
+}
+
+std::unique_ptr<Codec> getCodec(
+    std::shared_ptr<const CompressionDictionary> dictionary) {
+  auto const type = dictionary->type();
+  auto const level = dictionary->level();
+  switch (type) {
+#if FOLLY_HAVE_LIBZSTD
+    case CodecType::ZSTD:
+      return getStreamCodec(std::move(dictionary));
+#endif
+#if (FOLLY_HAVE_LIBLZ4 && LZ4_VERSION_NUMBER >= 10700)
+    case CodecType::LZ4:
+    case CodecType::LZ4_VARINT_SIZE:
+      return std::make_unique<LZ4Codec>(
+          level,
+          type,
+          std::static_pointer_cast<const LZ4Dictionary>(std::move(dictionary)));
+#endif
+    default:
+      (void)level;
+      throw std::invalid_argument(to<std::string>(
+          "Compression type ", type, " doesn't support dictionaries"));
+  }
+}
+
+std::unique_ptr<StreamCodec> getStreamCodec(
+    std::shared_ptr<const CompressionDictionary> dictionary) {
+#if FOLLY_HAVE_LIBZSTD
+  if (dictionary->type() == CodecType::ZSTD) {
+    auto const level = dictionary->level();
+    return std::make_unique<ZSTDStreamCodec>(
+        level,
+        CodecType::ZSTD,
+        std::static_pointer_cast<const ZSTDDictionary>(std::move(dictionary)));
+  }
+#endif
+  throw std::invalid_argument(to<std::string>(
+      "Compression type ",
+      dictionary->type(),
+      " doesn't support streaming with dictionaries"));
+}
 } // namespace io
 } // namespace folly
@@ -458,6 +458,103 @@ std::unique_ptr<StreamCodec> getStreamCodec(
 std::unique_ptr<Codec> getAutoUncompressionCodec(
     std::vector<std::unique_ptr<Codec>> customCodecs = {});
 
+/**
+ * Shared history for compressing small inputs, such as RPC payloads or cache
+ * values, that have a lot of content in common but compress poorly on their
+ * own.  Data compressed by a codec with a dictionary can only be
+ * uncompressed by a codec with the same dictionary.
+ *
+ * A dictionary is parsed and prepared for its codec type once, when it is
+ * created, so that creating codecs with it and compressing with them is
+ * cheap.  It is immutable, and may be shared between codecs on any number
+ * of threads.
+ */
+class CompressionDictionary {
+ public:
+  virtual ~CompressionDictionary() {}
+
+  CodecType type() const {
+    return type_;
+  }
+
+  /**
+   * The codec-specific compression level that codecs using this dictionary
+   * compress with.
+   */
+  int level() const {
+    return level_;
+  }
+
+  ByteRange data() const {
+    return ByteRange(StringPiece(data_));
+  }
+
+  /**
+   * The ID stored in a ZSTD dictionary's header, or 0 for raw content
+   * dictionaries and other codec types.  ZSTD records it in every frame
+   * compressed with the dictionary, and uncompressing a frame with a
+   * dictionary whose ID differs throws std::runtime_error.
+   */
+  uint32_t id() const {
+    return id_;
+  }
+
+ protected:
+  CompressionDictionary(CodecType type, int level, ByteRange data, uint32_t id)
+      : type_(type), level_(level), data_(StringPiece(data).str()), id_(id) {}
+
+ private:
+  CodecType type_;
+  int level_;
+  std::string data_;
+  uint32_t id_;
+};
+
+/**
+ * Train a ZSTD dictionary of at most maxSize bytes from sample inputs.
+ * Samples should be representative of the data that will be compressed;
+ * a few thousand of them, totalling about 100 times maxSize, is typical.
+ * The result may be passed to createCompressionDictionary() for ZSTD, or
+ * used as raw content for other codec types.
+ *
+ * Throws std::invalid_argument if ZSTD is not supported, and
+ * std::runtime_error if training fails, e.g. for too few samples.
+ */
+std::string trainCompressionDictionary(
+    const std::vector<const IOBuf*>& samples,
+    size_t maxSize = 64 * 1024);
+
+/**
+ * Prepare a dictionary for codecs of the given type.  For ZSTD, data may be
+ * a trained dictionary or arbitrary raw content; for LZ4 and
+ * LZ4_VARINT_SIZE it is used as raw content, of which only the last 64KiB
+ * matter.
+ *
+ * The level is interpreted as for getCodec().  LZ4 dictionaries only support
+ * the fast level.
+ *
+ * Throws std::invalid_argument if the codec type doesn't support
+ * dictionaries, and std::runtime_error if ZSTD can't load the dictionary.
+ */
+std::shared_ptr<const CompressionDictionary> createCompressionDictionary(
+    CodecType type,
+    ByteRange data,
+    int level = COMPRESSION_LEVEL_DEFAULT);
+
+/**
+ * Return a codec of the dictionary's type and level that compresses and
+ * uncompresses with the dictionary.
+ */
+std::unique_ptr<Codec> getCodec(
+    std::shared_ptr<const CompressionDictionary> dictionary);
+
+/**
+ * Return a streaming codec that uses the dictionary.  Only ZSTD supports
+ * this; for other types std::invalid_argument is thrown.
+ */
+std::unique_ptr<StreamCodec> getStreamCodec(
+    std::shared_ptr<const CompressionDictionary> dictionary);
+
 /**
  * Check if a specified codec is supported.
  */
@@ -41,6 +41,32 @@ class CursorNoopAppender {
   void append(ByteRange) {}
 };
 
+/*
+ * Whether the chain holds delimiter at the given offset of buf, continuing
+ * into the following buffers up to (but not including) end.
+ */
+inline bool cursorMatchesAt(
+    const IOBuf* buf,
+    size_t offset,
+    const IOBuf* end,
+    ByteRange delimiter) {
+  while (true) {
+    auto n = std::min(buf->length() - offset, delimiter.size());
+    if (memcmp(buf->data() + offset, delimiter.data(), n) != 0) {
+      return false;
+    }
+    delimiter.advance(n);
+    if (delimiter.empty()) {
+      return true;
+    }
+    buf = buf->next();
+    if (buf == end) {
+      return false;
+    }
+    offset = 0;
+  }
+}
+
 template <class Derived, class BufType>
 std::string CursorBase<Derived, BufType>::readTerminatedString(
     char termChar,
@@ -105,6 +131,86 @@ void CursorBase<Derived, BufType>::skipWhile(const Predicate& predicate) {
   CursorNoopAppender appender;
   readWhile(predicate, appender);
 }
+
+template <class Derived, class BufType>
+size_t CursorBase<Derived, BufType>::find(uint8_t needle) const {
+  const IOBuf* buf = crtBuf_;
+  ByteRange bytes{data(), length()};
+  size_t skipped = 0;
+  while (true) {
+    auto pos = qfind(bytes, needle);
+    if (pos != std::string::npos) {
+      return skipped + pos;
+    }
+    skipped += bytes.size();
+    buf = buf->next();
+    if (buf == buffer_) {
+      return std::string::npos;
+    }
+    bytes = ByteRange{buf->data(), buf->length()};
+  }
+}
+
+template <class Derived, class BufType>
+size_t CursorBase<Derived, BufType>::find(ByteRange delimiter) const {
+  if (delimiter.size() <= 1) {
+    return delimiter.empty() ? 0 : find(delimiter[0]);
+  }
+  const IOBuf* buf = crtBuf_;
+  size_t offset = offset_;
+  size_t skipped = 0;
+  while (true) {
+    // Look for the first byte, then check the rest, which may continue into
+    // the next buffers.
+    ByteRange bytes{buf->data() + offset, buf->length() - offset};
+    size_t pos = 0;
+    while ((pos = qfind(bytes, delimiter[0])) != std::string::npos) {
+      auto start = size_t(bytes.data() - buf->data()) + pos;
+      if (cursorMatchesAt(buf, start, buffer_, delimiter)) {
+        return skipped + start - offset;
+      }
+      bytes.advance(pos + 1);
+    }
+    skipped += buf->length() - offset;
+    buf = buf->next();
+    if (buf == buffer_) {
+      return std::string::npos;
+    }
+    offset = 0;
+  }
+}
+
+template <class Derived, class BufType>
+size_t CursorBase<Derived, BufType>::findFirstOf(ByteRange needles) const {
+  const IOBuf* buf = crtBuf_;
+  ByteRange bytes{data(), length()};
+  size_t skipped = 0;
+  while (true) {
+    auto pos = qfind_first_of(bytes, needles);
+    if (pos != std::string::npos) {
+      return skipped + pos;
+    }
+    skipped += bytes.size();
+    buf = buf->next();
+    if (buf == buffer_) {
+      return std::string::npos;
+    }
+    bytes = ByteRange{buf->data(), buf->length()};
+  }
+}
+
+template <class Derived, class BufType>
+bool CursorBase<Derived, BufType>::cloneUntil(
+    std::unique_ptr<folly::IOBuf>& buf,
+    ByteRange delimiter) {
+  auto pos = find(delimiter);
+  if (pos == std::string::npos) {
+    return false;
+  }
+  clone(buf, pos);
+  skip(delimiter.size());
+  return true;
+}
 } // namespace detail
 } // namespace io
 } // namespace folly
@@ -306,6 +306,36 @@ class CursorBase {
   template <typename Predicate>
   void skipWhile(const Predicate& predicate);
 
+  /**
+   * Return the offset from the cursor of the first occurrence of needle,
+   * searching across the rest of the chain, or std::string::npos if there is
+   * none.  The cursor is not moved.
+   *
+   * These use the same vectorized kernels as StringPiece::find() and
+   * find_first_of() on each buffer, so they are much faster than readWhile()
+   * for finding delimiters in text protocols.
+   */
+  size_t find(uint8_t needle) const;
+
+  /**
+   * Like find(uint8_t), but for a multi-byte delimiter, which may be split
+   * between buffers.  An empty delimiter is found at offset 0.
+   */
+  size_t find(ByteRange delimiter) const;
+
+  /**
+   * Return the offset of the first byte that is any of the given needles.
+   */
+  size_t findFirstOf(ByteRange needles) const;
+
+  /**
+   * If delimiter occurs in the rest of the chain, clone the data up to it
+   * into buf without copying, move the cursor past the delimiter and return
+   * true.  Otherwise leave both alone and return false, so the caller can
+   * retry once more data has arrived.
+   */
+  bool cloneUntil(std::unique_ptr<folly::IOBuf>& buf, ByteRange delimiter);
+
   size_t skipAtMost(size_t len) {
     if (LIKELY(length() >= len)) {
       offset_ += len;
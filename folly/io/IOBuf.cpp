@@ -32,6 +32,7 @@
 #include <folly/ScopeGuard.h>
 #include <folly/hash/SpookyHashV2.h>
 #include <folly/io/Cursor.h>
+#include <folly/io/IOBufPool.h>
 
 using std::unique_ptr;
 
@@ -43,6 +44,8 @@ enum : uint16_t {
   kIOBufInUse = 0x01,
   // This memory segment contains buffer data that is still in use
   kDataInUse = 0x02,
+  // This memory segment came from IOBufPool rather than malloc()
+  kPooled = 0x04,
 };
 
 enum : uint64_t {
@@ -162,10 +165,14 @@ void IOBuf::releaseStorage(HeapStorage* storage, uint16_t freeFlags) {
 
   while (true) {
     uint16_t newFlags = uint16_t(flags & ~freeFlags);
-    if (newFlags == 0) {
+    if ((newFlags & (kIOBufInUse | kDataInUse)) == 0) {
       // The storage space is now unused.  Free it.
       storage->prefix.HeapPrefix::~HeapPrefix();
-      free(storage);
+      if (newFlags & kPooled) {
+        IOBufPool::deallocate(storage);
+      } else {
+        free(storage);
+      }
       return;
     }
 
@@ -242,12 +249,30 @@ unique_ptr<IOBuf> IOBuf::createCombined(uint64_t capacity) {
   size_t requiredStorage = offsetof(HeapFullStorage, align) + capacity;
   size_t mallocSize = goodMallocSize(requiredStorage);
   auto* storage = static_cast<HeapFullStorage*>(malloc(mallocSize));
+  return initCombined(storage, mallocSize, kIOBufInUse | kDataInUse);
+}
+
+unique_ptr<IOBuf> IOBuf::createPooled(uint64_t capacity) {
+  size_t requiredStorage = offsetof(HeapFullStorage, align) + capacity;
+  if (requiredStorage > IOBufPool::kMaxBlockSize) {
+    return create(capacity);
+  }
+  size_t blockSize;
+  auto* storage = static_cast<HeapFullStorage*>(
+      IOBufPool::allocate(requiredStorage, &blockSize));
+  return initCombined(
+      storage, blockSize, kIOBufInUse | kDataInUse | kPooled);
+}
 
-  new (&storage->hs.prefix) HeapPrefix(kIOBufInUse | kDataInUse);
+unique_ptr<IOBuf> IOBuf::initCombined(
+    HeapFullStorage* storage,
+    size_t storageSize,
+    uint16_t flags) {
+  new (&storage->hs.prefix) HeapPrefix(flags);
   new (&storage->shared) SharedInfo(freeInternalBuf, storage);
 
   uint8_t* bufAddr = reinterpret_cast<uint8_t*>(&storage->align);
-  uint8_t* storageEnd = reinterpret_cast<uint8_t*>(storage) + mallocSize;
+  uint8_t* storageEnd = reinterpret_cast<uint8_t*>(storage) + storageSize;
   size_t actualCapacity = size_t(storageEnd - bufAddr);
   unique_ptr<IOBuf> ret(new (&storage->hs.buf) IOBuf(
         InternalConstructor(), packFlagsAndSharedInfo(0, &storage->shared),
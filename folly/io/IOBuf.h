@@ -262,6 +262,15 @@ class IOBuf {
    */
   static std::unique_ptr<IOBuf> createCombined(uint64_t capacity);
 
+  /**
+   * Like createCombined(), but the memory comes from the calling thread's
+   * IOBufPool cache rather than malloc(), and goes back to the cache of the
+   * thread that allocated it when the last reference to the buffer goes
+   * away.  See IOBufPool for the size classes; larger buffers are created
+   * with create().
+   */
+  static std::unique_ptr<IOBuf> createPooled(uint64_t capacity);
+
   /**
    * Create a new IOBuf, using separate memory allocations for the IOBuf object
    * for the IOBuf and the data storage space.
@@ -1319,6 +1328,10 @@ class IOBuf {
                              SharedInfo** infoReturn,
                              uint64_t* capacityReturn);
   static void releaseStorage(HeapStorage* storage, uint16_t freeFlags);
+  static std::unique_ptr<IOBuf> initCombined(
+      HeapFullStorage* storage,
+      size_t storageSize,
+      uint16_t flags);
   static void freeInternalBuf(void* buf, void* userData);
 
   /*
@@ -0,0 +1,303 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/io/IOBufPool.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include <folly/Bits.h>
+#include <folly/Indestructible.h>
+#include <folly/Likely.h>
+#include <folly/detail/ThreadLocalUntilExit.h>
+
+namespace folly {
+
+constexpr size_t IOBufPool::kMinBlockSize;
+constexpr size_t IOBufPool::kMaxBlockSize;
+
+namespace {
+
+constexpr size_t kNumClasses = 10;
+static_assert(
+    (IOBufPool::kMinBlockSize << (kNumClasses - 1)) == IOBufPool::kMaxBlockSize,
+    "size classes must cover kMinBlockSize to kMaxBlockSize");
+// Bytes each thread keeps cached per size class, but at least kMinCached
+// blocks.
+constexpr size_t kMaxCachedBytes = 256 * 1024;
+constexpr size_t kMinCached = 8;
+// Blocks freed for another thread that are handed over together.
+constexpr size_t kRemoteBatchSize = 32;
+
+struct ThreadCache;
+
+// Precedes the memory handed out by allocate().
+struct alignas(folly::max_align_t) Block {
+  // nullptr for blocks allocated while the thread was exiting
+  ThreadCache* owner;
+  Block* next;
+  uint32_t sizeClass;
+};
+
+struct ThreadCache {
+  Block* freeList[kNumClasses] = {};
+  size_t numFree[kNumClasses] = {};
+  // Blocks that other threads freed for this one.
+  std::atomic<Block*> remote{nullptr};
+  // Set once the thread has exited: blocks freed for it from then on go
+  // straight back to malloc.
+  std::atomic<bool> dead{false};
+
+  // Blocks freed here for batchOwner, not handed over yet.
+  ThreadCache* batchOwner{nullptr};
+  Block* batchHead{nullptr};
+  Block* batchTail{nullptr};
+  size_t batchSize{0};
+
+  // Only written by the thread using the cache.
+  std::atomic<uint64_t> hits{0};
+  std::atomic<uint64_t> misses{0};
+  std::atomic<uint64_t> remoteFrees{0};
+};
+
+struct Registry {
+  std::mutex mutex;
+  // Caches are never freed: blocks point at their owner's.
+  std::vector<ThreadCache*> caches;
+  // Caches of exited threads, up for reuse.
+  std::vector<ThreadCache*> idle;
+};
+
+Registry& registry() {
+  static Indestructible<Registry> registry;
+  return *registry;
+}
+
+void bump(std::atomic<uint64_t>& counter) {
+  counter.store(
+      counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+size_t classSize(uint32_t sizeClass) {
+  return IOBufPool::kMinBlockSize << sizeClass;
+}
+
+uint32_t sizeClassFor(size_t size) {
+  if (size <= IOBufPool::kMinBlockSize) {
+    return 0;
+  }
+  return uint32_t(
+      findLastSet(size - 1) - findLastSet(IOBufPool::kMinBlockSize - 1));
+}
+
+void cacheBlock(ThreadCache* cache, Block* block) {
+  auto sizeClass = block->sizeClass;
+  auto maxCached =
+      std::max(kMinCached, kMaxCachedBytes / classSize(sizeClass));
+  if (cache->numFree[sizeClass] >= maxCached) {
+    free(block);
+    return;
+  }
+  block->next = cache->freeList[sizeClass];
+  cache->freeList[sizeClass] = block;
+  ++cache->numFree[sizeClass];
+}
+
+void freeRemote(ThreadCache* cache) {
+  auto block = cache->remote.exchange(nullptr);
+  while (block) {
+    auto next = block->next;
+    free(block);
+    block = next;
+  }
+}
+
+void pushRemote(ThreadCache* owner, Block* head, Block* tail) {
+  auto old = owner->remote.load(std::memory_order_relaxed);
+  do {
+    tail->next = old;
+  } while (!owner->remote.compare_exchange_weak(
+      old, head, std::memory_order_seq_cst, std::memory_order_relaxed));
+  // Pairs with ~CacheHolder(), which sets dead before taking the remote
+  // list: either it takes these blocks, or we see that it won't.
+  if (UNLIKELY(owner->dead.load())) {
+    freeRemote(owner);
+  }
+}
+
+void flushBatch(ThreadCache* cache) {
+  if (cache->batchHead) {
+    pushRemote(cache->batchOwner, cache->batchHead, cache->batchTail);
+    cache->batchHead = nullptr;
+    cache->batchTail = nullptr;
+    cache->batchSize = 0;
+  }
+  cache->batchOwner = nullptr;
+}
+
+void collectRemote(ThreadCache* cache) {
+  if (!cache->remote.load(std::memory_order_relaxed)) {
+    return;
+  }
+  auto block = cache->remote.exchange(nullptr, std::memory_order_acquire);
+  while (block) {
+    auto next = block->next;
+    cacheBlock(cache, block);
+    block = next;
+  }
+}
+
+// Binds a cache to the thread for the thread's lifetime.
+class CacheHolder {
+ public:
+  CacheHolder() {
+    auto& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    if (reg.idle.empty()) {
+      cache_ = new ThreadCache();
+      reg.caches.push_back(cache_);
+    } else {
+      cache_ = reg.idle.back();
+      reg.idle.pop_back();
+      cache_->dead.store(false);
+    }
+  }
+
+  ~CacheHolder() {
+    cache_->dead.store(true);
+    flushBatch(cache_);
+    freeRemote(cache_);
+    for (size_t i = 0; i < kNumClasses; ++i) {
+      while (auto block = cache_->freeList[i]) {
+        cache_->freeList[i] = block->next;
+        free(block);
+      }
+      cache_->numFree[i] = 0;
+    }
+    auto& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    reg.idle.push_back(cache_);
+  }
+
+  ThreadCache* cache() const {
+    return cache_;
+  }
+
+ private:
+  ThreadCache* cache_;
+};
+
+ThreadCache* localCache() {
+  auto holder = detail::ThreadLocalUntilExit<CacheHolder>::get();
+  return holder ? holder->cache() : nullptr;
+}
+
+} // namespace
+
+void* IOBufPool::allocate(size_t size, size_t* blockSize) {
+  DCHECK_LE(size, kMaxBlockSize);
+  auto sizeClass = sizeClassFor(size);
+  auto cache = localCache();
+
+  Block* block = nullptr;
+  if (LIKELY(cache != nullptr)) {
+    if (!cache->freeList[sizeClass]) {
+      // Don't sit on blocks other threads are waiting for either.
+      flushBatch(cache);
+      collectRemote(cache);
+    }
+    block = cache->freeList[sizeClass];
+    if (block) {
+      cache->freeList[sizeClass] = block->next;
+      --cache->numFree[sizeClass];
+      bump(cache->hits);
+    } else {
+      bump(cache->misses);
+    }
+  }
+
+  if (!block) {
+    block = static_cast<Block*>(malloc(sizeof(Block) + classSize(sizeClass)));
+    if (UNLIKELY(block == nullptr)) {
+      throw std::bad_alloc();
+    }
+    block->owner = cache;
+    block->sizeClass = sizeClass;
+  }
+
+  *blockSize = classSize(sizeClass);
+  return block + 1;
+}
+
+void IOBufPool::deallocate(void* p) noexcept {
+  auto block = static_cast<Block*>(p) - 1;
+  auto owner = block->owner;
+  if (UNLIKELY(owner == nullptr)) {
+    free(block);
+    return;
+  }
+
+  auto cache = localCache();
+  if (LIKELY(owner == cache)) {
+    cacheBlock(cache, block);
+    return;
+  }
+  if (!cache) {
+    pushRemote(owner, block, block);
+    return;
+  }
+
+  bump(cache->remoteFrees);
+  if (owner->dead.load(std::memory_order_relaxed)) {
+    free(block);
+    if (cache->batchOwner == owner) {
+      flushBatch(cache);
+    }
+    return;
+  }
+  if (cache->batchOwner != owner) {
+    flushBatch(cache);
+    cache->batchOwner = owner;
+  }
+  block->next = cache->batchHead;
+  if (!cache->batchHead) {
+    cache->batchTail = block;
+  }
+  cache->batchHead = block;
+  if (++cache->batchSize >= kRemoteBatchSize) {
+    flushBatch(cache);
+  }
+}
+
+IOBufPool::Stats IOBufPool::getStats() {
+  Stats stats;
+  auto& reg = registry();
+  std::lock_guard<std::mutex> lock(reg.mutex);
+  for (auto cache : reg.caches) {
+    stats.hits += cache->hits.load(std::memory_order_relaxed);
+    stats.misses += cache->misses.load(std::memory_order_relaxed);
+    stats.remoteFrees += cache->remoteFrees.load(std::memory_order_relaxed);
+  }
+  return stats;
+}
+
+} // namespace folly
@@ -0,0 +1,79 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace folly {
+
+/**
+ * Thread-cached memory for IOBuf::createPooled(), which puts the IOBuf, its
+ * SharedInfo and its data in a single block from here.
+ *
+ * Blocks come in power-of-two size classes from kMinBlockSize to
+ * kMaxBlockSize.  Every thread keeps a free list per size class, so
+ * allocating and freeing on the same thread doesn't touch malloc or any
+ * shared state.  A block freed by a thread other than the one that
+ * allocated it is batched with other blocks going back to the same thread,
+ * and the batch is handed over with a single atomic operation; the owner
+ * picks them up once its own free list runs dry.  This keeps the common
+ * pipeline of allocating on an I/O thread and freeing on a worker from
+ * draining the I/O thread's cache into the worker's.  A partial batch is
+ * handed over when its thread next misses in its own cache, or exits.
+ *
+ * The per-thread caches of exited threads are reused by new threads.
+ * Blocks freed after the thread that allocated them has exited go straight
+ * back to malloc.
+ */
+class IOBufPool {
+ public:
+  static constexpr size_t kMinBlockSize = 128;
+  static constexpr size_t kMaxBlockSize = 64 * 1024;
+
+  struct Stats {
+    // Allocations served from a thread's cache, and those that had to go to
+    // malloc.
+    uint64_t hits{0};
+    uint64_t misses{0};
+    // Blocks freed by a thread other than the one that allocated them.
+    uint64_t remoteFrees{0};
+  };
+
+  /**
+   * Allocate at least size bytes, which must be no more than kMaxBlockSize.
+   * The usable size (the block's size class) is returned in *blockSize.
+   *
+   * Throws std::bad_alloc on error.
+   */
+  static void* allocate(size_t size, size_t* blockSize);
+
+  /**
+   * Give back a block from allocate().  May be called from any thread.
+   */
+  static void deallocate(void* p) noexcept;
+
+  /**
+   * Counters summed over all threads.
+   */
+  static Stats getStats();
+
+ private:
+  IOBufPool() = delete;
+};
+
+} // namespace folly
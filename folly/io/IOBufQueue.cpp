@@ -180,7 +180,10 @@ pair<void*,uint64_t>
 IOBufQueue::preallocateSlow(uint64_t min, uint64_t newAllocationSize,
                             uint64_t max) {
   // Allocate a new buffer of the requested max size.
-  unique_ptr<IOBuf> newBuf(IOBuf::create(std::max(min, newAllocationSize)));
+  auto capacity = std::max(min, newAllocationSize);
+  unique_ptr<IOBuf> newBuf(
+      options_.pooled ? IOBuf::createPooled(capacity)
+                      : IOBuf::create(capacity));
   appendToChain(head_, std::move(newBuf), false);
   IOBuf* last = head_->prev();
   return make_pair(last->writableTail(),
@@ -34,13 +34,14 @@ namespace folly {
 class IOBufQueue {
  public:
   struct Options {
-    Options() : cacheChainLength(false) { }
+    Options() : cacheChainLength(false), pooled(false) { }
     bool cacheChainLength;
+    // Allocate the buffers of preallocate() with IOBuf::createPooled().
+    bool pooled;
   };
 
   /**
-   * Commonly used Options, currently the only possible value other than
-   * the default.
+   * Commonly used Options.
    */
   static Options cacheChainLength() {
     Options options;
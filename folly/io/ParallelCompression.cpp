@@ -0,0 +1,318 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/io/ParallelCompression.h>
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+#include <folly/Baton.h>
+#include <folly/Conv.h>
+#include <folly/Optional.h>
+#include <folly/io/CodecPool.h>
+#include <folly/io/Cursor.h>
+
+namespace folly {
+namespace io {
+
+namespace {
+
+constexpr uint32_t kZSTDMagicLE = 0xFD2FB528;
+constexpr uint32_t kLZ4FrameMagicLE = 0x184D2204;
+// Shared by zstd and lz4: any value of the low 4 bits.
+constexpr uint32_t kSkippableMagicLE = 0x184D2A50;
+constexpr uint32_t kSkippableMagicMask = 0xFFFFFFF0;
+
+struct Frame {
+  std::unique_ptr<IOBuf> data;
+  // From the frame header, if it is there.
+  Optional<uint64_t> uncompressedLength;
+};
+
+/**
+ * Run fn(0), ..., fn(n - 1) on executor and wait for all of them.  Rethrows
+ * the first exception thrown by fn.
+ *
+ * The calling thread runs them too, taking whichever are left, so that we
+ * finish even if none of the tasks added to executor get to run before we
+ * are done: if it is out of threads (we may be running on one of them), or
+ * executor->add() throws.  The tasks that start late find nothing to do.
+ */
+template <class Fn>
+void runAll(Executor* executor, size_t n, const Fn& fn) {
+  if (n == 1) {
+    fn(0);
+    return;
+  }
+
+  struct State {
+    State(size_t n_, const Fn& fn_) : n(n_), remaining(n_), fn(fn_) {}
+
+    void work() {
+      for (size_t i; (i = next.fetch_add(1)) < n;) {
+        try {
+          fn(i);
+        } catch (...) {
+          std::lock_guard<std::mutex> lock(errorMutex);
+          if (!error) {
+            error = std::current_exception();
+          }
+        }
+        if (remaining.fetch_sub(1) == 1) {
+          done.post();
+        }
+      }
+    }
+
+    const size_t n;
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> remaining;
+    // Only used while some of the n calls haven't returned yet.
+    const Fn& fn;
+    Baton<> done;
+    std::mutex errorMutex;
+    std::exception_ptr error;
+  };
+  // Shared with the tasks, which may outlive this call.
+  auto state = std::make_shared<State>(n, fn);
+
+  for (size_t i = 1; i < n; ++i) {
+    try {
+      executor->add([state] { state->work(); });
+    } catch (...) {
+      break;
+    }
+  }
+  state->work();
+  state->done.wait();
+  if (state->error) {
+    std::rethrow_exception(state->error);
+  }
+}
+
+// Skip the rest of a zstd frame, starting right after the magic number, and
+// return the content size from its header.
+Optional<uint64_t> skipZSTDFrame(Cursor& cursor) {
+  const uint8_t descriptor = cursor.read<uint8_t>();
+  const uint8_t fcsFlag = descriptor >> 6;
+  const bool singleSegment = descriptor & 0x20;
+  const bool hasChecksum = descriptor & 0x04;
+  const uint8_t dictIDFlag = descriptor & 0x03;
+  if (descriptor & 0x08) {
+    throw std::runtime_error("ZSTD: reserved frame header bit set");
+  }
+
+  static constexpr uint8_t kDictIDSize[] = {0, 1, 2, 4};
+  static constexpr uint8_t kContentSizeSize[] = {0, 2, 4, 8};
+  cursor.skip((singleSegment ? 0 : 1) + kDictIDSize[dictIDFlag]);
+  Optional<uint64_t> contentSize;
+  switch (fcsFlag == 0 && singleSegment ? 1 : kContentSizeSize[fcsFlag]) {
+    case 0:
+      break;
+    case 1:
+      contentSize = cursor.read<uint8_t>();
+      break;
+    case 2:
+      contentSize = cursor.readLE<uint16_t>() + 256;
+      break;
+    case 4:
+      contentSize = cursor.readLE<uint32_t>();
+      break;
+    default:
+      contentSize = cursor.readLE<uint64_t>();
+      break;
+  }
+
+  for (bool last = false; !last;) {
+    const uint32_t header = cursor.read<uint8_t>() |
+        (uint32_t(cursor.readLE<uint16_t>()) << 8);
+    last = header & 1;
+    const uint32_t blockType = (header >> 1) & 3;
+    const uint32_t blockSize = header >> 3;
+    if (blockType == 3) {
+      throw std::runtime_error("ZSTD: reserved block type");
+    }
+    // RLE blocks store their byte once.
+    cursor.skip(blockType == 1 ? 1 : blockSize);
+  }
+  if (hasChecksum) {
+    cursor.skip(4);
+  }
+  return contentSize;
+}
+
+// Same for an lz4 frame.
+Optional<uint64_t> skipLZ4Frame(Cursor& cursor) {
+  const uint8_t flags = cursor.read<uint8_t>();
+  if ((flags >> 6) != 1) {
+    throw std::runtime_error("LZ4Frame: unsupported version");
+  }
+  const bool hasBlockChecksum = flags & 0x10;
+  const bool hasContentSize = flags & 0x08;
+  const bool hasContentChecksum = flags & 0x04;
+  const bool hasDictID = flags & 0x01;
+  // Block descriptor
+  cursor.skip(1);
+  Optional<uint64_t> contentSize;
+  if (hasContentSize) {
+    contentSize = cursor.readLE<uint64_t>();
+  }
+  // Dictionary ID and header checksum
+  cursor.skip((hasDictID ? 4 : 0) + 1);
+
+  while (const uint32_t blockSize = cursor.readLE<uint32_t>() & 0x7FFFFFFF) {
+    cursor.skip(blockSize + (hasBlockChecksum ? 4 : 0));
+  }
+  if (hasContentChecksum) {
+    cursor.skip(4);
+  }
+  return contentSize;
+}
+
+std::vector<Frame> splitFrames(CodecType type, const IOBuf* data) {
+  std::vector<Frame> frames;
+  Cursor cursor(data);
+  try {
+    while (!cursor.isAtEnd()) {
+      const Cursor start = cursor;
+      const uint32_t magic = cursor.readLE<uint32_t>();
+      if ((magic & kSkippableMagicMask) == kSkippableMagicLE) {
+        cursor.skip(cursor.readLE<uint32_t>());
+        continue;
+      }
+      Frame frame;
+      if (type == CodecType::ZSTD && magic == kZSTDMagicLE) {
+        frame.uncompressedLength = skipZSTDFrame(cursor);
+      } else if (type == CodecType::LZ4_FRAME && magic == kLZ4FrameMagicLE) {
+        frame.uncompressedLength = skipLZ4Frame(cursor);
+      } else {
+        throw std::runtime_error(
+            to<std::string>("Codec: invalid frame at offset ", start - data));
+      }
+      Cursor(start).clone(frame.data, cursor - start);
+      frames.push_back(std::move(frame));
+    }
+  } catch (const std::out_of_range&) {
+    throw std::runtime_error("Codec: truncated frame");
+  }
+  return frames;
+}
+
+void checkParallelCodec(CodecType type) {
+  if (!hasParallelCodec(type)) {
+    throw std::invalid_argument(to<std::string>(
+        "Parallel compression is not supported for codec type ",
+        static_cast<int>(type)));
+  }
+}
+
+std::unique_ptr<IOBuf> chainAll(std::vector<std::unique_ptr<IOBuf>> bufs) {
+  auto result = IOBuf::create(0);
+  for (auto& buf : bufs) {
+    result->prependChain(std::move(buf));
+  }
+  return result;
+}
+
+} // namespace
+
+bool hasParallelCodec(CodecType type) {
+  return (type == CodecType::ZSTD || type == CodecType::LZ4_FRAME) &&
+      hasCodec(type);
+}
+
+std::unique_ptr<IOBuf> compressParallel(
+    CodecType type,
+    const IOBuf* data,
+    Executor* executor,
+    int level,
+    uint64_t blockSize) {
+  checkParallelCodec(type);
+  if (blockSize == 0) {
+    throw std::invalid_argument("Parallel compression: blockSize must be > 0");
+  }
+  const uint64_t length = data->computeChainDataLength();
+  if (length == 0) {
+    return IOBuf::create(0);
+  }
+
+  const size_t numBlocks = (length + blockSize - 1) / blockSize;
+  std::vector<std::unique_ptr<IOBuf>> blocks(numBlocks);
+  Cursor cursor(data);
+  for (size_t i = 0; i < numBlocks; ++i) {
+    cursor.clone(blocks[i], std::min(blockSize, length - i * blockSize));
+  }
+
+  runAll(executor, numBlocks, [&](size_t i) {
+    // Codecs aren't thread-safe, so each block gets its own; the pool keeps
+    // their contexts around on the executor's threads.
+    auto block = std::move(blocks[i]);
+    blocks[i] = getPooledCodec(type, level)->compress(block.get());
+  });
+  return chainAll(std::move(blocks));
+}
+
+std::unique_ptr<IOBuf> uncompressParallel(
+    CodecType type,
+    const IOBuf* data,
+    Executor* executor,
+    uint64_t maxUncompressedLength) {
+  checkParallelCodec(type);
+  auto frames = splitFrames(type, data);
+  if (frames.empty()) {
+    return IOBuf::create(0);
+  }
+
+  // The frames that declare their length are checked before anything is
+  // allocated for them, the others as they are decompressed.
+  uint64_t declared = 0;
+  for (const auto& frame : frames) {
+    if (frame.uncompressedLength) {
+      if (*frame.uncompressedLength > maxUncompressedLength - declared) {
+        throw std::runtime_error(
+            "Parallel decompression: uncompressed length too large");
+      }
+      declared += *frame.uncompressedLength;
+    }
+  }
+  std::atomic<uint64_t> undeclared{0};
+
+  std::vector<std::unique_ptr<IOBuf>> outputs(frames.size());
+  runAll(executor, frames.size(), [&](size_t i) {
+    auto& frame = frames[i];
+    outputs[i] = getPooledCodec(type)->uncompress(
+        frame.data.get(), frame.uncompressedLength);
+    frame.data.reset();
+    if (!frame.uncompressedLength) {
+      const uint64_t length = outputs[i]->computeChainDataLength();
+      if (undeclared.fetch_add(length) + length >
+          maxUncompressedLength - declared) {
+        outputs[i].reset();
+        throw std::runtime_error(
+            "Parallel decompression: uncompressed length too large");
+      }
+    }
+  });
+  return chainAll(std::move(outputs));
+}
+
+} // namespace io
+} // namespace folly
@@ -0,0 +1,93 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+#include <folly/Executor.h>
+#include <folly/io/Compression.h>
+#include <folly/io/IOBuf.h>
+
+/**
+ * Multi-threaded compression of large IOBufs.
+ *
+ * compressParallel() splits its input into blocks of a fixed size, and
+ * compresses each block into a separate frame on the given executor.  The
+ * frames are concatenated in order, which is a valid stream for the
+ * format: the zstd and lz4 command line tools, and any other decoder that
+ * accepts concatenated frames, can decompress it.
+ *
+ * uncompressParallel() finds the frame boundaries by walking the frame
+ * headers (without decompressing anything), and decompresses each frame
+ * on the executor.  It accepts any stream of concatenated frames, including
+ * a single frame from Codec::compress(), which is simply decompressed on
+ * the calling thread.
+ *
+ * Both block until all the work is done, and the calling thread does its
+ * share of it.  They may be called from one of the executor's own threads:
+ * the calling thread finishes the work itself if the executor doesn't get
+ * to it.
+ */
+
+namespace folly {
+namespace io {
+
+constexpr uint64_t kDefaultParallelCompressionBlockSize = uint64_t(4) << 20;
+
+/**
+ * Can type be used with compressParallel() and uncompressParallel()?
+ * True for ZSTD and LZ4_FRAME when compiled in.
+ */
+bool hasParallelCodec(CodecType type);
+
+/**
+ * Compress data in blocks of blockSize bytes (the last one may be shorter)
+ * on executor.  The output shares no storage with data.  Data that fits in
+ * a single block is compressed on the calling thread.
+ *
+ * Throws std::invalid_argument if hasParallelCodec(type) is false or
+ * blockSize is 0, and rethrows the first error from compressing a block.
+ */
+std::unique_ptr<IOBuf> compressParallel(
+    CodecType type,
+    const IOBuf* data,
+    Executor* executor,
+    int level = COMPRESSION_LEVEL_DEFAULT,
+    uint64_t blockSize = kDefaultParallelCompressionBlockSize);
+
+/**
+ * Decompress a sequence of frames, such as the output of compressParallel(),
+ * on executor.  Skippable frames are ignored.
+ *
+ * The output may be no longer than maxUncompressedLength.  The lengths the
+ * frame headers declare are checked against it before any output is
+ * allocated, so untrusted data can't make us allocate more than that; the
+ * frames that don't declare one are checked once decompressed.
+ *
+ * Throws std::invalid_argument if hasParallelCodec(type) is false, and
+ * std::runtime_error if data isn't a sequence of complete frames, one of
+ * them fails to decompress, or the output would be too long.
+ */
+std::unique_ptr<IOBuf> uncompressParallel(
+    CodecType type,
+    const IOBuf* data,
+    Executor* executor,
+    uint64_t maxUncompressedLength);
+
+} // namespace io
+} // namespace folly
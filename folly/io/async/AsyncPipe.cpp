@@ -16,8 +16,13 @@
 #include <folly/io/async/AsyncPipe.h>
 
 #include <folly/FileUtil.h>
+#include <folly/io/async/AsyncSocket.h>
 #include <folly/io/async/AsyncSocketException.h>
 
+#ifdef __linux__
+#include <sys/ioctl.h>
+#endif
+
 using std::string;
 using std::unique_ptr;
 using folly::IOBuf;
@@ -29,6 +34,15 @@ AsyncPipeReader::~AsyncPipeReader() {
   close();
 }
 
+void AsyncPipeReader::destroy() {
+  // Nobody is left to report the splice to.  A write the socket still has
+  // queued reads from fd_, so spliceWriteGuard_ holds off the destructor
+  // (and closing fd_) until the socket is done with it.
+  spliceSocket_ = nullptr;
+  spliceCallback_ = nullptr;
+  DelayedDestruction::destroy();
+}
+
 void AsyncPipeReader::failRead(const AsyncSocketException& ex) {
   VLOG(5) << "AsyncPipeReader(this=" << this << ", fd=" << fd_ <<
     "): failed while reading: " << ex.what();
@@ -41,6 +55,7 @@ void AsyncPipeReader::failRead(const AsyncSocketException& ex) {
 }
 
 void AsyncPipeReader::close() {
+  DCHECK_EQ(spliceWriteBytes_, 0u);
   unregisterHandler();
   if (fd_ >= 0) {
     changeHandlerFD(-1);
@@ -54,11 +69,83 @@ void AsyncPipeReader::close() {
   }
 }
 
+void AsyncPipeReader::spliceTo(AsyncSocket* socket, SpliceCallback* callback) {
+  CHECK(readCallback_ == nullptr);
+  CHECK(spliceSocket_ == nullptr);
+  spliceSocket_ = socket;
+  spliceCallback_ = callback;
+  bytesSpliced_ = 0;
+  registerHandler(EventHandler::READ | EventHandler::PERSIST);
+}
+
+void AsyncPipeReader::handleSplice() {
+#ifdef __linux__
+  int avail = 0;
+  if (ioctl(fd_, FIONREAD, &avail) != 0) {
+    AsyncSocketException ex(AsyncSocketException::INTERNAL_ERROR,
+                            "FIONREAD failed", errno);
+    finishSplice(&ex);
+    return;
+  }
+  // Stop watching the pipe until the socket has taken this batch.
+  unregisterHandler();
+  if (avail == 0) {
+    // Readable with nothing buffered means EOF
+    finishSplice(nullptr);
+    return;
+  }
+  spliceWriteBytes_ = size_t(avail);
+  spliceWriteGuard_ = this;
+  spliceSocket_->writeFromFd(this, fd_, -1, spliceWriteBytes_);
+#else
+  AsyncSocketException ex(AsyncSocketException::NOT_SUPPORTED,
+                          "spliceTo() is not supported on this platform");
+  finishSplice(&ex);
+#endif
+}
+
+void AsyncPipeReader::finishSplice(
+    const AsyncSocketException* ex,
+    size_t bytesWritten) {
+  unregisterHandler();
+  auto callback = spliceCallback_;
+  spliceSocket_ = nullptr;
+  spliceCallback_ = nullptr;
+  if (ex) {
+    callback->spliceError(bytesSpliced_ + bytesWritten, *ex);
+  } else {
+    callback->spliceComplete(bytesSpliced_);
+  }
+}
+
+void AsyncPipeReader::writeSuccess() noexcept {
+  DestructorGuard dg(std::move(spliceWriteGuard_));
+  bytesSpliced_ += spliceWriteBytes_;
+  spliceWriteBytes_ = 0;
+  if (spliceSocket_ && fd_ >= 0) {
+    registerHandler(EventHandler::READ | EventHandler::PERSIST);
+  }
+}
+
+void AsyncPipeReader::writeErr(
+    size_t bytesWritten,
+    const AsyncSocketException& ex) noexcept {
+  DestructorGuard dg(std::move(spliceWriteGuard_));
+  spliceWriteBytes_ = 0;
+  if (spliceSocket_) {
+    finishSplice(&ex, bytesWritten);
+  }
+}
+
 void AsyncPipeReader::handlerReady(uint16_t events) noexcept {
   DestructorGuard dg(this);
   CHECK(events & EventHandler::READ);
 
   VLOG(5) << "AsyncPipeReader::handlerReady() this=" << this << ", fd=" << fd_;
+  if (spliceSocket_) {
+    handleSplice();
+    return;
+  }
   assert(readCallback_ != nullptr);
 
   while (readCallback_) {
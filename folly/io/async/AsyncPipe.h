@@ -26,6 +26,7 @@
 
 namespace folly {
 
+class AsyncSocket;
 class AsyncSocketException;
 
 /**
@@ -33,8 +34,28 @@ class AsyncSocketException;
  */
 class AsyncPipeReader : public EventHandler,
                         public AsyncReader,
-                        public DelayedDestruction {
+                        public DelayedDestruction,
+                        private AsyncWriter::WriteCallback {
  public:
+  class SpliceCallback {
+   public:
+    virtual ~SpliceCallback() = default;
+
+    /**
+     * The pipe reached EOF and everything read from it has been written to
+     * the socket.
+     */
+    virtual void spliceComplete(size_t bytesSpliced) noexcept = 0;
+
+    /**
+     * Reading from the pipe or writing to the socket failed.  bytesSpliced
+     * is how much made it to the socket before that.
+     */
+    virtual void spliceError(
+        size_t bytesSpliced,
+        const AsyncSocketException& ex) noexcept = 0;
+  };
+
   typedef std::unique_ptr<AsyncPipeReader,
                           folly::DelayedDestruction::Destructor> UniquePtr;
 
@@ -70,6 +91,23 @@ class AsyncPipeReader : public EventHandler,
     return readCallback_;
   }
 
+  /**
+   * Relay everything written to the pipe to socket until EOF, with splice()
+   * moving the data inside the kernel (see AsyncSocket::writeFromFd()).
+   *
+   * Whatever the pipe holds when it becomes readable is handed to the socket
+   * as one write, and the pipe is not read again until that write has
+   * completed, so a slow socket backs up into the pipe and eventually blocks
+   * its writer.  No read callback may be installed meanwhile.  socket must
+   * stay alive until callback has been invoked.  Only supported on Linux;
+   * elsewhere callback gets a NOT_SUPPORTED error once the pipe is readable.
+   *
+   * Destroying the reader stops the splice without invoking callback.  If
+   * the socket still has a write from the pipe queued, the pipe is closed
+   * once that write completes or fails rather than right away.
+   */
+  void spliceTo(AsyncSocket* socket, SpliceCallback* callback);
+
   /**
    * Set a special hook to close the socket (otherwise, will call close())
    */
@@ -77,6 +115,8 @@ class AsyncPipeReader : public EventHandler,
     closeCb_ = closeCb;
   }
 
+  void destroy() override;
+
  private:
   ~AsyncPipeReader() override;
 
@@ -84,9 +124,24 @@ class AsyncPipeReader : public EventHandler,
   void failRead(const AsyncSocketException& ex);
   void close();
 
+  void handleSplice();
+  void finishSplice(const AsyncSocketException* ex, size_t bytesWritten = 0);
+
+  // AsyncWriter::WriteCallback, for the writes issued by spliceTo()
+  void writeSuccess() noexcept override;
+  void writeErr(size_t bytesWritten,
+                const AsyncSocketException& ex) noexcept override;
+
   int fd_;
   AsyncReader::ReadCallback* readCallback_{nullptr};
   std::function<void(int)> closeCb_;
+
+  AsyncSocket* spliceSocket_{nullptr};
+  SpliceCallback* spliceCallback_{nullptr};
+  size_t spliceWriteBytes_{0};
+  size_t bytesSpliced_{0};
+  // Held while the socket has a write from fd_ queued
+  DestructorGuard spliceWriteGuard_;
 };
 
 /**
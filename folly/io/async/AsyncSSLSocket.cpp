@@ -31,6 +31,7 @@
 #include <folly/io/Cursor.h>
 #include <folly/io/IOBuf.h>
 #include <folly/portability/OpenSSL.h>
+#include <folly/ssl/OpenSSLHash.h>
 
 using folly::SocketAddress;
 using folly::SSLContext;
@@ -199,6 +200,83 @@ void* initsslBioMethod(void) {
   return nullptr;
 }
 
+#ifdef __linux__
+// Kernel TLS constants and crypto_info layout from <linux/tls.h>, which may
+// be newer than the system headers.
+const uint16_t kKTLSVersionTLS12 = 0x0303;
+const uint16_t kKTLSCipherAesGcm128 = 51;
+const uint16_t kKTLSCipherAesGcm256 = 52;
+const uint8_t kTLSRecordTypeAlert = 21;
+const uint8_t kTLSRecordTypeHandshake = 22;
+const uint8_t kTLSRecordTypeApplicationData = 23;
+// TLS 1.2 AES-GCM: 4 byte implicit salt, 8 byte explicit nonce.
+const size_t kAesGcmSaltSize = 4;
+
+template <size_t KeySize>
+struct KTLSCryptoInfo {
+  uint16_t version;
+  uint16_t cipherType;
+  uint8_t iv[8];
+  uint8_t key[KeySize];
+  uint8_t salt[kAesGcmSaltSize];
+  uint8_t recSeq[8];
+};
+
+template <size_t KeySize>
+bool setKTLSCryptoInfo(
+    int fd,
+    int direction,
+    const uint8_t* key,
+    const uint8_t* salt,
+    uint64_t seq) {
+  KTLSCryptoInfo<KeySize> info;
+  info.version = kKTLSVersionTLS12;
+  info.cipherType =
+      KeySize == 16 ? kKTLSCipherAesGcm128 : kKTLSCipherAesGcm256;
+  auto seqBE = Endian::big(seq);
+  memcpy(info.recSeq, &seqBE, sizeof(info.recSeq));
+  // OpenSSL uses the record sequence number as the explicit nonce; the
+  // kernel carries on from whatever it is given here.
+  memcpy(info.iv, &seqBE, sizeof(info.iv));
+  memcpy(info.key, key, KeySize);
+  memcpy(info.salt, salt, kAesGcmSaltSize);
+  int rc = setsockopt(fd, SOL_TLS, direction, &info, sizeof(info));
+  OPENSSL_cleanse(&info, sizeof(info));
+  return rc == 0;
+}
+
+// The TLS 1.2 PRF (RFC 5246, section 5): P_hash(secret, label + seed).
+void tls12Prf(
+    const EVP_MD* md,
+    folly::ByteRange secret,
+    folly::ByteRange labelAndSeed,
+    folly::MutableByteRange out) {
+  auto mdSize = size_t(EVP_MD_size(md));
+  uint8_t a[EVP_MAX_MD_SIZE];
+  uint8_t chunk[EVP_MAX_MD_SIZE];
+  SCOPE_EXIT {
+    OPENSSL_cleanse(a, sizeof(a));
+    OPENSSL_cleanse(chunk, sizeof(chunk));
+  };
+  // A(1) = HMAC(secret, seed)
+  OpenSSLHash::hmac(folly::MutableByteRange(a, mdSize), md, secret,
+                    labelAndSeed);
+  while (!out.empty()) {
+    OpenSSLHash::Hmac hmac;
+    hmac.hash_init(md, secret);
+    hmac.hash_update(folly::ByteRange(a, mdSize));
+    hmac.hash_update(labelAndSeed);
+    hmac.hash_final(folly::MutableByteRange(chunk, mdSize));
+    auto n = std::min(mdSize, out.size());
+    memcpy(out.begin(), chunk, n);
+    out.advance(n);
+    // A(i + 1) = HMAC(secret, A(i))
+    OpenSSLHash::hmac(folly::MutableByteRange(a, mdSize), md, secret,
+                      folly::ByteRange(a, mdSize));
+  }
+}
+#endif // __linux__
+
 } // namespace
 
 namespace folly {
@@ -311,12 +389,16 @@ void AsyncSSLSocket::init() {
 void AsyncSSLSocket::closeNow() {
   // Close the SSL connection.
   if (ssl_ != nullptr && fd_ != -1) {
-    int rc = SSL_shutdown(ssl_);
-    if (rc == 0) {
-      rc = SSL_shutdown(ssl_);
-    }
-    if (rc < 0) {
-      ERR_clear_error();
+    if (ktlsSend_ || ktlsRecv_) {
+      shutdownKTLS();
+    } else {
+      int rc = SSL_shutdown(ssl_);
+      if (rc == 0) {
+        rc = SSL_shutdown(ssl_);
+      }
+      if (rc < 0) {
+        ERR_clear_error();
+      }
     }
   }
 
@@ -338,10 +420,28 @@ void AsyncSSLSocket::closeNow() {
         AsyncSocketException::END_OF_FILE,
         "SSL connection closed locally"));
 
+#if FOLLY_OPENSSL_HAS_ASYNC
+  if (ssl_ != nullptr && SSL_waiting_for_async(ssl_)) {
+    // Freeing the SSL now would leak the paused job along with the private
+    // key operation it waits for.  asyncJobReady() lets the job finish and
+    // frees the SSL once the operation is done; stay alive until then.
+    asyncJobGuard_ = this;
+  } else {
+    // The wait fd belongs to the SSL and is closed along with it.
+    if (asyncJobHandler_) {
+      asyncJobHandler_->unregisterHandler();
+    }
+    if (ssl_ != nullptr) {
+      SSL_free(ssl_);
+      ssl_ = nullptr;
+    }
+  }
+#else
   if (ssl_ != nullptr) {
     SSL_free(ssl_);
     ssl_ = nullptr;
   }
+#endif
 
   // Close the socket.
   AsyncSocket::closeNow();
@@ -776,6 +876,12 @@ void AsyncSSLSocket::sslConn(
     return failHandshake(__func__, ex);
   }
 
+#if FOLLY_OPENSSL_HAS_ASYNC
+  if (ctx_->hasPrivateKeyExecutor()) {
+    SSL_set_mode(ssl_, SSL_MODE_ASYNC);
+  }
+#endif
+
   applyVerificationOptions(ssl_);
 
   if (sslSession_ != nullptr) {
@@ -984,6 +1090,22 @@ bool AsyncSSLSocket::willBlock(int ret,
 
     // The timeout (if set) keeps running here
     return true;
+#if FOLLY_OPENSSL_HAS_ASYNC
+  } else if (error == SSL_ERROR_WANT_ASYNC) {
+    // A private key operation was handed to another thread (see
+    // SSLContext::setPrivateKeyExecutor()).  asyncJobReady() re-calls
+    // handleAccept or handleConnect once its result is in.
+    sslState_ = STATE_ASYNC_PENDING;
+
+    // Unregister for all events while blocked here
+    updateEventRegistration(
+      EventHandler::NONE,
+      EventHandler::READ | EventHandler::WRITE
+    );
+
+    // The timeout (if set) keeps running here
+    return waitForAsyncJob();
+#endif
   } else {
     unsigned long lastError = *errErrorOut = ERR_get_error();
     VLOG(6) << "AsyncSSLSocket(fd=" << fd_ << ", "
@@ -1001,6 +1123,69 @@ bool AsyncSSLSocket::willBlock(int ret,
   }
 }
 
+#if FOLLY_OPENSSL_HAS_ASYNC
+bool AsyncSSLSocket::waitForAsyncJob() noexcept {
+  OSSL_ASYNC_FD fd;
+  size_t numFds = 0;
+  if (SSL_get_all_async_fds(ssl_, nullptr, &numFds) != 1 || numFds != 1 ||
+      SSL_get_all_async_fds(ssl_, &fd, &numFds) != 1) {
+    VLOG(4) << "AsyncSSLSocket(fd=" << fd_ << "): SSL_ERROR_WANT_ASYNC with "
+            << numFds << " wait fds, expected exactly one";
+    return false;
+  }
+  if (!asyncJobHandler_) {
+    asyncJobHandler_.reset(new AsyncJobHandler(this, eventBase_));
+  }
+  asyncJobHandler_->changeHandlerFD(fd);
+  return asyncJobHandler_->registerHandler(EventHandler::READ);
+}
+
+void AsyncSSLSocket::asyncJobReady() noexcept {
+  VLOG(3) << "AsyncSSLSocket::asyncJobReady() this=" << this
+          << ", fd=" << fd_ << ", sslState=" << sslState_;
+  DestructorGuard dg(this);
+  // The fd is closed once the job has picked up its result.
+  asyncJobHandler_->unregisterHandler();
+  if ((sslState_ == STATE_ERROR || sslState_ == STATE_CLOSED) &&
+      SSL_waiting_for_async(ssl_)) {
+    // The handshake timed out or the socket was closed meanwhile.  Let the
+    // job run to completion anyway, so that OpenSSL can reclaim it.  Our fd
+    // is or will be closed, and may be reused, so take it away from the SSL;
+    // the handshake then fails as soon as it writes.
+    OpenSSLUtils::setBioFd(SSL_get_wbio(ssl_), -1, BIO_NOCLOSE);
+    SSL_do_handshake(ssl_);
+    ERR_clear_error();
+    if (SSL_waiting_for_async(ssl_) && waitForAsyncJob() && asyncJobGuard_) {
+      // Paused for another operation; closeNow() is still waiting.
+      return;
+    }
+  }
+  if (asyncJobGuard_) {
+    // closeNow() left freeing the SSL to us.  dg keeps this alive past the
+    // release.
+    SSL_free(ssl_);
+    ssl_ = nullptr;
+    asyncJobGuard_ = nullptr;
+    return;
+  }
+  if (server_) {
+    restartSSLAccept();
+    return;
+  }
+  if (sslState_ == STATE_CLOSED) {
+    return;
+  }
+  if (sslState_ == STATE_ERROR) {
+    AsyncSocketException ex(
+        AsyncSocketException::TIMED_OUT, "SSL connect timed out");
+    failHandshake(__func__, ex);
+    return;
+  }
+  sslState_ = STATE_CONNECTING;
+  handleConnect();
+}
+#endif
+
 void AsyncSSLSocket::checkForImmediateRead() noexcept {
   // openssl may have buffered data that it read from the socket already.
   // In this case we have to process it immediately, rather than waiting for
@@ -1070,6 +1255,12 @@ AsyncSSLSocket::handleAccept() noexcept {
 
     SSL_set_ex_data(ssl_, getSSLExDataIndex(), this);
 
+#if FOLLY_OPENSSL_HAS_ASYNC
+    if (ctx_->hasPrivateKeyExecutor()) {
+      SSL_set_mode(ssl_, SSL_MODE_ASYNC);
+    }
+#endif
+
     applyVerificationOptions(ssl_);
   }
 
@@ -1093,12 +1284,25 @@ AsyncSSLSocket::handleAccept() noexcept {
   }
 
   handshakeComplete_ = true;
+#if FOLLY_OPENSSL_HAS_ASYNC
+  // Only the handshake's private key operations are offloaded; reads and
+  // writes stay out of async jobs.
+  SSL_clear_mode(ssl_, SSL_MODE_ASYNC);
+#endif
   updateEventRegistration(0, EventHandler::READ | EventHandler::WRITE);
 
   // Move into STATE_ESTABLISHED in the normal case that we are in
   // STATE_ACCEPTING.
   sslState_ = STATE_ESTABLISHED;
 
+  if (ctx_ && ctx_->getSessionCache()) {
+    ctx_->getSessionCache()->recordHandshake(SSL_session_reused(ssl_) != 0);
+  }
+
+  if (ktlsEnabled_) {
+    enableKTLS();
+  }
+
   VLOG(3) << "AsyncSSLSocket " << this << ": fd " << fd_
           << " successfully accepted; state=" << int(state_)
           << ", sslState=" << sslState_ << ", events=" << eventFlags_;
@@ -1165,12 +1369,21 @@ AsyncSSLSocket::handleConnect() noexcept {
   }
 
   handshakeComplete_ = true;
+#if FOLLY_OPENSSL_HAS_ASYNC
+  // Only the handshake's private key operations are offloaded; reads and
+  // writes stay out of async jobs.
+  SSL_clear_mode(ssl_, SSL_MODE_ASYNC);
+#endif
   updateEventRegistration(0, EventHandler::READ | EventHandler::WRITE);
 
   // Move into STATE_ESTABLISHED in the normal case that we are in
   // STATE_CONNECTING.
   sslState_ = STATE_ESTABLISHED;
 
+  if (ktlsEnabled_) {
+    enableKTLS();
+  }
+
   VLOG(3) << "AsyncSSLSocket " << this << ": "
           << "fd " << fd_ << " successfully connected; "
           << "state=" << int(state_) << ", sslState=" << sslState_
@@ -1251,7 +1464,7 @@ void AsyncSSLSocket::setReadCB(ReadCallback *callback) {
 #ifdef SSL_MODE_MOVE_BUFFER_OWNERSHIP
   // turn on the buffer movable in openssl
   if (bufferMovableEnabled_ && ssl_ != nullptr && !isBufferMovable_ &&
-      callback != nullptr && callback->isBufferMovable()) {
+      !ktlsRecv_ && callback != nullptr && callback->isBufferMovable()) {
     SSL_set_mode(ssl_, SSL_get_mode(ssl_) | SSL_MODE_MOVE_BUFFER_OWNERSHIP);
     isBufferMovable_ = true;
   }
@@ -1308,6 +1521,9 @@ AsyncSSLSocket::performRead(void** buf, size_t* buflen, size_t* offset) {
   if (sslState_ == STATE_UNENCRYPTED) {
     return AsyncSocket::performRead(buf, buflen, offset);
   }
+  if (ktlsRecv_) {
+    return performKTLSRead(*buf, *buflen);
+  }
 
   int bytes = 0;
   if (!isBufferMovable_) {
@@ -1441,6 +1657,16 @@ AsyncSocket::WriteResult AsyncSSLSocket::performWrite(
     return WriteResult(
         WRITE_ERROR, std::make_unique<SSLException>(SSLError::EARLY_WRITE));
   }
+  if (ktlsSend_) {
+    // The kernel frames the records.  Older kernels reject MSG_EOR on a TLS
+    // socket, and MSG_ZEROCOPY isn't supported there.
+    return AsyncSocket::performWrite(
+        vec,
+        count,
+        unSet(flags, WriteFlags::EOR | WriteFlags::WRITE_MSG_ZEROCOPY),
+        countWritten,
+        partialWritten);
+  }
 
   // Declare a buffer used to hold small write requests.  It could point to a
   // memory block either on stack or on heap. If it is on heap, we release it
@@ -1604,6 +1830,216 @@ int AsyncSSLSocket::eorAwareSSLWrite(SSL *ssl, const void *buf, int n,
   return n;
 }
 
+void AsyncSSLSocket::enableKTLS() noexcept {
+#ifdef __linux__
+  // Only TLS 1.2 AES-GCM is handled: with TLS 1.3 OpenSSL keeps sending
+  // encrypted post-handshake messages, so its record state can't be handed
+  // over at this point.
+  if (SSL_version(ssl_) != TLS1_2_VERSION) {
+    VLOG(4) << "AsyncSSLSocket(this=" << this << ", fd=" << fd_
+            << "): kTLS needs TLS 1.2";
+    return;
+  }
+  StringPiece cipherName(getNegotiatedCipherName());
+  size_t keySize;
+  const EVP_MD* md;
+  if (cipherName.endsWith("AES128-GCM-SHA256")) {
+    keySize = 16;
+    md = EVP_sha256();
+  } else if (cipherName.endsWith("AES256-GCM-SHA384")) {
+    keySize = 32;
+    md = EVP_sha384();
+  } else {
+    VLOG(4) << "AsyncSSLSocket(this=" << this << ", fd=" << fd_
+            << "): no kTLS support for cipher " << cipherName;
+    return;
+  }
+
+  // key_block = PRF(master_secret, "key expansion",
+  //                 server_random + client_random)
+  // laid out as client key, server key, client salt, server salt.
+  static const char kLabel[] = "key expansion";
+  const size_t kLabelSize = sizeof(kLabel) - 1;
+  uint8_t masterKey[SSL_MAX_MASTER_KEY_LENGTH];
+  uint8_t seed[kLabelSize + 2 * SSL3_RANDOM_SIZE];
+  uint8_t keyBlock[2 * (32 + kAesGcmSaltSize)];
+  SCOPE_EXIT {
+    OPENSSL_cleanse(masterKey, sizeof(masterKey));
+    OPENSSL_cleanse(keyBlock, sizeof(keyBlock));
+  };
+  memcpy(seed, kLabel, kLabelSize);
+  auto serverRandom = seed + kLabelSize;
+  auto clientRandom = serverRandom + SSL3_RANDOM_SIZE;
+  if (!OpenSSLUtils::getTLSMasterKey(
+          SSL_get_session(ssl_),
+          MutableByteRange(masterKey, sizeof(masterKey))) ||
+      !OpenSSLUtils::getTLSServerRandom(
+          ssl_, MutableByteRange(serverRandom, SSL3_RANDOM_SIZE)) ||
+      !OpenSSLUtils::getTLSClientRandom(
+          ssl_, MutableByteRange(clientRandom, SSL3_RANDOM_SIZE))) {
+    VLOG(4) << "AsyncSSLSocket(this=" << this << ", fd=" << fd_
+            << "): TLS key material unavailable for kTLS";
+    return;
+  }
+  auto keyBlockSize = 2 * (keySize + kAesGcmSaltSize);
+  try {
+    tls12Prf(md,
+             ByteRange(masterKey, sizeof(masterKey)),
+             ByteRange(seed, sizeof(seed)),
+             MutableByteRange(keyBlock, keyBlockSize));
+  } catch (const std::exception& e) {
+    VLOG(4) << "AsyncSSLSocket(this=" << this << ", fd=" << fd_
+            << "): kTLS key derivation failed: " << e.what();
+    return;
+  }
+  const uint8_t* clientKey = keyBlock;
+  const uint8_t* serverKey = clientKey + keySize;
+  const uint8_t* clientSalt = serverKey + keySize;
+  const uint8_t* serverSalt = clientSalt + kAesGcmSaltSize;
+
+  if (setsockopt(fd_, IPPROTO_TCP, TCP_ULP, "tls", sizeof("tls")) != 0) {
+    VLOG(4) << "AsyncSSLSocket(this=" << this << ", fd=" << fd_
+            << "): TCP_ULP tls failed, errno=" << errno;
+    return;
+  }
+
+  // The handshake has just finished, so each side's Finished message was
+  // record 0 under the new keys and no application data has been sent or
+  // received yet.
+  const uint64_t kFirstAppDataSeq = 1;
+  auto setCryptoInfo = keySize == 16 ? &setKTLSCryptoInfo<16>
+                                     : &setKTLSCryptoInfo<32>;
+  ktlsSend_ = setCryptoInfo(
+      fd_,
+      TLS_TX,
+      server_ ? serverKey : clientKey,
+      server_ ? serverSalt : clientSalt,
+      kFirstAppDataSeq);
+
+  // Records OpenSSL has already pulled off the socket would be lost to the
+  // kernel, so only offload receive when nothing is buffered.
+  bool rxBuffered = SSL_pending(ssl_) > 0 ||
+      (preReceivedData_ && !preReceivedData_->empty());
+#if FOLLY_OPENSSL_IS_110
+  rxBuffered = rxBuffered || SSL_has_pending(ssl_);
+#endif
+  if (!rxBuffered && !isBufferMovable_) {
+    ktlsRecv_ = setCryptoInfo(
+        fd_,
+        TLS_RX,
+        server_ ? clientKey : serverKey,
+        server_ ? clientSalt : serverSalt,
+        kFirstAppDataSeq);
+  }
+
+  VLOG(3) << "AsyncSSLSocket(this=" << this << ", fd=" << fd_
+          << "): kTLS send=" << ktlsSend_ << ", recv=" << ktlsRecv_;
+#endif // __linux__
+}
+
+AsyncSocket::ReadResult AsyncSSLSocket::performKTLSRead(
+    void* buf,
+    size_t buflen) {
+#ifdef __linux__
+  // The kernel returns one non-application-data record at a time, with its
+  // type in a control message.
+  uint8_t type = kTLSRecordTypeApplicationData;
+  char control[CMSG_SPACE(sizeof(type))];
+  struct iovec iov;
+  iov.iov_base = buf;
+  iov.iov_len = buflen;
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  ssize_t bytes = recvmsg(fd_, &msg, MSG_DONTWAIT);
+  if (bytes < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      return ReadResult(READ_BLOCKING);
+    }
+    return ReadResult(READ_ERROR);
+  }
+
+  auto cmsg = CMSG_FIRSTHDR(&msg);
+  if (cmsg && cmsg->cmsg_level == SOL_TLS &&
+      cmsg->cmsg_type == TLS_GET_RECORD_TYPE) {
+    type = *reinterpret_cast<uint8_t*>(CMSG_DATA(cmsg));
+  }
+  if (type == kTLSRecordTypeApplicationData) {
+    appBytesReceived_ += bytes;
+    return ReadResult(bytes);
+  }
+
+  auto data = static_cast<const uint8_t*>(buf);
+  if (type == kTLSRecordTypeAlert && bytes == 2 &&
+      data[1] == SSL_AD_CLOSE_NOTIFY) {
+    // Same as SSL_read() returning SSL_ERROR_ZERO_RETURN
+    return ReadResult(0);
+  }
+  if (type == kTLSRecordTypeHandshake) {
+    return ReadResult(
+        READ_ERROR,
+        std::make_unique<SSLException>(
+            server_ ? SSLError::CLIENT_RENEGOTIATION
+                    : SSLError::INVALID_RENEGOTIATION));
+  }
+  return ReadResult(
+      READ_ERROR,
+      std::make_unique<AsyncSocketException>(
+          AsyncSocketException::SSL_ERROR,
+          folly::sformat(
+              "unexpected TLS record type {} with kTLS", int(type))));
+#else
+  // enableKTLS() never turns kTLS on
+  (void)buf;
+  (void)buflen;
+  return ReadResult(
+      READ_ERROR,
+      std::make_unique<AsyncSocketException>(
+          AsyncSocketException::NOT_SUPPORTED,
+          "kTLS is only supported on Linux"));
+#endif // __linux__
+}
+
+void AsyncSSLSocket::shutdownKTLS() noexcept {
+  // OpenSSL's record state is stale in whichever direction the kernel owns,
+  // so SSL_shutdown() must not read or write records there.
+#ifdef __linux__
+  if (ktlsSend_) {
+    uint8_t type = kTLSRecordTypeAlert;
+    uint8_t alert[] = {SSL3_AL_WARNING, SSL_AD_CLOSE_NOTIFY};
+    char control[CMSG_SPACE(sizeof(type))];
+    struct iovec iov;
+    iov.iov_base = alert;
+    iov.iov_len = sizeof(alert);
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    auto cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_TLS;
+    cmsg->cmsg_type = TLS_SET_RECORD_TYPE;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(type));
+    *reinterpret_cast<uint8_t*>(CMSG_DATA(cmsg)) = type;
+    // Best effort, like SSL_shutdown() on a non-blocking socket
+    sendmsg(fd_, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+    // Mark the shutdown as complete so the session stays resumable.
+    SSL_set_shutdown(ssl_, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+    return;
+  }
+#endif // __linux__
+  // Send close_notify from userspace but don't wait for the peer's.
+  SSL_set_shutdown(ssl_, SSL_RECEIVED_SHUTDOWN);
+  if (SSL_shutdown(ssl_) < 0) {
+    ERR_clear_error();
+  }
+}
+
 void AsyncSSLSocket::sslInfoCallback(const SSL* ssl, int where, int ret) {
   AsyncSSLSocket *sslSocket = AsyncSSLSocket::getFromSSL(ssl);
   if (sslSocket->handshakeComplete_ && (where & SSL_CB_HANDSHAKE_START)) {
@@ -312,7 +312,8 @@ class AsyncSSLSocket : public virtual AsyncSocket {
           folly::SSLContext::SSLVerifyPeerEnum::USE_CTX);
 
   /**
-   * Invoke SSL accept following an asynchronous session cache lookup
+   * Invoke SSL accept following an asynchronous session cache lookup or
+   * private key operation
    */
   void restartSSLAccept();
 
@@ -722,6 +723,43 @@ class AsyncSSLSocket : public virtual AsyncSocket {
     return totalConnectTimeout_;
   }
 
+  /**
+   * Hand record encryption over to the kernel (kTLS) once the handshake
+   * completes.
+   *
+   * When enabled, the negotiated keys are installed on the socket with
+   * TCP_ULP "tls" right after the handshake, before any application data is
+   * exchanged.  From then on reads and writes go through the plain
+   * AsyncSocket path, with no copy through the SSL BIO.
+   *
+   * Offload is best effort: it needs Linux with the tls module, a TLS 1.2
+   * connection and an AES-GCM cipher.  Otherwise the connection stays in
+   * userspace.  Receive offload is skipped if OpenSSL has already buffered
+   * data past the handshake.  Once offloaded, getRawBytesWritten() and
+   * getRawBytesReceived() no longer advance.
+   *
+   * Must be called before sslConn() or sslAccept().
+   */
+  void setKTLSEnabled(bool enabled) {
+    ktlsEnabled_ = enabled;
+  }
+
+  bool getKTLSEnabled() const {
+    return ktlsEnabled_;
+  }
+
+  /**
+   * Whether records sent (or received) on this connection are encrypted (or
+   * decrypted) by the kernel.
+   */
+  bool isKTLSSendActive() const {
+    return ktlsSend_;
+  }
+
+  bool isKTLSRecvActive() const {
+    return ktlsRecv_;
+  }
+
  private:
 
   void init();
@@ -751,6 +789,11 @@ class AsyncSSLSocket : public virtual AsyncSocket {
                  unsigned long* errErrorOut) noexcept;
 
   void checkForImmediateRead() noexcept override;
+  // A short SSL_read() (or a completed handshake) doesn't mean the socket
+  // is drained.
+  bool supportsEdgeTriggeredReads() const noexcept override {
+    return false;
+  }
   // AsyncSocket calls this at the wrong time for SSL
   void handleInitialReadWrite() noexcept override {}
 
@@ -762,6 +805,12 @@ class AsyncSSLSocket : public virtual AsyncSocket {
       WriteFlags flags,
       uint32_t* countWritten,
       uint32_t* partialWritten) override;
+  // writeFromFd() stays zero-copy only while the data goes out unencrypted
+  // or once send offload is active, since the kernel then encrypts whatever
+  // sendfile()/splice() hand it.
+  bool canWriteFromFdInKernel() const override {
+    return sslState_ == STATE_UNENCRYPTED || ktlsSend_;
+  }
 
   ssize_t performWriteIovec(const iovec* vec, uint32_t count,
                             WriteFlags flags, uint32_t* countWritten,
@@ -812,6 +861,30 @@ class AsyncSSLSocket : public virtual AsyncSocket {
 
   void startSSLConnect();
 
+#if FOLLY_OPENSSL_HAS_ASYNC
+  // Resumes the handshake once the async job it is paused in can continue.
+  class AsyncJobHandler : public EventHandler {
+   public:
+    AsyncJobHandler(AsyncSSLSocket* sslSocket, EventBase* eventBase)
+        : EventHandler(eventBase, -1), sslSocket_(sslSocket) {}
+
+    void handlerReady(uint16_t /* events */) noexcept override {
+      sslSocket_->asyncJobReady();
+    }
+
+   private:
+    AsyncSSLSocket* sslSocket_;
+  };
+
+  bool waitForAsyncJob() noexcept;
+  void asyncJobReady() noexcept;
+#endif
+
+  // Install the negotiated keys in the kernel, if enabled and supported.
+  void enableKTLS() noexcept;
+  ReadResult performKTLSRead(void* buf, size_t buflen);
+  void shutdownKTLS() noexcept;
+
   static void sslInfoCallback(const SSL *ssl, int type, int val);
 
   // Whether the current write to the socket should use MSG_MORE.
@@ -874,6 +947,16 @@ class AsyncSSLSocket : public virtual AsyncSocket {
   bool sessionResumptionAttempted_{false};
   std::chrono::milliseconds totalConnectTimeout_{0};
 
+  bool ktlsEnabled_{false};
+  bool ktlsSend_{false};
+  bool ktlsRecv_{false};
+
+#if FOLLY_OPENSSL_HAS_ASYNC
+  std::unique_ptr<AsyncJobHandler> asyncJobHandler_;
+  // Held from closeNow() until the job that ssl_ is paused in has finished.
+  DestructorGuard asyncJobGuard_;
+#endif
+
   std::string sslVerificationAlert_;
 };
 
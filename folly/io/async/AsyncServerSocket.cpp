@@ -35,6 +35,15 @@
 #include <string.h>
 #include <sys/types.h>
 
+#ifdef __linux__
+#include <linux/filter.h>
+
+// Linux 4.5
+#ifndef SO_ATTACH_REUSEPORT_CBPF
+#define SO_ATTACH_REUSEPORT_CBPF 51
+#endif
+#endif
+
 namespace fsp = folly::portability::sockets;
 
 namespace folly {
@@ -118,6 +127,185 @@ void AsyncServerSocket::RemoteAcceptor::messageAvailable(
   }
 }
 
+namespace {
+
+// Replaces the SO_REUSEPORT group's steering program with one that picks the
+// socket at index (cpu % numSockets).
+void attachReusePortCpuSteering(int fd, uint32_t numSockets) {
+#ifdef __linux__
+  struct sock_filter code[] = {
+    // A = the CPU processing the packet
+    {BPF_LD | BPF_W | BPF_ABS, 0, 0, uint32_t(SKF_AD_OFF + SKF_AD_CPU)},
+    // A %= numSockets
+    {BPF_ALU | BPF_MOD | BPF_K, 0, 0, numSockets},
+    // A is the index of the socket in the group
+    {BPF_RET | BPF_A, 0, 0, 0},
+  };
+  struct sock_fprog prog;
+  prog.len = sizeof(code) / sizeof(code[0]);
+  prog.filter = code;
+  if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF,
+                 &prog, sizeof(prog)) != 0) {
+    folly::throwSystemError(errno,
+                            "failed to attach SO_REUSEPORT steering program");
+  }
+#else
+  (void)fd;
+  (void)numSockets;
+  throw std::runtime_error(
+      "SO_REUSEPORT CPU steering is only supported on Linux");
+#endif
+}
+
+} // namespace
+
+/*
+ * AsyncServerSocket::ShardAcceptor
+ */
+
+AsyncServerSocket::ShardAcceptor::~ShardAcceptor() {
+  listeners_.clear();
+  closeSockets();
+}
+
+void AsyncServerSocket::ShardAcceptor::start(bool accepting) {
+  if (!eventBase_->runInEventBaseThread([=](){
+        for (const auto& fd : fds_) {
+          listeners_.push_back(
+              std::make_unique<Listener>(this, fd.first, fd.second));
+        }
+        callback_->acceptStarted();
+        accepting_ = accepting;
+        updateRegistration();
+      })) {
+    throw std::invalid_argument("unable to start accepting in the specified "
+                                "EventBase thread");
+  }
+}
+
+void AsyncServerSocket::ShardAcceptor::setAccepting(bool accepting) {
+  eventBase_->runInEventBaseThread([=](){
+    accepting_ = accepting;
+    if (!accepting_ && backoffTimeout_) {
+      backoffTimeout_->cancelTimeout();
+    }
+    updateRegistration();
+  });
+}
+
+void AsyncServerSocket::ShardAcceptor::stop() {
+  stopped_ = true;
+  if (!eventBase_->runInEventBaseThread([=](){
+        listeners_.clear();
+        closeSockets();
+        callback_->acceptStopped();
+        delete this;
+      })) {
+    throw std::invalid_argument("unable to stop accepting in the specified "
+                                "EventBase thread");
+  }
+}
+
+void AsyncServerSocket::ShardAcceptor::updateRegistration() {
+  bool enable = accepting_ && !stopped_ &&
+      !(backoffTimeout_ && backoffTimeout_->isScheduled());
+  for (auto& listener : listeners_) {
+    if (enable) {
+      if (!listener->registerHandler(
+            EventHandler::READ | EventHandler::PERSIST)) {
+        throw std::runtime_error("failed to register for accept events");
+      }
+    } else {
+      listener->unregisterHandler();
+    }
+  }
+}
+
+void AsyncServerSocket::ShardAcceptor::closeSockets() {
+  for (const auto& fd : fds_) {
+    if (shutdownSocketSet_) {
+      shutdownSocketSet_->close(fd.first);
+    } else {
+      closeNoInt(fd.first);
+    }
+  }
+  fds_.clear();
+}
+
+void AsyncServerSocket::ShardAcceptor::handlerReady(
+    int fd, sa_family_t addressFamily) noexcept {
+  for (uint32_t n = 0; n < maxAtOnce_; ++n) {
+    if (!accepting_ || stopped_.load(std::memory_order_relaxed)) {
+      return;
+    }
+
+    SocketAddress address;
+
+    sockaddr_storage addrStorage;
+    socklen_t addrLen = sizeof(addrStorage);
+    sockaddr* saddr = reinterpret_cast<sockaddr*>(&addrStorage);
+    saddr->sa_family = addressFamily;
+
+#ifdef SOCK_NONBLOCK
+    int clientSocket = accept4(fd, saddr, &addrLen, SOCK_NONBLOCK);
+#else
+    int clientSocket = accept(fd, saddr, &addrLen);
+#endif
+
+    if (clientSocket < 0) {
+      int errnoCopy = errno;
+      if (errnoCopy == EAGAIN) {
+        return;
+      } else if (errnoCopy == EMFILE || errnoCopy == ENFILE) {
+        // Same back-off as the primary accept loop, just for this shard.
+        LOG(ERROR) << "accept failed: out of file descriptors; entering accept "
+                "back-off state";
+        if (!backoffTimeout_) {
+          backoffTimeout_ = AsyncTimeout::make(*eventBase_, [this]() noexcept {
+            updateRegistration();
+            if (connectionEventCallback_) {
+              connectionEventCallback_->onBackoffEnded();
+            }
+          });
+        }
+        backoffTimeout_->scheduleTimeout(1000);
+        updateRegistration();
+        if (connectionEventCallback_) {
+          connectionEventCallback_->onBackoffStarted();
+        }
+      }
+      std::runtime_error ex(
+        std::string("accept() failed") + folly::to<std::string>(errnoCopy));
+      callback_->acceptError(ex);
+      if (connectionEventCallback_) {
+        connectionEventCallback_->onConnectionAcceptError(errnoCopy);
+      }
+      return;
+    }
+
+    address.setFromSockaddr(saddr, addrLen);
+    if (connectionEventCallback_) {
+      connectionEventCallback_->onConnectionAccepted(clientSocket, address);
+    }
+
+#ifndef SOCK_NONBLOCK
+    // Explicitly set the new connection to non-blocking mode
+    if (fcntl(clientSocket, F_SETFL, O_NONBLOCK) != 0) {
+      closeNoInt(clientSocket);
+      std::runtime_error ex(
+          "failed to set accepted socket to non-blocking mode");
+      callback_->acceptError(ex);
+      if (connectionEventCallback_) {
+        connectionEventCallback_->onConnectionDropped(clientSocket, address);
+      }
+      return;
+    }
+#endif
+
+    callback_->connectionAccepted(clientSocket, address);
+  }
+}
+
 /*
  * AsyncServerSocket::BackoffTimeout
  */
@@ -222,7 +410,11 @@ int AsyncServerSocket::stopAccepting(int shutdownFlags) {
        it != callbacksCopy.end();
        ++it) {
     // consumer may not be set if we are running in primary event base
-    if (it->consumer) {
+    if (it->shard) {
+      it->shard->stop();
+    } else if (reusePortSharding_) {
+      // never started
+    } else if (it->consumer) {
       DCHECK(it->eventBase);
       it->consumer->stop(it->eventBase, it->callback);
     } else {
@@ -515,6 +707,18 @@ void AsyncServerSocket::listen(int backlog) {
     eventBase_->dcheckIsInEventBaseThread();
   }
 
+  listenBacklog_ = backlog;
+  if (reusePortSharding_) {
+    // The bound sockets only hold the address; connections are spread
+    // over the callbacks' own listening sockets instead.
+    for (auto& info : callbacks_) {
+      if (!info.shard) {
+        startShard(info);
+      }
+    }
+    return;
+  }
+
   // Start listening
   for (auto& handler : sockets_) {
     if (fsp::listen(handler.socket_, backlog) == -1) {
@@ -555,7 +759,7 @@ void AsyncServerSocket::addAcceptCallback(AcceptCallback *callback,
   // start accepting once the callback is installed.
   bool runStartAccepting = accepting_ && callbacks_.empty();
 
-  callbacks_.emplace_back(callback, eventBase);
+  callbacks_.emplace_back(callback, eventBase, maxAtOnce);
 
   SCOPE_SUCCESS {
     // If this is the first accept callback and we are supposed to be accepting,
@@ -565,6 +769,19 @@ void AsyncServerSocket::addAcceptCallback(AcceptCallback *callback,
     }
   };
 
+  if (reusePortSharding_) {
+    // Without listening sockets yet, listen() starts the shard.
+    if (listenBacklog_ >= 0) {
+      try {
+        startShard(callbacks_.back());
+      } catch (...) {
+        callbacks_.pop_back();
+        throw;
+      }
+    }
+    return;
+  }
+
   if (!eventBase) {
     // Run in AsyncServerSocket's eventbase; notify that we are
     // starting to accept connections
@@ -639,7 +856,11 @@ void AsyncServerSocket::removeAcceptCallback(AcceptCallback *callback,
     }
   }
 
-  if (info.consumer) {
+  if (info.shard) {
+    info.shard->stop();
+  } else if (reusePortSharding_) {
+    // not listening yet, so the shard was never started
+  } else if (info.consumer) {
     // consumer could be nullptr is we run callbacks in primary event
     // base
     DCHECK(info.eventBase);
@@ -671,6 +892,15 @@ void AsyncServerSocket::startAccepting() {
     return;
   }
 
+  if (reusePortSharding_) {
+    for (auto& info : callbacks_) {
+      if (info.shard) {
+        info.shard->setAccepting(true);
+      }
+    }
+    return;
+  }
+
   for (auto& handler : sockets_) {
     if (!handler.registerHandler(
           EventHandler::READ | EventHandler::PERSIST)) {
@@ -687,6 +917,11 @@ void AsyncServerSocket::pauseAccepting() {
   for (auto& handler : sockets_) {
    handler. unregisterHandler();
   }
+  for (auto& info : callbacks_) {
+    if (info.shard) {
+      info.shard->setAccepting(false);
+    }
+  }
 
   // If we were in the accept backoff state, disable the backoff timeout
   if (backoffTimeout_) {
@@ -694,6 +929,71 @@ void AsyncServerSocket::pauseAccepting() {
   }
 }
 
+void AsyncServerSocket::startShard(CallbackInfo& info) {
+  std::unique_ptr<ShardAcceptor> shard(new ShardAcceptor(
+      info.callback,
+      info.eventBase ? info.eventBase : eventBase_,
+      connectionEventCallback_,
+      shutdownSocketSet_,
+      info.maxAtOnce));
+  uint32_t numShards = 1;
+  for (const auto& other : callbacks_) {
+    if (other.shard) {
+      ++numShards;
+    }
+  }
+
+  // One listening socket per bound address, joining its SO_REUSEPORT group
+  for (const auto& handler : sockets_) {
+    SocketAddress address;
+    address.setFromLocalAddress(handler.socket_);
+    if (address.getFamily() == AF_UNIX) {
+      throw std::invalid_argument(
+          "SO_REUSEPORT sharding is not supported for AF_UNIX sockets");
+    }
+
+    int fd = createSocket(address.getFamily());
+    shard->addSocket(fd, address.getFamily());
+
+    if (address.getFamily() == AF_INET6) {
+      int v6only = 0;
+      socklen_t len = sizeof(v6only);
+      if (getsockopt(handler.socket_, IPPROTO_IPV6, IPV6_V6ONLY,
+                     &v6only, &len) == 0) {
+        setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &v6only, sizeof(v6only));
+      }
+    }
+
+    sockaddr_storage addrStorage;
+    address.getAddress(&addrStorage);
+    sockaddr* saddr = reinterpret_cast<sockaddr*>(&addrStorage);
+    if (fsp::bind(fd, saddr, address.getActualSize()) != 0) {
+      folly::throwSystemError(errno,
+          "failed to bind to async server socket: " +
+          address.describe());
+    }
+
+#if __linux__
+    if (noTransparentTls_) {
+      // Ignore return value, errors are ok
+      setsockopt(fd, SOL_SOCKET, SO_NO_TRANSPARENT_TLS, nullptr, 0);
+    }
+#endif
+
+    if (fsp::listen(fd, listenBacklog_) == -1) {
+      folly::throwSystemError(errno,
+                              "failed to listen on async server socket");
+    }
+
+    if (reusePortCpuSteering_) {
+      attachReusePortCpuSteering(fd, numShards);
+    }
+  }
+
+  shard->start(accepting_);
+  info.shard = shard.release();
+}
+
 int AsyncServerSocket::createSocket(int family) {
   int fd = fsp::socket(family, SOCK_STREAM, 0);
   if (fd == -1) {
@@ -725,7 +1025,7 @@ void AsyncServerSocket::setupSocket(int fd, int family) {
 
   // Set reuseport to support multiple accept threads
   int zero = 0;
-  if (reusePortEnabled_ &&
+  if ((reusePortEnabled_ || reusePortSharding_) &&
       setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(int)) != 0) {
     LOG(ERROR) << "failed to set SO_REUSEPORT on async server socket "
                << strerror(errno);
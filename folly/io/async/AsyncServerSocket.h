@@ -28,8 +28,10 @@
 
 #include <limits.h>
 #include <stddef.h>
+#include <atomic>
 #include <exception>
 #include <memory>
+#include <utility>
 #include <vector>
 
 // Due to the way kernel headers are included, this may or may not be defined.
@@ -661,6 +663,56 @@ class AsyncServerSocket : public DelayedDestruction
     return reusePortEnabled_;
   }
 
+  /**
+   * Give every AcceptCallback its own SO_REUSEPORT listening socket(s),
+   * bound to the same address(es) and accepted from directly in the
+   * callback's EventBase thread (the primary EventBase for callbacks added
+   * with a nullptr EventBase). The kernel spreads incoming connections
+   * across the listening sockets, so accepting scales with the number of
+   * callbacks and no connection is handed between threads.
+   *
+   * The sockets created by bind() then only reserve the address: they are
+   * never listened on.  The per-callback sockets are opened by listen(), or
+   * by addAcceptCallback() once listening.  Closing one (removing its
+   * callback) resets the connections still in its backlog.
+   *
+   * setMaxNumMessagesInQueue() and setAcceptRateAdjustSpeed() have no
+   * effect in this mode.
+   *
+   * Must be called before bind().  Not supported for AF_UNIX sockets.
+   */
+  void setReusePortSharding(bool enabled) {
+    if (!sockets_.empty()) {
+      throw std::invalid_argument(
+          "setReusePortSharding() must be called before bind()");
+    }
+    reusePortSharding_ = enabled;
+  }
+
+  bool getReusePortSharding() const {
+    return reusePortSharding_;
+  }
+
+  /**
+   * With setReusePortSharding(), attach a classic BPF program to the
+   * SO_REUSEPORT group (Linux 4.5+) that hands each connection to the n-th
+   * callback's socket, n being the CPU that processed the incoming SYN
+   * modulo the number of callbacks, instead of hashing the 4-tuple.  When
+   * the n-th callback's EventBase thread is pinned to CPU n and the NIC
+   * queues are steered to the same CPUs, connections stay on the CPU that
+   * received them.  The mapping only holds while callbacks are added in
+   * CPU order and none is removed.
+   *
+   * Must be called before listen().
+   */
+  void setReusePortCpuSteering(bool enabled) {
+    reusePortCpuSteering_ = enabled;
+  }
+
+  bool getReusePortCpuSteering() const {
+    return reusePortCpuSteering_;
+  }
+
   /**
    * Set whether or not the socket should close during exec() (FD_CLOEXEC). By
    * default, this is enabled
@@ -770,20 +822,90 @@ class AsyncServerSocket : public DelayedDestruction
     NotificationQueue<QueueMessage> queue_;
   };
 
+  /**
+   * Accepts connections for one AcceptCallback on its own SO_REUSEPORT
+   * listening sockets, see setReusePortSharding().
+   *
+   * Created and started from the primary EventBase thread; everything else
+   * happens in the callback's EventBase thread, and stop() deletes it
+   * there.  It doesn't refer back to the AsyncServerSocket, which may be
+   * destroyed first.
+   */
+  class ShardAcceptor {
+   public:
+    ShardAcceptor(AcceptCallback* callback,
+                  EventBase* eventBase,
+                  ConnectionEventCallback* connectionEventCallback,
+                  ShutdownSocketSet* shutdownSocketSet,
+                  uint32_t maxAtOnce)
+      : callback_(callback),
+        eventBase_(eventBase),
+        connectionEventCallback_(connectionEventCallback),
+        shutdownSocketSet_(shutdownSocketSet),
+        maxAtOnce_(maxAtOnce) {}
+
+    ~ShardAcceptor();
+
+    // Takes ownership of a listening socket; only before start()
+    void addSocket(int fd, sa_family_t family) {
+      fds_.emplace_back(fd, family);
+    }
+
+    void start(bool accepting);
+    void setAccepting(bool accepting);
+    void stop();
+
+   private:
+    struct Listener : public EventHandler {
+      Listener(ShardAcceptor* parent, int fd, sa_family_t family)
+        : EventHandler(parent->eventBase_, fd),
+          parent_(parent),
+          fd_(fd),
+          family_(family) {}
+
+      void handlerReady(uint16_t /* events */) noexcept override {
+        parent_->handlerReady(fd_, family_);
+      }
+
+      ShardAcceptor* parent_;
+      int fd_;
+      sa_family_t family_;
+    };
+
+    void handlerReady(int fd, sa_family_t family) noexcept;
+    void updateRegistration();
+    void closeSockets();
+
+    AcceptCallback* callback_;
+    EventBase* eventBase_;
+    ConnectionEventCallback* connectionEventCallback_;
+    ShutdownSocketSet* shutdownSocketSet_;
+    uint32_t maxAtOnce_;
+    bool accepting_{false};
+    // set by stop(), which may be called from within the accept loop
+    std::atomic<bool> stopped_{false};
+    std::vector<std::pair<int, sa_family_t>> fds_;
+    std::vector<std::unique_ptr<Listener>> listeners_;
+    std::unique_ptr<AsyncTimeout> backoffTimeout_;
+  };
+
   /**
    * A struct to keep track of the callbacks associated with this server
    * socket.
    */
   struct CallbackInfo {
-    CallbackInfo(AcceptCallback *cb, EventBase *evb)
+    CallbackInfo(AcceptCallback *cb, EventBase *evb, uint32_t atOnce)
       : callback(cb),
         eventBase(evb),
-        consumer(nullptr) {}
+        consumer(nullptr),
+        maxAtOnce(atOnce) {}
 
     AcceptCallback *callback;
     EventBase *eventBase;
 
     RemoteAcceptor* consumer;
+    ShardAcceptor* shard{nullptr};
+    uint32_t maxAtOnce;
   };
 
   class BackoffTimeout;
@@ -794,6 +916,7 @@ class AsyncServerSocket : public DelayedDestruction
   int createSocket(int family);
   void setupSocket(int fd, int family);
   void bindSocket(int fd, const SocketAddress& address, bool isExistingSocket);
+  void startShard(CallbackInfo& info);
   void dispatchSocket(int socket, SocketAddress&& address);
   void dispatchError(const char *msg, int errnoValue);
   void enterBackoff();
@@ -868,6 +991,10 @@ class AsyncServerSocket : public DelayedDestruction
   std::vector<CallbackInfo> callbacks_;
   bool keepAliveEnabled_;
   bool reusePortEnabled_{false};
+  bool reusePortSharding_{false};
+  bool reusePortCpuSteering_{false};
+  // backlog passed to listen(), -1 before
+  int listenBacklog_{-1};
   bool closeOnExec_;
   bool tfo_{false};
   bool noTransparentTls_{false};
@@ -34,7 +34,7 @@ AsyncSignalHandler::~AsyncSignalHandler() {
   for (SignalEventMap::iterator it = signalEvents_.begin();
        it != signalEvents_.end();
        ++it) {
-    event_del(&it->second);
+    eventBase_->getBackend()->eb_event_del(it->second);
   }
 }
 
@@ -69,7 +69,7 @@ void AsyncSignalHandler::registerSignalHandler(int signum) {
                                  signum));
     }
 
-    if (event_add(ev, nullptr) != 0) {
+    if (eventBase_->getBackend()->eb_event_add(*ev, nullptr) != 0) {
       throw std::runtime_error(folly::to<string>(
                                  "error adding event handler for signal ",
                                  signum));
@@ -88,7 +88,7 @@ void AsyncSignalHandler::unregisterSignalHandler(int signum) {
                                signum, ": signal not registered"));
   }
 
-  event_del(&it->second);
+  eventBase_->getBackend()->eb_event_del(it->second);
   signalEvents_.erase(it);
 }
 
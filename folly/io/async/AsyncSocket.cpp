@@ -17,13 +17,17 @@
 #include <folly/io/async/AsyncSocket.h>
 
 #include <folly/ExceptionWrapper.h>
+#include <folly/FileUtil.h>
 #include <folly/Portability.h>
+#include <folly/ScopeGuard.h>
 #include <folly/SocketAddress.h>
 #include <folly/io/Cursor.h>
 #include <folly/io/IOBuf.h>
 #include <folly/io/IOBufQueue.h>
+#include <folly/io/async/ReadBufferPool.h>
 #include <folly/portability/Fcntl.h>
 #include <folly/portability/Sockets.h>
+#include <folly/portability/SysStat.h>
 #include <folly/portability/SysUio.h>
 #include <folly/portability/Unistd.h>
 
@@ -33,6 +37,14 @@
 #include <sys/types.h>
 #include <thread>
 
+#ifdef __linux__
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <linux/sockios.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#endif
+
 using std::string;
 using std::unique_ptr;
 
@@ -47,6 +59,18 @@ static constexpr bool msgErrQueueSupported =
     false;
 #endif // MSG_ERRQUEUE
 
+#if defined(__linux__) && defined(SO_TIMESTAMPING) && \
+    defined(SO_EE_ORIGIN_TIMESTAMPING)
+#define FOLLY_HAVE_TX_TIMESTAMPING 1
+// Linux 6.2+: key bytes from the first byte not yet written to the socket
+// rather than the first unacknowledged one
+#ifndef SOF_TIMESTAMPING_OPT_ID_TCP
+#define SOF_TIMESTAMPING_OPT_ID_TCP (1 << 16)
+#endif
+#else
+#define FOLLY_HAVE_TX_TIMESTAMPING 0
+#endif
+
 // static members initializers
 const AsyncSocket::OptionMap AsyncSocket::emptyOptionMap;
 
@@ -79,7 +103,8 @@ class AsyncSocket::BytesWriteRequest : public AsyncSocket::WriteRequest {
                                        uint32_t partialWritten,
                                        uint32_t bytesWritten,
                                        unique_ptr<IOBuf>&& ioBuf,
-                                       WriteFlags flags) {
+                                       WriteFlags flags,
+                                       IOBuf* zeroCopyBuf = nullptr) {
     assert(opCount > 0);
     // Since we put a variable size iovec array at the end
     // of each BytesWriteRequest, we have to manually allocate the memory.
@@ -91,7 +116,7 @@ class AsyncSocket::BytesWriteRequest : public AsyncSocket::WriteRequest {
 
     return new(buf) BytesWriteRequest(socket, callback, ops, opCount,
                                       partialWritten, bytesWritten,
-                                      std::move(ioBuf), flags);
+                                      std::move(ioBuf), flags, zeroCopyBuf);
   }
 
   void destroy() override {
@@ -104,8 +129,12 @@ class AsyncSocket::BytesWriteRequest : public AsyncSocket::WriteRequest {
     if (getNext() != nullptr) {
       writeFlags |= WriteFlags::CORK;
     }
+    auto firstZeroCopyId = socket_->zeroCopyBufId_;
     auto writeResult = socket_->performWrite(
         getOps(), getOpCount(), writeFlags, &opsWritten_, &partialBytes_);
+    if (zeroCopyBuf_) {
+      socket_->trackZeroCopySends(zeroCopyBuf_, firstZeroCopyId);
+    }
     bytesWritten_ = writeResult.writeReturn > 0 ? writeResult.writeReturn : 0;
     return writeResult;
   }
@@ -147,12 +176,14 @@ class AsyncSocket::BytesWriteRequest : public AsyncSocket::WriteRequest {
                     uint32_t partialBytes,
                     uint32_t bytesWritten,
                     unique_ptr<IOBuf>&& ioBuf,
-                    WriteFlags flags)
+                    WriteFlags flags,
+                    IOBuf* zeroCopyBuf)
     : AsyncSocket::WriteRequest(socket, callback)
     , opCount_(opCount)
     , opIndex_(0)
     , flags_(flags)
     , ioBuf_(std::move(ioBuf))
+    , zeroCopyBuf_(zeroCopyBuf)
     , opsWritten_(0)
     , partialBytes_(partialBytes)
     , bytesWritten_(bytesWritten) {
@@ -160,7 +191,11 @@ class AsyncSocket::BytesWriteRequest : public AsyncSocket::WriteRequest {
   }
 
   // private destructor, to ensure callers use destroy()
-  ~BytesWriteRequest() override = default;
+  ~BytesWriteRequest() override {
+    if (zeroCopyBuf_) {
+      socket_->releaseZeroCopyBuf(zeroCopyBuf_);
+    }
+  }
 
   const struct iovec* getOps() const {
     assert(opCount_ > opIndex_);
@@ -176,6 +211,7 @@ class AsyncSocket::BytesWriteRequest : public AsyncSocket::WriteRequest {
   uint32_t opIndex_;            ///< current index into writeOps_
   WriteFlags flags_;            ///< set for WriteFlags
   unique_ptr<IOBuf> ioBuf_;     ///< underlying IOBuf, or nullptr if N/A
+  IOBuf* zeroCopyBuf_;          ///< IOBuf held by the socket for MSG_ZEROCOPY
 
   // for consume(), how much we wrote on the last write
   uint32_t opsWritten_;         ///< complete ops written
@@ -185,6 +221,193 @@ class AsyncSocket::BytesWriteRequest : public AsyncSocket::WriteRequest {
   struct iovec writeOps_[];     ///< write operation(s) list
 };
 
+/* The WriteRequest used by writeFromFd(), which moves data from a regular
+ * file (sendfile()) or a pipe (splice()) to the socket inside the kernel.
+ *
+ * Unlike BytesWriteRequest, it is also what writeFromFd() uses for the
+ * immediate write attempt, and it accounts for its progress as it goes.
+ */
+// Most that a write from an fd reads into memory at a time, when it can't
+// move the data inside the kernel
+static constexpr size_t kWriteFromFdChunkSize = 64 * 1024;
+
+class AsyncSocket::FdWriteRequest : public AsyncSocket::WriteRequest {
+ public:
+  FdWriteRequest(AsyncSocket* socket,
+                 WriteCallback* callback,
+                 int fd,
+                 off_t offset,
+                 size_t length,
+                 bool isPipe,
+                 WriteFlags flags)
+    : AsyncSocket::WriteRequest(socket, callback)
+    , fd_(fd)
+    , offset_(offset)
+    , remaining_(length)
+    , isPipe_(isPipe)
+    , flags_(flags) {}
+
+  void destroy() override {
+    delete this;
+  }
+
+  WriteResult performWrite() override {
+#ifdef __linux__
+    if (!chunk_ && socket_->canWriteFromFdInKernel()) {
+      return performKernelWrite();
+    }
+#endif
+    return performCopyWrite();
+  }
+
+  bool isComplete() override {
+    return remaining_ == 0;
+  }
+
+  void consume() override {
+    // performWrite() already advanced past what it wrote.
+  }
+
+ private:
+  // private destructor, to ensure callers use destroy()
+  ~FdWriteRequest() override = default;
+
+#ifdef __linux__
+  WriteResult performKernelWrite() {
+    size_t written = 0;
+    while (remaining_ > 0) {
+      ssize_t n;
+      if (isPipe_) {
+        unsigned int spliceFlags = SPLICE_F_MOVE | SPLICE_F_NONBLOCK;
+        if (getNext() != nullptr || isSet(flags_, WriteFlags::CORK)) {
+          spliceFlags |= SPLICE_F_MORE;
+        }
+        n = splice(
+            fd_, nullptr, socket_->fd_, nullptr, remaining_, spliceFlags);
+      } else {
+        n = sendfile(
+            socket_->fd_, fd_, offset_ >= 0 ? &offset_ : nullptr, remaining_);
+      }
+      if (n > 0) {
+        remaining_ -= size_t(n);
+        written += size_t(n);
+        bytesWritten(size_t(n));
+      } else if (n == 0) {
+        return sourceEndedEarly();
+      } else if (errno == EAGAIN) {
+        // splice() can't tell a full socket from an empty pipe.  Only the
+        // former is worth waiting for write readiness.
+        if (isPipe_ && !pipeHasData()) {
+          return pipeRanDry();
+        }
+        break;
+      } else if (errno != EINTR) {
+        return WriteResult(
+            WRITE_ERROR,
+            std::make_unique<AsyncSocketException>(
+                AsyncSocketException::INTERNAL_ERROR,
+                isPipe_ ? "splice() failed" : "sendfile() failed",
+                errno));
+      }
+    }
+    return WriteResult(ssize_t(written));
+  }
+
+  bool pipeHasData() const {
+    int avail = 0;
+    return ioctl(fd_, FIONREAD, &avail) == 0 && avail > 0;
+  }
+#endif
+
+  // Read the data into chunk_ and write it with performWrite(), for sockets
+  // that have to see it (e.g. to encrypt it).  The next chunk is only read
+  // once the socket has taken all of the previous one.
+  WriteResult performCopyWrite() {
+    size_t written = 0;
+    while (remaining_ > 0) {
+      if (!chunk_) {
+        chunk_ = IOBuf::create(std::min(remaining_, kWriteFromFdChunkSize));
+      }
+      if (chunk_->empty()) {
+        chunk_->clear();
+        auto toRead = std::min(remaining_, chunk_->capacity());
+        auto n = offset_ >= 0
+            ? preadNoInt(fd_, chunk_->writableData(), toRead, offset_)
+            : readNoInt(fd_, chunk_->writableData(), toRead);
+        if (n == 0) {
+          return sourceEndedEarly();
+        } else if (n < 0) {
+          if (isPipe_ && errno == EAGAIN) {
+            return pipeRanDry();
+          }
+          return WriteResult(
+              WRITE_ERROR,
+              std::make_unique<AsyncSocketException>(
+                  AsyncSocketException::INTERNAL_ERROR,
+                  "writeFromFd() read failed",
+                  errno));
+        }
+        if (offset_ >= 0) {
+          offset_ += n;
+        }
+        chunk_->append(size_t(n));
+      }
+
+      WriteFlags writeFlags = flags_;
+      if (chunk_->length() < remaining_) {
+        // Only the last chunk ends the record.
+        writeFlags = unSet(writeFlags, WriteFlags::EOR) | WriteFlags::CORK;
+      }
+      if (getNext() != nullptr) {
+        writeFlags |= WriteFlags::CORK;
+      }
+      iovec op;
+      op.iov_base = chunk_->writableData();
+      op.iov_len = chunk_->length();
+      uint32_t opsWritten = 0;
+      uint32_t partialBytes = 0;
+      auto writeResult = socket_->performWrite(
+          &op, 1, writeFlags, &opsWritten, &partialBytes);
+      if (writeResult.writeReturn < 0) {
+        return writeResult;
+      }
+      auto n = size_t(writeResult.writeReturn);
+      chunk_->trimStart(n);
+      remaining_ -= n;
+      written += n;
+      // performWrite() has already counted these as app bytes.
+      totalBytesWritten_ += uint32_t(n);
+      if (!chunk_->empty()) {
+        break;
+      }
+    }
+    return WriteResult(ssize_t(written));
+  }
+
+  static WriteResult sourceEndedEarly() {
+    return WriteResult(
+        WRITE_ERROR,
+        std::make_unique<AsyncSocketException>(
+            AsyncSocketException::END_OF_FILE,
+            "writeFromFd() source ended early"));
+  }
+
+  static WriteResult pipeRanDry() {
+    return WriteResult(
+        WRITE_ERROR,
+        std::make_unique<AsyncSocketException>(
+            AsyncSocketException::BAD_ARGS,
+            "writeFromFd() pipe holds fewer bytes than requested"));
+  }
+
+  int fd_;                      ///< source file or pipe
+  off_t offset_;                ///< file offset, or -1 for the current one
+  size_t remaining_;            ///< bytes still to be written
+  bool isPipe_;                 ///< splice() rather than sendfile()
+  WriteFlags flags_;            ///< set for WriteFlags
+  std::unique_ptr<IOBuf> chunk_; ///< data read but not yet written, if copying
+};
+
 int AsyncSocket::SendMsgParamsCallback::getDefaultFlags(folly::WriteFlags flags)
                                                                       noexcept {
   int msg_flags = MSG_DONTWAIT;
@@ -205,6 +428,12 @@ int AsyncSocket::SendMsgParamsCallback::getDefaultFlags(folly::WriteFlags flags)
     msg_flags |= MSG_EOR;
   }
 
+#ifdef MSG_ZEROCOPY
+  if (isSet(flags, WriteFlags::WRITE_MSG_ZEROCOPY)) {
+    msg_flags |= MSG_ZEROCOPY;
+  }
+#endif // MSG_ZEROCOPY
+
   return msg_flags;
 }
 
@@ -418,6 +647,10 @@ void AsyncSocket::connect(ConnectCallback* callback,
           errnoCopy);
     }
 
+    if (zeroCopyRequested_) {
+      applyZeroCopy();
+    }
+
 #if !defined(MSG_NOSIGNAL) && defined(F_SETNOSIGPIPE)
     // iOS and OS X don't support MSG_NOSIGNAL; set F_SETNOSIGPIPE instead
     rv = fcntl(fd_, F_SETNOSIGPIPE, 1);
@@ -678,6 +911,117 @@ AsyncSocket::SendMsgParamsCallback* AsyncSocket::getSendMsgParamsCB() const {
   return sendMsgParamCallback_;
 }
 
+bool AsyncSocket::setZeroCopy(bool enable) {
+#ifdef MSG_ZEROCOPY
+  zeroCopyRequested_ = enable;
+  if (fd_ < 0) {
+    // applied by connect() once the socket exists
+    return true;
+  }
+  return applyZeroCopy();
+#else
+  (void)enable;
+  return false;
+#endif // MSG_ZEROCOPY
+}
+
+bool AsyncSocket::applyZeroCopy() {
+#ifdef MSG_ZEROCOPY
+  if (!zeroCopyRequested_ && !zeroCopyEnabled_) {
+    return true;
+  }
+  // SO_ZEROCOPY can't be turned off once set; disabling only stops us from
+  // passing MSG_ZEROCOPY.
+  if (zeroCopyRequested_) {
+    int val = 1;
+    if (setsockopt(fd_, SOL_SOCKET, SO_ZEROCOPY, &val, sizeof(val)) != 0) {
+      VLOG(2) << "failed to enable SO_ZEROCOPY on AsyncSocket " << this
+              << "(fd=" << fd_ << ", state=" << state_
+              << "): " << strerror(errno);
+      zeroCopyRequested_ = false;
+      zeroCopyEnabled_ = false;
+      return false;
+    }
+  }
+  zeroCopyEnabled_ = zeroCopyRequested_;
+  return true;
+#else
+  return false;
+#endif // MSG_ZEROCOPY
+}
+
+bool AsyncSocket::setByteEventCallback(ByteEventCallback* callback) {
+  if (callback == byteEventCallback_) {
+    return true;
+  }
+  if (!FOLLY_HAVE_TX_TIMESTAMPING && callback != nullptr) {
+    return false;
+  }
+
+  byteEventCallback_ = callback;
+  switch ((StateEnum)state_) {
+    case StateEnum::UNINIT:
+    case StateEnum::CONNECTING:
+    case StateEnum::FAST_OPEN:
+      // applied by invokeConnectSuccess()
+      return true;
+    case StateEnum::ESTABLISHED:
+      if (!applyByteEvents()) {
+        byteEventCallback_ = nullptr;
+        return false;
+      }
+      updateErrQueueRegistration();
+      return true;
+    case StateEnum::CLOSED:
+    case StateEnum::ERROR:
+      byteEventCallback_ = nullptr;
+      return callback == nullptr;
+  }
+  return false;
+}
+
+bool AsyncSocket::applyByteEvents() {
+#if FOLLY_HAVE_TX_TIMESTAMPING
+  bool enable = byteEventCallback_ != nullptr;
+  if (enable == byteEventsEnabled_) {
+    return true;
+  }
+  if (!enable) {
+    int val = 0;
+    setsockopt(fd_, SOL_SOCKET, SO_TIMESTAMPING, &val, sizeof(val));
+    byteEventsEnabled_ = false;
+    return true;
+  }
+
+  int val = SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY |
+      SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_TX_SCHED |
+      SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_TX_ACK;
+  int idTcp = SOF_TIMESTAMPING_OPT_ID_TCP | val;
+  if (setsockopt(fd_, SOL_SOCKET, SO_TIMESTAMPING, &idTcp, sizeof(idTcp)) ==
+      0) {
+    byteEventOffset_ = getRawBytesWritten();
+  } else {
+    // Older kernels key bytes from the first unacknowledged one.  An ACK
+    // arriving between the two calls below skews the offsets by the number
+    // of bytes it acknowledges.
+    int unacked = 0;
+    if (ioctl(fd_, SIOCOUTQ, &unacked) != 0 ||
+        setsockopt(fd_, SOL_SOCKET, SO_TIMESTAMPING, &val, sizeof(val)) != 0) {
+      VLOG(2) << "failed to enable SO_TIMESTAMPING on AsyncSocket " << this
+              << "(fd=" << fd_ << ", state=" << state_
+              << "): " << strerror(errno);
+      return false;
+    }
+    byteEventOffset_ = getRawBytesWritten() - uint64_t(unacked);
+  }
+  byteEventsAcked_ = getRawBytesWritten();
+  byteEventsEnabled_ = true;
+  return true;
+#else
+  return byteEventCallback_ == nullptr;
+#endif // FOLLY_HAVE_TX_TIMESTAMPING
+}
+
 void AsyncSocket::setReadCB(ReadCallback *callback) {
   VLOG(6) << "AsyncSocket::setReadCallback() this=" << this << ", fd=" << fd_
           << ", callback=" << callback << ", state=" << state_;
@@ -789,6 +1133,11 @@ void AsyncSocket::writev(WriteCallback* callback,
 
 void AsyncSocket::writeChain(WriteCallback* callback, unique_ptr<IOBuf>&& buf,
                               WriteFlags flags) {
+  if (zeroCopyEnabled_ &&
+      buf->computeChainDataLength() >= zeroCopyWriteChainThreshold_) {
+    flags |= WriteFlags::WRITE_MSG_ZEROCOPY;
+  }
+
   constexpr size_t kSmallSizeMax = 64;
   size_t count = buf->countChainElements();
   if (count <= kSmallSizeMax) {
@@ -834,6 +1183,24 @@ void AsyncSocket::writeImpl(WriteCallback* callback, const iovec* vec,
     return invalidState(callback);
   }
 
+  // With MSG_ZEROCOPY the kernel keeps referring to the IOBufs after the
+  // write has completed, so they are handed to zeroCopyBufs_ instead of the
+  // write request.  zeroCopyBuf holds the reference of this write until it
+  // is passed on to the BytesWriteRequest.
+  IOBuf* zeroCopyBuf = nullptr;
+  if (isSet(flags, WriteFlags::WRITE_MSG_ZEROCOPY)) {
+    if (ioBuf && zeroCopyEnabled_) {
+      zeroCopyBuf = addZeroCopyBuf(std::move(ioBuf));
+    } else {
+      flags = unSet(flags, WriteFlags::WRITE_MSG_ZEROCOPY);
+    }
+  }
+  SCOPE_EXIT {
+    if (zeroCopyBuf) {
+      releaseZeroCopyBuf(zeroCopyBuf);
+    }
+  };
+
   uint32_t countWritten = 0;
   uint32_t partialWritten = 0;
   ssize_t bytesWritten = 0;
@@ -846,8 +1213,12 @@ void AsyncSocket::writeImpl(WriteCallback* callback, const iovec* vec,
       assert(writeReqTail_ == nullptr);
       assert((eventFlags_ & EventHandler::WRITE) == 0);
 
+      auto firstZeroCopyId = zeroCopyBufId_;
       auto writeResult = performWrite(
           vec, uint32_t(count), flags, &countWritten, &partialWritten);
+      if (zeroCopyBuf) {
+        trackZeroCopySends(zeroCopyBuf, firstZeroCopyId);
+      }
       bytesWritten = writeResult.writeReturn;
       if (bytesWritten < 0) {
         auto errnoCopy = errno;
@@ -865,6 +1236,9 @@ void AsyncSocket::writeImpl(WriteCallback* callback, const iovec* vec,
         if (callback) {
           callback->writeSuccess();
         }
+        if (zeroCopyBuf || byteEventsEnabled_) {
+          updateErrQueueRegistration();
+        }
         return;
       } else { // continue writing the next writeReq
         if (bufferCallback_) {
@@ -895,7 +1269,9 @@ void AsyncSocket::writeImpl(WriteCallback* callback, const iovec* vec,
         partialWritten,
         uint32_t(bytesWritten),
         std::move(ioBuf),
-        flags);
+        flags,
+        zeroCopyBuf);
+    zeroCopyBuf = nullptr;
   } catch (const std::exception& ex) {
     // we mainly expect to catch std::bad_alloc here
     AsyncSocketException tex(AsyncSocketException::INTERNAL_ERROR,
@@ -903,6 +1279,85 @@ void AsyncSocket::writeImpl(WriteCallback* callback, const iovec* vec,
     return failWrite(__func__, callback, size_t(bytesWritten), tex);
   }
   req->consume();
+  queueWriteRequest(req, mustRegister);
+}
+
+void AsyncSocket::writeFromFd(
+    WriteCallback* callback,
+    int fd,
+    off_t offset,
+    size_t length,
+    WriteFlags flags) {
+  VLOG(6) << "AsyncSocket::writeFromFd() this=" << this << ", fd=" << fd_
+          << ", callback=" << callback << ", srcFd=" << fd
+          << ", offset=" << offset << ", length=" << length
+          << ", state=" << state_;
+  DestructorGuard dg(this);
+  eventBase_->dcheckIsInEventBaseThread();
+
+  if (shutdownFlags_ & (SHUT_WRITE | SHUT_WRITE_PENDING)) {
+    // See writeImpl()
+    return invalidState(callback);
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    auto errnoCopy = errno;
+    AsyncSocketException ex(
+        AsyncSocketException::BAD_ARGS,
+        withAddr("writeFromFd() could not stat its source"),
+        errnoCopy);
+    return failWrite(__func__, callback, 0, ex);
+  }
+  bool isPipe = S_ISFIFO(st.st_mode);
+  if (isPipe ? offset >= 0 : !S_ISREG(st.st_mode)) {
+    AsyncSocketException ex(
+        AsyncSocketException::BAD_ARGS,
+        withAddr("writeFromFd() needs a regular file, or a pipe without "
+                 "an offset"));
+    return failWrite(__func__, callback, 0, ex);
+  }
+
+  auto req =
+      new FdWriteRequest(this, callback, fd, offset, length, isPipe, flags);
+  bool mustRegister = false;
+  // Unlike writeImpl(), there is no userspace data to carry a TCP Fast Open
+  // connect, so FAST_OPEN counts as an invalid state here.
+  if (state_ == StateEnum::ESTABLISHED && !connecting()) {
+    if (writeReqHead_ == nullptr) {
+      assert(writeReqTail_ == nullptr);
+      assert((eventFlags_ & EventHandler::WRITE) == 0);
+
+      auto writeResult = req->performWrite();
+      if (writeResult.writeReturn < 0) {
+        auto bytesWritten = req->getTotalBytesWritten();
+        req->destroy();
+        return failWrite(
+            __func__, callback, bytesWritten, *writeResult.exception);
+      } else if (req->isComplete()) {
+        req->destroy();
+        if (callback) {
+          callback->writeSuccess();
+        }
+        if (byteEventsEnabled_) {
+          updateErrQueueRegistration();
+        }
+        return;
+      }
+      if (bufferCallback_) {
+        bufferCallback_->onEgressBuffered();
+      }
+      mustRegister = true;
+    }
+  } else if (!connecting()) {
+    req->destroy();
+    return invalidState(callback);
+  }
+
+  queueWriteRequest(req, mustRegister);
+}
+
+void AsyncSocket::queueWriteRequest(WriteRequest* req, bool mustRegister) {
   if (writeReqTail_ == nullptr) {
     assert(writeReqHead_ == nullptr);
     writeReqHead_ = writeReqTail_ = req;
@@ -1017,7 +1472,7 @@ void AsyncSocket::closeNow() {
       writeTimeout_.cancelTimeout();
 
       // If we are registered for I/O events, unregister.
-      if (eventFlags_ != EventHandler::NONE) {
+      if (eventFlags_ != EventHandler::NONE || errQueueRegistered_) {
         eventFlags_ = EventHandler::NONE;
         if (!updateEventRegistration()) {
           // We will have been moved into the error state.
@@ -1399,6 +1854,30 @@ int AsyncSocket::setQuickAck(bool quickack) {
 #endif
 }
 
+int AsyncSocket::setBusyPoll(std::chrono::microseconds timeout) {
+  if (fd_ < 0) {
+    VLOG(4) << "AsyncSocket::setBusyPoll() called on non-open socket "
+               << this << "(state=" << state_ << ")";
+    return EINVAL;
+  }
+
+#ifdef SO_BUSY_POLL // Linux-only
+  int value = int(timeout.count());
+  if (setsockopt(fd_, SOL_SOCKET, SO_BUSY_POLL, &value, sizeof(value)) != 0) {
+    int errnoCopy = errno;
+    VLOG(2) << "failed to update SO_BUSY_POLL option on AsyncSocket "
+            << this << " (fd=" << fd_ << ", state=" << state_ << "): "
+            << strerror(errnoCopy);
+    return errnoCopy;
+  }
+
+  return 0;
+#else
+  (void)timeout;
+  return ENOSYS;
+#endif
+}
+
 int AsyncSocket::setSendBufSize(size_t bufsize) {
   if (fd_ < 0) {
     VLOG(4) << "AsyncSocket::setSendBufSize() called on non-open socket "
@@ -1473,7 +1952,11 @@ void AsyncSocket::ioReady(uint16_t events) noexcept {
     return;
   }
 
-  if (relevantEvents == EventHandler::READ) {
+  // READ may only have been registered for the error queue.
+  relevantEvents &= eventFlags_;
+  if (relevantEvents == EventHandler::NONE) {
+    // Nothing else to do
+  } else if (relevantEvents == EventHandler::READ) {
     handleRead();
   } else if (relevantEvents == EventHandler::WRITE) {
     handleWrite();
@@ -1497,6 +1980,12 @@ void AsyncSocket::ioReady(uint16_t events) noexcept {
                << std::hex << events << "(this=" << this << ")";
     abort();
   }
+
+  // Writes may have left notifications to wait for, or the last one may
+  // have come in.
+  if (eventBase_ == originalEventBase) {
+    updateErrQueueRegistration();
+  }
 }
 
 AsyncSocket::ReadResult
@@ -1545,7 +2034,8 @@ void AsyncSocket::handleErrMessages() noexcept {
   // supporting per-socket error queues.
   VLOG(5) << "AsyncSocket::handleErrMessages() this=" << this << ", fd=" << fd_
           << ", state=" << state_;
-  if (errMessageCallback_ == nullptr) {
+  if (errMessageCallback_ == nullptr && byteEventCallback_ == nullptr &&
+      zeroCopyBufIds_.empty()) {
     VLOG(7) << "AsyncSocket::handleErrMessages(): "
             << "no callback installed - exiting.";
     return;
@@ -1568,7 +2058,10 @@ void AsyncSocket::handleErrMessages() noexcept {
   msg.msg_flags = 0;
 
   int ret;
-  while (true) {
+  std::chrono::system_clock::time_point timestamp;
+  while (fd_ != -1) {
+    msg.msg_controllen = sizeof(ctrl);
+    msg.msg_flags = 0;
     ret = recvmsg(fd_, &msg, MSG_ERRQUEUE);
     VLOG(5) << "AsyncSocket::handleErrMessages(): recvmsg returned " << ret;
 
@@ -1587,16 +2080,181 @@ void AsyncSocket::handleErrMessages() noexcept {
     }
 
     for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
-         cmsg != nullptr &&
-           cmsg->cmsg_len != 0 &&
-           errMessageCallback_ != nullptr;
+         cmsg != nullptr && cmsg->cmsg_len != 0;
          cmsg = CMSG_NXTHDR(&msg, cmsg)) {
-      errMessageCallback_->errMessage(*cmsg);
+      if (isZeroCopyMsg(*cmsg)) {
+        processZeroCopyMsg(*cmsg);
+      } else if (
+          !processByteEventMsg(*cmsg, timestamp) &&
+          errMessageCallback_ != nullptr) {
+        errMessageCallback_->errMessage(*cmsg);
+      }
+    }
+
+    if (errMessageCallback_ == nullptr && byteEventCallback_ == nullptr &&
+        zeroCopyBufIds_.empty()) {
+      return;
     }
   }
 #endif //MSG_ERRQUEUE
 }
 
+IOBuf* AsyncSocket::addZeroCopyBuf(std::unique_ptr<IOBuf>&& buf) {
+  IOBuf* ptr = buf.get();
+  auto& entry = zeroCopyBufs_[ptr];
+  DCHECK(!entry.buf);
+  entry.refs = 1;
+  entry.buf = std::move(buf);
+  return ptr;
+}
+
+void AsyncSocket::trackZeroCopySends(IOBuf* buf, uint32_t firstId) {
+  for (uint32_t id = firstId; id != zeroCopyBufId_; ++id) {
+    auto it = zeroCopyBufs_.find(buf);
+    if (it == zeroCopyBufs_.end()) {
+      return;
+    }
+    ++it->second.refs;
+    zeroCopyBufIds_[id] = buf;
+  }
+}
+
+void AsyncSocket::releaseZeroCopyBuf(IOBuf* buf) {
+  auto it = zeroCopyBufs_.find(buf);
+  // doClose() drops the bookkeeping at once
+  if (it == zeroCopyBufs_.end()) {
+    return;
+  }
+  if (--it->second.refs == 0) {
+    zeroCopyBufs_.erase(it);
+  }
+}
+
+bool AsyncSocket::isZeroCopyMsg(const cmsghdr& cmsg) const {
+#if defined(MSG_ZEROCOPY) && defined(__linux__)
+  // Leave the notifications to the ErrMessageCallback if the application
+  // passes MSG_ZEROCOPY itself.
+  if (!zeroCopyEnabled_ && zeroCopyBufIds_.empty()) {
+    return false;
+  }
+  if ((cmsg.cmsg_level == SOL_IP && cmsg.cmsg_type == IP_RECVERR) ||
+      (cmsg.cmsg_level == SOL_IPV6 && cmsg.cmsg_type == IPV6_RECVERR)) {
+    auto serr = reinterpret_cast<const struct sock_extended_err*>(
+        CMSG_DATA(&cmsg));
+    return serr->ee_errno == 0 && serr->ee_origin == SO_EE_ORIGIN_ZEROCOPY;
+  }
+#else
+  (void)cmsg;
+#endif
+  return false;
+}
+
+void AsyncSocket::processZeroCopyMsg(const cmsghdr& cmsg) {
+#if defined(MSG_ZEROCOPY) && defined(__linux__)
+  auto serr =
+      reinterpret_cast<const struct sock_extended_err*>(CMSG_DATA(&cmsg));
+  // The kernel coalesces notifications for consecutive sends into the
+  // inclusive range [ee_info, ee_data].
+  uint32_t hi = serr->ee_data;
+  uint32_t lo = serr->ee_info;
+  if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+    zeroCopyCopiedCount_ += hi - lo + 1;
+  }
+  for (uint32_t id = lo; id != hi + 1; ++id) {
+    auto it = zeroCopyBufIds_.find(id);
+    if (it == zeroCopyBufIds_.end()) {
+      continue;
+    }
+    auto buf = it->second;
+    zeroCopyBufIds_.erase(it);
+    releaseZeroCopyBuf(buf);
+  }
+#else
+  (void)cmsg;
+#endif
+}
+
+bool AsyncSocket::waitingForErrMessages() const {
+  // Zero copy completions release the IOBufs, and ACK timestamps are the
+  // last byte events the kernel reports for a write.
+  return !zeroCopyBufIds_.empty() ||
+      (byteEventsEnabled_ && byteEventsAcked_ < getRawBytesWritten());
+}
+
+bool AsyncSocket::needsErrQueueRegistration() const {
+  return state_ == StateEnum::ESTABLISHED &&
+      (eventFlags_ & EventHandler::READ) == 0 && waitingForErrMessages();
+}
+
+void AsyncSocket::updateErrQueueRegistration() {
+  if (needsErrQueueRegistration() != errQueueRegistered_) {
+    // updateEventRegistration() will move us into the error state if it
+    // fails
+    (void)updateEventRegistration();
+  }
+}
+
+bool AsyncSocket::processByteEventMsg(
+    const cmsghdr& cmsg,
+    std::chrono::system_clock::time_point& time) {
+#if FOLLY_HAVE_TX_TIMESTAMPING
+  if (byteEventCallback_ == nullptr || !byteEventsEnabled_) {
+    return false;
+  }
+  // The kernel sends the timestamp first, then the error describing which
+  // bytes and which stage it is for.
+  if (cmsg.cmsg_level == SOL_SOCKET && cmsg.cmsg_type == SCM_TIMESTAMPING) {
+    auto tss =
+        reinterpret_cast<const struct scm_timestamping*>(CMSG_DATA(&cmsg));
+    time = std::chrono::system_clock::time_point(
+        std::chrono::duration_cast<std::chrono::system_clock::duration>(
+            std::chrono::seconds(tss->ts[0].tv_sec) +
+            std::chrono::nanoseconds(tss->ts[0].tv_nsec)));
+    return true;
+  }
+  if ((cmsg.cmsg_level != SOL_IP || cmsg.cmsg_type != IP_RECVERR) &&
+      (cmsg.cmsg_level != SOL_IPV6 || cmsg.cmsg_type != IPV6_RECVERR)) {
+    return false;
+  }
+  auto serr =
+      reinterpret_cast<const struct sock_extended_err*>(CMSG_DATA(&cmsg));
+  if (serr->ee_errno != ENOMSG ||
+      serr->ee_origin != SO_EE_ORIGIN_TIMESTAMPING) {
+    return false;
+  }
+
+  ByteEventCallback::ByteEvent event;
+  switch (serr->ee_info) {
+    case SCM_TSTAMP_SCHED:
+      event.type = ByteEventCallback::Type::SCHED;
+      break;
+    case SCM_TSTAMP_SND:
+      event.type = ByteEventCallback::Type::TX;
+      break;
+    case SCM_TSTAMP_ACK:
+      event.type = ByteEventCallback::Type::ACK;
+      break;
+    default:
+      return true;
+  }
+  // ee_data is the low 32 bits of the index of the last byte covered, which
+  // can't be more than 4GB behind the last byte written.
+  uint64_t last = getRawBytesWritten() - byteEventOffset_ - 1;
+  event.offset =
+      byteEventOffset_ + last - uint32_t(uint32_t(last) - serr->ee_data);
+  event.time = time;
+  if (event.type == ByteEventCallback::Type::ACK) {
+    byteEventsAcked_ = std::max(byteEventsAcked_, event.offset + 1);
+  }
+  byteEventCallback_->byteEvent(event);
+  return true;
+#else
+  (void)cmsg;
+  (void)time;
+  return false;
+#endif // FOLLY_HAVE_TX_TIMESTAMPING
+}
+
 void AsyncSocket::handleRead() noexcept {
   VLOG(5) << "AsyncSocket::handleRead() this=" << this << ", fd=" << fd_
           << ", state=" << state_;
@@ -1611,6 +2269,11 @@ void AsyncSocket::handleRead() noexcept {
   // - the number of loop iterations exceeds the optional maximum
   // - this AsyncSocket is moved to another EventBase
   //
+  // When registered edge-triggered the loop must not stop before a read
+  // would block while the callback is still installed, or the data left in
+  // the socket would not be reported again.  A short read from the socket
+  // proves it's drained, a short read of pre-received data doesn't.
+  //
   // When we invoke readDataAvailable() it may uninstall the readCallback_,
   // which is why need to check for it here.
   //
@@ -1625,41 +2288,62 @@ void AsyncSocket::handleRead() noexcept {
   // readDataAvailable() returns.)
   uint16_t numReads = 0;
   EventBase* originalEventBase = eventBase_;
+  ReadBufferPool* pool = nullptr;
+  edgeReadPending_ = false;
   while (readCallback_ && eventBase_ == originalEventBase) {
     // Get the buffer to read into.
     void* buf = nullptr;
     size_t buflen = 0, offset = 0;
-    try {
-      prepareReadBuffer(&buf, &buflen);
-      VLOG(5) << "prepareReadBuffer() buf=" << buf << ", buflen=" << buflen;
-    } catch (const AsyncSocketException& ex) {
-      return failRead(__func__, ex);
-    } catch (const std::exception& ex) {
-      AsyncSocketException tex(AsyncSocketException::BAD_ARGS,
-                              string("ReadCallback::getReadBuffer() "
-                                     "threw exception: ") +
-                              ex.what());
-      return failRead(__func__, tex);
-    } catch (...) {
-      AsyncSocketException ex(AsyncSocketException::BAD_ARGS,
-                             "ReadCallback::getReadBuffer() threw "
-                             "non-exception type");
-      return failRead(__func__, ex);
-    }
-    if (!isBufferMovable_ && (buf == nullptr || buflen == 0)) {
-      AsyncSocketException ex(AsyncSocketException::BAD_ARGS,
-                             "ReadCallback::getReadBuffer() returned "
-                             "empty buffer");
-      return failRead(__func__, ex);
+    std::unique_ptr<uint8_t[]> slab;
+    if (pooledReads_ && !isBufferMovable_ &&
+        readCallback_->isBufferMovable()) {
+      if (!pool) {
+        pool = &ReadBufferPool::get(*eventBase_);
+      }
+      slab = pool->acquire();
+      buf = slab.get();
+      buflen = std::min(pool->getSlabSize(), readCallback_->maxBufferSize());
+    } else {
+      try {
+        prepareReadBuffer(&buf, &buflen);
+        VLOG(5) << "prepareReadBuffer() buf=" << buf << ", buflen=" << buflen;
+      } catch (const AsyncSocketException& ex) {
+        return failRead(__func__, ex);
+      } catch (const std::exception& ex) {
+        AsyncSocketException tex(AsyncSocketException::BAD_ARGS,
+                                string("ReadCallback::getReadBuffer() "
+                                       "threw exception: ") +
+                                ex.what());
+        return failRead(__func__, tex);
+      } catch (...) {
+        AsyncSocketException ex(AsyncSocketException::BAD_ARGS,
+                               "ReadCallback::getReadBuffer() threw "
+                               "non-exception type");
+        return failRead(__func__, ex);
+      }
+      if (!isBufferMovable_ && (buf == nullptr || buflen == 0)) {
+        AsyncSocketException ex(AsyncSocketException::BAD_ARGS,
+                               "ReadCallback::getReadBuffer() returned "
+                               "empty buffer");
+        return failRead(__func__, ex);
+      }
     }
 
     // Perform the read
+    bool preReceived = preReceivedData_ && !preReceivedData_->empty();
     auto readResult = performRead(&buf, &buflen, &offset);
     auto bytesRead = readResult.readReturn;
     VLOG(4) << "this=" << this << ", AsyncSocket::handleRead() got "
             << bytesRead << " bytes";
+    if (slab && bytesRead <= 0) {
+      pool->release(std::move(slab), 0);
+    }
     if (bytesRead > 0) {
-      if (!isBufferMovable_) {
+      if (slab) {
+        // Give the slab back before the callback can read another socket.
+        auto readBuf = pool->release(std::move(slab), size_t(bytesRead));
+        readCallback_->readBufferAvailable(std::move(readBuf));
+      } else if (!isBufferMovable_) {
         readCallback_->readDataAvailable(size_t(bytesRead));
       } else {
         CHECK(kOpenSslModeMoveBufferOwnership);
@@ -1676,7 +2360,7 @@ void AsyncSocket::handleRead() noexcept {
       // completely filled the available buffer.
       // Note that readCallback_ may have been uninstalled or changed inside
       // readDataAvailable().
-      if (size_t(bytesRead) < buflen) {
+      if (size_t(bytesRead) < buflen && !(edgeTriggered_ && preReceived)) {
         return;
       }
     } else if (bytesRead == READ_BLOCKING) {
@@ -1714,6 +2398,8 @@ void AsyncSocket::handleRead() noexcept {
       if (readCallback_ != nullptr) {
         // We might still have data in the socket.
         // (e.g. see comment in AsyncSSLSocket::checkForImmediateRead)
+        // An edge-triggered registration won't tell us about it again.
+        edgeReadPending_ = edgeTriggered_;
         scheduleImmediateRead();
       }
       return;
@@ -1875,8 +2561,12 @@ void AsyncSocket::checkForImmediateRead() noexcept {
   // find out from libevent on the next event loop doesn't seem that bad.
   //
   // The exception to this is if we have pre-received data. In that case there
-  // is definitely data available immediately.
-  if (preReceivedData_ && !preReceivedData_->empty()) {
+  // is definitely data available immediately.  The same goes for an
+  // edge-triggered socket that handleRead() stopped reading at
+  // maxReadsPerEvent_.
+  if ((preReceivedData_ && !preReceivedData_->empty()) ||
+      (edgeReadPending_ && readCallback_ &&
+       (eventFlags_ & EventHandler::READ))) {
     handleRead();
   }
 }
@@ -2129,6 +2819,10 @@ AsyncSocket::WriteResult AsyncSocket::performWrite(
   }
   int msg_flags = sendMsgParamCallback_->getFlags(flags);
 
+  std::chrono::system_clock::time_point writeTime;
+  if (byteEventCallback_ != nullptr) {
+    writeTime = std::chrono::system_clock::now();
+  }
   auto writeResult = sendSocketMessage(fd_, &msg, msg_flags);
   auto totalWritten = writeResult.writeReturn;
   if (totalWritten < 0) {
@@ -2153,6 +2847,19 @@ AsyncSocket::WriteResult AsyncSocket::performWrite(
   }
 
   appBytesWritten_ += totalWritten;
+  if (byteEventCallback_ != nullptr && totalWritten > 0) {
+    ByteEventCallback::ByteEvent event;
+    event.type = ByteEventCallback::Type::WRITE;
+    event.offset = appBytesWritten_ - 1;
+    event.time = writeTime;
+    byteEventCallback_->byteEvent(event);
+  }
+#ifdef MSG_ZEROCOPY
+  if (zeroCopyEnabled_ && (msg_flags & MSG_ZEROCOPY) && totalWritten > 0) {
+    // the kernel numbers every successful zero copy send
+    ++zeroCopyBufId_;
+  }
+#endif // MSG_ZEROCOPY
 
   uint32_t bytesWritten;
   uint32_t n;
@@ -2188,16 +2895,31 @@ bool AsyncSocket::updateEventRegistration() {
           << ", fd=" << fd_ << ", evb=" << eventBase_ << ", state=" << state_
           << ", events=" << std::hex << eventFlags_;
   eventBase_->dcheckIsInEventBaseThread();
-  if (eventFlags_ == EventHandler::NONE) {
+  errQueueRegistered_ = needsErrQueueRegistration();
+  if (eventFlags_ == EventHandler::NONE && !errQueueRegistered_) {
     ioHandler_.unregisterHandler();
     return true;
   }
 
   // Always register for persistent events, so we don't have to re-register
   // after being called back.
-  if (!ioHandler_.registerHandler(
-          uint16_t(eventFlags_ | EventHandler::PERSIST))) {
+  auto events = uint16_t(eventFlags_ | EventHandler::PERSIST);
+  if (errQueueRegistered_) {
+    events |= EventHandler::READ;
+  }
+#ifdef EV_ET
+  edgeTriggered_ = eventBase_->getBackend()->preferEdgeTriggered() &&
+      supportsEdgeTriggeredReads();
+  // Edge-triggered when READ is only for the error queue, so that data
+  // nobody reads yet doesn't wake us up on every loop.  Backends that don't
+  // honor EDGE do, until the last notification is in.
+  if (edgeTriggered_ || errQueueRegistered_) {
+    events |= EventHandler::EDGE;
+  }
+#endif
+  if (!ioHandler_.registerHandler(events)) {
     eventFlags_ = EventHandler::NONE; // we're not registered after error
+    errQueueRegistered_ = false;
     AsyncSocketException ex(AsyncSocketException::INTERNAL_ERROR,
         withAddr("failed to update AsyncSocket event registration"));
     fail("updateEventRegistration", ex);
@@ -2228,8 +2950,9 @@ void AsyncSocket::startFail() {
   // so all future attempts to read or write will be rejected
   shutdownFlags_ |= (SHUT_READ | SHUT_WRITE);
 
-  if (eventFlags_ != EventHandler::NONE) {
+  if (eventFlags_ != EventHandler::NONE || errQueueRegistered_) {
     eventFlags_ = EventHandler::NONE;
+    errQueueRegistered_ = false;
     ioHandler_.unregisterHandler();
   }
   writeTimeout_.cancelTimeout();
@@ -2316,10 +3039,20 @@ void AsyncSocket::failErrMessageRead(const char* fn,
     errMessageCallback_ = nullptr;
     callback->errMessageError(ex);
   }
+  failByteEvents(ex);
 
   finishFail();
 }
 
+void AsyncSocket::failByteEvents(const AsyncSocketException& ex) {
+  if (byteEventCallback_ != nullptr) {
+    ByteEventCallback* callback = byteEventCallback_;
+    byteEventCallback_ = nullptr;
+    applyByteEvents();
+    callback->byteEventError(ex);
+  }
+}
+
 void AsyncSocket::failWrite(const char* fn, const AsyncSocketException& ex) {
   VLOG(5) << "AsyncSocket(this=" << this << ", fd=" << fd_ << ", state="
                << state_ << " host=" << addr_.describe()
@@ -2441,6 +3174,14 @@ void AsyncSocket::invokeConnectErr(const AsyncSocketException& ex) {
 
 void AsyncSocket::invokeConnectSuccess() {
   connectEndTime_ = std::chrono::steady_clock::now();
+  if (byteEventCallback_ != nullptr && state_ == StateEnum::ESTABLISHED &&
+      !applyByteEvents()) {
+    auto errnoCopy = errno;
+    failByteEvents(AsyncSocketException(
+        AsyncSocketException::INTERNAL_ERROR,
+        withAddr("failed to enable SO_TIMESTAMPING"),
+        errnoCopy));
+  }
   if (connectCallback_) {
     ConnectCallback* callback = connectCallback_;
     connectCallback_ = nullptr;
@@ -2496,6 +3237,20 @@ void AsyncSocket::doClose() {
     ::close(fd_);
   }
   fd_ = -1;
+
+  // Completions can't be received any more, but the kernel may still be
+  // sending (or retransmitting) from the buffers of the sends that weren't
+  // acknowledged, so those stay allocated until we are destroyed.
+  for (const auto& id : zeroCopyBufIds_) {
+    auto it = zeroCopyBufs_.find(id.second);
+    if (it != zeroCopyBufs_.end() && it->second.buf) {
+      closedZeroCopyBufs_.push_back(std::move(it->second.buf));
+    }
+  }
+  zeroCopyBufIds_.clear();
+  zeroCopyBufs_.clear();
+  zeroCopyBufId_ = 0;
+  byteEventsEnabled_ = false;
 }
 
 std::ostream& operator << (std::ostream& os,
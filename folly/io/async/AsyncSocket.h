@@ -33,6 +33,8 @@
 #include <chrono>
 #include <map>
 #include <memory>
+#include <unordered_map>
+#include <vector>
 
 namespace folly {
 
@@ -143,6 +145,51 @@ class AsyncSocket : virtual public AsyncTransportWrapper {
     virtual void errMessageError(const AsyncSocketException& ex) noexcept = 0;
   };
 
+  /**
+   * Receives the timestamps of the bytes written to the socket, once
+   * installed with setByteEventCallback().
+   *
+   * Each event covers every byte of the stream up to and including offset,
+   * counted like getRawBytesWritten() (the first byte written has offset 0).
+   * A write's bytes have reached a stage once an event of that type reports
+   * an offset at or past the write's last byte.  WRITE is reported by the
+   * socket when it hands the bytes to the kernel, SCHED by the kernel when
+   * they enter the packet scheduler, TX when they are passed to the device,
+   * and ACK when the peer has acknowledged all of them.  Together they split
+   * a response's latency into time queued in the socket, in the kernel and
+   * on the network.
+   *
+   * WRITE events are only reported by sockets that do their own writes
+   * (not by AsyncSSLSocket), and from within the write path: byteEvent()
+   * must not write to, close or detach the socket.
+   */
+  class ByteEventCallback {
+   public:
+    enum class Type : uint8_t {
+      WRITE,
+      SCHED,
+      TX,
+      ACK,
+    };
+
+    struct ByteEvent {
+      Type type;
+      uint64_t offset;
+      // The kernel's timestamps use the realtime clock
+      std::chrono::system_clock::time_point time;
+    };
+
+    virtual ~ByteEventCallback() = default;
+
+    virtual void byteEvent(const ByteEvent& event) noexcept = 0;
+
+    /**
+     * Kernel timestamping could not be enabled, or the error queue could
+     * not be read.  The callback has been uninstalled.
+     */
+    virtual void byteEventError(const AsyncSocketException& ex) noexcept = 0;
+  };
+
   class SendMsgParamsCallback {
    public:
     virtual ~SendMsgParamsCallback() = default;
@@ -468,6 +515,25 @@ class AsyncSocket : virtual public AsyncTransportWrapper {
     return maxReadsPerEvent_;
   }
 
+  /**
+   * Read into the slab of the EventBase's ReadBufferPool instead of a buffer
+   * from ReadCallback::getReadBuffer(), and pass each read on through
+   * readBufferAvailable() in an IOBuf that fits the data.
+   *
+   * This costs a copy per read, but the socket no longer makes its callback
+   * set aside a read buffer that then sits mostly empty, which is what
+   * limits servers with many idle connections.  Only applies while the read
+   * callback's isBufferMovable() returns true; other callbacks keep using
+   * getReadBuffer().
+   */
+  void setPooledReads(bool pooled) {
+    pooledReads_ = pooled;
+  }
+
+  bool getPooledReads() const {
+    return pooledReads_;
+  }
+
   /**
    * Set a pointer to ErrMessageCallback implementation which will be
    * receiving notifications for messages posted to the error queue
@@ -486,6 +552,25 @@ class AsyncSocket : virtual public AsyncTransportWrapper {
    */
   virtual ErrMessageCallback* getErrMessageCallback() const;
 
+  /**
+   * Install a ByteEventCallback, enabling SO_TIMESTAMPING on the socket
+   * (Linux only), or uninstall it with nullptr.
+   *
+   * Kernel timestamps are read from the same error queue as the messages for
+   * ErrMessageCallback.  The socket stays registered for events until every
+   * byte written has been ACKed, so the events arrive without a read
+   * callback installed.  If the socket is not connected yet,
+   * timestamping is enabled once it is; TCP fast open is not supported.
+   *
+   * @return false if kernel timestamping is not supported or could not be
+   *         enabled, in which case no callback is installed.
+   */
+  bool setByteEventCallback(ByteEventCallback* callback);
+
+  ByteEventCallback* getByteEventCallback() const {
+    return byteEventCallback_;
+  }
+
   /**
    * Set a pointer to SendMsgParamsCallback implementation which
    * will be used to form ::sendmsg() system call parameters
@@ -500,6 +585,58 @@ class AsyncSocket : virtual public AsyncTransportWrapper {
    */
   virtual SendMsgParamsCallback* getSendMsgParamsCB() const;
 
+  /**
+   * Enable or disable MSG_ZEROCOPY (Linux 4.14+) for writeChain().
+   *
+   * With zero copy enabled, writeChain() calls whose chain holds at least
+   * getZeroCopyWriteChainThreshold() bytes, or which pass
+   * WriteFlags::WRITE_MSG_ZEROCOPY, hand the IOBufs' memory to the kernel
+   * instead of copying it.  The socket keeps the IOBufs alive until the
+   * completion notifications arrive on the socket's error queue, which may
+   * be well after writeSuccess() has been invoked; isZeroCopyWriteInProgress()
+   * tells whether any are still held.  The IOBufs must therefore not be
+   * modified through other references after they are written.  The socket
+   * stays registered for the notifications while any are outstanding, also
+   * when no read callback is installed.
+   *
+   * May be called before connect(), in which case it takes effect once the
+   * socket has been created.
+   *
+   * @return false if zero copy is not supported for this socket.
+   */
+  bool setZeroCopy(bool enable);
+
+  bool getZeroCopy() const {
+    return zeroCopyEnabled_;
+  }
+
+  /**
+   * Smaller writeChain() calls are copied as usual: below a few pages the
+   * page pinning and completion handling cost more than the copy.
+   */
+  void setZeroCopyWriteChainThreshold(size_t threshold) {
+    zeroCopyWriteChainThreshold_ = threshold;
+  }
+
+  size_t getZeroCopyWriteChainThreshold() const {
+    return zeroCopyWriteChainThreshold_;
+  }
+
+  bool isZeroCopyWriteInProgress() const {
+    return !zeroCopyBufs_.empty();
+  }
+
+  /**
+   * Number of zero copy completions for which the kernel reported that it
+   * copied the data after all (e.g. over loopback, or when the device
+   * can't do scatter-gather), in which case zero copy only adds overhead.
+   */
+  size_t getZeroCopyCopiedCount() const {
+    return zeroCopyCopiedCount_;
+  }
+
+  static constexpr size_t kDefaultZeroCopyWriteChainThreshold = 64 * 1024;
+
   // Read and write methods
   void setReadCB(ReadCallback* callback) override;
   ReadCallback* getReadCallback() const override;
@@ -512,6 +649,36 @@ class AsyncSocket : virtual public AsyncTransportWrapper {
                   std::unique_ptr<folly::IOBuf>&& buf,
                   WriteFlags flags = WriteFlags::NONE) override;
 
+  /**
+   * Write length bytes read from fd to the socket without copying them
+   * through userspace, using sendfile() for a regular file and splice() for
+   * a pipe.
+   *
+   * For a regular file, a non-negative offset reads from that offset and
+   * leaves the file position alone, while -1 reads from (and advances) the
+   * current position.  A pipe is always read from its head, so offset must
+   * be -1, and it must already hold length bytes, or receive them while the
+   * socket drains: splice() can't wait for data, so a write that finds the
+   * pipe empty fails rather than spinning.  Running into EOF before length
+   * bytes is reported as an END_OF_FILE write error.
+   *
+   * The write is ordered with, and completes like, any other write; fd must
+   * stay open until callback has been invoked.
+   *
+   * Unlike sendmsg(), sendfile() and splice() cannot suppress SIGPIPE, so
+   * the caller must block or ignore SIGPIPE before using this; otherwise a
+   * peer that resets the connection kills the process.
+   *
+   * Where the data can't bypass userspace (on other platforms than Linux,
+   * or when canWriteFromFdInKernel() says so), it is read in chunks of at
+   * most 64KB, each read only once the previous one has been written.
+   */
+  virtual void writeFromFd(WriteCallback* callback,
+                           int fd,
+                           off_t offset,
+                           size_t length,
+                           WriteFlags flags = WriteFlags::NONE);
+
   class WriteRequest;
   virtual void writeRequest(WriteRequest* req);
   void writeRequestReady() {
@@ -656,6 +823,17 @@ class AsyncSocket : virtual public AsyncTransportWrapper {
    */
   int setQuickAck(bool quickack);
 
+  /*
+   * Have the kernel busy-poll the device queue for up to timeout before a
+   * read from this socket finds it empty (SO_BUSY_POLL).  Complements
+   * EventBase::setBusyPollBudget(), which spins in userspace.  Raising the
+   * value above net.core.busy_read requires CAP_NET_ADMIN.
+   *
+   * @return Returns 0 if SO_BUSY_POLL was successfully updated,
+   *         or a non-zero errno value on error.
+   */
+  int setBusyPoll(std::chrono::microseconds timeout);
+
   /**
    * Set the send bufsize
    */
@@ -927,6 +1105,7 @@ class AsyncSocket : virtual public AsyncTransportWrapper {
   };
 
   class BytesWriteRequest;
+  class FdWriteRequest;
 
   class WriteTimeout : public AsyncTimeout {
    public:
@@ -999,6 +1178,14 @@ class AsyncSocket : virtual public AsyncTransportWrapper {
   // event notification methods
   void ioReady(uint16_t events) noexcept;
   virtual void checkForImmediateRead() noexcept;
+  /**
+   * Whether handleRead() drains the socket whenever it returns with the read
+   * callback still installed, so that the fd may be registered
+   * edge-triggered with backends that prefer it.
+   */
+  virtual bool supportsEdgeTriggeredReads() const noexcept {
+    return true;
+  }
   virtual void handleInitialReadWrite() noexcept;
   virtual void prepareReadBuffer(void** buf, size_t* buflen);
   virtual void handleErrMessages() noexcept;
@@ -1051,6 +1238,12 @@ class AsyncSocket : virtual public AsyncTransportWrapper {
                  std::unique_ptr<folly::IOBuf>&& buf,
                  WriteFlags flags = WriteFlags::NONE);
 
+  /**
+   * Append req to the write queue, first registering for write events and
+   * starting the send timeout if mustRegister is set.
+   */
+  void queueWriteRequest(WriteRequest* req, bool mustRegister);
+
   /**
    * Attempt to write to the socket.
    *
@@ -1073,6 +1266,15 @@ class AsyncSocket : virtual public AsyncTransportWrapper {
       uint32_t* countWritten,
       uint32_t* partialWritten);
 
+  /**
+   * Whether writeFromFd() may move its data straight from the source to the
+   * socket with sendfile()/splice().  When this returns false, the data is
+   * read through userspace instead and written with performWrite().
+   */
+  virtual bool canWriteFromFdInKernel() const {
+    return true;
+  }
+
   /**
    * Sends the message over the socket using sendmsg
    *
@@ -1130,6 +1332,37 @@ class AsyncSocket : virtual public AsyncTransportWrapper {
 
   std::string withAddr(const std::string& s);
 
+  // MSG_ZEROCOPY bookkeeping. Each successful sendmsg() with MSG_ZEROCOPY
+  // is assigned the next id by the kernel; the IOBuf it sent from is kept
+  // in zeroCopyBufs_ until the write request is done with it and every id
+  // referring to it has been acknowledged on the error queue.
+  struct ZeroCopyBuf {
+    size_t refs{0};
+    std::unique_ptr<IOBuf> buf;
+  };
+  bool applyZeroCopy();
+  IOBuf* addZeroCopyBuf(std::unique_ptr<IOBuf>&& buf);
+  void trackZeroCopySends(IOBuf* buf, uint32_t firstId);
+  void releaseZeroCopyBuf(IOBuf* buf);
+  bool isZeroCopyMsg(const cmsghdr& cmsg) const;
+  void processZeroCopyMsg(const cmsghdr& cmsg);
+
+  // The error queue is only reported through READ events, so we stay
+  // registered for READ while notifications we depend on are outstanding,
+  // even without a read callback.
+  bool waitingForErrMessages() const;
+  bool needsErrQueueRegistration() const;
+  void updateErrQueueRegistration();
+
+  // Kernel timestamps (SO_TIMESTAMPING with SOF_TIMESTAMPING_OPT_ID) identify
+  // bytes by their index since timestamping was enabled, modulo 2^32;
+  // byteEventOffset_ is the stream offset of index 0.
+  bool applyByteEvents();
+  bool processByteEventMsg(
+      const cmsghdr& cmsg,
+      std::chrono::system_clock::time_point& time);
+  void failByteEvents(const AsyncSocketException& ex);
+
   void cacheLocalAddress() const;
   void cachePeerAddress() const;
 
@@ -1158,6 +1391,10 @@ class AsyncSocket : virtual public AsyncTransportWrapper {
   size_t appBytesReceived_;              ///< Num of bytes received from socket
   size_t appBytesWritten_;               ///< Num of bytes written to socket
   bool isBufferMovable_{false};
+  bool pooledReads_{false};              ///< Read through ReadBufferPool
+  bool edgeTriggered_{false};            ///< Registered with EventHandler::EDGE
+  bool edgeReadPending_{false};          ///< Stopped reading before EAGAIN
+  bool errQueueRegistered_{false};       ///< READ only for the error queue
 
   // Pre-received data, to be returned to read callback before any data from the
   // socket.
@@ -1179,6 +1416,21 @@ class AsyncSocket : virtual public AsyncTransportWrapper {
   // Whether to track EOR or not.
   bool trackEor_{false};
 
+  bool zeroCopyRequested_{false};
+  bool zeroCopyEnabled_{false};
+  size_t zeroCopyWriteChainThreshold_{kDefaultZeroCopyWriteChainThreshold};
+  uint32_t zeroCopyBufId_{0};            ///< id of the next zero copy send
+  size_t zeroCopyCopiedCount_{0};
+  std::unordered_map<uint32_t, IOBuf*> zeroCopyBufIds_;
+  std::unordered_map<IOBuf*, ZeroCopyBuf> zeroCopyBufs_;
+  // Buffers of sends still unacknowledged when the socket was closed
+  std::vector<std::unique_ptr<IOBuf>> closedZeroCopyBufs_;
+
+  ByteEventCallback* byteEventCallback_{nullptr};
+  bool byteEventsEnabled_{false};        ///< SO_TIMESTAMPING is set on fd_
+  uint64_t byteEventOffset_{0};
+  uint64_t byteEventsAcked_{0};          ///< end of the bytes ACKed so far
+
   std::unique_ptr<EvbChangeCallback> evbChangeCb_{nullptr};
 };
 #ifdef _MSC_VER
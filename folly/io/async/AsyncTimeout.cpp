@@ -153,7 +153,7 @@ void AsyncTimeout::libeventCallback(libevent_fd_t fd, short events, void* arg) {
 
   RequestContextScopeGuard rctx(timeout->context_);
 
-  timeout->timeoutExpired();
+  timeout->timeoutManager_->runTimeout(timeout);
 }
 
 } // namespace folly
@@ -60,6 +60,12 @@ enum class WriteFlags : uint32_t {
    * this indicates that only the write side of socket should be shutdown
    */
   WRITE_SHUTDOWN = 0x04,
+  /*
+   * Send with MSG_ZEROCOPY. Only honored by AsyncSocket::writeChain() on a
+   * socket with zero copy enabled, which keeps the IOBufs alive until the
+   * kernel reports that it is done with them.
+   */
+  WRITE_MSG_ZEROCOPY = 0x08,
 };
 
 /*
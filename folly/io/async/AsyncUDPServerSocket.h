@@ -95,6 +95,14 @@ class AsyncUDPServerSocket : private AsyncUDPSocket::ReadCallback
     reusePort_ = reusePort;
   }
 
+  /**
+   * Read up to this many packets per wakeup with a single recvmmsg() call.
+   * Must be set before listen().
+   */
+  void setReadBatchSize(size_t readBatchSize) {
+    readBatchSize_ = readBatchSize;
+  }
+
   folly::SocketAddress address() const {
     CHECK(socket_);
     return socket_->address();
@@ -122,6 +130,7 @@ class AsyncUDPServerSocket : private AsyncUDPSocket::ReadCallback
       });
     }
 
+    socket_->setMaxReadDatagramSize(packetSize_);
     socket_->resumeRead(this);
   }
 
@@ -151,8 +160,24 @@ class AsyncUDPServerSocket : private AsyncUDPSocket::ReadCallback
       size_t len,
       bool truncated) noexcept override {
     buf_.postallocate(len);
-    auto data = buf_.split(len);
+    dispatch(clientAddress, buf_.split(len), truncated);
+  }
 
+  size_t getReadBatchSize() noexcept override {
+    return readBatchSize_;
+  }
+
+  void onDatagramsAvailable(
+      std::vector<AsyncUDPSocket::Datagram>& datagrams) noexcept override {
+    for (auto& datagram : datagrams) {
+      dispatch(datagram.client, std::move(datagram.data), datagram.truncated);
+    }
+  }
+
+  void dispatch(
+      const folly::SocketAddress& clientAddress,
+      std::unique_ptr<folly::IOBuf> data,
+      bool truncated) noexcept {
     if (listeners_.empty()) {
       LOG(WARNING) << "UDP server socket dropping packet, "
                    << "no listener registered";
@@ -216,6 +241,7 @@ class AsyncUDPServerSocket : private AsyncUDPSocket::ReadCallback
   folly::IOBufQueue buf_;
 
   bool reusePort_{false};
+  size_t readBatchSize_{1};
 };
 
 } // namespace folly
@@ -24,16 +24,118 @@
 
 #include <errno.h>
 
+#include <algorithm>
+
 // Due to the way kernel headers are included, this may or may not be defined.
 // Number pulled from 3.10 kernel headers.
 #ifndef SO_REUSEPORT
 #define SO_REUSEPORT 15
 #endif
 
+#ifdef __linux__
+// UDP_SEGMENT (Linux 4.18) and UDP_GRO (Linux 5.0) may be newer than the
+// libc headers.
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#endif
+
 namespace fsp = folly::portability::sockets;
 
 namespace folly {
 
+namespace {
+
+#ifdef __linux__
+using MMsgHdr = struct ::mmsghdr;
+#else
+struct MMsgHdr {
+  struct msghdr msg_hdr;
+  unsigned int msg_len;
+};
+#endif
+
+// Same as ::recvmmsg/::sendmmsg, emulated with one syscall per message
+// where they don't exist.
+int recvmmsgCompat(int fd, MMsgHdr* msgs, unsigned int n, int flags) {
+#ifdef __linux__
+  return ::recvmmsg(fd, msgs, n, flags, nullptr);
+#else
+  for (unsigned int i = 0; i < n; ++i) {
+    auto ret = recvmsg(fd, &msgs[i].msg_hdr, flags);
+    if (ret < 0) {
+      return i > 0 ? int(i) : -1;
+    }
+    msgs[i].msg_len = static_cast<unsigned int>(ret);
+  }
+  return int(n);
+#endif
+}
+
+int sendmmsgCompat(int fd, MMsgHdr* msgs, unsigned int n, int flags) {
+#ifdef __linux__
+  return ::sendmmsg(fd, msgs, n, flags);
+#else
+  for (unsigned int i = 0; i < n; ++i) {
+    auto ret = sendmsg(fd, &msgs[i].msg_hdr, flags);
+    if (ret < 0) {
+      return i > 0 ? int(i) : -1;
+    }
+    msgs[i].msg_len = static_cast<unsigned int>(ret);
+  }
+  return int(n);
+#endif
+}
+
+// Enough for the one int of UDP_GRO
+constexpr size_t kReadBatchControlSize = CMSG_SPACE(sizeof(int));
+// recvmmsg() and sendmmsg() don't take more than UIO_MAXIOV messages
+constexpr size_t kMaxBatchSize = 1024;
+
+} // namespace
+
+// Scratch space for batched reads, kept across reads of the same size.
+struct AsyncUDPSocket::ReadBatch {
+  ReadBatch(size_t n, size_t size)
+      : datagramSize(size),
+        msgs(n),
+        iovs(n),
+        addrs(n),
+        control(n * kReadBatchControlSize),
+        bufs(n) {}
+
+  size_t datagramSize;
+  std::vector<MMsgHdr> msgs;
+  std::vector<struct iovec> iovs;
+  std::vector<struct sockaddr_storage> addrs;
+  std::vector<char> control;
+  // One buffer of datagramSize per message; empty once handed out.
+  std::vector<std::unique_ptr<IOBuf>> bufs;
+};
+
+void AsyncUDPSocket::ReadCallback::onDatagramsAvailable(
+    std::vector<Datagram>& datagrams) noexcept {
+  for (auto& datagram : datagrams) {
+    void* buf = nullptr;
+    size_t len = 0;
+    getReadBuffer(&buf, &len);
+    if (buf == nullptr) {
+      continue;
+    }
+    auto data = datagram.data->coalesce();
+    bool truncated = datagram.truncated || data.size() > len;
+    len = std::min(len, data.size());
+    memcpy(buf, data.data(), len);
+    onDataAvailable(datagram.client, len, truncated);
+  }
+}
+
 AsyncUDPSocket::AsyncUDPSocket(EventBase* evb)
     : EventHandler(CHECK_NOTNULL(evb)),
       readCallback_(nullptr),
@@ -179,6 +281,104 @@ ssize_t AsyncUDPSocket::writev(const folly::SocketAddress& address,
   return sendmsg(fd_, &msg, 0);
 }
 
+int AsyncUDPSocket::writem(const folly::SocketAddress& address,
+                           const std::unique_ptr<folly::IOBuf>* bufs,
+                           size_t count) {
+  CHECK_NE(-1, fd_) << "Socket not yet bound";
+  count = std::min(count, kMaxBatchSize);
+  if (count == 0) {
+    return 0;
+  }
+
+  sockaddr_storage addrStorage;
+  address.getAddress(&addrStorage);
+
+  size_t numIovecs = 0;
+  for (size_t i = 0; i < count; ++i) {
+    numIovecs += bufs[i]->countChainElements();
+  }
+  std::vector<struct iovec> iovs(numIovecs);
+  std::vector<MMsgHdr> msgs(count);
+
+  size_t iovIndex = 0;
+  for (size_t i = 0; i < count; ++i) {
+    auto& msg = msgs[i].msg_hdr;
+    size_t iovecLen = bufs[i]->fillIov(
+        iovs.data() + iovIndex, bufs[i]->countChainElements());
+    msg.msg_name = reinterpret_cast<void*>(&addrStorage);
+    msg.msg_namelen = address.getActualSize();
+    msg.msg_iov = iovs.data() + iovIndex;
+    msg.msg_iovlen = iovecLen;
+    msg.msg_control = nullptr;
+    msg.msg_controllen = 0;
+    msg.msg_flags = 0;
+    iovIndex += iovecLen;
+  }
+
+  return sendmmsgCompat(fd_, msgs.data(), static_cast<unsigned int>(count), 0);
+}
+
+ssize_t AsyncUDPSocket::writeGSO(const folly::SocketAddress& address,
+                                 const std::unique_ptr<folly::IOBuf>& buf,
+                                 int gsoSize) {
+  if (gsoSize <= 0) {
+    return write(address, buf);
+  }
+#ifdef __linux__
+  CHECK_NE(-1, fd_) << "Socket not yet bound";
+
+  // A GSO train may be up to 64KB, so don't cap the chain length like
+  // write() does.
+  std::vector<struct iovec> vec(buf->countChainElements());
+  size_t iovecLen = buf->fillIov(vec.data(), vec.size());
+
+  sockaddr_storage addrStorage;
+  address.getAddress(&addrStorage);
+
+  union {
+    char buf[CMSG_SPACE(sizeof(uint16_t))];
+    struct cmsghdr align;
+  } control;
+  memset(&control, 0, sizeof(control));
+
+  struct msghdr msg;
+  msg.msg_name = reinterpret_cast<void*>(&addrStorage);
+  msg.msg_namelen = address.getActualSize();
+  msg.msg_iov = vec.data();
+  msg.msg_iovlen = iovecLen;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+  msg.msg_flags = 0;
+
+  struct cmsghdr* cm = CMSG_FIRSTHDR(&msg);
+  cm->cmsg_level = SOL_UDP;
+  cm->cmsg_type = UDP_SEGMENT;
+  cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+  uint16_t segmentSize = static_cast<uint16_t>(gsoSize);
+  memcpy(CMSG_DATA(cm), &segmentSize, sizeof(segmentSize));
+
+  return sendmsg(fd_, &msg, 0);
+#else
+  errno = ENOTSUP;
+  return -1;
+#endif
+}
+
+bool AsyncUDPSocket::setGRO(bool enabled) {
+#ifdef __linux__
+  CHECK_NE(-1, fd_) << "Socket not yet bound";
+  int value = enabled ? 1 : 0;
+  if (setsockopt(fd_, SOL_UDP, UDP_GRO, &value, sizeof(value)) != 0) {
+    return false;
+  }
+  gro_ = enabled;
+  return true;
+#else
+  (void)enabled;
+  return false;
+#endif
+}
+
 void AsyncUDPSocket::resumeRead(ReadCallback* cob) {
   CHECK(!readCallback_) << "Another read callback already installed";
   CHECK_NE(-1, fd_) << "UDP server socket not yet bind to an address";
@@ -228,6 +428,11 @@ void AsyncUDPSocket::handlerReady(uint16_t events) noexcept {
 }
 
 void AsyncUDPSocket::handleRead() noexcept {
+  size_t batchSize = readCallback_->getReadBatchSize();
+  if (batchSize > 1) {
+    return handleReadBatch(std::min(batchSize, kMaxBatchSize));
+  }
+
   void* buf{nullptr};
   size_t len{0};
 
@@ -256,35 +461,118 @@ void AsyncUDPSocket::handleRead() noexcept {
   if (bytesRead >= 0) {
     clientAddress_.setFromSockaddr(rawAddr, addrLen);
 
-    if (bytesRead > 0) {
-      bool truncated = false;
-      if ((size_t)bytesRead > len) {
-        truncated = true;
-        bytesRead = ssize_t(len);
-      }
-
-      readCallback_->onDataAvailable(
-          clientAddress_, size_t(bytesRead), truncated);
+    bool truncated = false;
+    if ((size_t)bytesRead > len) {
+      truncated = true;
+      bytesRead = ssize_t(len);
     }
+
+    readCallback_->onDataAvailable(
+        clientAddress_, size_t(bytesRead), truncated);
   } else {
     if (errno == EAGAIN || errno == EWOULDBLOCK) {
       // No data could be read without blocking the socket
       return;
     }
 
-    AsyncSocketException ex(AsyncSocketException::INTERNAL_ERROR,
-                           "::recvfrom() failed",
-                           errno);
+    failRead("::recvfrom() failed", errno);
+  }
+}
 
-    // In case of UDP we can continue reading from the socket
-    // even if the current request fails. We notify the user
-    // so that he can do some logging/stats collection if he wants.
-    auto cob = readCallback_;
-    readCallback_ = nullptr;
+void AsyncUDPSocket::handleReadBatch(size_t batchSize) noexcept {
+  const size_t datagramSize = maxReadDatagramSize_;
+  if (!readBatch_ || readBatch_->msgs.size() != batchSize ||
+      readBatch_->datagramSize != datagramSize) {
+    readBatch_ = std::make_unique<ReadBatch>(batchSize, datagramSize);
+  }
+  auto& batch = *readBatch_;
 
-    cob->onReadError(ex);
-    updateRegistration();
+  for (size_t i = 0; i < batchSize; ++i) {
+    auto& buf = batch.bufs[i];
+    if (!buf) {
+      buf = IOBuf::create(datagramSize);
+    }
+    batch.iovs[i].iov_base = buf->writableData();
+    batch.iovs[i].iov_len = datagramSize;
+
+    auto& msg = batch.msgs[i].msg_hdr;
+    msg.msg_name = &batch.addrs[i];
+    msg.msg_namelen = sizeof(batch.addrs[i]);
+    msg.msg_iov = &batch.iovs[i];
+    msg.msg_iovlen = 1;
+    if (gro_) {
+      msg.msg_control = &batch.control[i * kReadBatchControlSize];
+      msg.msg_controllen = kReadBatchControlSize;
+    } else {
+      msg.msg_control = nullptr;
+      msg.msg_controllen = 0;
+    }
+    msg.msg_flags = 0;
+  }
+
+  int ret = recvmmsgCompat(
+      fd_, batch.msgs.data(), static_cast<unsigned int>(batchSize), 0);
+  if (ret < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      // No data could be read without blocking the socket
+      return;
+    }
+    failRead("::recvmmsg() failed", errno);
+    return;
   }
+
+  std::vector<Datagram> datagrams;
+  datagrams.reserve(size_t(ret));
+  for (size_t i = 0; i < size_t(ret); ++i) {
+    auto& msg = batch.msgs[i].msg_hdr;
+    // Empty datagrams are valid, and delivered like any other
+    size_t len = std::min<size_t>(batch.msgs[i].msg_len, datagramSize);
+    Datagram datagram;
+    datagram.client.setFromSockaddr(
+        reinterpret_cast<sockaddr*>(&batch.addrs[i]), msg.msg_namelen);
+    // A datagram that fills less than half of its buffer is copied out and
+    // the buffer kept for the next read, so that holding on to a small
+    // datagram doesn't hold on to datagramSize bytes (64KB with GRO).
+    auto& buf = batch.bufs[i];
+    if (len * 2 <= datagramSize) {
+      datagram.data = IOBuf::copyBuffer(buf->data(), len);
+    } else {
+      datagram.data = std::move(buf);
+      datagram.data->append(len);
+    }
+    datagram.truncated = (msg.msg_flags & MSG_TRUNC) != 0;
+#ifdef __linux__
+    if (gro_) {
+      for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr;
+           cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+          int segmentSize;
+          memcpy(&segmentSize, CMSG_DATA(cmsg), sizeof(segmentSize));
+          datagram.segmentSize = size_t(segmentSize);
+        }
+      }
+    }
+#endif
+    datagrams.push_back(std::move(datagram));
+  }
+
+  if (!datagrams.empty()) {
+    readCallback_->onDatagramsAvailable(datagrams);
+  }
+}
+
+void AsyncUDPSocket::failRead(const char* fn, int errnoCopy) noexcept {
+  AsyncSocketException ex(
+      AsyncSocketException::INTERNAL_ERROR, fn, errnoCopy);
+
+  // In case of UDP we can continue reading from the socket
+  // even if the current request fails. We notify the user
+  // so that he can do some logging/stats collection if he wants.
+  auto cob = readCallback_;
+  readCallback_ = nullptr;
+
+  cob->onReadError(ex);
+  updateRegistration();
 }
 
 bool AsyncUDPSocket::updateRegistration() noexcept {
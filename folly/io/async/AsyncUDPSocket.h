@@ -17,6 +17,7 @@
 #pragma once
 
 #include <memory>
+#include <vector>
 
 #include <folly/ScopeGuard.h>
 #include <folly/SocketAddress.h>
@@ -38,6 +39,18 @@ class AsyncUDPSocket : public EventHandler {
     SHARED
   };
 
+  /**
+   * A datagram read by a batched read, see ReadCallback::getReadBatchSize().
+   */
+  struct Datagram {
+    folly::SocketAddress client;
+    std::unique_ptr<folly::IOBuf> data;
+    bool truncated{false};
+    // With GRO enabled, the size of the datagrams the kernel coalesced into
+    // data (all but the last one have this size), 0 otherwise.
+    size_t segmentSize{0};
+  };
+
   class ReadCallback {
    public:
     /**
@@ -74,6 +87,27 @@ class AsyncUDPSocket : public EventHandler {
      */
     virtual void onReadClosed() noexcept = 0;
 
+    /**
+     * Return the maximum number of datagrams to read per wakeup. If this is
+     * more than 1 they are read with a single recvmmsg() call into buffers
+     * allocated by the socket (see setMaxReadDatagramSize()) and handed to
+     * onDatagramsAvailable(), instead of one recvfrom() per wakeup.
+     */
+    virtual size_t getReadBatchSize() noexcept {
+      return 1;
+    }
+
+    /**
+     * Invoked with the datagrams read by a batched read. Each datagram has
+     * a buffer of its own, at most twice its size, so the callback may
+     * move them out and keep them.
+     *
+     * The default implementation copies each datagram into the buffer
+     * returned by getReadBuffer() and calls onDataAvailable().
+     */
+    virtual void onDatagramsAvailable(
+        std::vector<Datagram>& datagrams) noexcept;
+
     virtual ~ReadCallback() = default;
   };
 
@@ -121,6 +155,28 @@ class AsyncUDPSocket : public EventHandler {
   virtual ssize_t writev(const folly::SocketAddress& address,
                          const struct iovec* vec, size_t veclen);
 
+  /**
+   * Send each of the `count` buffers as a separate datagram to destination
+   * with a single ::sendmmsg call (one ::sendmsg per datagram where that
+   * isn't available). Returns the number of datagrams sent, which may be
+   * less than `count` if the socket buffer filled up, or -1 with errno set
+   * if the first one couldn't be sent.
+   */
+  virtual int writem(const folly::SocketAddress& address,
+                     const std::unique_ptr<folly::IOBuf>* bufs,
+                     size_t count);
+
+  /**
+   * Send the data in buffer to destination as a train of `gsoSize` byte
+   * datagrams (the last one may be shorter) handed to the kernel in one
+   * ::sendmsg call, using UDP generic segmentation offload (Linux 4.18+).
+   * A `gsoSize` of 0 sends a single datagram, like write(). Returns the
+   * return code from ::sendmsg.
+   */
+  virtual ssize_t writeGSO(const folly::SocketAddress& address,
+                           const std::unique_ptr<folly::IOBuf>& buf,
+                           int gsoSize);
+
   /**
    * Start reading datagrams
    */
@@ -158,6 +214,31 @@ class AsyncUDPSocket : public EventHandler {
     reuseAddr_ = reuseAddr;
   }
 
+  /**
+   * Enable UDP generic receive offload (Linux 5.0+): the kernel coalesces
+   * consecutive datagrams from the same flow into a single read, reported
+   * to batched reads through Datagram::segmentSize. Only takes effect with
+   * a read batch size above 1, and setMaxReadDatagramSize() must leave room
+   * for the coalesced datagrams. Returns false if not supported.
+   */
+  bool setGRO(bool enabled);
+
+  bool getGRO() const {
+    return gro_;
+  }
+
+  /**
+   * Size of the buffer each datagram of a batched read is received into.
+   * Longer datagrams are truncated.
+   */
+  void setMaxReadDatagramSize(size_t size) {
+    maxReadDatagramSize_ = size;
+  }
+
+  size_t getMaxReadDatagramSize() const {
+    return maxReadDatagramSize_;
+  }
+
   EventBase* getEventBase() const {
     return eventBase_;
   }
@@ -178,6 +259,8 @@ class AsyncUDPSocket : public EventHandler {
   void handlerReady(uint16_t events) noexcept override;
 
   void handleRead() noexcept;
+  void handleReadBatch(size_t batchSize) noexcept;
+  void failRead(const char* fn, int errnoCopy) noexcept;
   bool updateRegistration() noexcept;
 
   EventBase* eventBase_;
@@ -191,6 +274,11 @@ class AsyncUDPSocket : public EventHandler {
 
   bool reuseAddr_{true};
   bool reusePort_{false};
+  bool gro_{false};
+  size_t maxReadDatagramSize_{1500};
+
+  struct ReadBatch;
+  std::unique_ptr<ReadBatch> readBatch_;
 };
 
 } // namespace folly
@@ -26,10 +26,14 @@
 #include <thread>
 
 #include <folly/Baton.h>
+#include <folly/Demangle.h>
 #include <folly/Memory.h>
+#include <folly/String.h>
 #include <folly/ThreadName.h>
-#include <folly/io/async/NotificationQueue.h>
+#include <folly/io/async/MPSCNotificationQueue.h>
 #include <folly/io/async/VirtualEventBase.h>
+#include <folly/portability/Asm.h>
+#include <folly/portability/Builtins.h>
 #include <folly/portability/Unistd.h>
 
 namespace folly {
@@ -39,7 +43,7 @@ namespace folly {
  */
 
 class EventBase::FunctionRunner
-    : public NotificationQueue<EventBase::Func>::Consumer {
+    : public MPSCNotificationQueue<EventBase::Func>::Consumer {
  public:
   void messageAvailable(Func&& msg) noexcept override {
     // In libevent2, internal events do not break the loop.
@@ -48,80 +52,142 @@ class EventBase::FunctionRunner
     // To have similar bejaviour to libevent1.4, tell the loop to break here.
     // Note that loop() may still continue to loop, but it will also check the
     // stop_ flag as well as runInLoop callbacks, etc.
-    event_base_loopbreak(getEventBase()->evb_);
+    getEventBase()->evb_->eb_event_base_loopbreak();
 
     if (!msg) {
       // terminateLoopSoon() sends a null message just to
       // wake up the loop.  We can ignore these messages.
       return;
     }
+    EventBase::CallbackTimer timer(*getEventBase());
     msg();
   }
 };
 
-// The interface used to libevent is not thread-safe.  Calls to
-// event_init() and event_base_free() directly modify an internal
-// global 'current_base', so a mutex is required to protect this.
-//
-// event_init() should only ever be called once.  Subsequent calls
-// should be made to event_base_new().  We can recognise that
-// event_init() has already been called by simply inspecting current_base.
-static std::mutex libevent_mutex_;
+/*
+ * EventBaseCallbackObserver methods
+ */
+
+std::string EventBaseCallbackObserver::CallbackInfo::describe() const {
+  static const char* const kTypeNames[] = {
+      "EVENT_HANDLER", "TIMEOUT", "LOOP_CALLBACK", "FUNCTION"};
+  std::string desc = kTypeNames[static_cast<size_t>(type)];
+  if (typeInfo) {
+    desc += ' ';
+    desc += demangle(*typeInfo).toStdString();
+  }
+  if (id) {
+    stringAppendf(&desc, "@%p", reinterpret_cast<void*>(id));
+  }
+  if (callSite) {
+    stringAppendf(
+        &desc, " scheduled at %p", reinterpret_cast<void*>(callSite));
+  }
+  return desc;
+}
 
 /*
- * EventBase methods
+ * EventBase::CallbackTimer methods
  */
 
-EventBase::EventBase(bool enableTimeMeasurement)
-  : runOnceCallbacks_(nullptr)
-  , stop_(false)
-  , loopThread_()
-  , queue_(nullptr)
-  , fnRunner_(nullptr)
-  , maxLatency_(0)
-  , avgLoopTime_(std::chrono::seconds(2))
-  , maxLatencyLoopTime_(avgLoopTime_)
-  , enableTimeMeasurement_(enableTimeMeasurement)
-  , nextLoopCnt_(uint64_t(-40)) // Early wrap-around so bugs will manifest soon
-  , latestLoopCnt_(nextLoopCnt_)
-  , startWork_()
-  , observer_(nullptr)
-  , observerSampleCount_(0)
-  , executionObserver_(nullptr) {
-  struct event ev;
-  {
-    std::lock_guard<std::mutex> lock(libevent_mutex_);
-
-    // The value 'current_base' (libevent 1) or
-    // 'event_global_current_base_' (libevent 2) is filled in by event_set(),
-    // allowing examination of its value without an explicit reference here.
-    // If ev.ev_base is nullptr, then event_init() must be called, otherwise
-    // call event_base_new().
-    event_set(&ev, 0, 0, nullptr, nullptr);
-    if (!ev.ev_base) {
-      evb_ = event_init();
+void EventBase::CallbackTimer::start(const EventHandler* handler) {
+  if (begin(
+          EventBaseCallbackObserver::CallbackType::EVENT_HANDLER,
+          reinterpret_cast<uintptr_t>(handler))) {
+    info_.typeInfo = &typeid(*handler);
+  }
+}
+
+void EventBase::CallbackTimer::start(const AsyncTimeout* timeout) {
+  if (begin(
+          EventBaseCallbackObserver::CallbackType::TIMEOUT,
+          reinterpret_cast<uintptr_t>(timeout))) {
+    info_.typeInfo = &typeid(*timeout);
+  }
+}
+
+void EventBase::CallbackTimer::start(const LoopCallback* callback) {
+  auto function = dynamic_cast<const FunctionLoopCallback*>(callback);
+  if (function) {
+    if (begin(
+            EventBaseCallbackObserver::CallbackType::FUNCTION,
+            reinterpret_cast<uintptr_t>(callback))) {
+      info_.callSite = function->getCallSite();
     }
+  } else if (begin(
+                 EventBaseCallbackObserver::CallbackType::LOOP_CALLBACK,
+                 reinterpret_cast<uintptr_t>(callback))) {
+    info_.typeInfo = &typeid(*callback);
   }
+}
 
-  if (ev.ev_base) {
-    evb_ = event_base_new();
+void EventBase::CallbackTimer::startFunction() {
+  begin(EventBaseCallbackObserver::CallbackType::FUNCTION, 0);
+}
+
+bool EventBase::CallbackTimer::begin(
+    EventBaseCallbackObserver::CallbackType type,
+    uintptr_t id) {
+  auto& observer = evb_.callbackObserver_;
+  if (observer &&
+      ++evb_.callbackSampleCount_ >= std::max(observer->getSampleRate(), 1u)) {
+    evb_.callbackSampleCount_ = 0;
+    sampled_ = true;
+  }
+  if (!sampled_ && !evb_.slowLoopCallback_) {
+    return false;
   }
+  active_ = true;
+  info_.type = type;
+  info_.id = id;
+  parent_ = evb_.currentCallbackTimer_;
+  evb_.currentCallbackTimer_ = this;
+  start_ = std::chrono::steady_clock::now();
+  return true;
+}
 
-  if (UNLIKELY(evb_ == nullptr)) {
-    LOG(ERROR) << "EventBase(): Failed to init event base.";
-    folly::throwSystemError("error in EventBase::EventBase()");
+void EventBase::CallbackTimer::finish() {
+  info_.duration = std::chrono::steady_clock::now() - start_;
+  evb_.currentCallbackTimer_ = parent_;
+  if (parent_) {
+    parent_->nestedTime_ += info_.duration;
+  }
+  if (sampled_ && evb_.callbackObserver_) {
+    evb_.callbackObserver_->callbackSample(info_);
+  }
+  if (evb_.slowLoopCallback_) {
+    ++evb_.loopInfo_.numCallbacks;
+    if (!parent_) {
+      evb_.loopTime_ += info_.duration;
+    }
+    auto selfTime = info_.duration - nestedTime_;
+    if (selfTime > evb_.slowestSelfTime_) {
+      evb_.slowestSelfTime_ = selfTime;
+      evb_.loopInfo_.slowest = info_;
+    }
   }
-  VLOG(5) << "EventBase(): Created.";
-  initNotificationQueue();
-  RequestContext::saveContext();
 }
 
+/*
+ * EventBase methods
+ */
+
+EventBase::EventBase(bool enableTimeMeasurement)
+    : EventBase(std::make_unique<EventBaseBackend>(), enableTimeMeasurement) {}
+
 // takes ownership of the event_base
 EventBase::EventBase(event_base* evb, bool enableTimeMeasurement)
+    : EventBase(
+          std::make_unique<EventBaseBackend>(evb),
+          enableTimeMeasurement) {}
+
+EventBase::EventBase(
+    std::unique_ptr<EventBaseBackendBase>&& evb,
+    bool enableTimeMeasurement)
   : runOnceCallbacks_(nullptr)
   , stop_(false)
   , loopThread_()
-  , evb_(evb)
+  , evb_(std::move(evb))
   , queue_(nullptr)
   , fnRunner_(nullptr)
   , maxLatency_(0)
@@ -135,9 +201,10 @@ EventBase::EventBase(event_base* evb, bool enableTimeMeasurement)
   , observerSampleCount_(0)
   , executionObserver_(nullptr) {
   if (UNLIKELY(evb_ == nullptr)) {
-    LOG(ERROR) << "EventBase(): Pass nullptr as event base.";
-    throw std::invalid_argument("EventBase(): event base cannot be nullptr");
+    LOG(ERROR) << "EventBase(): Pass nullptr as backend.";
+    throw std::invalid_argument("EventBase(): backend cannot be nullptr");
   }
+  VLOG(5) << "EventBase(): Created.";
   initNotificationQueue();
   RequestContext::saveContext();
 }
@@ -179,10 +246,7 @@ EventBase::~EventBase() {
 
   // Stop consumer before deleting NotificationQueue
   fnRunner_->stopConsuming();
-  {
-    std::lock_guard<std::mutex> lock(libevent_mutex_);
-    event_base_free(evb_);
-  }
+  evb_.reset();
 
   for (auto storage : localStorageToDtor_) {
     storage->onEventBaseDestruction(*this);
@@ -312,13 +376,21 @@ bool EventBase::loopBody(int flags) {
     // nobody can add loop callbacks from within this thread if
     // we don't have to handle anything to start with...
     if (blocking && loopCallbacks_.empty()) {
-      res = event_base_loop(evb_, EVLOOP_ONCE);
+      if (busyPollBudget_ > std::chrono::microseconds::zero()) {
+        res = busyPollLoop();
+      } else {
+        res = evb_->eb_event_base_loop(EVLOOP_ONCE);
+      }
     } else {
-      res = event_base_loop(evb_, EVLOOP_ONCE | EVLOOP_NONBLOCK);
+      res = evb_->eb_event_base_loop(EVLOOP_ONCE | EVLOOP_NONBLOCK);
     }
 
     ranLoopCallbacks = runLoopCallbacks();
 
+    if (slowLoopCallback_) {
+      checkSlowLoop();
+    }
+
     if (enableTimeMeasurement_) {
       busy = std::chrono::duration_cast<std::chrono::microseconds>(
           std::chrono::steady_clock::now() - startWork_);
@@ -457,7 +529,37 @@ void EventBase::loopForever() {
   }
 }
 
+int EventBase::busyPollLoop() {
+  auto start = std::chrono::steady_clock::now();
+  auto deadline = start + busyPollBudget_;
+  auto handlerRuns = handlerRuns_;
+  int res;
+  bool hit = false;
+  do {
+    res = evb_->eb_event_base_loop(EVLOOP_ONCE | EVLOOP_NONBLOCK);
+    ++busyPollStats_.polls;
+    // res != 0 means there is nothing to wait for; let loopBody() decide.
+    if (res != 0 || handlerRuns_ != handlerRuns || !loopCallbacks_.empty() ||
+        stop_.load(std::memory_order_relaxed)) {
+      hit = true;
+      break;
+    }
+    asm_volatile_pause();
+  } while (std::chrono::steady_clock::now() < deadline);
+
+  busyPollStats_.spinTime +=
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - start);
+  if (hit) {
+    ++busyPollStats_.hits;
+    return res;
+  }
+  ++busyPollStats_.misses;
+  return evb_->eb_event_base_loop(EVLOOP_ONCE);
+}
+
 void EventBase::bumpHandlingTime() {
+  ++handlerRuns_;
   if (!enableTimeMeasurement_) {
     return;
   }
@@ -474,6 +576,40 @@ void EventBase::bumpHandlingTime() {
   }
 }
 
+void EventBase::setCallbackObserver(
+    std::shared_ptr<EventBaseCallbackObserver> observer) {
+  dcheckIsInEventBaseThread();
+  callbackObserver_ = std::move(observer);
+  callbackSampleCount_ = 0;
+  timeCallbacks_ = callbackObserver_ || slowLoopCallback_;
+}
+
+void EventBase::setSlowLoopCallback(
+    std::chrono::microseconds threshold,
+    SlowLoopCallback cb) {
+  dcheckIsInEventBaseThread();
+  slowLoopThreshold_ = threshold;
+  slowLoopCallback_ = std::move(cb);
+  timeCallbacks_ = callbackObserver_ || slowLoopCallback_;
+  loopInfo_ = SlowLoopInfo();
+  loopTime_ = slowestSelfTime_ = std::chrono::nanoseconds::zero();
+}
+
+void EventBase::checkSlowLoop() {
+  if (loopTime_ > slowLoopThreshold_) {
+    loopInfo_.busyTime =
+        std::chrono::duration_cast<std::chrono::microseconds>(loopTime_);
+    slowLoopCallback_(loopInfo_);
+  }
+  loopInfo_ = SlowLoopInfo();
+  loopTime_ = slowestSelfTime_ = std::chrono::nanoseconds::zero();
+}
+
+void EventBase::runTimeout(AsyncTimeout* timeout) noexcept {
+  CallbackTimer timer(*this, timeout);
+  timeout->timeoutExpired();
+}
+
 void EventBase::terminateLoopSoon() {
   VLOG(5) << "EventBase(): Received terminateLoopSoon() command.";
 
@@ -484,7 +620,7 @@ void EventBase::terminateLoopSoon() {
 
   // Call event_base_loopbreak() so that libevent will exit the next time
   // around the loop.
-  event_base_loopbreak(evb_);
+  evb_->eb_event_base_loopbreak();
 
   // If terminateLoopSoon() is called from another thread,
   // the EventBase thread might be stuck waiting for events.
@@ -515,8 +651,15 @@ void EventBase::runInLoop(LoopCallback* callback, bool thisIteration) {
 }
 
 void EventBase::runInLoop(Func cob, bool thisIteration) {
+  runInLoop(
+      std::move(cob),
+      thisIteration,
+      reinterpret_cast<uintptr_t>(__builtin_return_address(0)));
+}
+
+void EventBase::runInLoop(Func cob, bool thisIteration, uintptr_t callSite) {
   dcheckIsInEventBaseThread();
-  auto wrapper = new FunctionLoopCallback(std::move(cob));
+  auto wrapper = new FunctionLoopCallback(std::move(cob), callSite);
   wrapper->context_ = RequestContext::saveContext();
   if (runOnceCallbacks_ != nullptr && thisIteration) {
     runOnceCallbacks_->push_back(*wrapper);
@@ -550,7 +693,10 @@ bool EventBase::runInEventBaseThread(Func fn) {
 
   // Short-circuit if we are already in our event base
   if (inRunningEventBaseThread()) {
-    runInLoop(std::move(fn));
+    runInLoop(
+        std::move(fn),
+        false,
+        reinterpret_cast<uintptr_t>(__builtin_return_address(0)));
     return true;
 
   }
@@ -613,6 +759,7 @@ bool EventBase::runLoopCallbacks() {
       LoopCallback* callback = &currentCallbacks.front();
       currentCallbacks.pop_front();
       folly::RequestContextScopeGuard rctx(callback->context_);
+      CallbackTimer timer(*this, callback);
       callback->runLoopCallback();
     }
 
@@ -624,7 +771,7 @@ bool EventBase::runLoopCallbacks() {
 
 void EventBase::initNotificationQueue() {
   // Infinite size queue
-  queue_.reset(new NotificationQueue<Func>());
+  queue_.reset(new MPSCNotificationQueue<Func>());
 
   // We allocate fnRunner_ separately, rather than declaring it directly
   // as a member of EventBase solely so that we don't need to include
@@ -714,7 +861,7 @@ bool EventBase::scheduleTimeout(AsyncTimeout* obj,
   tv.tv_usec = long((timeout.count() % 1000LL) * 1000LL);
 
   struct event* ev = obj->getEvent();
-  if (event_add(ev, &tv) < 0) {
+  if (evb_->eb_event_add(*ev, &tv) < 0) {
     LOG(ERROR) << "EventBase: failed to schedule timeout: " << strerror(errno);
     return false;
   }
@@ -726,7 +873,7 @@ void EventBase::cancelTimeout(AsyncTimeout* obj) {
   dcheckIsInEventBaseThread();
   struct event* ev = obj->getEvent();
   if (EventUtil::isEventRegistered(ev)) {
-    event_del(ev);
+    evb_->eb_event_del(*ev);
   }
 }
 
@@ -27,6 +27,8 @@
 #include <queue>
 #include <set>
 #include <stack>
+#include <string>
+#include <typeinfo>
 #include <unordered_map>
 #include <unordered_set>
 #include <utility>
@@ -43,6 +45,7 @@
 #include <folly/experimental/ExecutionObserver.h>
 #include <folly/futures/DrivableExecutor.h>
 #include <folly/io/async/AsyncTimeout.h>
+#include <folly/io/async/EventBaseBackendBase.h>
 #include <folly/io/async/HHWheelTimer.h>
 #include <folly/io/async/Request.h>
 #include <folly/io/async/TimeoutManager.h>
@@ -53,7 +56,8 @@ namespace folly {
 
 using Cob = Func; // defined in folly/Executor.h
 template <typename MessageT>
-class NotificationQueue;
+class MPSCNotificationQueue;
+class EventHandler;
 
 namespace detail {
 class EventBaseLocalBase;
@@ -77,6 +81,54 @@ class EventBaseObserver {
     int64_t busyTime, int64_t idleTime) = 0;
 };
 
+/**
+ * Receives the run times of individual callbacks run by an EventBase; see
+ * EventBase::setCallbackObserver().
+ */
+class EventBaseCallbackObserver {
+ public:
+  enum class CallbackType : uint8_t {
+    // EventHandler::handlerReady()
+    EVENT_HANDLER,
+    // AsyncTimeout::timeoutExpired()
+    TIMEOUT,
+    // LoopCallback::runLoopCallback()
+    LOOP_CALLBACK,
+    // Functions passed to runInLoop() or runInEventBaseThread()
+    FUNCTION,
+  };
+
+  struct CallbackInfo {
+    CallbackType type{CallbackType::EVENT_HANDLER};
+    // Address of the EventHandler, AsyncTimeout or LoopCallback, or of the
+    // wrapper of a function run through runInLoop().  0 for functions
+    // queued from other threads.
+    uintptr_t id{0};
+    // Dynamic type of the callback object; nullptr for functions
+    const std::type_info* typeInfo{nullptr};
+    // For functions passed to runInLoop(), or to runInEventBaseThread() from
+    // the EventBase thread: the return address into the code that scheduled
+    // them, which folly::symbolizer can resolve.  0 otherwise.
+    uintptr_t callSite{0};
+    std::chrono::nanoseconds duration{0};
+
+    /**
+     * Human readable identity of the callback, e.g.
+     * "TIMEOUT folly::HHWheelTimer@0x7f0c3a41e000".
+     */
+    std::string describe() const;
+  };
+
+  virtual ~EventBaseCallbackObserver() = default;
+
+  /**
+   * Time one callback in every getSampleRate(); 1 times all of them.
+   */
+  virtual uint32_t getSampleRate() const = 0;
+
+  virtual void callbackSample(const CallbackInfo& info) noexcept = 0;
+};
+
 // Helper class that sets and retrieves the EventBase associated with a given
 // request via RequestContext. See Request.h for that mechanism.
 class RequestEventBase : public RequestData {
@@ -168,16 +220,22 @@ class EventBase : private boost::noncopyable,
 
   class FunctionLoopCallback : public LoopCallback {
    public:
-    explicit FunctionLoopCallback(Func&& function)
-        : function_(std::move(function)) {}
+    explicit FunctionLoopCallback(Func&& function, uintptr_t callSite = 0)
+        : function_(std::move(function)), callSite_(callSite) {}
 
     void runLoopCallback() noexcept override {
       function_();
       delete this;
     }
 
+    // Where the function was scheduled from, if known
+    uintptr_t getCallSite() const {
+      return callSite_;
+    }
+
    private:
     Func function_;
+    uintptr_t callSite_;
   };
 
   // Like FunctionLoopCallback, but saves one allocation. Use with caution.
@@ -221,6 +279,20 @@ class EventBase : private boost::noncopyable,
    *                              observer, max latency and avg loop time.
    */
   explicit EventBase(event_base* evb, bool enableTimeMeasurement = true);
+
+  /**
+   * Create a new EventBase object driven by the given backend, e.g. one
+   * that does not use libevent to wait for events.
+   *
+   * @param enableTimeMeasurement Informs whether this event base should measure
+   *                              time. Disabling it would likely improve
+   *                              performance, but will disable some features
+   *                              that relies on time-measurement, including:
+   *                              observer, max latency and avg loop time.
+   */
+  explicit EventBase(
+      std::unique_ptr<EventBaseBackendBase>&& evb,
+      bool enableTimeMeasurement = true);
   ~EventBase() override;
 
   /**
@@ -462,6 +534,46 @@ class EventBase : private boost::noncopyable,
     return avgLoopTime_.get();
   }
 
+  /**
+   * Spin for up to budget before blocking to wait for events.
+   *
+   * Once it runs out of work the loop normally blocks in the backend, and
+   * every wakeup then pays the scheduler's latency.  With a non-zero budget
+   * it first keeps polling the backend without blocking, which picks up fd
+   * readiness, expired timeouts and runInEventBaseThread() requests, and
+   * only blocks if nothing turned up within budget.  The thread burns a core
+   * meanwhile; getBusyPollStats() shows how much of that paid off.  See also
+   * AsyncSocket::setBusyPoll(), which has the kernel poll the device.
+   *
+   * Zero, the default, disables spinning.
+   */
+  void setBusyPollBudget(std::chrono::microseconds budget) {
+    busyPollBudget_ = budget;
+  }
+
+  std::chrono::microseconds getBusyPollBudget() const {
+    return busyPollBudget_;
+  }
+
+  struct BusyPollStats {
+    // Spins that found work within their budget
+    uint64_t hits{0};
+    // Spins that used up their budget and went on to block
+    uint64_t misses{0};
+    // Non-blocking backend polls made while spinning
+    uint64_t polls{0};
+    // Total time spent spinning (also part of the loop's idle time)
+    std::chrono::microseconds spinTime{0};
+  };
+
+  /**
+   * Busy-poll counters since the EventBase was created.  Only call from the
+   * EventBase thread.
+   */
+  const BusyPollStats& getBusyPollStats() const {
+    return busyPollStats_;
+  }
+
   /**
     * check if the event base loop is running.
    */
@@ -515,10 +627,21 @@ class EventBase : private boost::noncopyable,
   // Avoid using these functions if possible.  These functions are not
   // guaranteed to always be present if we ever provide alternative EventBase
   // implementations that do not use libevent internally.
-  event_base* getLibeventBase() const { return evb_; }
+  event_base* getLibeventBase() const {
+    return evb_->getEventBase();
+  }
   static const char* getLibeventVersion();
   static const char* getLibeventMethod();
 
+  /**
+   * The backend which waits for and dispatches events for this EventBase.
+   * EventHandler, AsyncTimeout and AsyncSignalHandler arm and disarm their
+   * events through it.
+   */
+  EventBaseBackendBase* getBackend() {
+    return evb_.get();
+  }
+
   /**
    * only EventHandler/AsyncTimeout subclasses and ourselves should
    * ever call this.
@@ -585,6 +708,111 @@ class EventBase : private boost::noncopyable,
     return executionObserver_;
   }
 
+  /**
+   * Time individual callbacks: EventHandlers, AsyncTimeouts, LoopCallbacks
+   * and functions passed to runInLoop() or runInEventBaseThread().  One in
+   * every observer->getSampleRate() of them is timed and reported to
+   * observer; the others only cost a counter increment.
+   *
+   * Pass nullptr to stop.  Only call from the EventBase thread.
+   */
+  void setCallbackObserver(
+      std::shared_ptr<EventBaseCallbackObserver> observer);
+
+  const std::shared_ptr<EventBaseCallbackObserver>& getCallbackObserver() {
+    return callbackObserver_;
+  }
+
+  struct SlowLoopInfo {
+    // Time spent running callbacks in the iteration
+    std::chrono::microseconds busyTime{0};
+    // Number of callbacks that ran
+    size_t numCallbacks{0};
+    // The callback that spent the most time itself, not counting the time
+    // spent in callbacks it ran, such as the notification queue handler
+    // running runInEventBaseThread() functions
+    EventBaseCallbackObserver::CallbackInfo slowest;
+  };
+
+  using SlowLoopCallback = Function<void(const SlowLoopInfo&)>;
+
+  /**
+   * Call cb at the end of every loop iteration whose callbacks ran for more
+   * than threshold in total, with the identity of the callback to blame.
+   * For functions that is where they were scheduled from: cb may resolve
+   * slowest.callSite to a symbol, e.g. with folly::symbolizer.
+   *
+   * While set, every callback is timed, which costs two clock reads each.
+   * Pass an empty cb to stop.  Only call from the EventBase thread.
+   */
+  void setSlowLoopCallback(
+      std::chrono::microseconds threshold,
+      SlowLoopCallback cb);
+
+  /**
+   * Times one callback for the callback observer and the slow loop
+   * callback, when either is set; used around each callback this EventBase
+   * runs.
+   */
+  class CallbackTimer {
+   public:
+    CallbackTimer(EventBase& evb, const EventHandler* handler) : evb_(evb) {
+      if (UNLIKELY(evb_.timeCallbacks_)) {
+        start(handler);
+      }
+    }
+
+    CallbackTimer(EventBase& evb, const AsyncTimeout* timeout) : evb_(evb) {
+      if (UNLIKELY(evb_.timeCallbacks_)) {
+        start(timeout);
+      }
+    }
+
+    CallbackTimer(EventBase& evb, const LoopCallback* callback) : evb_(evb) {
+      if (UNLIKELY(evb_.timeCallbacks_)) {
+        start(callback);
+      }
+    }
+
+    // For functions queued by runInEventBaseThread()
+    explicit CallbackTimer(EventBase& evb) : evb_(evb) {
+      if (UNLIKELY(evb_.timeCallbacks_)) {
+        startFunction();
+      }
+    }
+
+    ~CallbackTimer() {
+      if (UNLIKELY(active_)) {
+        finish();
+      }
+    }
+
+    CallbackTimer(const CallbackTimer&) = delete;
+    CallbackTimer& operator=(const CallbackTimer&) = delete;
+
+   private:
+    void start(const EventHandler* handler);
+    void start(const AsyncTimeout* timeout);
+    void start(const LoopCallback* callback);
+    void startFunction();
+    bool begin(EventBaseCallbackObserver::CallbackType type, uintptr_t id);
+    void finish();
+
+    EventBase& evb_;
+    bool active_{false};
+    bool sampled_{false};
+    EventBaseCallbackObserver::CallbackInfo info_;
+    std::chrono::steady_clock::time_point start_;
+    // Time spent in callbacks timed while this one was running
+    std::chrono::nanoseconds nestedTime_{0};
+    CallbackTimer* parent_{nullptr};
+  };
+
+  /**
+   * Times timeout->timeoutExpired().
+   */
+  void runTimeout(AsyncTimeout* timeout) noexcept override;
+
   /**
    * Set the name of the thread that runs this event base.
    */
@@ -673,9 +901,19 @@ class EventBase : private boost::noncopyable,
 
   bool loopBody(int flags = 0);
 
+  // Polls the backend until something happens or busyPollBudget_ runs out,
+  // then blocks.  Same return value as eb_event_base_loop().
+  int busyPollLoop();
+
   // executes any callbacks queued by runInLoop(); returns false if none found
   bool runLoopCallbacks();
 
+  void runInLoop(Func cob, bool thisIteration, uintptr_t callSite);
+
+  // Reports the iteration to slowLoopCallback_ if it was slow, and resets
+  // the per-iteration callback timing state
+  void checkSlowLoop();
+
   void initNotificationQueue();
 
   // should only be accessed through public getter
@@ -699,12 +937,12 @@ class EventBase : private boost::noncopyable,
   // std::thread::id{} if loop is not running.
   std::atomic<std::thread::id> loopThread_;
 
-  // pointer to underlying event_base class doing the heavy lifting
-  event_base* evb_;
+  // the backend (by default libevent) doing the heavy lifting
+  std::unique_ptr<EventBaseBackendBase> evb_;
 
   // A notification queue for runInEventBaseThread() to use
   // to send function requests to the EventBase thread.
-  std::unique_ptr<NotificationQueue<Func>> queue_;
+  std::unique_ptr<MPSCNotificationQueue<Func>> queue_;
   std::unique_ptr<FunctionRunner> fnRunner_;
   ssize_t loopKeepAliveCount_{0};
   std::atomic<ssize_t> loopKeepAliveCountAtomic_{0};
@@ -733,6 +971,12 @@ class EventBase : private boost::noncopyable,
   uint64_t nextLoopCnt_;
   uint64_t latestLoopCnt_;
   std::chrono::steady_clock::time_point startWork_;
+
+  // Number of bumpHandlingTime() calls, which tells busyPollLoop() that a
+  // handler has run.
+  uint64_t handlerRuns_{0};
+  std::chrono::microseconds busyPollBudget_{0};
+  BusyPollStats busyPollStats_;
   // Prevent undefined behavior from invoking event_base_loop() reentrantly.
   // This is needed since many projects use libevent-1.4, which lacks commit
   // b557b175c00dc462c1fce25f6e7dd67121d2c001 from
@@ -746,6 +990,20 @@ class EventBase : private boost::noncopyable,
   // EventHandler's execution observer.
   ExecutionObserver* executionObserver_;
 
+  // Callback timing, enabled by either of setCallbackObserver() and
+  // setSlowLoopCallback()
+  bool timeCallbacks_{false};
+  std::shared_ptr<EventBaseCallbackObserver> callbackObserver_;
+  uint32_t callbackSampleCount_{0};
+  std::chrono::microseconds slowLoopThreshold_{0};
+  SlowLoopCallback slowLoopCallback_;
+  // The innermost callback being timed
+  CallbackTimer* currentCallbackTimer_{nullptr};
+  // This iteration so far, when slowLoopCallback_ is set
+  SlowLoopInfo loopInfo_;
+  std::chrono::nanoseconds loopTime_{0};
+  std::chrono::nanoseconds slowestSelfTime_{0};
+
   // Name of the thread running this EventBase
   std::string name_;
 
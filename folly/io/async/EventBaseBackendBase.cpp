@@ -0,0 +1,94 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/io/async/EventBaseBackendBase.h>
+
+#include <mutex>
+#include <stdexcept>
+
+#include <glog/logging.h>
+
+#include <folly/Exception.h>
+#include <folly/Likely.h>
+
+namespace folly {
+
+// The interface used to libevent is not thread-safe.  Calls to
+// event_init() and event_base_free() directly modify an internal
+// global 'current_base', so a mutex is required to protect this.
+//
+// event_init() should only ever be called once.  Subsequent calls
+// should be made to event_base_new().  We can recognise that
+// event_init() has already been called by simply inspecting current_base.
+static std::mutex libevent_mutex_;
+
+EventBaseBackend::EventBaseBackend() {
+  struct event ev;
+  {
+    std::lock_guard<std::mutex> lock(libevent_mutex_);
+
+    // The value 'current_base' (libevent 1) or
+    // 'event_global_current_base_' (libevent 2) is filled in by event_set(),
+    // allowing examination of its value without an explicit reference here.
+    // If ev.ev_base is nullptr, then event_init() must be called, otherwise
+    // call event_base_new().
+    event_set(&ev, 0, 0, nullptr, nullptr);
+    if (!ev.ev_base) {
+      evb_ = event_init();
+    }
+  }
+
+  if (ev.ev_base) {
+    evb_ = event_base_new();
+  }
+
+  if (UNLIKELY(evb_ == nullptr)) {
+    LOG(ERROR) << "EventBase(): Failed to init event base.";
+    folly::throwSystemError("error in EventBase::EventBase()");
+  }
+}
+
+EventBaseBackend::EventBaseBackend(event_base* evb) : evb_(evb) {
+  if (UNLIKELY(evb_ == nullptr)) {
+    LOG(ERROR) << "EventBase(): Pass nullptr as event base.";
+    throw std::invalid_argument("EventBase(): event base cannot be nullptr");
+  }
+}
+
+EventBaseBackend::~EventBaseBackend() {
+  std::lock_guard<std::mutex> lock(libevent_mutex_);
+  event_base_free(evb_);
+}
+
+int EventBaseBackend::eb_event_base_loop(int flags) {
+  return event_base_loop(evb_, flags);
+}
+
+int EventBaseBackend::eb_event_base_loopbreak() {
+  return event_base_loopbreak(evb_);
+}
+
+int EventBaseBackend::eb_event_add(
+    struct event& event,
+    const struct timeval* timeout) {
+  return event_add(&event, timeout);
+}
+
+int EventBaseBackend::eb_event_del(struct event& event) {
+  return event_del(&event);
+}
+
+} // namespace folly
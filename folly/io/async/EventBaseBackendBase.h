@@ -0,0 +1,103 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <folly/portability/Event.h>
+
+namespace folly {
+
+/**
+ * The event notification mechanism underneath an EventBase.
+ *
+ * EventHandler, AsyncTimeout and AsyncSignalHandler describe what they wait
+ * for with a libevent `struct event` attached (event_base_set()) to
+ * getEventBase(), and arm and disarm it with eb_event_add() and
+ * eb_event_del(). The default EventBaseBackend hands all of this to libevent.
+ *
+ * Other backends dispatch the events themselves. They still provide an
+ * event_base for events to be attached to, invoke the event's callback with
+ * the libevent signature, and keep the EVLIST_INSERTED / EVLIST_TIMEOUT
+ * flags of each armed event up to date so that
+ * EventUtil::isEventRegistered() keeps working. Events flagged
+ * EVLIST_INTERNAL don't count as pending work, just as with libevent.
+ *
+ * All methods except eb_event_base_loopbreak() are called from the loop
+ * thread only.
+ */
+class EventBaseBackendBase {
+ public:
+  virtual ~EventBaseBackendBase() = default;
+
+  virtual event_base* getEventBase() = 0;
+
+  /**
+   * Same contract as event_base_loop(): returns 0 on success, -1 on error,
+   * and 1 if there were no (non-internal) events to wait for.
+   */
+  virtual int eb_event_base_loop(int flags) = 0;
+  virtual int eb_event_base_loopbreak() = 0;
+
+  virtual int eb_event_add(
+      struct event& event,
+      const struct timeval* timeout) = 0;
+  virtual int eb_event_del(struct event& event) = 0;
+
+  /**
+   * Change the events of a registered event in place, as if it had been
+   * deleted, event_set() with the new events and added again. Returns -1
+   * if the backend can't do that, in which case the caller falls back to
+   * exactly that sequence.
+   */
+  virtual int eb_event_modify(struct event& /* event */, short /* events */) {
+    return -1;
+  }
+
+  /**
+   * Whether sockets that drain their fd on every wakeup should register
+   * edge-triggered (EventHandler::EDGE) with this backend.
+   */
+  virtual bool preferEdgeTriggered() const {
+    return false;
+  }
+};
+
+/**
+ * The libevent backend.
+ */
+class EventBaseBackend : public EventBaseBackendBase {
+ public:
+  EventBaseBackend();
+  // Takes ownership of evb, which will be freed with event_base_free().
+  explicit EventBaseBackend(event_base* evb);
+  ~EventBaseBackend() override;
+
+  event_base* getEventBase() override {
+    return evb_;
+  }
+
+  int eb_event_base_loop(int flags) override;
+  int eb_event_base_loopbreak() override;
+
+  int eb_event_add(struct event& event, const struct timeval* timeout)
+      override;
+  int eb_event_del(struct event& event) override;
+
+ private:
+  event_base* evb_;
+};
+
+} // namespace folly
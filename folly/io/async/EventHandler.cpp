@@ -51,7 +51,14 @@ bool EventHandler::registerImpl(uint16_t events, bool internal) {
       return true;
     }
 
-    event_del(&event_);
+    // Backends that can change the events in place save a del / add pair.
+    if (static_cast<bool>(flags & EVLIST_INTERNAL) == internal &&
+        eventBase_->getBackend()->eb_event_modify(event_, short(events)) ==
+            0) {
+      return true;
+    }
+
+    eventBase_->getBackend()->eb_event_del(event_);
   }
 
   // Update the event flags
@@ -88,11 +95,11 @@ bool EventHandler::registerImpl(uint16_t events, bool internal) {
   // if the I/O event flags haven't changed.  Using a separate event struct is
   // therefore slightly more efficient in this case (although it does take up
   // more space).
-  if (event_add(&event_, nullptr) < 0) {
+  if (eventBase_->getBackend()->eb_event_add(event_, nullptr) < 0) {
     LOG(ERROR) << "EventBase: failed to register event handler for fd "
                << event_.ev_fd << ": " << strerror(errno);
     // Call event_del() to make sure the event is completely uninstalled
-    event_del(&event_);
+    eventBase_->getBackend()->eb_event_del(event_);
     return false;
   }
 
@@ -101,7 +108,7 @@ bool EventHandler::registerImpl(uint16_t events, bool internal) {
 
 void EventHandler::unregisterHandler() {
   if (isHandlerRegistered()) {
-    event_del(&event_);
+    eventBase_->getBackend()->eb_event_del(event_);
   }
 }
 
@@ -157,7 +164,10 @@ void EventHandler::libeventCallback(libevent_fd_t fd, short events, void* arg) {
   // this can't possibly fire if handler->eventBase_ is nullptr
   handler->eventBase_->bumpHandlingTime();
 
-  handler->handlerReady(uint16_t(events));
+  {
+    EventBase::CallbackTimer timer(*handler->eventBase_, handler);
+    handler->handlerReady(uint16_t(events));
+  }
 
   if (observer) {
     observer->stopped(reinterpret_cast<uintptr_t>(handler));
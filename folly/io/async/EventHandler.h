@@ -46,6 +46,11 @@ class EventHandler : private boost::noncopyable {
 // Temporary flag until EPOLLPRI is upstream on libevent.
 #ifdef EV_PRI
     PRI = EV_PRI,
+#endif
+#ifdef EV_ET
+    // Only honored by backends whose preferEdgeTriggered() is true; the
+    // handler must then read or write until EAGAIN on every wakeup.
+    EDGE = EV_ET,
 #endif
   };
 
@@ -24,6 +24,7 @@
 #include <folly/Bits.h>
 
 #include <cassert>
+#include <limits>
 
 using std::chrono::milliseconds;
 
@@ -65,9 +66,8 @@ void HHWheelTimer::Callback::cancelTimeoutImpl() {
     wheel_->AsyncTimeout::cancelTimeout();
   }
   unlink();
-  if ((-1 != bucket_) && (wheel_->buckets_[0][bucket_].empty())) {
-    auto bi = makeBitIterator(wheel_->bitmap_.begin());
-    *(bi + bucket_) = false;
+  if ((-1 != bucket_) && (wheel_->buckets_[bucket_][tick_].empty())) {
+    wheel_->setListBusy(bucket_, tick_, false);
   }
 
   wheel_ = nullptr;
@@ -87,7 +87,7 @@ HHWheelTimer::HHWheelTimer(
       count_(0),
       startTime_(getCurTime()),
       processingCallbacksGuard_(nullptr) {
-  bitmap_.resize((WHEEL_SIZE / sizeof(uint64_t)) / 8, 0);
+  bitmap_.resize(WHEEL_BUCKETS * (WHEEL_SIZE / sizeof(uint64_t)) / 8, 0);
 }
 
 HHWheelTimer::~HHWheelTimer() {
@@ -112,31 +112,34 @@ void HHWheelTimer::scheduleTimeoutImpl(Callback* callback,
   auto nextTick = calcNextTick();
   int64_t due = timeToWheelTicks(timeout) + nextTick;
   int64_t diff = due - nextTick;
-  CallbackList* list;
-
-  auto bi = makeBitIterator(bitmap_.begin());
+  int bucket;
+  int tick;
 
   if (diff < 0) {
-    list = &buckets_[0][nextTick & WHEEL_MASK];
-    *(bi + (nextTick & WHEEL_MASK)) = true;
-    callback->bucket_ = nextTick & WHEEL_MASK;
+    bucket = 0;
+    tick = nextTick & WHEEL_MASK;
   } else if (diff < WHEEL_SIZE) {
-    list = &buckets_[0][due & WHEEL_MASK];
-    *(bi + (due & WHEEL_MASK)) = true;
-    callback->bucket_ = due & WHEEL_MASK;
+    bucket = 0;
+    tick = due & WHEEL_MASK;
   } else if (diff < 1 << (2 * WHEEL_BITS)) {
-    list = &buckets_[1][(due >> WHEEL_BITS) & WHEEL_MASK];
+    bucket = 1;
+    tick = (due >> WHEEL_BITS) & WHEEL_MASK;
   } else if (diff < 1 << (3 * WHEEL_BITS)) {
-    list = &buckets_[2][(due >> 2 * WHEEL_BITS) & WHEEL_MASK];
+    bucket = 2;
+    tick = (due >> 2 * WHEEL_BITS) & WHEEL_MASK;
   } else {
     /* in largest slot */
     if (diff > LARGEST_SLOT) {
       diff = LARGEST_SLOT;
       due = diff + nextTick;
     }
-    list = &buckets_[3][(due >> 3 * WHEEL_BITS) & WHEEL_MASK];
+    bucket = 3;
+    tick = (due >> 3 * WHEEL_BITS) & WHEEL_MASK;
   }
-  list->push_back(*callback);
+  buckets_[bucket][tick].push_back(*callback);
+  setListBusy(bucket, tick, true);
+  callback->bucket_ = bucket;
+  callback->tick_ = tick;
 }
 
 void HHWheelTimer::scheduleTimeout(Callback* callback,
@@ -165,13 +168,101 @@ void HHWheelTimer::scheduleTimeout(Callback* callback) {
   scheduleTimeout(callback, defaultTimeout_);
 }
 
+void HHWheelTimer::scheduleTimeouts(
+    Range<Callback* const*> callbacks,
+    std::chrono::milliseconds timeout) {
+  auto context = RequestContext::saveContext();
+  for (auto* callback : callbacks) {
+    callback->cancelTimeout();
+    callback->context_ = context;
+    count_++;
+    callback->setScheduled(this, timeout);
+    scheduleTimeoutImpl(callback, timeout);
+  }
+
+  if (!processingCallbacksGuard_) {
+    scheduleNextTimeout();
+  }
+}
+
+size_t HHWheelTimer::cancelTimeouts(Range<Callback* const*> callbacks) {
+  size_t count = 0;
+  for (auto* callback : callbacks) {
+    if (callback->wheel_ == this) {
+      callback->cancelTimeoutImpl();
+      ++count;
+    } else {
+      callback->cancelTimeout();
+    }
+  }
+
+  // The timer may still be armed for a list that is now empty.
+  if (tickless_ && count_ > 0 && count > 0 && !processingCallbacksGuard_) {
+    this->AsyncTimeout::cancelTimeout();
+    scheduleNextTimeout();
+  }
+  return count;
+}
+
+void HHWheelTimer::setTickless(bool tickless) {
+  if (tickless_ == tickless) {
+    return;
+  }
+  tickless_ = tickless;
+  if (count_ > 0 && !processingCallbacksGuard_) {
+    this->AsyncTimeout::cancelTimeout();
+    scheduleNextTimeout();
+  }
+}
+
+void HHWheelTimer::setListBusy(int bucket, int tick, bool busy) {
+  auto bi = makeBitIterator(bitmap_.begin());
+  *(bi + bucket * WHEEL_SIZE + tick) = busy;
+}
+
+int HHWheelTimer::findBusyList(int bucket, int tick) {
+  auto begin = makeBitIterator(bitmap_.begin()) + bucket * WHEEL_SIZE;
+  auto end = begin + WHEEL_SIZE;
+  auto it = folly::findFirstSet(begin + tick, end);
+  if (it == end) {
+    it = folly::findFirstSet(begin, begin + tick);
+    if (it == begin + tick) {
+      return -1;
+    }
+  }
+  return int(std::distance(begin, it));
+}
+
+int64_t HHWheelTimer::findNextBusyTick(int64_t nextTick) {
+  // Lists of bucket 0 come due once per rotation, the lists of bucket N are
+  // cascaded once every WHEEL_SIZE^N ticks.
+  int64_t next = std::numeric_limits<int64_t>::max();
+  for (int bucket = 0; bucket < WHEEL_BUCKETS; ++bucket) {
+    int shift = bucket * WHEEL_BITS;
+    int64_t period = int64_t(1) << shift;
+    int64_t first = (nextTick + period - 1) >> shift;
+    int current = first & WHEEL_MASK;
+    int tick = findBusyList(bucket, current);
+    if (tick != -1) {
+      int64_t distance = (tick - current) & WHEEL_MASK;
+      next = std::min(next, (first + distance) << shift);
+    }
+  }
+  return next;
+}
+
 bool HHWheelTimer::cascadeTimers(int bucket, int tick) {
   CallbackList cbs;
   cbs.swap(buckets_[bucket][tick]);
+  setListBusy(bucket, tick, false);
+  // Measure what is left from the start of the tick being processed, which
+  // scheduleTimeoutImpl() counts from, rather than from now: if we woke up
+  // late, the timeouts would otherwise fire early by as much.
+  auto tickTime = startTime_ + interval_ * lastTick_;
   while (!cbs.empty()) {
     auto* cb = &cbs.front();
     cbs.pop_front();
-    scheduleTimeoutImpl(cb, cb->getTimeRemaining(getCurTime()));
+    scheduleTimeoutImpl(cb, cb->getTimeRemaining(tickTime));
   }
 
   // If tick is zero, timeoutExpired will cascade the next bucket.
@@ -203,8 +294,7 @@ void HHWheelTimer::timeoutExpired() noexcept {
   while (lastTick_ < nextTick) {
     int idx = lastTick_ & WHEEL_MASK;
 
-    auto bi = makeBitIterator(bitmap_.begin());
-    *(bi + idx) = false;
+    setListBusy(0, idx, false);
 
     lastTick_++;
     CallbackList* cbs = &buckets_[0][idx];
@@ -276,12 +366,17 @@ size_t HHWheelTimer::cancelAll() {
 }
 
 void HHWheelTimer::scheduleNextTimeout() {
+  if (tickless_) {
+    scheduleNextTicklessTimeout();
+    return;
+  }
+
   auto nextTick = calcNextTick();
   int64_t tick = 1;
 
   if (nextTick & WHEEL_MASK) {
     auto bi = makeBitIterator(bitmap_.begin());
-    auto bi_end = makeBitIterator(bitmap_.end());
+    auto bi_end = bi + WHEEL_SIZE;
     auto it = folly::findFirstSet(bi + (nextTick & WHEEL_MASK), bi_end);
     if (it == bi_end) {
       tick = WHEEL_SIZE - ((nextTick - 1) & WHEEL_MASK);
@@ -301,6 +396,31 @@ void HHWheelTimer::scheduleNextTimeout() {
   }
 }
 
+void HHWheelTimer::scheduleNextTicklessTimeout() {
+  if (count_ == 0) {
+    this->AsyncTimeout::cancelTimeout();
+    return;
+  }
+
+  auto nextTick = calcNextTick();
+  auto tick = findNextBusyTick(nextTick);
+  if (this->AsyncTimeout::isScheduled() && expireTick_ <= tick) {
+    return;
+  }
+
+  // timeoutExpired() handles tick once calcNextTick() has moved past it.
+  auto now = getCurTime();
+  auto due = startTime_ + interval_ * (tick + 1);
+  auto timeout = std::chrono::milliseconds(0);
+  if (due > now) {
+    timeout = std::chrono::duration_cast<std::chrono::milliseconds>(
+        due - now + std::chrono::milliseconds(1) -
+        std::chrono::steady_clock::duration(1));
+  }
+  this->AsyncTimeout::scheduleTimeout(timeout);
+  expireTick_ = tick;
+}
+
 int64_t HHWheelTimer::calcNextTick() {
   auto intervals = (getCurTime() - startTime_) / interval_;
   // Slow eventbases will have skew between the actual time and the
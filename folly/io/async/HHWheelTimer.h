@@ -17,6 +17,7 @@
 #pragma once
 
 #include <folly/Optional.h>
+#include <folly/Range.h>
 #include <folly/io/async/AsyncTimeout.h>
 #include <folly/io/async/DelayedDestruction.h>
 
@@ -50,6 +51,12 @@ namespace folly {
  * Unlike the original timer wheel paper, this implementation does
  * *not* tick constantly, and instead calculates the exact next wakeup
  * time.
+ *
+ * By default it still wakes up at the end of every rotation of bucket 0
+ * while any timeout is pending, to cascade the next list of bucket 1.  In
+ * tickless mode (see setTickless()) it only wakes up for lists that
+ * actually hold timeouts, so timeouts that are far out, like idle
+ * connection timeouts, cost no wakeups until they are nearly due.
  */
 class HHWheelTimer : private folly::AsyncTimeout,
                      public folly::DelayedDestruction {
@@ -131,7 +138,9 @@ class HHWheelTimer : private folly::AsyncTimeout,
 
     HHWheelTimer* wheel_{nullptr};
     std::chrono::steady_clock::time_point expiration_{};
+    // Wheel bucket and list this callback is on
     int bucket_{-1};
+    int tick_{-1};
 
     typedef boost::intrusive::list<
       Callback,
@@ -187,6 +196,21 @@ class HHWheelTimer : private folly::AsyncTimeout,
     return defaultTimeout_;
   }
 
+  /**
+   * Switch tickless mode on or off.
+   *
+   * In tickless mode the timer only wakes up when a list of the wheel that
+   * holds timeouts comes due: a list of bucket 0 when its timeouts expire,
+   * or a list of a higher bucket when it has to be cascaded.  Empty lists
+   * are skipped, and each wakeup is armed for the exact time its tick
+   * starts rather than a whole number of ticks from now.
+   */
+  void setTickless(bool tickless);
+
+  bool isTickless() const {
+    return tickless_;
+  }
+
   /**
    * Schedule the specified Callback to be invoked after the
    * specified timeout interval.
@@ -232,6 +256,25 @@ class HHWheelTimer : private folly::AsyncTimeout,
     scheduleTimeout(w, timeout);
   }
 
+  /**
+   * Schedule several callbacks to be invoked after the same timeout
+   * interval, like calling scheduleTimeout() on each of them, but only
+   * re-arming the timer once.  Callbacks that are already scheduled are
+   * rescheduled.
+   */
+  void scheduleTimeouts(
+      Range<Callback* const*> callbacks,
+      std::chrono::milliseconds timeout);
+
+  /**
+   * Cancel several callbacks, like calling cancelTimeout() on each of them.
+   * In tickless mode the timer is then re-armed once for whatever is still
+   * pending, instead of waking up for the lists that were emptied.
+   *
+   * @returns the number of callbacks that were scheduled on this timer.
+   */
+  size_t cancelTimeouts(Range<Callback* const*> callbacks);
+
   /**
    * Return the number of currently pending timeouts
    */
@@ -282,6 +325,14 @@ class HHWheelTimer : private folly::AsyncTimeout,
   }
 
   bool cascadeTimers(int bucket, int tick);
+
+  // Track which lists of the wheel are non-empty
+  void setListBusy(int bucket, int tick, bool busy);
+  // First non-empty list of bucket at or after tick, wrapping around the
+  // wheel, or -1 if the whole bucket is empty
+  int findBusyList(int bucket, int tick);
+  // First tick from nextTick on that needs a wakeup in tickless mode
+  int64_t findNextBusyTick(int64_t nextTick);
   int64_t lastTick_;
   int64_t expireTick_;
   uint64_t count_;
@@ -290,9 +341,11 @@ class HHWheelTimer : private folly::AsyncTimeout,
   int64_t calcNextTick();
 
   void scheduleNextTimeout();
+  void scheduleNextTicklessTimeout();
 
   bool* processingCallbacksGuard_;
   CallbackList timeouts; // Timeouts queued to run
+  bool tickless_{false};
 
   std::chrono::steady_clock::time_point getCurTime() {
     return std::chrono::steady_clock::now();
@@ -0,0 +1,695 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+#include <folly/Exception.h>
+#include <folly/FileUtil.h>
+#include <folly/Likely.h>
+#include <folly/ScopeGuard.h>
+#include <folly/io/async/DelayedDestruction.h>
+#include <folly/io/async/EventBase.h>
+#include <folly/io/async/EventHandler.h>
+#include <folly/io/async/Request.h>
+#include <folly/portability/Fcntl.h>
+#include <folly/portability/Sockets.h>
+#include <folly/portability/Unistd.h>
+
+#include <glog/logging.h>
+
+#if __linux__ && !__ANDROID__
+#ifndef FOLLY_HAVE_EVENTFD
+#define FOLLY_HAVE_EVENTFD
+#endif
+#include <folly/io/async/EventFDWrapper.h>
+#endif
+
+namespace folly {
+
+/**
+ * A lock-free multi-producer, single-consumer variant of NotificationQueue.
+ *
+ * Messages can be added from any thread, but at most one Consumer may be
+ * consuming from the queue at a time.  This is the shape of most queues
+ * feeding an EventBase (runInEventBaseThread() being the obvious one), and
+ * it lets producers get away with a single compare-and-swap instead of
+ * contending on a spinlock with each other and with the consumer.
+ *
+ * Producers push onto an intrusive stack.  Only the producer that finds the
+ * stack empty signals the eventfd/pipe, so a burst of N messages costs one
+ * write(2) rather than N.  The consumer takes the whole stack with a single
+ * exchange, reverses it into FIFO order and works through the batch without
+ * touching shared state again, only going back to the stack once the batch
+ * is exhausted.
+ *
+ * The interface mirrors NotificationQueue: maxSize is still advisory (only
+ * tryPutMessage() honours it), messages are delivered in the order they
+ * were put, each message runs in the RequestContext it was put from, and no
+ * messages may be added while consumeUntilDrained() is running.
+ *
+ * An MPSCNotificationQueue may not be destroyed while a consumer is still
+ * registered.  MessageT should be MoveConstructible; see NotificationQueue
+ * for what happens if its move constructor throws.
+ */
+template <typename MessageT>
+class MPSCNotificationQueue {
+  struct Node;
+
+ public:
+  /**
+   * A callback interface for consuming messages from the queue as they arrive.
+   */
+  class Consumer : public DelayedDestruction, private EventHandler {
+   public:
+    enum : uint16_t { kDefaultMaxReadAtOnce = 10 };
+
+    Consumer() {}
+
+    // create a consumer in-place, without the need to build new class
+    template <typename TCallback>
+    static std::unique_ptr<Consumer, DelayedDestruction::Destructor> make(
+        TCallback&& callback);
+
+    /**
+     * messageAvailable() will be invoked whenever a new
+     * message is available from the queue.
+     */
+    virtual void messageAvailable(MessageT&& message) noexcept = 0;
+
+    /**
+     * Begin consuming messages from the specified queue.
+     *
+     * The queue must not have another consumer registered.
+     */
+    void startConsuming(EventBase* eventBase, MPSCNotificationQueue* queue) {
+      init(eventBase, queue);
+      registerHandler(READ | PERSIST);
+    }
+
+    /**
+     * Same as above but registers this event handler as internal so that it
+     * doesn't count towards the pending reader count for the IOLoop.
+     */
+    void startConsumingInternal(
+        EventBase* eventBase, MPSCNotificationQueue* queue) {
+      init(eventBase, queue);
+      registerInternalHandler(READ | PERSIST);
+    }
+
+    /**
+     * Stop consuming messages.
+     *
+     * Messages that have not been delivered yet stay on the queue, and will
+     * be delivered to the next consumer.
+     */
+    void stopConsuming();
+
+    /**
+     * Consume messages off the queue until it is empty, ignoring the
+     * maxReadAtOnce limit.  putMessage()/tryPutMessage() throw, and
+     * tryPutMessageNoThrow() fails, while the queue is being drained.
+     *
+     * Must be called from the consumer's EventBase thread.  Returns false if
+     * the queue is already being drained.
+     */
+    bool consumeUntilDrained(size_t* numConsumed = nullptr) noexcept;
+
+    MPSCNotificationQueue* getCurrentQueue() const {
+      return queue_;
+    }
+
+    /**
+     * Set a limit on how many messages this consumer will read each iteration
+     * around the event loop.  A limit of 0 means no limit will be enforced.
+     */
+    void setMaxReadAtOnce(uint32_t maxAtOnce) {
+      maxReadAtOnce_ = maxAtOnce;
+    }
+    uint32_t getMaxReadAtOnce() const {
+      return maxReadAtOnce_;
+    }
+
+    EventBase* getEventBase() {
+      return base_;
+    }
+
+    void handlerReady(uint16_t events) noexcept override;
+
+   protected:
+    void destroy() override;
+
+    ~Consumer() override {}
+
+   private:
+    void consumeMessages(bool isDrain, size_t* numConsumed = nullptr) noexcept;
+
+    void init(EventBase* eventBase, MPSCNotificationQueue* queue);
+
+    MPSCNotificationQueue* queue_{nullptr};
+    bool* destroyedFlagPtr_{nullptr};
+    uint32_t maxReadAtOnce_{kDefaultMaxReadAtOnce};
+    EventBase* base_{nullptr};
+  };
+
+  enum class FdType {
+    PIPE,
+#ifdef FOLLY_HAVE_EVENTFD
+    EVENTFD,
+#endif
+  };
+
+  /**
+   * Create a new MPSCNotificationQueue.
+   *
+   * maxSize and fdType have the same meaning as for NotificationQueue.
+   */
+  explicit MPSCNotificationQueue(uint32_t maxSize = 0,
+#ifdef FOLLY_HAVE_EVENTFD
+                                 FdType fdType = FdType::EVENTFD)
+#else
+                                 FdType fdType = FdType::PIPE)
+#endif
+      : advisoryMaxQueueSize_(maxSize), pid_(pid_t(getpid())) {
+
+    RequestContext::saveContext();
+
+#ifdef FOLLY_HAVE_EVENTFD
+    if (fdType == FdType::EVENTFD) {
+      eventfd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+      if (eventfd_ == -1) {
+        if (errno == ENOSYS || errno == EINVAL) {
+          LOG(ERROR) << "failed to create eventfd for MPSCNotificationQueue: "
+                     << errno << ", falling back to pipe mode";
+          fdType = FdType::PIPE;
+        } else {
+          folly::throwSystemError("Failed to create eventfd for "
+                                  "MPSCNotificationQueue", errno);
+        }
+      }
+    }
+#endif
+    if (fdType == FdType::PIPE) {
+      if (pipe(pipeFds_)) {
+        folly::throwSystemError(
+            "Failed to create pipe for MPSCNotificationQueue", errno);
+      }
+      try {
+        if (fcntl(pipeFds_[0], F_SETFL, O_RDONLY | O_NONBLOCK) != 0) {
+          folly::throwSystemError("failed to put MPSCNotificationQueue pipe "
+                                  "read endpoint into non-blocking mode",
+                                  errno);
+        }
+        if (fcntl(pipeFds_[1], F_SETFL, O_WRONLY | O_NONBLOCK) != 0) {
+          folly::throwSystemError("failed to put MPSCNotificationQueue pipe "
+                                  "write endpoint into non-blocking mode",
+                                  errno);
+        }
+      } catch (...) {
+        ::close(pipeFds_[0]);
+        ::close(pipeFds_[1]);
+        throw;
+      }
+    }
+  }
+
+  ~MPSCNotificationQueue() {
+    freeList(pending_);
+    freeList(head_.load(std::memory_order_acquire));
+    if (eventfd_ >= 0) {
+      ::close(eventfd_);
+    }
+    if (pipeFds_[0] >= 0) {
+      ::close(pipeFds_[0]);
+    }
+    if (pipeFds_[1] >= 0) {
+      ::close(pipeFds_[1]);
+    }
+  }
+
+  /**
+   * Set the advisory maximum queue size enforced by tryPutMessage().
+   */
+  void setMaxQueueSize(uint32_t max) {
+    advisoryMaxQueueSize_ = max;
+  }
+
+  /**
+   * Put a message on the queue unless it already holds the advisory maximum
+   * number of messages, in which case std::overflow_error is thrown.  Throws
+   * std::runtime_error if the queue is being drained.
+   */
+  template <typename MessageTT>
+  void tryPutMessage(MessageTT&& message) {
+    putMessageImpl(std::forward<MessageTT>(message), advisoryMaxQueueSize_);
+  }
+
+  /**
+   * No-throw version of the above.  Returns false instead of throwing
+   * std::overflow_error or std::runtime_error; the message is left untouched
+   * in that case.
+   */
+  template <typename MessageTT>
+  bool tryPutMessageNoThrow(MessageTT&& message) {
+    return putMessageImpl(
+        std::forward<MessageTT>(message), advisoryMaxQueueSize_, false);
+  }
+
+  /**
+   * Unconditionally put a message on the queue, ignoring the maximum queue
+   * size.  Throws std::runtime_error if the queue is being drained.
+   */
+  template <typename MessageTT>
+  void putMessage(MessageTT&& message) {
+    putMessageImpl(std::forward<MessageTT>(message), 0);
+  }
+
+  /**
+   * Put several messages on the queue.  They are published together, so the
+   * consumer never sees only some of them.
+   */
+  template <typename InputIteratorT>
+  void putMessages(InputIteratorT first, InputIteratorT last) {
+    checkPid();
+    checkDraining();
+
+    // Build the chain newest-first, the same order the stack is kept in.
+    Node* chainHead = nullptr;
+    Node* chainTail = nullptr;
+    size_t numAdded = 0;
+    auto guard = makeGuard([&] { freeList(chainHead); });
+    auto ctx = RequestContext::saveContext();
+    for (; first != last; ++first) {
+      auto node = new Node(*first, ctx);
+      node->next = chainHead;
+      chainHead = node;
+      if (!chainTail) {
+        chainTail = node;
+      }
+      ++numAdded;
+    }
+    guard.dismiss();
+    if (numAdded == 0) {
+      return;
+    }
+    size_.fetch_add(numAdded, std::memory_order_relaxed);
+    push(chainHead, chainTail);
+  }
+
+  /**
+   * Try to immediately pull a message off of the queue, without blocking.
+   *
+   * This is a consumer-side operation: it must not race with a registered
+   * Consumer, so only call it from the consumer's thread or while no
+   * consumer is registered.
+   */
+  bool tryConsume(MessageT& result) {
+    checkPid();
+
+    Node* node = front();
+    if (UNLIKELY(node == nullptr)) {
+      return false;
+    }
+
+    result = std::move(node->msg);
+    RequestContext::setContext(std::move(node->context));
+    popFront();
+
+    return true;
+  }
+
+  /**
+   * Number of messages in the queue.  Only a snapshot when called outside
+   * the consumer's thread.
+   */
+  size_t size() const {
+    return size_t(std::max<ssize_t>(size_.load(std::memory_order_relaxed), 0));
+  }
+
+  /**
+   * Check that the queue is being used from the process that created it; see
+   * NotificationQueue::checkPid().
+   */
+  void checkPid() const { CHECK_EQ(pid_, pid_t(getpid())); }
+
+ private:
+  struct Node {
+    template <typename MessageTT>
+    Node(MessageTT&& m, std::shared_ptr<RequestContext> ctx)
+        : msg(std::forward<MessageTT>(m)), context(std::move(ctx)) {}
+
+    MessageT msg;
+    std::shared_ptr<RequestContext> context;
+    Node* next{nullptr};
+  };
+
+  MPSCNotificationQueue(MPSCNotificationQueue const&) = delete;
+  MPSCNotificationQueue& operator=(MPSCNotificationQueue const&) = delete;
+
+  static void freeList(Node* node) {
+    while (node) {
+      auto next = node->next;
+      delete node;
+      node = next;
+    }
+  }
+
+  void checkDraining() const {
+    if (UNLIKELY(draining_.load(std::memory_order_relaxed))) {
+      throw std::runtime_error("queue is draining, cannot add message");
+    }
+  }
+
+  // Reserve a slot, honouring maxSize if it is non-zero.
+  bool reserve(size_t maxSize, bool throws) {
+    if (maxSize == 0) {
+      size_.fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+    auto size = size_.load(std::memory_order_relaxed);
+    do {
+      if (size >= ssize_t(maxSize)) {
+        if (throws) {
+          throw std::overflow_error(
+              "unable to add message to MPSCNotificationQueue: "
+              "queue is full");
+        }
+        return false;
+      }
+    } while (!size_.compare_exchange_weak(
+        size, size + 1, std::memory_order_relaxed));
+    return true;
+  }
+
+  template <typename MessageTT>
+  bool putMessageImpl(MessageTT&& message, size_t maxSize, bool throws = true) {
+    checkPid();
+    if (UNLIKELY(draining_.load(std::memory_order_relaxed))) {
+      if (throws) {
+        throw std::runtime_error("queue is draining, cannot add message");
+      }
+      return false;
+    }
+    if (!reserve(maxSize, throws)) {
+      return false;
+    }
+    Node* node;
+    try {
+      node = new Node(
+          std::forward<MessageTT>(message), RequestContext::saveContext());
+    } catch (...) {
+      size_.fetch_sub(1, std::memory_order_relaxed);
+      throw;
+    }
+    push(node, node);
+    return true;
+  }
+
+  // Publish the chain first..last, which is linked newest-first.
+  void push(Node* first, Node* last) {
+    auto head = head_.load(std::memory_order_relaxed);
+    do {
+      last->next = head;
+    } while (!head_.compare_exchange_weak(
+        head, first, std::memory_order_release, std::memory_order_relaxed));
+    // Only the transition from empty needs a wakeup: anyone who finds the
+    // stack non-empty knows the consumer either has a signal pending or has
+    // yet to take the stack, and will see this message when it does.
+    if (head == nullptr) {
+      signal();
+    }
+  }
+
+  // Consumer side: the oldest message, taking a new batch off the stack if
+  // the current one is used up.
+  Node* front() {
+    if (pending_ == nullptr) {
+      auto node = head_.exchange(nullptr, std::memory_order_acquire);
+      // reverse into FIFO order
+      while (node) {
+        auto next = node->next;
+        node->next = pending_;
+        pending_ = node;
+        node = next;
+      }
+    }
+    return pending_;
+  }
+
+  void popFront() {
+    auto node = pending_;
+    pending_ = node->next;
+    size_.fetch_sub(1, std::memory_order_relaxed);
+    delete node;
+  }
+
+  void signal() const {
+    ssize_t bytes_written = 0;
+    size_t bytes_expected = 0;
+
+    do {
+      if (eventfd_ >= 0) {
+        // eventfd(2) dictates that we must write a 64-bit integer
+        uint64_t signal = 1;
+        bytes_expected = sizeof(signal);
+        bytes_written = ::write(eventfd_, &signal, bytes_expected);
+      } else {
+        uint8_t signal = 1;
+        bytes_expected = sizeof(signal);
+        bytes_written = ::write(pipeFds_[1], &signal, bytes_expected);
+      }
+    } while (bytes_written == -1 && errno == EINTR);
+
+    // A full pipe (or a saturated eventfd counter) is already readable.
+    if (bytes_written != ssize_t(bytes_expected) && errno != EAGAIN) {
+      folly::throwSystemError("failed to signal MPSCNotificationQueue after "
+                              "write", errno);
+    }
+  }
+
+  void drainSignals() {
+    if (eventfd_ >= 0) {
+      uint64_t message;
+      auto bytes_read = readNoInt(eventfd_, &message, sizeof(message));
+      CHECK(bytes_read != -1 || errno == EAGAIN);
+    } else {
+      uint8_t message[32];
+      ssize_t result;
+      while ((result = readNoInt(pipeFds_[0], &message, sizeof(message))) !=
+             -1) {
+      }
+      CHECK(errno == EAGAIN);
+    }
+  }
+
+  int getFd() const {
+    return eventfd_ >= 0 ? eventfd_ : pipeFds_[0];
+  }
+
+  // Written by producers, taken wholesale by the consumer.  Newest first.
+  std::atomic<Node*> head_{nullptr};
+  // The consumer's current batch, oldest first.  Only the consumer touches it.
+  Node* pending_{nullptr};
+  // Messages put but not yet consumed, including reserved slots whose
+  // message is still being constructed.
+  std::atomic<ssize_t> size_{0};
+  std::atomic<bool> draining_{false};
+  int eventfd_{-1};
+  int pipeFds_[2]{-1, -1}; // to fallback to on older/non-linux systems
+  uint32_t advisoryMaxQueueSize_;
+  pid_t pid_;
+  Consumer* consumer_{nullptr};
+};
+
+template <typename MessageT>
+void MPSCNotificationQueue<MessageT>::Consumer::destroy() {
+  // See NotificationQueue::Consumer::destroy().
+  if (destroyedFlagPtr_) {
+    *destroyedFlagPtr_ = true;
+  }
+  stopConsuming();
+  DelayedDestruction::destroy();
+}
+
+template <typename MessageT>
+void MPSCNotificationQueue<MessageT>::Consumer::handlerReady(
+    uint16_t /*events*/) noexcept {
+  consumeMessages(false);
+}
+
+template <typename MessageT>
+void MPSCNotificationQueue<MessageT>::Consumer::consumeMessages(
+    bool isDrain, size_t* numConsumed) noexcept {
+  DestructorGuard dg(this);
+  uint32_t numProcessed = 0;
+  SCOPE_EXIT {
+    if (numConsumed != nullptr) {
+      *numConsumed = numProcessed;
+    }
+  };
+
+  // Clear the signal before looking at the stack: a producer that pushes
+  // after we have taken it finds it empty and signals again, so no wakeup is
+  // lost.
+  auto queue = queue_;
+  queue->drainSignals();
+  SCOPE_EXIT {
+    // If we stopped early, make sure we are called again next time around
+    // the loop for whatever is left.  Nobody else will signal for it: that
+    // includes messages pushed onto the stack before we drained the signal
+    // above, if the batch ended before we got back to the stack for them.
+    if (queue_ == queue &&
+        (queue->pending_ != nullptr ||
+         queue->head_.load(std::memory_order_relaxed) != nullptr)) {
+      queue->signal();
+    }
+  };
+
+  while (true) {
+    Node* node = queue->front();
+    if (node == nullptr) {
+      return;
+    }
+
+    try {
+      MessageT msg(std::move(node->msg));
+      RequestContextScopeGuard rctx(std::move(node->context));
+      queue->popFront();
+
+      bool callbackDestroyed = false;
+      CHECK(destroyedFlagPtr_ == nullptr);
+      destroyedFlagPtr_ = &callbackDestroyed;
+      messageAvailable(std::move(msg));
+      destroyedFlagPtr_ = nullptr;
+
+      // If the callback was destroyed before it returned, we are done
+      if (callbackDestroyed) {
+        return;
+      }
+
+      // If the callback is no longer installed, we are done.
+      if (queue_ != queue) {
+        return;
+      }
+
+      ++numProcessed;
+      if (!isDrain && maxReadAtOnce_ > 0 && numProcessed >= maxReadAtOnce_) {
+        return;
+      }
+    } catch (const std::exception&) {
+      // Only the MessageT move constructor can get us here; the message is
+      // left at the front of the queue and retried next time around the
+      // event loop, as NotificationQueue does.
+      return;
+    }
+  }
+}
+
+template <typename MessageT>
+void MPSCNotificationQueue<MessageT>::Consumer::init(
+    EventBase* eventBase,
+    MPSCNotificationQueue* queue) {
+  eventBase->dcheckIsInEventBaseThread();
+  assert(queue_ == nullptr);
+  assert(!isHandlerRegistered());
+  queue->checkPid();
+  CHECK(queue->consumer_ == nullptr)
+      << "MPSCNotificationQueue supports a single consumer";
+
+  base_ = eventBase;
+  queue_ = queue;
+  queue_->consumer_ = this;
+
+  // Messages may have been left behind by a previous consumer, or put while
+  // there was none, and their signal may already have been consumed.  Like
+  // NotificationQueue, just start with a wakeup.
+  queue_->signal();
+
+  initHandler(eventBase, queue_->getFd());
+}
+
+template <typename MessageT>
+void MPSCNotificationQueue<MessageT>::Consumer::stopConsuming() {
+  if (queue_ == nullptr) {
+    assert(!isHandlerRegistered());
+    return;
+  }
+
+  assert(isHandlerRegistered());
+  unregisterHandler();
+  detachEventBase();
+  queue_->consumer_ = nullptr;
+  queue_ = nullptr;
+}
+
+template <typename MessageT>
+bool MPSCNotificationQueue<MessageT>::Consumer::consumeUntilDrained(
+    size_t* numConsumed) noexcept {
+  DestructorGuard dg(this);
+  auto queue = queue_;
+  if (queue->draining_.exchange(true, std::memory_order_relaxed)) {
+    return false;
+  }
+  consumeMessages(true, numConsumed);
+  queue->draining_.store(false, std::memory_order_relaxed);
+  return true;
+}
+
+namespace detail {
+
+template <typename MessageT, typename TCallback>
+struct mpsc_notification_queue_consumer_wrapper
+    : public MPSCNotificationQueue<MessageT>::Consumer {
+  template <typename UCallback>
+  explicit mpsc_notification_queue_consumer_wrapper(UCallback&& callback)
+      : callback_(std::forward<UCallback>(callback)) {}
+
+  void messageAvailable(MessageT&& message) noexcept override {
+    static_assert(
+        noexcept(std::declval<TCallback>()(std::forward<MessageT>(message))),
+        "callback must be declared noexcept, e.g.: `[]() noexcept {}`");
+
+    callback_(std::forward<MessageT>(message));
+  }
+
+ private:
+  TCallback callback_;
+};
+
+} // namespace detail
+
+template <typename MessageT>
+template <typename TCallback>
+std::unique_ptr<typename MPSCNotificationQueue<MessageT>::Consumer,
+                DelayedDestruction::Destructor>
+MPSCNotificationQueue<MessageT>::Consumer::make(TCallback&& callback) {
+  return std::unique_ptr<MPSCNotificationQueue<MessageT>::Consumer,
+                         DelayedDestruction::Destructor>(
+      new detail::mpsc_notification_queue_consumer_wrapper<
+          MessageT,
+          typename std::decay<TCallback>::type>(
+          std::forward<TCallback>(callback)));
+}
+
+} // namespace folly
@@ -0,0 +1,78 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/io/async/ReadBufferPool.h>
+
+#include <algorithm>
+
+#include <glog/logging.h>
+
+#include <folly/io/async/EventBaseLocal.h>
+
+namespace folly {
+
+constexpr size_t ReadBufferPool::kDefaultSlabSize;
+
+ReadBufferPool::ReadBufferPool(size_t slabSize) : slabSize_(slabSize) {
+  CHECK_GT(slabSize_, 0u);
+}
+
+ReadBufferPool& ReadBufferPool::get(EventBase& evb) {
+  static EventBaseLocal<ReadBufferPool> pools;
+  return pools.getOrCreate(evb);
+}
+
+std::unique_ptr<uint8_t[]> ReadBufferPool::acquire() {
+  std::unique_ptr<uint8_t[]> slab;
+  if (freeSlabs_.empty()) {
+    slab.reset(new uint8_t[slabSize_]);
+  } else {
+    slab = std::move(freeSlabs_.back());
+    freeSlabs_.pop_back();
+  }
+  highWaterSlabs_ = std::max(highWaterSlabs_, ++lentSlabs_);
+  return slab;
+}
+
+std::unique_ptr<IOBuf> ReadBufferPool::release(
+    std::unique_ptr<uint8_t[]> slab,
+    size_t bytesRead) {
+  DCHECK_GT(lentSlabs_, 0u);
+  DCHECK_LE(bytesRead, slabSize_);
+  --lentSlabs_;
+  std::unique_ptr<IOBuf> buf;
+  if (bytesRead > 0) {
+    buf = IOBuf::copyBuffer(slab.get(), bytesRead);
+    ++reads_;
+    bytesRead_ += bytesRead;
+    highWaterRead_ = std::max(highWaterRead_, bytesRead);
+  }
+  freeSlabs_.push_back(std::move(slab));
+  return buf;
+}
+
+ReadBufferPool::Stats ReadBufferPool::getStats() const {
+  Stats stats;
+  stats.slabSize = slabSize_;
+  stats.numSlabs = freeSlabs_.size() + lentSlabs_;
+  stats.highWaterSlabs = highWaterSlabs_;
+  stats.reads = reads_;
+  stats.bytesRead = bytesRead_;
+  stats.highWaterRead = highWaterRead_;
+  return stats;
+}
+
+} // namespace folly
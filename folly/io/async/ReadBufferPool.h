@@ -0,0 +1,102 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <folly/io/IOBuf.h>
+
+namespace folly {
+
+class EventBase;
+
+/**
+ * Read buffers shared by all the sockets of one EventBase that read in
+ * pooled mode (see AsyncSocket::setPooledReads()).
+ *
+ * A pooled read lands in a slab borrowed from here, and only the bytes that
+ * actually arrived are copied out into an IOBuf of their own.  A connection
+ * that is idle, or whose reader drains every buffer it is handed, therefore
+ * holds no receive buffer at all.  Everything on an EventBase runs in one
+ * thread, so a single slab normally serves all of its sockets; more are only
+ * allocated if a read callback reads from another pooled socket while the
+ * slab is still lent out.
+ *
+ * Not thread-safe: only use it from the thread running its EventBase.
+ */
+class ReadBufferPool {
+ public:
+  static constexpr size_t kDefaultSlabSize = 64 * 1024;
+
+  struct Stats {
+    // Size of every slab
+    size_t slabSize{0};
+    // Slabs currently allocated, whether lent out or not
+    size_t numSlabs{0};
+    // Most slabs lent out at the same time
+    size_t highWaterSlabs{0};
+    // Reads served from the pool, and the bytes they returned
+    uint64_t reads{0};
+    uint64_t bytesRead{0};
+    // Largest single read
+    size_t highWaterRead{0};
+  };
+
+  explicit ReadBufferPool(size_t slabSize = kDefaultSlabSize);
+
+  ReadBufferPool(const ReadBufferPool&) = delete;
+  ReadBufferPool& operator=(const ReadBufferPool&) = delete;
+
+  /**
+   * The pool shared by the sockets of evb, created on first use.
+   */
+  static ReadBufferPool& get(EventBase& evb);
+
+  size_t getSlabSize() const {
+    return slabSize_;
+  }
+
+  /**
+   * Borrow a slab of getSlabSize() bytes.  It must be returned with
+   * release() before control goes back to the event loop.
+   */
+  std::unique_ptr<uint8_t[]> acquire();
+
+  /**
+   * Return a slab, after copying the bytesRead bytes read into it out into
+   * an IOBuf that fits them exactly.
+   */
+  std::unique_ptr<IOBuf> release(
+      std::unique_ptr<uint8_t[]> slab,
+      size_t bytesRead);
+
+  Stats getStats() const;
+
+ private:
+  const size_t slabSize_;
+  std::vector<std::unique_ptr<uint8_t[]>> freeSlabs_;
+  size_t lentSlabs_{0};
+  size_t highWaterSlabs_{0};
+  uint64_t reads_{0};
+  uint64_t bytesRead_{0};
+  size_t highWaterRead_{0};
+};
+
+} // namespace folly
@@ -23,6 +23,7 @@
 #include <folly/SpinLock.h>
 #include <folly/ThreadId.h>
 #include <folly/ssl/Init.h>
+#include <folly/ssl/PrivateKeyOffload.h>
 
 // ---------------------------------------------------------------------
 // SSLContext implementation
@@ -74,6 +75,11 @@ SSLContext::SSLContext(SSLVersion version) {
 
 SSLContext::~SSLContext() {
   if (ctx_ != nullptr) {
+    // SSL objects may keep ctx_ alive past this point, so they must not
+    // reach a cache we no longer own.
+    if (sessionCache_) {
+      ssl::SSLSessionCache::install(ctx_, nullptr);
+    }
     SSL_CTX_free(ctx_);
     ctx_ = nullptr;
   }
@@ -311,6 +317,14 @@ void SSLContext::loadPrivateKeyFromBufferPEM(folly::StringPiece pkey) {
   }
 }
 
+void SSLContext::setPrivateKeyExecutor(std::shared_ptr<Executor> executor) {
+  if (!executor) {
+    throw std::invalid_argument("setPrivateKeyExecutor: executor is null");
+  }
+  ssl::offloadPrivateKeyOperations(ctx_, executor.get());
+  privateKeyExecutor_ = std::move(executor);
+}
+
 void SSLContext::loadTrustedCertificates(const char* path) {
   if (path == nullptr) {
     throw std::invalid_argument("loadTrustedCertificates: <path> is nullptr");
@@ -601,6 +615,11 @@ void SSLContext::setSessionCacheContext(const std::string& context) {
           SSL_MAX_SSL_SESSION_ID_LENGTH));
 }
 
+void SSLContext::setSessionCache(std::shared_ptr<ssl::SSLSessionCache> cache) {
+  ssl::SSLSessionCache::install(ctx_, cache.get());
+  sessionCache_ = std::move(cache);
+}
+
 /**
  * Match a name with a pattern. The pattern may include wildcard. A single
  * wildcard "*" can match up to one component in the domain name.
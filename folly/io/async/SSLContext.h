@@ -30,12 +30,14 @@
 #include <folly/folly-config.h>
 #endif
 
+#include <folly/Executor.h>
 #include <folly/Portability.h>
 #include <folly/Range.h>
 #include <folly/io/async/ssl/OpenSSLUtils.h>
 #include <folly/portability/OpenSSL.h>
 #include <folly/ssl/OpenSSLLockTypes.h>
 #include <folly/ssl/OpenSSLPtrTypes.h>
+#include <folly/ssl/SSLSessionCache.h>
 
 namespace folly {
 
@@ -249,6 +251,22 @@ class SSLContext {
    * @param pkey  A PEM formatted key
    */
   virtual void loadPrivateKeyFromBufferPEM(folly::StringPiece pkey);
+  /**
+   * Run the RSA/ECDSA private key operations of handshakes on executor
+   * rather than on the EventBase thread of each AsyncSSLSocket, which
+   * suspends the handshake until the result is in.  Must be called after
+   * the certificate and private key are loaded.  Requires OpenSSL 1.1.0+.
+   *
+   * @param executor Executor to run the private key operations on
+   */
+  virtual void setPrivateKeyExecutor(std::shared_ptr<Executor> executor);
+  /**
+   * Whether setPrivateKeyExecutor() was called, in which case handshakes
+   * run in OpenSSL async jobs.
+   */
+  bool hasPrivateKeyExecutor() const {
+    return privateKeyExecutor_ != nullptr;
+  }
   /**
    * Load trusted certificates from specified file.
    *
@@ -344,6 +362,18 @@ class SSLContext {
    */
   void setSessionCacheContext(const std::string& context);
 
+  /**
+   * Store server-side sessions in the given cache instead of OpenSSL's
+   * per-context internal one. The same cache may be installed on any number
+   * of contexts (e.g. one per SNI name) to share sessions between them.
+   * Passing nullptr restores the internal cache.
+   */
+  void setSessionCache(std::shared_ptr<ssl::SSLSessionCache> cache);
+
+  const std::shared_ptr<ssl::SSLSessionCache>& getSessionCache() const {
+    return sessionCache_;
+  }
+
   /**
    * Set the options on the SSL_CTX object.
    */
@@ -483,6 +513,8 @@ class SSLContext {
   bool checkPeerName_;
   std::string peerFixedName_;
   std::shared_ptr<PasswordCollector> collector_;
+  std::shared_ptr<ssl::SSLSessionCache> sessionCache_;
+  std::shared_ptr<Executor> privateKeyExecutor_;
 #if FOLLY_OPENSSL_HAS_SNI
   ServerNameCallback serverNameCb_;
   std::vector<ClientHelloCallback> clientHelloCbs_;
@@ -97,6 +97,10 @@ bool TimeoutManager::tryRunAfterDelay(
   return true;
 }
 
+void TimeoutManager::runTimeout(AsyncTimeout* timeout) noexcept {
+  timeout->timeoutExpired();
+}
+
 void TimeoutManager::clearCobTimeouts() {
   if (!cobTimeouts_) {
     return;
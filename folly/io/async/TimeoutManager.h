@@ -68,6 +68,12 @@ class TimeoutManager {
    */
   virtual void bumpHandlingTime() = 0;
 
+  /**
+   * Called by AsyncTimeout to run timeout->timeoutExpired() when it fires,
+   * which lets the manager instrument its timeouts.
+   */
+  virtual void runTimeout(AsyncTimeout* timeout) noexcept;
+
   /**
    * Helper method to know whether we are running in the timeout manager
    * thread
@@ -105,6 +105,10 @@ class VirtualEventBase : public folly::Executor, public folly::TimeoutManager {
     evb_.bumpHandlingTime();
   }
 
+  void runTimeout(AsyncTimeout* timeout) noexcept override {
+    evb_.runTimeout(timeout);
+  }
+
   bool isInTimeoutManagerThread() override {
     return evb_.isInTimeoutManagerThread();
   }
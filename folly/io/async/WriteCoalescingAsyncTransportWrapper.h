@@ -0,0 +1,289 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <utility>
+#include <vector>
+
+#include <folly/io/IOBuf.h>
+#include <folly/io/IOBufQueue.h>
+#include <folly/io/async/AsyncTransport.h>
+#include <folly/io/async/DecoratedAsyncTransportWrapper.h>
+#include <folly/io/async/EventBase.h>
+
+namespace folly {
+
+/**
+ * Transport wrapper that coalesces the writes issued during one EventBase
+ * loop iteration into a single writeChain() on the wrapped transport.
+ *
+ * Protocol stacks that emit many small frames per request would otherwise
+ * pay for one writev() per frame.  Here every write is appended to a buffer
+ * (small buffers are packed together), and the buffer is handed to the
+ * wrapped transport from a loop callback once the current iteration is done
+ * with its callbacks.  The buffer is flushed earlier when it reaches
+ * Options::maxBufferSize, or on the next write once the oldest buffered
+ * write has waited Options::maxDelay.
+ *
+ * Write callbacks are invoked in order once the coalesced write that carried
+ * their bytes completes.  If it fails, callbacks whose bytes were all
+ * written still get writeSuccess(), and the others get writeErr() with the
+ * number of their own bytes that made it out.
+ *
+ * Empty writes, writes of maxBufferSize bytes or more, and writes with
+ * WRITE_SHUTDOWN or WRITE_MSG_ZEROCOPY set, flush the buffer and then go
+ * straight to the wrapped transport.  CORK is ignored, and EOR applies to
+ * the last byte of the coalesced write.  Closing, shutting down writes or
+ * detaching the EventBase flushes the buffer first.
+ */
+template <class T>
+class WriteCoalescingAsyncTransportWrapper
+    : public DecoratedAsyncTransportWrapper<T>,
+      private EventBase::LoopCallback {
+ public:
+  using UniquePtr = std::unique_ptr<
+      WriteCoalescingAsyncTransportWrapper,
+      DelayedDestruction::Destructor>;
+
+  struct Options {
+    // Flush as soon as this many bytes are buffered.
+    size_t maxBufferSize{64 * 1024};
+    // Flush on the next write once the oldest buffered write is this old.
+    // Zero disables the check.
+    std::chrono::microseconds maxDelay{0};
+  };
+
+  explicit WriteCoalescingAsyncTransportWrapper(
+      typename T::UniquePtr transport)
+      : WriteCoalescingAsyncTransportWrapper(std::move(transport), Options()) {}
+
+  WriteCoalescingAsyncTransportWrapper(
+      typename T::UniquePtr transport,
+      Options options)
+      : DecoratedAsyncTransportWrapper<T>(std::move(transport)),
+        options_(options) {}
+
+  void write(
+      folly::AsyncTransportWrapper::WriteCallback* callback,
+      const void* buf,
+      size_t bytes,
+      folly::WriteFlags flags = folly::WriteFlags::NONE) override {
+    if (!shouldBuffer(bytes, flags)) {
+      flush();
+      this->transport_->write(callback, buf, bytes, flags);
+      return;
+    }
+    auto begin = buffer_.chainLength();
+    buffer_.append(buf, bytes);
+    buffered(callback, flags, begin);
+  }
+
+  void writev(
+      folly::AsyncTransportWrapper::WriteCallback* callback,
+      const iovec* vec,
+      size_t count,
+      folly::WriteFlags flags = folly::WriteFlags::NONE) override {
+    size_t bytes = 0;
+    for (size_t i = 0; i < count; ++i) {
+      bytes += vec[i].iov_len;
+    }
+    if (!shouldBuffer(bytes, flags)) {
+      flush();
+      this->transport_->writev(callback, vec, count, flags);
+      return;
+    }
+    auto begin = buffer_.chainLength();
+    for (size_t i = 0; i < count; ++i) {
+      buffer_.append(vec[i].iov_base, vec[i].iov_len);
+    }
+    buffered(callback, flags, begin);
+  }
+
+  void writeChain(
+      folly::AsyncTransportWrapper::WriteCallback* callback,
+      std::unique_ptr<folly::IOBuf>&& buf,
+      folly::WriteFlags flags = folly::WriteFlags::NONE) override {
+    if (!buf || !shouldBuffer(buf->computeChainDataLength(), flags)) {
+      flush();
+      this->transport_->writeChain(callback, std::move(buf), flags);
+      return;
+    }
+    auto begin = buffer_.chainLength();
+    buffer_.append(std::move(buf), true);
+    buffered(callback, flags, begin);
+  }
+
+  /**
+   * Hand everything buffered so far to the wrapped transport now.
+   */
+  void flush() {
+    DelayedDestruction::DestructorGuard dg(this);
+    flushImpl();
+  }
+
+  /**
+   * Number of bytes waiting for the next flush.
+   */
+  size_t getBufferedBytes() const {
+    return buffer_.chainLength();
+  }
+
+  const Options& getOptions() const {
+    return options_;
+  }
+
+  void close() override {
+    flush();
+    this->transport_->close();
+  }
+
+  void closeNow() override {
+    flush();
+    this->transport_->closeNow();
+  }
+
+  void closeWithReset() override {
+    flush();
+    DecoratedAsyncTransportWrapper<T>::closeWithReset();
+  }
+
+  void shutdownWrite() override {
+    flush();
+    this->transport_->shutdownWrite();
+  }
+
+  void shutdownWriteNow() override {
+    flush();
+    this->transport_->shutdownWriteNow();
+  }
+
+  void detachEventBase() override {
+    flush();
+    cancelLoopCallback();
+    this->transport_->detachEventBase();
+  }
+
+ protected:
+  ~WriteCoalescingAsyncTransportWrapper() override {
+    flushImpl();
+  }
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  /**
+   * Write callback of one coalesced write, which fans its outcome out to the
+   * callbacks of the writes it carried and then deletes itself.
+   */
+  class Batch : public folly::AsyncTransportWrapper::WriteCallback {
+   public:
+    struct Entry {
+      WriteCallback* callback;
+      // Offsets of the write's bytes in the coalesced write
+      size_t begin;
+      size_t end;
+    };
+
+    // In write order.  Writes without a callback have no entry, so the
+    // entries needn't cover the coalesced write.
+    std::vector<Entry> entries;
+
+    void writeSuccess() noexcept override {
+      for (auto& entry : entries) {
+        entry.callback->writeSuccess();
+      }
+      delete this;
+    }
+
+    void writeErr(
+        size_t bytesWritten,
+        const AsyncSocketException& ex) noexcept override {
+      for (auto& entry : entries) {
+        if (entry.end <= bytesWritten) {
+          entry.callback->writeSuccess();
+        } else {
+          entry.callback->writeErr(
+              std::max(bytesWritten, entry.begin) - entry.begin, ex);
+        }
+      }
+      delete this;
+    }
+  };
+
+  bool shouldBuffer(size_t bytes, folly::WriteFlags flags) const {
+    return bytes > 0 && bytes < options_.maxBufferSize &&
+        !isSet(flags, folly::WriteFlags::WRITE_SHUTDOWN) &&
+        !isSet(flags, folly::WriteFlags::WRITE_MSG_ZEROCOPY) &&
+        this->transport_->getEventBase() != nullptr;
+  }
+
+  // Called once a write has been appended to buffer_, starting at begin.
+  void buffered(
+      folly::AsyncTransportWrapper::WriteCallback* callback,
+      folly::WriteFlags flags,
+      size_t begin) {
+    flags_ |= unSet(flags, folly::WriteFlags::CORK);
+    if (callback) {
+      if (!batch_) {
+        batch_ = new Batch();
+      }
+      batch_->entries.push_back({callback, begin, buffer_.chainLength()});
+    }
+
+    if (buffer_.chainLength() >= options_.maxBufferSize) {
+      flush();
+      return;
+    }
+    if (options_.maxDelay.count() > 0) {
+      auto now = Clock::now();
+      if (!isLoopCallbackScheduled()) {
+        firstWriteTime_ = now;
+      } else if (now - firstWriteTime_ >= options_.maxDelay) {
+        flush();
+        return;
+      }
+    }
+    if (!isLoopCallbackScheduled()) {
+      this->transport_->getEventBase()->runInLoop(this, true);
+    }
+  }
+
+  void flushImpl() {
+    cancelLoopCallback();
+    if (buffer_.empty()) {
+      return;
+    }
+    auto flags = flags_;
+    auto batch = batch_;
+    flags_ = folly::WriteFlags::NONE;
+    batch_ = nullptr;
+    this->transport_->writeChain(batch, buffer_.move(), flags);
+  }
+
+  void runLoopCallback() noexcept override {
+    flush();
+  }
+
+  const Options options_;
+  IOBufQueue buffer_{IOBufQueue::cacheChainLength()};
+  folly::WriteFlags flags_{folly::WriteFlags::NONE};
+  Batch* batch_{nullptr};
+  Clock::time_point firstWriteTime_;
+};
+
+} // namespace folly
@@ -47,6 +47,12 @@ bool OpenSSLUtils::getTLSMasterKey(
         masterKey, masterKey + session->master_key_length, keyOut.begin());
     return true;
   }
+#elif FOLLY_OPENSSL_IS_110
+  if (session &&
+      SSL_SESSION_get_master_key(session, nullptr, 0) == keyOut.size()) {
+    SSL_SESSION_get_master_key(session, keyOut.begin(), keyOut.size());
+    return true;
+  }
 #else
   (SSL_SESSION*)session;
   (MutableByteRange) keyOut;
@@ -64,6 +70,35 @@ bool OpenSSLUtils::getTLSClientRandom(
     std::copy(clientRandom, clientRandom + SSL3_RANDOM_SIZE, randomOut.begin());
     return true;
   }
+#elif FOLLY_OPENSSL_IS_110
+  if ((SSL_version(ssl) >> 8) == TLS1_VERSION_MAJOR &&
+      randomOut.size() == SSL3_RANDOM_SIZE) {
+    SSL_get_client_random(ssl, randomOut.begin(), randomOut.size());
+    return true;
+  }
+#else
+  (SSL*)ssl;
+  (MutableByteRange) randomOut;
+#endif
+  return false;
+}
+
+bool OpenSSLUtils::getTLSServerRandom(
+    const SSL* ssl,
+    MutableByteRange randomOut) {
+#if FOLLY_OPENSSL_IS_101 || FOLLY_OPENSSL_IS_102
+  if ((SSL_version(ssl) >> 8) == TLS1_VERSION_MAJOR && ssl->s3 &&
+      randomOut.size() == SSL3_RANDOM_SIZE) {
+    auto serverRandom = ssl->s3->server_random;
+    std::copy(serverRandom, serverRandom + SSL3_RANDOM_SIZE, randomOut.begin());
+    return true;
+  }
+#elif FOLLY_OPENSSL_IS_110
+  if ((SSL_version(ssl) >> 8) == TLS1_VERSION_MAJOR &&
+      randomOut.size() == SSL3_RANDOM_SIZE) {
+    SSL_get_server_random(ssl, randomOut.begin(), randomOut.size());
+    return true;
+  }
 #else
   (SSL*)ssl;
   (MutableByteRange) randomOut;
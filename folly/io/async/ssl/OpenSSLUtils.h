@@ -49,6 +49,17 @@ class OpenSSLUtils {
    */
   static bool getTLSClientRandom(const SSL* ssl, MutableByteRange randomOut);
 
+  /*
+   * Get the TLS Server Random used to generate the TLS key material
+   *
+   * @param ssl
+   * @param randomOut destination for the server random, the buffer must be
+   * exactly 32 bytes
+   * @return true if the server random is available (>= TLS1) and the output
+   * buffer is the right size
+   */
+  static bool getTLSServerRandom(const SSL* ssl, MutableByteRange randomOut);
+
   /**
    * Validate that the peer certificate's common name or subject alt names
    * match what we expect.  Currently this only checks for IPs within
@@ -15,10 +15,14 @@
  */
 #include <folly/io/async/test/AsyncSSLSocketTest.h>
 
+#include <folly/FileUtil.h>
+#include <folly/ScopeGuard.h>
 #include <folly/SocketAddress.h>
+#include <folly/experimental/TestUtil.h>
 #include <folly/io/Cursor.h>
 #include <folly/io/async/AsyncSSLSocket.h>
 #include <folly/io/async/EventBase.h>
+#include <folly/io/async/ScopedEventBaseThread.h>
 #include <folly/portability/GMock.h>
 #include <folly/portability/GTest.h>
 #include <folly/portability/OpenSSL.h>
@@ -179,6 +183,158 @@ TEST(AsyncSSLSocketTest, ConnectWriteReadClose) {
   EXPECT_EQ(socket->getSSLSocket()->getTotalConnectTimeout().count(), 10000);
 }
 
+namespace {
+
+// Whether the kernel accepts the "tls" ULP on a connected TCP socket.
+bool kernelSupportsKTLS() {
+#ifdef __linux__
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  int client = socket(AF_INET, SOCK_STREAM, 0);
+  int server = -1;
+  SCOPE_EXIT {
+    for (int fd : {listener, client, server}) {
+      if (fd >= 0) {
+        close(fd);
+      }
+    }
+  };
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t len = sizeof(addr);
+  if (listener < 0 || client < 0 ||
+      bind(listener, reinterpret_cast<sockaddr*>(&addr), len) != 0 ||
+      listen(listener, 1) != 0 ||
+      getsockname(listener, reinterpret_cast<sockaddr*>(&addr), &len) != 0 ||
+      connect(client, reinterpret_cast<sockaddr*>(&addr), len) != 0) {
+    return false;
+  }
+  server = accept(listener, nullptr, nullptr);
+  return setsockopt(client, IPPROTO_TCP, TCP_ULP, "tls", sizeof("tls")) == 0;
+#else
+  return false;
+#endif
+}
+
+} // namespace
+
+/**
+ * Test connecting, writing, reading and closing with kernel TLS requested on
+ * both ends.
+ */
+TEST(AsyncSSLSocketTest, KTLSConnectWriteReadClose) {
+  if (!kernelSupportsKTLS()) {
+    LOG(WARNING) << "kTLS not supported, skipping";
+    return;
+  }
+
+  class KTLSAcceptCallback : public SSLServerAcceptCallback {
+   public:
+    using SSLServerAcceptCallback::SSLServerAcceptCallback;
+
+    void connAccepted(
+        const std::shared_ptr<folly::AsyncSSLSocket>& s) noexcept override {
+      s->setKTLSEnabled(true);
+      SSLServerAcceptCallback::connAccepted(s);
+    }
+  };
+
+  WriteCallbackBase writeCallback;
+  ReadCallback readCallback(&writeCallback);
+  HandshakeCallback handshakeCallback(&readCallback);
+  KTLSAcceptCallback acceptCallback(&handshakeCallback);
+  TestSSLServer server(&acceptCallback);
+
+  // kTLS is only used for TLS 1.2 with AES-GCM.
+  auto sslContext = std::make_shared<SSLContext>(SSLContext::TLSv1_2);
+  sslContext->ciphers("ECDHE-RSA-AES128-GCM-SHA256");
+#ifdef SSL_OP_NO_TLSv1_3
+  SSL_CTX_set_options(sslContext->getSSLCtx(), SSL_OP_NO_TLSv1_3);
+#endif
+
+  auto socket =
+      std::make_shared<BlockingSocket>(server.getAddress(), sslContext);
+  auto sslSocket = socket->getSSLSocket();
+  sslSocket->setKTLSEnabled(true);
+  socket->open(std::chrono::milliseconds(10000));
+  EXPECT_EQ(TLS1_2_VERSION, sslSocket->getSSLVersion());
+
+  uint8_t buf[128];
+  memset(buf, 'a', sizeof(buf));
+  socket->write(buf, sizeof(buf));
+
+  uint8_t readbuf[128];
+  uint32_t bytesRead = socket->readAll(readbuf, sizeof(readbuf));
+  EXPECT_EQ(bytesRead, 128);
+  EXPECT_EQ(memcmp(buf, readbuf, bytesRead), 0);
+
+  // Neither end had data buffered past the handshake, so both directions
+  // are offloaded on both ends.
+  auto serverSocket = handshakeCallback.getSocket();
+  EXPECT_TRUE(sslSocket->isKTLSSendActive());
+  EXPECT_TRUE(sslSocket->isKTLSRecvActive());
+  EXPECT_TRUE(serverSocket->isKTLSSendActive());
+  EXPECT_TRUE(serverSocket->isKTLSRecvActive());
+
+  socket->close();
+}
+
+/**
+ * Test writeFromFd() without kTLS, where the data is read through userspace
+ * a chunk at a time and must stay ordered with the surrounding writes.
+ */
+TEST(AsyncSSLSocketTest, WriteFromFdWithoutKTLS) {
+  class FileWriteCallback : public AsyncTransportWrapper::WriteCallback {
+   public:
+    void writeSuccess() noexcept override {
+      succeeded = true;
+    }
+    void writeErr(size_t, const AsyncSocketException& ex) noexcept override {
+      ADD_FAILURE() << ex.what();
+    }
+
+    bool succeeded{false};
+  };
+
+  WriteCallbackBase writeCallback;
+  ReadCallback readCallback(&writeCallback);
+  HandshakeCallback handshakeCallback(&readCallback);
+  SSLServerAcceptCallback acceptCallback(&handshakeCallback);
+  TestSSLServer server(&acceptCallback);
+
+  auto sslContext = std::make_shared<SSLContext>();
+  auto socket =
+      std::make_shared<BlockingSocket>(server.getAddress(), sslContext);
+  socket->open(std::chrono::milliseconds(10000));
+
+  // Several chunks' worth
+  constexpr size_t kSize = 200 * 1024;
+  constexpr off_t kOffset = 100;
+  std::string data(kSize + kOffset, '\0');
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = char('a' + i % 26);
+  }
+  test::TemporaryFile file;
+  ASSERT_EQ(
+      ssize_t(data.size()), writeFull(file.fd(), data.data(), data.size()));
+
+  socket->write(reinterpret_cast<const uint8_t*>("hello"), 5);
+  FileWriteCallback fileCallback;
+  socket->getSSLSocket()->writeFromFd(&fileCallback, file.fd(), kOffset, kSize);
+  // Returns once "world" is written, which is after the file.
+  socket->write(reinterpret_cast<const uint8_t*>("world"), 5);
+  EXPECT_TRUE(fileCallback.succeeded);
+
+  // The server echoes everything back.
+  std::string echoed(kSize + 10, '\0');
+  EXPECT_EQ(
+      echoed.size(),
+      socket->readAll(reinterpret_cast<uint8_t*>(&echoed[0]), echoed.size()));
+  EXPECT_EQ("hello" + data.substr(kOffset) + "world", echoed);
+
+  socket->close();
+}
+
 /**
  * Test reading after server close.
  */
@@ -1296,6 +1452,156 @@ TEST(AsyncSSLSocketTest, SSLHandshakeValidationSuccess) {
   EXPECT_LE(0, server.handshakeTime.count());
 }
 
+#if FOLLY_OPENSSL_HAS_ASYNC
+namespace {
+// Runs private key operations on a separate thread, after an optional delay.
+class PrivateKeyExecutor : public folly::Executor {
+ public:
+  explicit PrivateKeyExecutor(
+      std::chrono::milliseconds delay = std::chrono::milliseconds(0))
+      : delay_(delay) {}
+
+  void add(Func func) override {
+    ++added_;
+    thread_.getEventBase()->runInEventBaseThread(
+        [ delay = delay_, func = std::move(func) ]() mutable {
+          /* sleep override */ std::this_thread::sleep_for(delay);
+          func();
+        });
+  }
+
+  int added() const {
+    return added_;
+  }
+
+ private:
+  std::chrono::milliseconds delay_;
+  std::atomic<int> added_{0};
+  ScopedEventBaseThread thread_;
+};
+
+class SSLHandshakeServerWithTimeout : public SSLHandshakeBase {
+ public:
+  SSLHandshakeServerWithTimeout(
+      AsyncSSLSocket::UniquePtr socket,
+      std::chrono::milliseconds timeout)
+      : SSLHandshakeBase(std::move(socket), false, false) {
+    socket_->sslAccept(this, timeout);
+  }
+};
+}
+
+/**
+ * Verify that the server's private key operation runs on the executor set
+ * on its context, and that the suspended handshake resumes and completes.
+ */
+TEST(AsyncSSLSocketTest, SSLHandshakeOffloadedPrivateKey) {
+  EventBase eventBase;
+  auto clientCtx = std::make_shared<SSLContext>();
+  auto dfServerCtx = std::make_shared<SSLContext>();
+
+  int fds[2];
+  getfds(fds);
+  getctx(clientCtx, dfServerCtx);
+  auto executor = std::make_shared<PrivateKeyExecutor>();
+  dfServerCtx->setPrivateKeyExecutor(executor);
+
+  AsyncSSLSocket::UniquePtr clientSock(
+      new AsyncSSLSocket(clientCtx, &eventBase, fds[0], false));
+  AsyncSSLSocket::UniquePtr serverSock(
+      new AsyncSSLSocket(dfServerCtx, &eventBase, fds[1], true));
+
+  SSLHandshakeClient client(std::move(clientSock), true, true);
+  SSLHandshakeServer server(std::move(serverSock), true, true);
+
+  eventBase.loop();
+
+  EXPECT_TRUE(client.handshakeSuccess_);
+  EXPECT_FALSE(client.handshakeError_);
+  EXPECT_TRUE(server.handshakeSuccess_);
+  EXPECT_FALSE(server.handshakeError_);
+  EXPECT_EQ(1, executor->added());
+}
+
+/**
+ * Verify that a handshake timing out while its private key operation is
+ * still running fails once the operation completes.
+ */
+TEST(AsyncSSLSocketTest, SSLHandshakeOffloadedPrivateKeyTimeout) {
+  EventBase eventBase;
+  auto clientCtx = std::make_shared<SSLContext>();
+  auto dfServerCtx = std::make_shared<SSLContext>();
+
+  int fds[2];
+  getfds(fds);
+  getctx(clientCtx, dfServerCtx);
+  auto executor =
+      std::make_shared<PrivateKeyExecutor>(std::chrono::milliseconds(200));
+  dfServerCtx->setPrivateKeyExecutor(executor);
+
+  AsyncSSLSocket::UniquePtr clientSock(
+      new AsyncSSLSocket(clientCtx, &eventBase, fds[0], false));
+  AsyncSSLSocket::UniquePtr serverSock(
+      new AsyncSSLSocket(dfServerCtx, &eventBase, fds[1], true));
+
+  SSLHandshakeClient client(std::move(clientSock), true, true);
+  SSLHandshakeServerWithTimeout server(
+      std::move(serverSock), std::chrono::milliseconds(20));
+
+  eventBase.loop();
+
+  EXPECT_FALSE(client.handshakeSuccess_);
+  EXPECT_TRUE(client.handshakeError_);
+  EXPECT_FALSE(server.handshakeSuccess_);
+  EXPECT_TRUE(server.handshakeError_);
+  EXPECT_EQ(1, executor->added());
+}
+
+/**
+ * Verify that closing a socket while its private key operation is still
+ * running keeps the SSL, and the async job it is paused in, around until
+ * the operation completes, and frees them then.
+ */
+TEST(AsyncSSLSocketTest, SSLHandshakeOffloadedPrivateKeyClose) {
+  EventBase eventBase;
+  auto clientCtx = std::make_shared<SSLContext>();
+  auto dfServerCtx = std::make_shared<SSLContext>();
+
+  int fds[2];
+  getfds(fds);
+  getctx(clientCtx, dfServerCtx);
+  const auto delay = std::chrono::milliseconds(200);
+  auto executor = std::make_shared<PrivateKeyExecutor>(delay);
+  dfServerCtx->setPrivateKeyExecutor(executor);
+
+  AsyncSSLSocket::UniquePtr clientSock(
+      new AsyncSSLSocket(clientCtx, &eventBase, fds[0], false));
+  AsyncSSLSocket::UniquePtr serverSock(
+      new AsyncSSLSocket(dfServerCtx, &eventBase, fds[1], true));
+  auto serverPtr = serverSock.get();
+
+  SSLHandshakeClient client(std::move(clientSock), true, true);
+  SSLHandshakeServer server(std::move(serverSock), true, true);
+
+  eventBase.runAfterDelay([&] {
+    EXPECT_EQ(1, executor->added());
+    EXPECT_NE(nullptr, serverPtr->getSSL());
+    serverPtr->closeNow();
+  }, 20);
+
+  auto start = std::chrono::steady_clock::now();
+  eventBase.loop();
+
+  // The loop only ran out of events once the operation had completed.
+  EXPECT_LE(delay, std::chrono::steady_clock::now() - start);
+  EXPECT_EQ(nullptr, serverPtr->getSSL());
+  EXPECT_FALSE(client.handshakeSuccess_);
+  EXPECT_TRUE(client.handshakeError_);
+  EXPECT_FALSE(server.handshakeSuccess_);
+  EXPECT_TRUE(server.handshakeError_);
+}
+#endif
+
 /**
  * Verify that the client's verification callback is able to fail SSL
  * connection establishment.
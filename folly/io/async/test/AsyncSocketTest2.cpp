@@ -17,11 +17,15 @@
 #include <folly/io/async/test/AsyncSocketTest2.h>
 
 #include <folly/ExceptionWrapper.h>
+#include <folly/FileUtil.h>
 #include <folly/Random.h>
 #include <folly/SocketAddress.h>
+#include <folly/io/async/AsyncPipe.h>
 #include <folly/io/async/AsyncSocket.h>
 #include <folly/io/async/AsyncTimeout.h>
 #include <folly/io/async/EventBase.h>
+#include <folly/io/async/ReadBufferPool.h>
+#include <folly/io/async/ScopedEventBaseThread.h>
 
 #include <folly/experimental/TestUtil.h>
 #include <folly/io/IOBuf.h>
@@ -36,7 +40,9 @@
 #include <boost/scoped_array.hpp>
 #include <fcntl.h>
 #include <sys/types.h>
+#include <atomic>
 #include <iostream>
+#include <map>
 #include <thread>
 
 using namespace boost;
@@ -2980,6 +2986,91 @@ TEST(AsyncSocketTest, ErrMessageCallback) {
   ASSERT_EQ(
       errMsgCB.gotByteSeq_ + errMsgCB.gotTimestamp_, errMsgCB.resetAfter_);
 }
+
+class TestByteEventCallback : public AsyncSocket::ByteEventCallback {
+ public:
+  void byteEvent(const ByteEvent& event) noexcept override {
+    events.push_back(event);
+    if (onEvent) {
+      onEvent(event);
+    }
+  }
+
+  void byteEventError(const AsyncSocketException& ex) noexcept override {
+    LOG(ERROR) << ex.what();
+    ++errors;
+  }
+
+  uint64_t lastOffset(Type type) const {
+    uint64_t offset = 0;
+    for (const auto& event : events) {
+      if (event.type == type) {
+        offset = std::max(offset, event.offset + 1);
+      }
+    }
+    return offset;
+  }
+
+  std::vector<ByteEvent> events;
+  std::function<void(const ByteEvent&)> onEvent;
+  int errors{0};
+};
+
+TEST(AsyncSocketTest, ByteEvents) {
+  TestServer server;
+  EventBase evb;
+  std::shared_ptr<AsyncSocket> socket = AsyncSocket::newSocket(&evb);
+
+  // Installed before connecting, so enabled once the socket is connected
+  TestByteEventCallback becb;
+  ASSERT_TRUE(socket->setByteEventCallback(&becb));
+  ConnCallback ccb;
+  socket->connect(&ccb, server.getAddress(), 30);
+  evb.loop();
+  ASSERT_EQ(ccb.state, STATE_SUCCEEDED);
+  ASSERT_EQ(&becb, socket->getByteEventCallback());
+
+  std::vector<uint8_t> wbuf(128, 'a');
+  WriteCallback wcb;
+  socket->write(&wcb, wbuf.data(), 100);
+  socket->write(&wcb, wbuf.data(), 28);
+  ASSERT_EQ(wcb.state, STATE_SUCCEEDED);
+  EXPECT_EQ(128, becb.lastOffset(AsyncSocket::ByteEventCallback::Type::WRITE));
+
+  std::shared_ptr<BlockingSocket> acceptedSocket = server.accept();
+  std::vector<uint8_t> rbuf(wbuf.size());
+  acceptedSocket->readAll(rbuf.data(), rbuf.size());
+
+  becb.onEvent = [&](const AsyncSocket::ByteEventCallback::ByteEvent&) {
+    if (becb.lastOffset(AsyncSocket::ByteEventCallback::Type::ACK) == 128) {
+      evb.terminateLoopSoon();
+    }
+  };
+  evb.runAfterDelay([&] { evb.terminateLoopSoon(); }, 5000);
+  evb.loop();
+
+  ASSERT_EQ(0, becb.errors);
+  using Type = AsyncSocket::ByteEventCallback::Type;
+  EXPECT_EQ(128, becb.lastOffset(Type::SCHED));
+  EXPECT_EQ(128, becb.lastOffset(Type::TX));
+  EXPECT_EQ(128, becb.lastOffset(Type::ACK));
+
+  // Each write's events are in stage order, and timestamped in that order
+  std::map<Type, AsyncSocket::ByteEventCallback::ByteEvent> first;
+  for (const auto& event : becb.events) {
+    if (event.offset == 99 && !first.count(event.type)) {
+      first[event.type] = event;
+    }
+  }
+  ASSERT_EQ(4, first.size());
+  EXPECT_LE(first[Type::WRITE].time, first[Type::SCHED].time);
+  EXPECT_LE(first[Type::SCHED].time, first[Type::TX].time);
+  EXPECT_LE(first[Type::TX].time, first[Type::ACK].time);
+
+  ASSERT_TRUE(socket->setByteEventCallback(nullptr));
+  acceptedSocket->close();
+  socket->close();
+}
 #endif // MSG_ERRQUEUE
 
 TEST(AsyncSocket, PreReceivedData) {
@@ -3266,3 +3357,574 @@ TEST(AsyncSocketTest, SendMessageAncillaryData) {
       transferredMagicString.begin()));
 }
 #endif
+
+#ifdef MSG_ZEROCOPY
+TEST(AsyncSocketTest, ZeroCopyWriteChain) {
+  TestServer server;
+
+  EventBase evb;
+  std::shared_ptr<AsyncSocket> socket = AsyncSocket::newSocket(&evb);
+  // Applied once connect() has created the socket
+  ASSERT_TRUE(socket->setZeroCopy(true));
+  socket->setZeroCopyWriteChainThreshold(64 * 1024);
+
+  ConnCallback ccb;
+  socket->connect(&ccb, server.getAddress(), 30);
+  std::shared_ptr<BlockingSocket> acceptedSocket = server.accept();
+  evb.loop();
+  ASSERT_EQ(ccb.state, STATE_SUCCEEDED);
+  if (!socket->getZeroCopy()) {
+    LOG(WARNING) << "SO_ZEROCOPY not supported, skipping";
+    return;
+  }
+
+  constexpr size_t kSize = 256 * 1024;
+  bool freed = false;
+  auto data = static_cast<uint8_t*>(malloc(kSize));
+  memset(data, 'z', kSize);
+  auto buf = IOBuf::takeOwnership(
+      data,
+      kSize,
+      [](void* p, void* userData) {
+        *static_cast<bool*>(userData) = true;
+        free(p);
+      },
+      &freed);
+
+  // Small chains are copied as usual
+  WriteCallback wcb1;
+  socket->writeChain(&wcb1, IOBuf::copyBuffer("hello"));
+  ASSERT_EQ(wcb1.state, STATE_SUCCEEDED);
+  ASSERT_FALSE(socket->isZeroCopyWriteInProgress());
+
+  WriteCallback wcb2;
+  socket->writeChain(&wcb2, std::move(buf));
+  ASSERT_TRUE(socket->isZeroCopyWriteInProgress());
+
+  std::thread reader([&] {
+    std::vector<uint8_t> rbuf(kSize + 5);
+    acceptedSocket->readAll(rbuf.data(), rbuf.size());
+    EXPECT_EQ(0, memcmp(rbuf.data(), "hello", 5));
+    EXPECT_EQ(std::vector<uint8_t>(kSize, 'z'),
+              std::vector<uint8_t>(rbuf.begin() + 5, rbuf.end()));
+  });
+
+  auto start = std::chrono::steady_clock::now();
+  while ((wcb2.state != STATE_SUCCEEDED ||
+          socket->isZeroCopyWriteInProgress()) &&
+         std::chrono::steady_clock::now() - start < std::chrono::seconds(5)) {
+    evb.loopOnce(EVLOOP_NONBLOCK);
+  }
+  reader.join();
+
+  ASSERT_EQ(wcb2.state, STATE_SUCCEEDED);
+  // The kernel has acknowledged every send, so the buffer is released.
+  ASSERT_FALSE(socket->isZeroCopyWriteInProgress());
+  ASSERT_TRUE(freed);
+  // Loopback traffic is always copied.
+  ASSERT_GT(socket->getZeroCopyCopiedCount(), 0);
+
+  acceptedSocket->close();
+  socket->close();
+}
+
+TEST(AsyncSocketTest, ZeroCopyCloseInFlight) {
+  TestServer server;
+
+  EventBase evb;
+  std::shared_ptr<AsyncSocket> socket = AsyncSocket::newSocket(&evb);
+  ASSERT_TRUE(socket->setZeroCopy(true));
+  socket->setZeroCopyWriteChainThreshold(64 * 1024);
+
+  ConnCallback ccb;
+  socket->connect(&ccb, server.getAddress(), 30);
+  std::shared_ptr<BlockingSocket> acceptedSocket = server.accept();
+  evb.loop();
+  ASSERT_EQ(ccb.state, STATE_SUCCEEDED);
+  if (!socket->getZeroCopy()) {
+    LOG(WARNING) << "SO_ZEROCOPY not supported, skipping";
+    return;
+  }
+
+  constexpr size_t kSize = 256 * 1024;
+  bool freed = false;
+  auto data = static_cast<uint8_t*>(malloc(kSize));
+  memset(data, 'z', kSize);
+  auto buf = IOBuf::takeOwnership(
+      data,
+      kSize,
+      [](void* p, void* userData) {
+        *static_cast<bool*>(userData) = true;
+        free(p);
+      },
+      &freed);
+
+  // Closed before any completion is read
+  WriteCallback wcb;
+  socket->writeChain(&wcb, std::move(buf));
+  ASSERT_TRUE(socket->isZeroCopyWriteInProgress());
+  socket->closeNow();
+  ASSERT_FALSE(socket->isZeroCopyWriteInProgress());
+  // The kernel may still be sending from it
+  ASSERT_FALSE(freed);
+
+  socket.reset();
+  evb.loop();
+  ASSERT_TRUE(freed);
+  acceptedSocket->close();
+}
+#endif // MSG_ZEROCOPY
+
+#ifdef __linux__
+namespace {
+
+std::shared_ptr<AsyncSocket> connectTo(
+    EventBase& evb,
+    TestServer& server,
+    std::shared_ptr<BlockingSocket>& acceptedSocket) {
+  auto socket = AsyncSocket::newSocket(&evb);
+  ConnCallback ccb;
+  socket->connect(&ccb, server.getAddress(), 30);
+  acceptedSocket = server.accept();
+  evb.loop();
+  EXPECT_EQ(ccb.state, STATE_SUCCEEDED);
+  return socket;
+}
+
+std::string makeData(size_t size) {
+  std::string data(size, '\0');
+  for (size_t i = 0; i < size; ++i) {
+    data[i] = char('a' + i % 26);
+  }
+  return data;
+}
+
+void loopUntil(EventBase& evb, const std::function<bool()>& done) {
+  auto start = std::chrono::steady_clock::now();
+  while (!done() &&
+         std::chrono::steady_clock::now() - start < std::chrono::seconds(5)) {
+    evb.loopOnce(EVLOOP_NONBLOCK);
+  }
+}
+
+} // namespace
+
+TEST(AsyncSocketTest, WriteFromFdFile) {
+  TestServer server;
+  EventBase evb;
+  std::shared_ptr<BlockingSocket> acceptedSocket;
+  auto socket = connectTo(evb, server, acceptedSocket);
+
+  // Large enough to fill the socket buffers, so that the write is usually
+  // finished from handleWrite().
+  constexpr size_t kSize = 4 * 1024 * 1024;
+  constexpr off_t kOffset = 100;
+  auto data = makeData(kSize + kOffset);
+  test::TemporaryFile file;
+  ASSERT_EQ(
+      ssize_t(data.size()), writeFull(file.fd(), data.data(), data.size()));
+
+  WriteCallback wcb1;
+  socket->write(&wcb1, "hello", 5);
+  WriteCallback wcb2;
+  socket->writeFromFd(&wcb2, file.fd(), kOffset, kSize);
+  WriteCallback wcb3;
+  socket->write(&wcb3, "world", 5);
+
+  std::thread reader([&] {
+    std::vector<char> rbuf(kSize + 10);
+    acceptedSocket->readAll(
+        reinterpret_cast<uint8_t*>(rbuf.data()), rbuf.size());
+    EXPECT_EQ("hello", std::string(rbuf.data(), 5));
+    EXPECT_TRUE(std::equal(
+        rbuf.begin() + 5, rbuf.end() - 5, data.begin() + kOffset));
+    EXPECT_EQ("world", std::string(rbuf.end() - 5, rbuf.end()));
+  });
+  loopUntil(evb, [&] { return wcb3.state != STATE_WAITING; });
+  reader.join();
+
+  ASSERT_EQ(wcb1.state, STATE_SUCCEEDED);
+  ASSERT_EQ(wcb2.state, STATE_SUCCEEDED);
+  ASSERT_EQ(wcb3.state, STATE_SUCCEEDED);
+  ASSERT_EQ(kSize + 10, socket->getAppBytesWritten());
+  // An explicit offset leaves the file position alone.
+  ASSERT_EQ(off_t(data.size()), lseek(file.fd(), 0, SEEK_CUR));
+  socket->close();
+}
+
+TEST(AsyncSocketTest, WriteFromFdShortFile) {
+  TestServer server;
+  EventBase evb;
+  std::shared_ptr<BlockingSocket> acceptedSocket;
+  auto socket = connectTo(evb, server, acceptedSocket);
+
+  test::TemporaryFile file;
+  ASSERT_EQ(5, writeFull(file.fd(), "hello", 5));
+
+  WriteCallback wcb;
+  socket->writeFromFd(&wcb, file.fd(), 0, 10);
+  ASSERT_EQ(wcb.state, STATE_FAILED);
+  ASSERT_EQ(wcb.exception.getType(), AsyncSocketException::END_OF_FILE);
+  ASSERT_EQ(5, wcb.bytesWritten);
+}
+
+TEST(AsyncSocketTest, WriteFromFdPipe) {
+  TestServer server;
+  EventBase evb;
+  std::shared_ptr<BlockingSocket> acceptedSocket;
+  auto socket = connectTo(evb, server, acceptedSocket);
+
+  int fds[2];
+  ASSERT_EQ(0, pipe(fds));
+  ASSERT_EQ(11, writeFull(fds[1], "hello world", 11));
+
+  WriteCallback wcb;
+  socket->writeFromFd(&wcb, fds[0], -1, 11);
+  ASSERT_EQ(wcb.state, STATE_SUCCEEDED);
+  char rbuf[11];
+  acceptedSocket->readAll(reinterpret_cast<uint8_t*>(rbuf), sizeof(rbuf));
+  ASSERT_EQ("hello world", std::string(rbuf, sizeof(rbuf)));
+
+  // A pipe can't be read from an offset
+  WriteCallback wcb2;
+  socket->writeFromFd(&wcb2, fds[0], 0, 11);
+  ASSERT_EQ(wcb2.state, STATE_FAILED);
+  ASSERT_EQ(wcb2.exception.getType(), AsyncSocketException::BAD_ARGS);
+
+  closeNoInt(fds[0]);
+  closeNoInt(fds[1]);
+}
+
+TEST(AsyncSocketTest, WriteFromFdEmptyPipe) {
+  TestServer server;
+  EventBase evb;
+  std::shared_ptr<BlockingSocket> acceptedSocket;
+  auto socket = connectTo(evb, server, acceptedSocket);
+
+  int fds[2];
+  ASSERT_EQ(0, pipe2(fds, O_NONBLOCK));
+  ASSERT_EQ(5, writeFull(fds[1], "hello", 5));
+
+  // Fails rather than waiting for data that may never arrive
+  WriteCallback wcb;
+  socket->writeFromFd(&wcb, fds[0], -1, 10);
+  ASSERT_EQ(wcb.state, STATE_FAILED);
+  ASSERT_EQ(wcb.exception.getType(), AsyncSocketException::BAD_ARGS);
+  ASSERT_EQ(5, wcb.bytesWritten);
+
+  closeNoInt(fds[0]);
+  closeNoInt(fds[1]);
+}
+
+namespace {
+
+class TestSpliceCallback : public AsyncPipeReader::SpliceCallback {
+ public:
+  void spliceComplete(size_t bytesSpliced) noexcept override {
+    state = STATE_SUCCEEDED;
+    bytes = bytesSpliced;
+  }
+
+  void spliceError(size_t bytesSpliced,
+                   const AsyncSocketException&) noexcept override {
+    state = STATE_FAILED;
+    bytes = bytesSpliced;
+  }
+
+  StateEnum state{STATE_WAITING};
+  size_t bytes{0};
+};
+
+} // namespace
+
+TEST(AsyncSocketTest, PipeSpliceTo) {
+  TestServer server;
+  EventBase evb;
+  std::shared_ptr<BlockingSocket> acceptedSocket;
+  auto socket = connectTo(evb, server, acceptedSocket);
+
+  int fds[2];
+  ASSERT_EQ(0, pipe2(fds, O_NONBLOCK));
+  auto reader = AsyncPipeReader::newReader(&evb, fds[0]);
+  auto writer = AsyncPipeWriter::newWriter(&evb, fds[1]);
+
+  // Much more than a pipe holds, so that the pipe writer has to wait for
+  // the splices to make room.
+  constexpr size_t kSize = 4 * 1024 * 1024;
+  auto data = makeData(kSize);
+  writer->write(IOBuf::copyBuffer(data));
+  writer->closeOnEmpty();
+
+  TestSpliceCallback scb;
+  reader->spliceTo(socket.get(), &scb);
+
+  std::thread receiver([&] {
+    std::vector<char> rbuf(kSize);
+    acceptedSocket->readAll(
+        reinterpret_cast<uint8_t*>(rbuf.data()), rbuf.size());
+    EXPECT_TRUE(std::equal(rbuf.begin(), rbuf.end(), data.begin()));
+  });
+  loopUntil(evb, [&] { return scb.state != STATE_WAITING; });
+  receiver.join();
+
+  ASSERT_EQ(scb.state, STATE_SUCCEEDED);
+  ASSERT_EQ(kSize, scb.bytes);
+  ASSERT_EQ(kSize, socket->getAppBytesWritten());
+  socket->close();
+}
+
+TEST(AsyncSocketTest, PipeSpliceToClosedSocket) {
+  TestServer server;
+  EventBase evb;
+  std::shared_ptr<BlockingSocket> acceptedSocket;
+  auto socket = connectTo(evb, server, acceptedSocket);
+  socket->closeNow();
+
+  int fds[2];
+  ASSERT_EQ(0, pipe2(fds, O_NONBLOCK));
+  auto reader = AsyncPipeReader::newReader(&evb, fds[0]);
+  ASSERT_EQ(5, writeFull(fds[1], "hello", 5));
+
+  TestSpliceCallback scb;
+  reader->spliceTo(socket.get(), &scb);
+  loopUntil(evb, [&] { return scb.state != STATE_WAITING; });
+  ASSERT_EQ(scb.state, STATE_FAILED);
+  ASSERT_EQ(0, scb.bytes);
+  closeNoInt(fds[1]);
+}
+
+TEST(AsyncSocketTest, PipeSpliceToDestroyReader) {
+  TestServer server;
+  EventBase evb;
+  std::shared_ptr<BlockingSocket> acceptedSocket;
+  auto socket = connectTo(evb, server, acceptedSocket);
+
+  // The peer doesn't read yet, so this stays queued, and so does the write
+  // the splice issues behind it.
+  constexpr size_t kSize = 16 * 1024 * 1024;
+  auto data = makeData(kSize);
+  WriteCallback wcb;
+  socket->write(&wcb, data.data(), data.size());
+  ASSERT_EQ(wcb.state, STATE_WAITING);
+
+  int fds[2];
+  ASSERT_EQ(0, pipe2(fds, O_NONBLOCK));
+  auto reader = AsyncPipeReader::newReader(&evb, fds[0]);
+  bool pipeClosed = false;
+  reader->setCloseCallback([&](int fd) {
+    pipeClosed = true;
+    closeNoInt(fd);
+  });
+  ASSERT_EQ(11, writeFull(fds[1], "hello world", 11));
+
+  TestSpliceCallback scb;
+  reader->spliceTo(socket.get(), &scb);
+  evb.loopOnce(EVLOOP_NONBLOCK);
+
+  // The socket still has to read from the pipe
+  reader.reset();
+  ASSERT_FALSE(pipeClosed);
+
+  std::thread receiver([&] {
+    std::vector<char> rbuf(kSize + 11);
+    acceptedSocket->readAll(
+        reinterpret_cast<uint8_t*>(rbuf.data()), rbuf.size());
+    EXPECT_TRUE(std::equal(rbuf.begin(), rbuf.end() - 11, data.begin()));
+    EXPECT_EQ("hello world", std::string(rbuf.end() - 11, rbuf.end()));
+  });
+  loopUntil(evb, [&] { return pipeClosed; });
+  receiver.join();
+
+  ASSERT_EQ(wcb.state, STATE_SUCCEEDED);
+  ASSERT_EQ(scb.state, STATE_WAITING);
+  ASSERT_EQ(kSize + 11, socket->getAppBytesWritten());
+  socket->close();
+  closeNoInt(fds[1]);
+}
+#endif // __linux__
+
+namespace {
+
+class PooledReadCallback : public AsyncTransportWrapper::ReadCallback {
+ public:
+  bool isBufferMovable() noexcept override {
+    return true;
+  }
+
+  void getReadBuffer(void**, size_t*) override {
+    ADD_FAILURE() << "pooled reads must not ask for a read buffer";
+  }
+
+  void readDataAvailable(size_t) noexcept override {
+    ADD_FAILURE() << "pooled reads must use readBufferAvailable()";
+  }
+
+  void readBufferAvailable(std::unique_ptr<IOBuf> buf) noexcept override {
+    EXPECT_EQ(buf->length(), buf->computeChainDataLength());
+    maxReadLength = std::max(maxReadLength, buf->length());
+    data.append(std::move(buf));
+  }
+
+  void readEOF() noexcept override {
+    eof = true;
+  }
+
+  void readErr(const AsyncSocketException& ex) noexcept override {
+    ADD_FAILURE() << ex.what();
+  }
+
+  IOBufQueue data{IOBufQueue::cacheChainLength()};
+  size_t maxReadLength{0};
+  bool eof{false};
+};
+
+} // namespace
+
+TEST(AsyncSocketTest, PooledReads) {
+  TestServer server;
+  EventBase evb;
+  auto socket = AsyncSocket::newSocket(&evb);
+  socket->setPooledReads(true);
+  ConnCallback ccb;
+  socket->connect(&ccb, server.getAddress(), 30);
+  auto acceptedSocket = server.accept();
+  evb.loop();
+  ASSERT_EQ(ccb.state, STATE_SUCCEEDED);
+
+  PooledReadCallback rcb;
+  socket->setReadCB(&rcb);
+  // Nothing is allocated for a connection that hasn't received anything.
+  auto& pool = ReadBufferPool::get(evb);
+  ASSERT_EQ(0, pool.getStats().numSlabs);
+
+  // More than one slab's worth, so that a read fills the slab.
+  std::string data(3 * ReadBufferPool::kDefaultSlabSize + 5, 'x');
+  std::thread writer([&] {
+    acceptedSocket->write(
+        reinterpret_cast<const uint8_t*>(data.data()), data.size());
+    acceptedSocket->close();
+  });
+  auto start = std::chrono::steady_clock::now();
+  while (!rcb.eof &&
+         std::chrono::steady_clock::now() - start < std::chrono::seconds(5)) {
+    evb.loopOnce(EVLOOP_NONBLOCK);
+  }
+  writer.join();
+
+  ASSERT_TRUE(rcb.eof);
+  ASSERT_EQ(data.size(), rcb.data.chainLength());
+  auto received = rcb.data.move();
+  received->coalesce();
+  ASSERT_EQ(data, received->moveToFbString().toStdString());
+
+  auto stats = pool.getStats();
+  EXPECT_EQ(1, stats.numSlabs);
+  EXPECT_EQ(1, stats.highWaterSlabs);
+  EXPECT_EQ(data.size(), stats.bytesRead);
+  EXPECT_GE(stats.reads, 4);
+  EXPECT_EQ(rcb.maxReadLength, stats.highWaterRead);
+  EXPECT_LE(stats.highWaterRead, ReadBufferPool::kDefaultSlabSize);
+  socket->close();
+}
+
+namespace {
+
+void testReusePortSharding(bool cpuSteering) {
+  EventBase eventBase;
+  std::shared_ptr<AsyncServerSocket> serverSocket(
+      AsyncServerSocket::newSocket(&eventBase));
+  serverSocket->setReusePortSharding(true);
+  serverSocket->setReusePortCpuSteering(cpuSteering);
+  serverSocket->bind(folly::SocketAddress("127.0.0.1", 0));
+
+  constexpr size_t kNumCallbacks = 2;
+  constexpr size_t kNumConnections = 32;
+  std::atomic<size_t> numAccepted{0};
+  ScopedEventBaseThread threads[kNumCallbacks];
+  TestAcceptCallback callbacks[kNumCallbacks];
+  for (size_t i = 0; i < kNumCallbacks; ++i) {
+    auto evb = threads[i].getEventBase();
+    callbacks[i].setConnectionAcceptedFn(
+        [&, evb](int fd, const folly::SocketAddress&) {
+          // Accepted in the callback's own thread, without a hand-off.
+          EXPECT_TRUE(evb->isInEventBaseThread());
+          closeNoInt(fd);
+          ++numAccepted;
+        });
+    callbacks[i].setAcceptErrorFn([](const std::exception& ex) {
+      ADD_FAILURE() << ex.what();
+    });
+    serverSocket->addAcceptCallback(&callbacks[i], evb);
+  }
+  serverSocket->listen(kNumConnections);
+  serverSocket->startAccepting();
+
+  folly::SocketAddress serverAddress;
+  serverSocket->getAddress(&serverAddress);
+  for (size_t i = 0; i < kNumConnections; ++i) {
+    BlockingSocket client(serverAddress, nullptr);
+    client.open();
+    client.close();
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  while (numAccepted < kNumConnections &&
+         std::chrono::steady_clock::now() - start < std::chrono::seconds(5)) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  EXPECT_EQ(kNumConnections, numAccepted);
+
+  // Stops the shards, which close their sockets in their own threads.
+  serverSocket.reset();
+  for (size_t i = 0; i < kNumCallbacks; ++i) {
+    threads[i].getEventBase()->runInEventBaseThreadAndWait([] {});
+    auto events = callbacks[i].getEvents();
+    ASSERT_GE(events->size(), 2);
+    EXPECT_EQ(TestAcceptCallback::TYPE_START, events->front().type);
+    EXPECT_EQ(TestAcceptCallback::TYPE_STOP, events->back().type);
+  }
+}
+
+} // namespace
+
+TEST(AsyncSocketTest, ReusePortSharding) {
+  testReusePortSharding(false);
+}
+
+#ifdef __linux__
+TEST(AsyncSocketTest, ReusePortShardingCpuSteering) {
+  testReusePortSharding(true);
+}
+#endif
+
+TEST(AsyncSocketTest, ReusePortShardingAddCallbackWhileListening) {
+  EventBase eventBase;
+  std::shared_ptr<AsyncServerSocket> serverSocket(
+      AsyncServerSocket::newSocket(&eventBase));
+  serverSocket->setReusePortSharding(true);
+  serverSocket->bind(folly::SocketAddress("127.0.0.1", 0));
+  serverSocket->listen(16);
+  serverSocket->startAccepting();
+  folly::SocketAddress serverAddress;
+  serverSocket->getAddress(&serverAddress);
+
+  // A callback in the primary EventBase gets a listening socket there.
+  TestAcceptCallback acceptCallback;
+  acceptCallback.setConnectionAcceptedFn(
+      [&](int fd, const folly::SocketAddress&) {
+        closeNoInt(fd);
+        serverSocket->removeAcceptCallback(&acceptCallback, nullptr);
+      });
+  serverSocket->addAcceptCallback(&acceptCallback, nullptr);
+
+  AsyncSocket::UniquePtr socket(new AsyncSocket(&eventBase, serverAddress));
+  eventBase.loop();
+
+  ASSERT_EQ(3, acceptCallback.getEvents()->size());
+  EXPECT_EQ(TestAcceptCallback::TYPE_START,
+            acceptCallback.getEvents()->at(0).type);
+  EXPECT_EQ(TestAcceptCallback::TYPE_ACCEPT,
+            acceptCallback.getEvents()->at(1).type);
+  EXPECT_EQ(TestAcceptCallback::TYPE_STOP,
+            acceptCallback.getEvents()->at(2).type);
+}
@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <folly/Conv.h>
 #include <folly/SocketAddress.h>
 #include <folly/io/async/AsyncTimeout.h>
 #include <folly/io/async/AsyncUDPServerSocket.h>
@@ -24,6 +25,8 @@
 #include <folly/portability/GMock.h>
 #include <folly/portability/GTest.h>
 
+#include <chrono>
+#include <functional>
 #include <thread>
 
 using folly::AsyncUDPSocket;
@@ -80,14 +83,19 @@ class UDPAcceptor
 
 class UDPServer {
  public:
-  UDPServer(EventBase* evb, folly::SocketAddress addr, int n)
-      : evb_(evb), addr_(addr), evbs_(n) {
+  UDPServer(
+      EventBase* evb,
+      folly::SocketAddress addr,
+      int n,
+      size_t readBatchSize = 1)
+      : evb_(evb), addr_(addr), evbs_(n), readBatchSize_(readBatchSize) {
   }
 
   void start() {
     CHECK(evb_->isInEventBaseThread());
 
     socket_ = std::make_unique<AsyncUDPServerSocket>(evb_, 1500);
+    socket_->setReadBatchSize(readBatchSize_);
 
     try {
       socket_->bind(addr_);
@@ -144,6 +152,7 @@ class UDPServer {
   std::vector<std::thread> threads_;
   std::vector<folly::EventBase> evbs_;
   std::vector<UDPAcceptor> acceptors_;
+  size_t readBatchSize_;
 };
 
 class UDPClient
@@ -246,9 +255,10 @@ class UDPClient
   char buf_[1024];
 };
 
-TEST(AsyncSocketTest, PingPong) {
+void runPingPong(size_t readBatchSize) {
   folly::EventBase sevb;
-  UDPServer server(&sevb, folly::SocketAddress("127.0.0.1", 0), 4);
+  UDPServer server(
+      &sevb, folly::SocketAddress("127.0.0.1", 0), 4, readBatchSize);
 
   // Start event loop in a separate thread
   auto serverThread = std::thread([&sevb] () {
@@ -292,9 +302,271 @@ TEST(AsyncSocketTest, PingPong) {
   serverThread.join();
 }
 
+TEST(AsyncSocketTest, PingPong) {
+  runPingPong(1);
+}
+
+TEST(AsyncSocketTest, PingPongBatchedRead) {
+  runPingPong(16);
+}
+
 class TestAsyncUDPSocket : public AsyncUDPSocket {
  public:
   explicit TestAsyncUDPSocket(EventBase* evb) : AsyncUDPSocket(evb) {}
 
   MOCK_METHOD3(sendmsg, ssize_t(int, const struct msghdr*, int));
 };
+
+class BatchReader : public AsyncUDPSocket::ReadCallback {
+ public:
+  explicit BatchReader(size_t batchSize) : batchSize_(batchSize) {}
+
+  void getReadBuffer(void** buf, size_t* len) noexcept override {
+    *buf = buf_;
+    *len = sizeof(buf_);
+  }
+
+  void onDataAvailable(const folly::SocketAddress&,
+                       size_t len,
+                       bool) noexcept override {
+    datagrams.emplace_back(buf_, len);
+  }
+
+  size_t getReadBatchSize() noexcept override {
+    return batchSize_;
+  }
+
+  void onDatagramsAvailable(
+      std::vector<AsyncUDPSocket::Datagram>& batch) noexcept override {
+    ++batches;
+    for (auto& datagram : batch) {
+      segmentSizes.push_back(datagram.segmentSize);
+    }
+    AsyncUDPSocket::ReadCallback::onDatagramsAvailable(batch);
+  }
+
+  void onReadError(const folly::AsyncSocketException& ex) noexcept override {
+    FAIL() << ex.what();
+  }
+
+  void onReadClosed() noexcept override {}
+
+  std::vector<std::string> datagrams;
+  std::vector<size_t> segmentSizes;
+  size_t batches{0};
+
+ private:
+  size_t batchSize_;
+  char buf_[64 * 1024];
+};
+
+namespace {
+
+void loopUntil(EventBase& evb, const std::function<bool()>& done) {
+  auto start = std::chrono::steady_clock::now();
+  while (!done() &&
+         std::chrono::steady_clock::now() - start < std::chrono::seconds(5)) {
+    evb.loopOnce(EVLOOP_NONBLOCK);
+  }
+}
+
+} // namespace
+
+TEST(AsyncUDPSocketTest, WritemAndBatchedRead) {
+  EventBase evb;
+  AsyncUDPSocket receiver(&evb);
+  receiver.bind(folly::SocketAddress("127.0.0.1", 0));
+  AsyncUDPSocket sender(&evb);
+  sender.bind(folly::SocketAddress("127.0.0.1", 0));
+
+  constexpr size_t kNumDatagrams = 20;
+  std::vector<std::unique_ptr<IOBuf>> bufs;
+  for (size_t i = 0; i < kNumDatagrams; ++i) {
+    auto buf = IOBuf::copyBuffer("datagram ");
+    buf->prependChain(IOBuf::copyBuffer(folly::to<std::string>(i)));
+    bufs.push_back(std::move(buf));
+  }
+  // Everything is queued before the receiver gets to read.
+  ASSERT_EQ(
+      int(kNumDatagrams),
+      sender.writem(receiver.address(), bufs.data(), bufs.size()));
+
+  BatchReader reader(8);
+  receiver.resumeRead(&reader);
+  loopUntil(evb, [&] { return reader.datagrams.size() == kNumDatagrams; });
+
+  ASSERT_EQ(kNumDatagrams, reader.datagrams.size());
+  for (size_t i = 0; i < kNumDatagrams; ++i) {
+    EXPECT_EQ("datagram " + folly::to<std::string>(i), reader.datagrams[i]);
+  }
+  // 8 + 8 + 4
+  EXPECT_EQ(3, reader.batches);
+  receiver.close();
+}
+
+TEST(AsyncUDPSocketTest, BatchedReadTruncates) {
+  EventBase evb;
+  AsyncUDPSocket receiver(&evb);
+  receiver.bind(folly::SocketAddress("127.0.0.1", 0));
+  receiver.setMaxReadDatagramSize(4);
+  AsyncUDPSocket sender(&evb);
+  sender.bind(folly::SocketAddress("127.0.0.1", 0));
+
+  ASSERT_EQ(
+      10, sender.write(receiver.address(), IOBuf::copyBuffer("0123456789")));
+
+  struct Reader : BatchReader {
+    Reader() : BatchReader(4) {}
+    void onDatagramsAvailable(
+        std::vector<AsyncUDPSocket::Datagram>& batch) noexcept override {
+      for (auto& datagram : batch) {
+        truncated.push_back(datagram.truncated);
+        datagrams.push_back(datagram.data->moveToFbString().toStdString());
+      }
+    }
+    std::vector<bool> truncated;
+  } reader;
+  receiver.resumeRead(&reader);
+  loopUntil(evb, [&] { return !reader.datagrams.empty(); });
+
+  ASSERT_EQ(std::vector<std::string>{"0123"}, reader.datagrams);
+  EXPECT_EQ(std::vector<bool>{true}, reader.truncated);
+  receiver.close();
+}
+
+TEST(AsyncUDPSocketTest, EmptyDatagrams) {
+  for (size_t batchSize : {1, 4}) {
+    SCOPED_TRACE(batchSize);
+    EventBase evb;
+    AsyncUDPSocket receiver(&evb);
+    receiver.bind(folly::SocketAddress("127.0.0.1", 0));
+    AsyncUDPSocket sender(&evb);
+    sender.bind(folly::SocketAddress("127.0.0.1", 0));
+
+    std::vector<std::unique_ptr<IOBuf>> bufs;
+    for (const char* data : {"", "x", ""}) {
+      bufs.push_back(IOBuf::copyBuffer(data));
+    }
+    ASSERT_EQ(3, sender.writem(receiver.address(), bufs.data(), bufs.size()));
+
+    BatchReader reader(batchSize);
+    receiver.resumeRead(&reader);
+    loopUntil(evb, [&] { return reader.datagrams.size() == 3; });
+
+    EXPECT_EQ((std::vector<std::string>{"", "x", ""}), reader.datagrams);
+    receiver.close();
+  }
+}
+
+TEST(AsyncUDPSocketTest, BatchedReadBuffersAreSeparate) {
+  EventBase evb;
+  AsyncUDPSocket receiver(&evb);
+  receiver.bind(folly::SocketAddress("127.0.0.1", 0));
+  receiver.setMaxReadDatagramSize(4096);
+  AsyncUDPSocket sender(&evb);
+  sender.bind(folly::SocketAddress("127.0.0.1", 0));
+
+  std::vector<std::unique_ptr<IOBuf>> bufs;
+  for (size_t size : {10, 3000, 20, 4000}) {
+    bufs.push_back(IOBuf::copyBuffer(std::string(size, 'x')));
+  }
+  ASSERT_EQ(4, sender.writem(receiver.address(), bufs.data(), bufs.size()));
+
+  // Kept after the batch, as if the application queued them.
+  struct Reader : BatchReader {
+    Reader() : BatchReader(4) {}
+    void onDatagramsAvailable(
+        std::vector<AsyncUDPSocket::Datagram>& batch) noexcept override {
+      for (auto& datagram : batch) {
+        kept.push_back(std::move(datagram.data));
+      }
+    }
+    std::vector<std::unique_ptr<IOBuf>> kept;
+  } reader;
+  receiver.resumeRead(&reader);
+  loopUntil(evb, [&] { return reader.kept.size() == 4; });
+
+  ASSERT_EQ(4, reader.kept.size());
+  for (auto& data : reader.kept) {
+    SCOPED_TRACE(data->length());
+    EXPECT_FALSE(data->isShared());
+    // Small datagrams are copied out of the 4096 byte receive buffers.
+    EXPECT_LE(data->capacity(), std::max<size_t>(2 * data->length(), 2048));
+  }
+  EXPECT_EQ(3000, reader.kept[1]->length());
+  receiver.close();
+}
+
+TEST(AsyncUDPSocketTest, WriteGSO) {
+  EventBase evb;
+  AsyncUDPSocket receiver(&evb);
+  receiver.bind(folly::SocketAddress("127.0.0.1", 0));
+  AsyncUDPSocket sender(&evb);
+  sender.bind(folly::SocketAddress("127.0.0.1", 0));
+
+  constexpr size_t kSegmentSize = 1000;
+  std::string data;
+  for (size_t i = 0; i < 10; ++i) {
+    data.append(kSegmentSize - (i == 9 ? 500 : 0), char('a' + i));
+  }
+  auto ret = sender.writeGSO(
+      receiver.address(), IOBuf::copyBuffer(data), int(kSegmentSize));
+  if (ret < 0 && (errno == EIO || errno == ENOPROTOOPT || errno == ENOTSUP)) {
+    LOG(WARNING) << "UDP GSO not supported, skipping";
+    return;
+  }
+  ASSERT_EQ(ssize_t(data.size()), ret);
+
+  BatchReader reader(16);
+  receiver.resumeRead(&reader);
+  loopUntil(evb, [&] { return reader.datagrams.size() == 10; });
+
+  ASSERT_EQ(10, reader.datagrams.size());
+  for (size_t i = 0; i < 10; ++i) {
+    EXPECT_EQ(data.substr(i * kSegmentSize, kSegmentSize), reader.datagrams[i]);
+  }
+  receiver.close();
+}
+
+TEST(AsyncUDPSocketTest, GRO) {
+  EventBase evb;
+  AsyncUDPSocket receiver(&evb);
+  receiver.bind(folly::SocketAddress("127.0.0.1", 0));
+  if (!receiver.setGRO(true)) {
+    LOG(WARNING) << "UDP GRO not supported, skipping";
+    return;
+  }
+  EXPECT_TRUE(receiver.getGRO());
+  receiver.setMaxReadDatagramSize(64 * 1024);
+  AsyncUDPSocket sender(&evb);
+  sender.bind(folly::SocketAddress("127.0.0.1", 0));
+
+  std::string data(10 * 1000, 'g');
+  auto ret = sender.writeGSO(receiver.address(), IOBuf::copyBuffer(data), 1000);
+  if (ret < 0) {
+    LOG(WARNING) << "UDP GSO not supported, skipping";
+    return;
+  }
+
+  BatchReader reader(16);
+  receiver.resumeRead(&reader);
+  size_t received = 0;
+  loopUntil(evb, [&] {
+    received = 0;
+    for (auto& datagram : reader.datagrams) {
+      received += datagram.size();
+    }
+    return received == data.size();
+  });
+
+  // Whether the datagrams are coalesced again is up to the kernel, but
+  // when they are the segment size is reported.
+  EXPECT_EQ(data.size(), received);
+  ASSERT_EQ(reader.datagrams.size(), reader.segmentSizes.size());
+  for (size_t i = 0; i < reader.datagrams.size(); ++i) {
+    if (reader.datagrams[i].size() > 1000) {
+      EXPECT_EQ(1000, reader.segmentSizes[i]);
+    }
+  }
+  receiver.close();
+}
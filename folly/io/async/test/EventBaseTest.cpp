@@ -26,8 +26,10 @@
 
 #include <folly/futures/Promise.h>
 
+#include <algorithm>
 #include <atomic>
 #include <iostream>
+#include <map>
 #include <memory>
 #include <thread>
 
@@ -1924,3 +1926,190 @@ TEST(EventBaseTest, RequestContextTest) {
   evb.loop();
   EXPECT_EQ(defaultCtx, RequestContext::get());
 }
+
+TEST(EventBaseTest, BusyPollPicksUpRemoteWork) {
+  EventBase evb;
+  evb.setBusyPollBudget(std::chrono::seconds(10));
+  EXPECT_EQ(std::chrono::seconds(10), evb.getBusyPollBudget());
+
+  bool ran = false;
+  std::thread t([&] {
+    evb.waitUntilRunning();
+    /* sleep override */ std::this_thread::sleep_for(20ms);
+    evb.runInEventBaseThread([&] {
+      ran = true;
+      evb.terminateLoopSoon();
+    });
+  });
+  evb.loopForever();
+  t.join();
+
+  EXPECT_TRUE(ran);
+  const auto& stats = evb.getBusyPollStats();
+  // The budget never ran out, so the loop never blocked.
+  EXPECT_EQ(0, stats.misses);
+  EXPECT_GE(stats.hits, 1);
+  EXPECT_GT(stats.polls, stats.hits);
+  EXPECT_GE(stats.spinTime, 10ms);
+}
+
+TEST(EventBaseTest, BusyPollBlocksAfterBudget) {
+  EventBase evb;
+  evb.setBusyPollBudget(1ms);
+
+  TimePoint start;
+  bool fired = false;
+  evb.tryRunAfterDelay([&] { fired = true; }, 50);
+  evb.loop();
+  TimePoint end;
+
+  EXPECT_TRUE(fired);
+  T_CHECK_TIMEOUT(start, end, milliseconds(50));
+  const auto& stats = evb.getBusyPollStats();
+  EXPECT_GE(stats.misses, 1);
+  EXPECT_LT(stats.spinTime, 50ms);
+}
+
+namespace {
+class TestCallbackObserver : public EventBaseCallbackObserver {
+ public:
+  explicit TestCallbackObserver(uint32_t sampleRate)
+      : sampleRate_(sampleRate) {}
+
+  uint32_t getSampleRate() const override {
+    return sampleRate_;
+  }
+
+  void callbackSample(const CallbackInfo& info) noexcept override {
+    samples.push_back(info);
+  }
+
+  std::vector<CallbackInfo> samples;
+
+ private:
+  uint32_t sampleRate_;
+};
+
+class SleepingTimeout : public AsyncTimeout {
+ public:
+  SleepingTimeout(EventBase* evb, milliseconds sleep)
+      : AsyncTimeout(evb), sleep_(sleep) {}
+
+  void timeoutExpired() noexcept override {
+    /* sleep override */ std::this_thread::sleep_for(sleep_);
+  }
+
+ private:
+  milliseconds sleep_;
+};
+} // namespace
+
+TEST(EventBaseTest, CallbackObserver) {
+  EventBase evb;
+  auto observer = std::make_shared<TestCallbackObserver>(1);
+  evb.setCallbackObserver(observer);
+
+  SleepingTimeout timeout(&evb, 0ms);
+  timeout.scheduleTimeout(1);
+  evb.runInLoop([] {});
+  evb.runInEventBaseThread([] {});
+  evb.loop();
+
+  // The timeout, the runInLoop() function, and the runInEventBaseThread()
+  // function with the notification queue handler that ran it.
+  using Type = EventBaseCallbackObserver::CallbackType;
+  std::multimap<Type, EventBaseCallbackObserver::CallbackInfo> byType;
+  for (const auto& info : observer->samples) {
+    byType.emplace(info.type, info);
+  }
+  ASSERT_EQ(4, byType.size());
+  ASSERT_EQ(1, byType.count(Type::TIMEOUT));
+  auto& timeoutInfo = byType.find(Type::TIMEOUT)->second;
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(&timeout), timeoutInfo.id);
+  EXPECT_EQ(&typeid(SleepingTimeout), timeoutInfo.typeInfo);
+  auto desc = timeoutInfo.describe();
+  EXPECT_EQ(0, desc.find("TIMEOUT "));
+  EXPECT_NE(std::string::npos, desc.find("SleepingTimeout"));
+  EXPECT_EQ(1, byType.count(Type::EVENT_HANDLER));
+
+  // Only the runInLoop() function knows where it was scheduled from; the
+  // loop was not running yet, so the other one went through the queue.
+  ASSERT_EQ(2, byType.count(Type::FUNCTION));
+  auto functions = byType.equal_range(Type::FUNCTION);
+  auto scheduledFunctions = std::count_if(
+      functions.first,
+      functions.second,
+      [](const std::pair<const Type, EventBaseCallbackObserver::CallbackInfo>&
+             entry) { return entry.second.callSite != 0; });
+  EXPECT_EQ(1, scheduledFunctions);
+
+  evb.setCallbackObserver(nullptr);
+  evb.runInLoop([] {});
+  evb.loop();
+  EXPECT_EQ(4, observer->samples.size());
+}
+
+TEST(EventBaseTest, CallbackObserverSampling) {
+  EventBase evb;
+  auto observer = std::make_shared<TestCallbackObserver>(4);
+  evb.setCallbackObserver(observer);
+  for (int i = 0; i < 20; ++i) {
+    evb.runInLoop([] {});
+  }
+  evb.loop();
+  EXPECT_EQ(5, observer->samples.size());
+}
+
+TEST(EventBaseTest, SlowLoopCallback) {
+  EventBase evb;
+  std::vector<EventBase::SlowLoopInfo> slowLoops;
+  evb.setSlowLoopCallback(
+      20ms, [&](const EventBase::SlowLoopInfo& info) {
+        slowLoops.push_back(info);
+      });
+
+  // A fast iteration is not reported.
+  evb.runInLoop([] {});
+  evb.loopOnce();
+  EXPECT_TRUE(slowLoops.empty());
+
+  SleepingTimeout timeout(&evb, 30ms);
+  timeout.scheduleTimeout(1);
+  evb.loop();
+
+  ASSERT_EQ(1, slowLoops.size());
+  const auto& info = slowLoops[0];
+  EXPECT_GE(info.busyTime, 30ms);
+  EXPECT_GE(info.numCallbacks, 1);
+  EXPECT_EQ(
+      EventBaseCallbackObserver::CallbackType::TIMEOUT, info.slowest.type);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(&timeout), info.slowest.id);
+  EXPECT_GE(info.slowest.duration, 30ms);
+}
+
+TEST(EventBaseTest, SlowLoopBlamesQueuedFunction) {
+  EventBase evb;
+  std::vector<EventBase::SlowLoopInfo> slowLoops;
+  evb.setSlowLoopCallback(
+      20ms, [&](const EventBase::SlowLoopInfo& info) {
+        slowLoops.push_back(info);
+      });
+
+  std::thread t([&] {
+    evb.waitUntilRunning();
+    evb.runInEventBaseThread([] {
+      /* sleep override */ std::this_thread::sleep_for(30ms);
+    });
+    evb.terminateLoopSoon();
+  });
+  evb.loopForever();
+  t.join();
+
+  ASSERT_EQ(1, slowLoops.size());
+  // The notification queue handler that ran the function is not blamed.
+  EXPECT_EQ(
+      EventBaseCallbackObserver::CallbackType::FUNCTION,
+      slowLoops[0].slowest.type);
+  EXPECT_GE(slowLoops[0].slowest.duration, 30ms);
+  EXPECT_GE(slowLoops[0].busyTime, 30ms);
+}
@@ -430,3 +430,109 @@ TEST_F(HHWheelTimerTest, IntrusivePtr) {
   T_CHECK_TIMEOUT(start, t3.timestamps[0], milliseconds(10));
   T_CHECK_TIMEOUT(start, end, milliseconds(10));
 }
+
+namespace {
+// Counts the AsyncTimeouts an EventBase runs, i.e. the wakeups of its timers
+class TimeoutCounter : public EventBaseCallbackObserver {
+ public:
+  uint32_t getSampleRate() const override {
+    return 1;
+  }
+
+  void callbackSample(const CallbackInfo& info) noexcept override {
+    if (info.type == CallbackType::TIMEOUT) {
+      ++timeouts;
+    }
+  }
+
+  size_t timeouts{0};
+};
+} // namespace
+
+TEST_F(HHWheelTimerTest, TicklessFireOrder) {
+  StackWheelTimer t(&eventBase, milliseconds(1));
+  t.setTickless(true);
+  EXPECT_TRUE(t.isTickless());
+
+  // In bucket 0, at the end of the first rotation, and in bucket 1.
+  TestTimeout t1(&t, milliseconds(5));
+  TestTimeout t2(&t, milliseconds(250));
+  TestTimeout t3(&t, milliseconds(300));
+
+  auto start = std::chrono::steady_clock::now();
+  eventBase.loop();
+
+  ASSERT_EQ(1, t1.timestamps.size());
+  ASSERT_EQ(1, t2.timestamps.size());
+  ASSERT_EQ(1, t3.timestamps.size());
+  EXPECT_GE(t1.timestamps[0].getTime() - start, milliseconds(4));
+  EXPECT_GE(t2.timestamps[0].getTime() - start, milliseconds(249));
+  EXPECT_GE(t3.timestamps[0].getTime() - start, milliseconds(299));
+  EXPECT_EQ(0, t.count());
+}
+
+TEST_F(HHWheelTimerTest, TicklessSkipsEmptyLists) {
+  StackWheelTimer t(&eventBase, milliseconds(1));
+  t.setTickless(true);
+  auto counter = std::make_shared<TimeoutCounter>();
+  eventBase.setCallbackObserver(counter);
+
+  // Cascaded from bucket 1 about 512ms from now.  The rotations ending at
+  // 256ms and 512ms only cost a wakeup for the list that holds it.
+  TestTimeout t1(&t, milliseconds(700));
+  auto start = std::chrono::steady_clock::now();
+  eventBase.loop();
+
+  ASSERT_EQ(1, t1.timestamps.size());
+  EXPECT_GE(t1.timestamps[0].getTime() - start, milliseconds(699));
+  EXPECT_EQ(2, counter->timeouts);
+}
+
+TEST_F(HHWheelTimerTest, TicklessIdleTimeouts) {
+  StackWheelTimer t(&eventBase, milliseconds(1));
+  t.setTickless(true);
+  auto counter = std::make_shared<TimeoutCounter>();
+  eventBase.setCallbackObserver(counter);
+
+  std::vector<TestTimeout> idle(100);
+  std::vector<HHWheelTimer::Callback*> callbacks;
+  for (auto& cb : idle) {
+    callbacks.push_back(&cb);
+  }
+  t.scheduleTimeouts(range(callbacks), std::chrono::seconds(10));
+  EXPECT_EQ(100, t.count());
+
+  // Nothing is due for a while, so the timer does not wake up at all.
+  eventBase.tryRunAfterDelay([&] { eventBase.terminateLoopSoon(); }, 600);
+  eventBase.loop();
+  EXPECT_EQ(1, counter->timeouts);
+
+  EXPECT_EQ(100, t.cancelTimeouts(range(callbacks)));
+  EXPECT_EQ(0, t.count());
+  for (auto& cb : idle) {
+    EXPECT_FALSE(cb.isScheduled());
+    EXPECT_TRUE(cb.timestamps.empty());
+    EXPECT_TRUE(cb.canceledTimestamps.empty());
+  }
+}
+
+TEST_F(HHWheelTimerTest, BulkReschedule) {
+  StackWheelTimer t(&eventBase, milliseconds(1));
+
+  TestTimeout t1;
+  TestTimeout t2;
+  TestTimeout t3;
+  HHWheelTimer::Callback* callbacks[] = {&t1, &t2};
+  t.scheduleTimeouts(range(callbacks), std::chrono::minutes(1));
+  t.scheduleTimeout(&t3, milliseconds(20));
+  t.scheduleTimeouts(range(callbacks), milliseconds(5));
+  EXPECT_EQ(3, t.count());
+
+  eventBase.loop();
+
+  ASSERT_EQ(1, t1.timestamps.size());
+  ASSERT_EQ(1, t2.timestamps.size());
+  ASSERT_EQ(1, t3.timestamps.size());
+  EXPECT_LE(t1.timestamps[0].getTime(), t3.timestamps[0].getTime());
+  EXPECT_LE(t2.timestamps[0].getTime(), t3.timestamps[0].getTime());
+}
@@ -0,0 +1,378 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/io/async/MPSCNotificationQueue.h>
+
+#include <deque>
+#include <list>
+#include <thread>
+#include <vector>
+
+#include <folly/io/async/ScopedEventBaseThread.h>
+#include <folly/portability/GTest.h>
+
+using namespace std;
+using namespace folly;
+
+typedef MPSCNotificationQueue<int> IntQueue;
+
+class MPSCQueueConsumer : public IntQueue::Consumer {
+ public:
+  void messageAvailable(int&& value) noexcept override {
+    messages.push_back(value);
+    if (fn) {
+      fn(value);
+    }
+  }
+
+  std::function<void(int)> fn;
+  std::deque<int> messages;
+};
+
+class MPSCQueueTest : public ::testing::TestWithParam<IntQueue::FdType> {
+ protected:
+  IntQueue queue{0, GetParam()};
+};
+
+TEST_P(MPSCQueueTest, SendOne) {
+  EventBase eventBase;
+
+  MPSCQueueConsumer consumer;
+  consumer.fn = [&](int) { consumer.stopConsuming(); };
+  consumer.startConsuming(&eventBase, &queue);
+
+  ScopedEventBaseThread t1;
+  t1.getEventBase()->runInEventBaseThread([&] { queue.putMessage(5); });
+
+  eventBase.loop();
+
+  ASSERT_EQ(1, consumer.messages.size());
+  EXPECT_EQ(5, consumer.messages.at(0));
+}
+
+TEST_P(MPSCQueueTest, PutMessages) {
+  EventBase eventBase;
+
+  // Hand the queue over to consumer2 in the middle of a batch; it should
+  // pick up exactly where consumer left off.
+  MPSCQueueConsumer consumer;
+  MPSCQueueConsumer consumer2;
+  consumer.fn = [&](int msg) {
+    if (msg == 0) {
+      consumer.stopConsuming();
+      consumer2.startConsuming(&eventBase, &queue);
+    }
+  };
+  consumer2.fn = [&](int msg) {
+    if (msg == 0) {
+      consumer2.stopConsuming();
+    }
+  };
+  consumer.startConsuming(&eventBase, &queue);
+
+  list<int> msgList = {1, 2, 3, 4};
+  vector<int> msgVector = {5, 0, 9, 8, 7, 6, 7, 7, 8, 8, 2, 9, 6, 6, 10, 2, 0};
+  queue.putMessages(msgList.begin(), msgList.end());
+  queue.putMessages(msgVector.begin() + 2, msgVector.begin() + 4);
+  queue.putMessage(7);
+  queue.putMessages(msgVector.begin(), msgVector.end());
+  EXPECT_EQ(24, queue.size());
+
+  eventBase.loop();
+
+  vector<int> expected = {1, 2, 3, 4, 9, 8, 7, 5, 0};
+  vector<int> expected2 = {9, 8, 7, 6, 7, 7, 8, 8, 2, 9, 6, 6, 10, 2, 0};
+  EXPECT_EQ(expected, vector<int>(
+      consumer.messages.begin(), consumer.messages.end()));
+  EXPECT_EQ(expected2, vector<int>(
+      consumer2.messages.begin(), consumer2.messages.end()));
+  EXPECT_EQ(0, queue.size());
+}
+
+TEST_P(MPSCQueueTest, MaxQueueSize) {
+  queue.setMaxQueueSize(5);
+  for (int n = 0; n < 5; ++n) {
+    queue.tryPutMessage(n);
+  }
+
+  EXPECT_THROW(queue.tryPutMessage(5), std::overflow_error);
+  EXPECT_FALSE(queue.tryPutMessageNoThrow(5));
+
+  int result = -1;
+  EXPECT_TRUE(queue.tryConsume(result));
+  EXPECT_EQ(0, result);
+
+  queue.tryPutMessage(5);
+  EXPECT_THROW(queue.tryPutMessage(6), std::overflow_error);
+  // putMessage() ignores the advisory limit
+  queue.putMessage(6);
+  EXPECT_EQ(6, queue.size());
+
+  EXPECT_TRUE(queue.tryConsume(result));
+  EXPECT_EQ(1, result);
+  EXPECT_THROW(queue.tryPutMessage(7), std::overflow_error);
+
+  EXPECT_TRUE(queue.tryConsume(result));
+  EXPECT_EQ(2, result);
+  queue.tryPutMessage(7);
+
+  for (int n = 3; n <= 7; ++n) {
+    EXPECT_TRUE(queue.tryConsume(result));
+    EXPECT_EQ(n, result);
+  }
+  result = -1;
+  EXPECT_FALSE(queue.tryConsume(result));
+  EXPECT_EQ(-1, result);
+}
+
+TEST_P(MPSCQueueTest, MaxReadAtOnce) {
+  for (int n = 0; n < 100; ++n) {
+    queue.putMessage(n);
+  }
+
+  EventBase eventBase;
+
+  uint32_t messagesThisLoop = 0;
+  std::vector<uint32_t> messagesPerLoop;
+  std::function<void()> loopFinished = [&] {
+    messagesPerLoop.push_back(messagesThisLoop);
+    messagesThisLoop = 0;
+    if (messagesPerLoop.size() != 55) {
+      eventBase.runInLoop(loopFinished);
+    }
+  };
+  eventBase.runInLoop(loopFinished);
+
+  MPSCQueueConsumer consumer;
+  consumer.setMaxReadAtOnce(10);
+  consumer.fn = [&](int value) {
+    ++messagesThisLoop;
+    if (value == 50) {
+      consumer.setMaxReadAtOnce(1);
+    }
+    if (value == 99) {
+      eventBase.terminateLoopSoon();
+    }
+  };
+  consumer.startConsuming(&eventBase, &queue);
+
+  eventBase.loop();
+
+  ASSERT_EQ(100, consumer.messages.size());
+  for (int n = 0; n < 100; ++n) {
+    EXPECT_EQ(n, consumer.messages.at(n));
+  }
+  if (messagesThisLoop > 0) {
+    messagesPerLoop.push_back(messagesThisLoop);
+  }
+
+  // Messages left over from a batch must still be delivered one loop
+  // iteration at a time, although nobody signals for them.
+  ASSERT_EQ(55, messagesPerLoop.size());
+  for (int n = 0; n < 5; ++n) {
+    EXPECT_EQ(10, messagesPerLoop.at(n));
+  }
+  for (int n = 5; n < 55; ++n) {
+    EXPECT_EQ(1, messagesPerLoop.at(n));
+  }
+}
+
+TEST_P(MPSCQueueTest, PutBetweenBatches) {
+  for (int n = 0; n < 4; ++n) {
+    queue.putMessage(n);
+  }
+
+  EventBase eventBase;
+  MPSCQueueConsumer consumer;
+  consumer.setMaxReadAtOnce(2);
+  consumer.startConsuming(&eventBase, &queue);
+
+  eventBase.loopOnce(EVLOOP_NONBLOCK);
+  ASSERT_EQ(2, consumer.messages.size());
+
+  // Its signal is cleared by the next batch, which then ends exactly as the
+  // messages left over from the first one run out.  It must not be stranded.
+  queue.putMessage(4);
+  eventBase.loopOnce(EVLOOP_NONBLOCK);
+  ASSERT_EQ(4, consumer.messages.size());
+  eventBase.loopOnce(EVLOOP_NONBLOCK);
+  ASSERT_EQ(5, consumer.messages.size());
+  EXPECT_EQ(4, consumer.messages.back());
+
+  consumer.stopConsuming();
+}
+
+TEST_P(MPSCQueueTest, DestroyCallback) {
+  class DestroyTestConsumer : public IntQueue::Consumer {
+   public:
+    void messageAvailable(int&& value) noexcept override {
+      DestructorGuard g(this);
+      if (fn && *fn) {
+        (*fn)(value);
+      }
+    }
+
+    std::function<void(int)>* fn;
+
+   protected:
+    ~DestroyTestConsumer() override = default;
+  };
+
+  EventBase eventBase;
+  queue.putMessage(1);
+  queue.putMessage(2);
+
+  std::unique_ptr<DestroyTestConsumer, DelayedDestruction::Destructor>
+      consumer(new DestroyTestConsumer);
+  std::function<void(int)> fn = [&](int) { consumer = nullptr; };
+  consumer->fn = &fn;
+  consumer->startConsuming(&eventBase, &queue);
+
+  eventBase.loop();
+
+  EXPECT_TRUE(!consumer);
+  int result = 1;
+  EXPECT_TRUE(queue.tryConsume(result));
+  EXPECT_EQ(2, result);
+}
+
+TEST_P(MPSCQueueTest, ConsumeUntilDrained) {
+  EventBase eventBase;
+  MPSCQueueConsumer consumer;
+  consumer.fn = [&](int i) {
+    EXPECT_THROW(queue.tryPutMessage(i), std::runtime_error);
+    EXPECT_FALSE(queue.tryPutMessageNoThrow(i));
+    EXPECT_THROW(queue.putMessage(i), std::runtime_error);
+    std::vector<int> ints{1, 2, 3};
+    EXPECT_THROW(
+        queue.putMessages(ints.begin(), ints.end()), std::runtime_error);
+  };
+  consumer.setMaxReadAtOnce(10); // We should ignore this
+  consumer.startConsuming(&eventBase, &queue);
+  for (int i = 0; i < 20; i++) {
+    queue.putMessage(i);
+  }
+  size_t numConsumed = 0;
+  EXPECT_TRUE(consumer.consumeUntilDrained(&numConsumed));
+  EXPECT_EQ(20, numConsumed);
+  EXPECT_EQ(20, consumer.messages.size());
+
+  consumer.fn = nullptr;
+  queue.putMessage(20);
+  eventBase.loopOnce();
+  EXPECT_EQ(21, consumer.messages.size());
+  consumer.stopConsuming();
+}
+
+TEST_P(MPSCQueueTest, MultiProducer) {
+  const int kNumProducers = 8;
+  const int kNumMessages = 20000;
+
+  EventBase eventBase;
+  MPSCQueueConsumer consumer;
+  consumer.setMaxReadAtOnce(0);
+  int remaining = kNumProducers * kNumMessages;
+  std::vector<int> last(kNumProducers, -1);
+  consumer.fn = [&](int value) {
+    // Every producer's messages must arrive in the order it put them.
+    int producer = value / kNumMessages;
+    int seq = value % kNumMessages;
+    EXPECT_EQ(last[producer] + 1, seq);
+    last[producer] = seq;
+    if (--remaining == 0) {
+      consumer.stopConsuming();
+    }
+  };
+  consumer.messages.clear();
+  consumer.startConsuming(&eventBase, &queue);
+
+  std::vector<std::thread> producers;
+  for (int p = 0; p < kNumProducers; ++p) {
+    producers.emplace_back([&, p] {
+      for (int n = 0; n < kNumMessages; ++n) {
+        if (n % 16 == 0) {
+          std::vector<int> batch;
+          for (int i = 0; i < 4 && n < kNumMessages; ++i, ++n) {
+            batch.push_back(p * kNumMessages + n);
+          }
+          queue.putMessages(batch.begin(), batch.end());
+          --n;
+        } else {
+          queue.putMessage(p * kNumMessages + n);
+        }
+      }
+    });
+  }
+
+  eventBase.loop();
+  for (auto& t : producers) {
+    t.join();
+  }
+
+  EXPECT_EQ(0, remaining);
+  EXPECT_EQ(0, queue.size());
+}
+
+INSTANTIATE_TEST_CASE_P(
+    MPSCNotificationQueueTest,
+    MPSCQueueTest,
+    ::testing::Values(
+#ifdef FOLLY_HAVE_EVENTFD
+        IntQueue::FdType::EVENTFD,
+#endif
+        IntQueue::FdType::PIPE));
+
+TEST(MPSCNotificationQueueTest, SingleConsumer) {
+  // The queue checks it is used from the process that created it, so build
+  // everything inside the death test's child.
+  EXPECT_DEATH(
+      {
+        EventBase evb;
+        IntQueue queue;
+        MPSCQueueConsumer consumer;
+        consumer.startConsuming(&evb, &queue);
+        MPSCQueueConsumer consumer2;
+        consumer2.startConsuming(&evb, &queue);
+      },
+      "single consumer");
+
+  EventBase evb;
+  IntQueue queue;
+  MPSCQueueConsumer consumer;
+  consumer.startConsuming(&evb, &queue);
+  consumer.stopConsuming();
+  MPSCQueueConsumer consumer2;
+  consumer2.startConsuming(&evb, &queue);
+  consumer2.stopConsuming();
+}
+
+TEST(MPSCNotificationQueueConsumer, make) {
+  int value = 0;
+  EventBase evb;
+  MPSCNotificationQueue<int> queue(32);
+
+  auto consumer = decltype(queue)::Consumer::make(
+      [&](int&& msg) noexcept { value = msg; });
+
+  consumer->startConsuming(&evb, &queue);
+
+  int const newValue = 10;
+  queue.tryPutMessage(newValue);
+
+  evb.loopOnce();
+
+  EXPECT_EQ(newValue, value);
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/io/async/ReadBufferPool.h>
+
+#include <cstring>
+
+#include <folly/io/async/EventBase.h>
+#include <folly/portability/GTest.h>
+
+using namespace folly;
+
+TEST(ReadBufferPool, CopiesOutExactly) {
+  ReadBufferPool pool(1024);
+  auto slab = pool.acquire();
+  memcpy(slab.get(), "hello", 5);
+  auto buf = pool.release(std::move(slab), 5);
+  ASSERT_NE(nullptr, buf);
+  EXPECT_EQ(5, buf->length());
+  EXPECT_EQ(0, buf->headroom());
+  EXPECT_EQ(0, memcmp(buf->data(), "hello", 5));
+
+  EXPECT_EQ(nullptr, pool.release(pool.acquire(), 0));
+
+  auto stats = pool.getStats();
+  EXPECT_EQ(1024, stats.slabSize);
+  EXPECT_EQ(1, stats.reads);
+  EXPECT_EQ(5, stats.bytesRead);
+  EXPECT_EQ(5, stats.highWaterRead);
+}
+
+TEST(ReadBufferPool, ReusesSlab) {
+  ReadBufferPool pool(1024);
+  EXPECT_EQ(0, pool.getStats().numSlabs);
+  auto slab = pool.acquire();
+  auto first = slab.get();
+  pool.release(std::move(slab), 10);
+  slab = pool.acquire();
+  EXPECT_EQ(first, slab.get());
+  pool.release(std::move(slab), 20);
+
+  auto stats = pool.getStats();
+  EXPECT_EQ(1, stats.numSlabs);
+  EXPECT_EQ(1, stats.highWaterSlabs);
+  EXPECT_EQ(2, stats.reads);
+  EXPECT_EQ(30, stats.bytesRead);
+  EXPECT_EQ(20, stats.highWaterRead);
+}
+
+TEST(ReadBufferPool, GrowsWhileLent) {
+  ReadBufferPool pool(1024);
+  auto a = pool.acquire();
+  auto b = pool.acquire();
+  EXPECT_NE(a.get(), b.get());
+  pool.release(std::move(b), 0);
+  pool.release(std::move(a), 0);
+
+  auto stats = pool.getStats();
+  EXPECT_EQ(2, stats.numSlabs);
+  EXPECT_EQ(2, stats.highWaterSlabs);
+  EXPECT_EQ(0, stats.reads);
+}
+
+TEST(ReadBufferPool, OnePerEventBase) {
+  EventBase evb1;
+  EventBase evb2;
+  auto& pool1 = ReadBufferPool::get(evb1);
+  EXPECT_EQ(&pool1, &ReadBufferPool::get(evb1));
+  EXPECT_NE(&pool1, &ReadBufferPool::get(evb2));
+  EXPECT_EQ(ReadBufferPool::kDefaultSlabSize, pool1.getSlabSize());
+}
@@ -186,4 +186,67 @@ TEST_F(SSLSessionTest, GetSessionID) {
   auto sessID = sess->getSessionID();
   ASSERT_GE(sessID.length(), 0);
 }
+
+/**
+ * A session established against one server context is resumed against
+ * another that shares its SSLSessionCache.
+ */
+TEST_F(SSLSessionTest, SharedSessionCacheTest) {
+  auto cache = std::make_shared<ssl::SSLSessionCache>();
+  getctx(clientCtx, hskServerCtx);
+  for (auto& ctx : {dfServerCtx, hskServerCtx}) {
+    ctx->setSessionCacheContext("shared");
+    ctx->setSessionCache(cache);
+    // Resume through session IDs rather than tickets, so that the cache is
+    // actually consulted.
+    ctx->setOptions(SSL_OP_NO_TICKET);
+#ifdef SSL_OP_NO_TLSv1_3
+    ctx->setOptions(SSL_OP_NO_TLSv1_3);
+#endif
+  }
+  std::unique_ptr<SSLSession> sess;
+
+  {
+    int fds[2];
+    getfds(fds);
+    AsyncSSLSocket::UniquePtr clientSock(
+        new AsyncSSLSocket(clientCtx, &eventBase, fds[0], serverName));
+    auto clientPtr = clientSock.get();
+    AsyncSSLSocket::UniquePtr serverSock(
+        new AsyncSSLSocket(dfServerCtx, &eventBase, fds[1], true));
+    SSLHandshakeClient client(std::move(clientSock), false, false);
+    SSLHandshakeServer server(std::move(serverSock), false, false);
+
+    eventBase.loop();
+    ASSERT_TRUE(client.handshakeSuccess_);
+    ASSERT_FALSE(clientPtr->getSSLSessionReused());
+
+    sess.reset(new SSLSession(clientPtr->getSSLSession()));
+  }
+  EXPECT_EQ(1, cache->size());
+
+  {
+    int fds[2];
+    getfds(fds);
+    AsyncSSLSocket::UniquePtr clientSock(
+        new AsyncSSLSocket(clientCtx, &eventBase, fds[0], serverName));
+    auto clientPtr = clientSock.get();
+    clientSock->setSSLSession(sess->getRawSSLSessionDangerous(), true);
+    AsyncSSLSocket::UniquePtr serverSock(
+        new AsyncSSLSocket(hskServerCtx, &eventBase, fds[1], true));
+    SSLHandshakeClient client(std::move(clientSock), false, false);
+    SSLHandshakeServer server(std::move(serverSock), false, false);
+
+    eventBase.loop();
+    ASSERT_TRUE(client.handshakeSuccess_);
+    ASSERT_TRUE(clientPtr->getSSLSessionReused());
+  }
+
+  auto stats = cache->getStats();
+  EXPECT_EQ(1, stats.stores);
+  EXPECT_EQ(1, stats.hits);
+  EXPECT_EQ(1, stats.fullHandshakes);
+  EXPECT_EQ(1, stats.resumedHandshakes);
+  EXPECT_DOUBLE_EQ(0.5, stats.resumptionRate());
+}
 }
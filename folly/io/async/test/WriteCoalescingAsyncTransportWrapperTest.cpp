@@ -0,0 +1,222 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/io/async/WriteCoalescingAsyncTransportWrapper.h>
+
+#include <string>
+#include <thread>
+
+#include <folly/io/async/AsyncSocket.h>
+#include <folly/io/async/EventBase.h>
+#include <folly/io/async/test/AsyncSocketTest.h>
+#include <folly/io/async/test/SocketPair.h>
+#include <folly/portability/GTest.h>
+#include <folly/portability/Sockets.h>
+
+namespace folly {
+namespace test {
+
+namespace {
+
+class CountingSocket : public AsyncSocket {
+ public:
+  using AsyncSocket::AsyncSocket;
+
+  void write(
+      WriteCallback* callback,
+      const void* buf,
+      size_t bytes,
+      WriteFlags flags = WriteFlags::NONE) override {
+    ++writes;
+    lastFlags = flags;
+    AsyncSocket::write(callback, buf, bytes, flags);
+  }
+
+  void writeChain(
+      WriteCallback* callback,
+      std::unique_ptr<IOBuf>&& buf,
+      WriteFlags flags = WriteFlags::NONE) override {
+    ++writes;
+    lastFlags = flags;
+    AsyncSocket::writeChain(callback, std::move(buf), flags);
+  }
+
+  size_t writes{0};
+  WriteFlags lastFlags{WriteFlags::NONE};
+};
+
+// Fails every writeChain() after the first failAfter bytes.
+class PartialFailSocket : public AsyncSocket {
+ public:
+  PartialFailSocket(EventBase* evb, size_t failAfter)
+      : AsyncSocket(evb), failAfter_(failAfter) {}
+
+  void writeChain(
+      WriteCallback* callback,
+      std::unique_ptr<IOBuf>&& /* buf */,
+      WriteFlags /* flags */ = WriteFlags::NONE) override {
+    callback->writeErr(
+        failAfter_,
+        AsyncSocketException(AsyncSocketException::INTERNAL_ERROR, "test"));
+  }
+
+ private:
+  size_t failAfter_;
+};
+
+using Wrapper = WriteCoalescingAsyncTransportWrapper<AsyncSocket>;
+
+std::string readAll(int fd) {
+  std::string out;
+  char buf[1024];
+  ssize_t n;
+  while ((n = recv(fd, buf, sizeof(buf), 0)) > 0) {
+    out.append(buf, n);
+  }
+  return out;
+}
+
+struct Fixture {
+  explicit Fixture(Wrapper::Options options = Wrapper::Options()) {
+    socket = new CountingSocket(&evb, pair.extractFD0());
+    transport.reset(
+        new Wrapper(AsyncSocket::UniquePtr(socket), std::move(options)));
+  }
+
+  EventBase evb;
+  SocketPair pair;
+  CountingSocket* socket;
+  Wrapper::UniquePtr transport;
+};
+
+} // namespace
+
+TEST(WriteCoalescingAsyncTransportWrapperTest, CoalescesLoopIteration) {
+  Fixture f;
+  WriteCallback wcb1;
+  WriteCallback wcb2;
+  WriteCallback wcb3;
+
+  f.evb.runInLoop([&] {
+    f.transport->write(&wcb1, "hello ", 6);
+    f.transport->write(nullptr, "there ", 6);
+    auto buf = IOBuf::copyBuffer("big ");
+    buf->prependChain(IOBuf::copyBuffer("wide "));
+    auto iov = buf->getIov();
+    f.transport->writev(&wcb2, iov.data(), iov.size(), WriteFlags::CORK);
+    f.transport->writeChain(
+        &wcb3, IOBuf::copyBuffer("world"), WriteFlags::EOR);
+    EXPECT_EQ(26, f.transport->getBufferedBytes());
+    EXPECT_EQ(0, f.socket->writes);
+  });
+  f.evb.loopOnce();
+
+  EXPECT_EQ(1, f.socket->writes);
+  EXPECT_EQ(WriteFlags::EOR, f.socket->lastFlags);
+  EXPECT_EQ(0, f.transport->getBufferedBytes());
+  EXPECT_EQ(STATE_SUCCEEDED, wcb1.state);
+  EXPECT_EQ(STATE_SUCCEEDED, wcb2.state);
+  EXPECT_EQ(STATE_SUCCEEDED, wcb3.state);
+  EXPECT_EQ("hello there big wide world", readAll(f.pair[1]));
+}
+
+TEST(WriteCoalescingAsyncTransportWrapperTest, MaxBufferSize) {
+  Wrapper::Options options;
+  options.maxBufferSize = 8;
+  Fixture f(options);
+
+  f.transport->write(nullptr, "abcde", 5);
+  EXPECT_EQ(0, f.socket->writes);
+  f.transport->write(nullptr, "fghij", 5);
+  EXPECT_EQ(1, f.socket->writes);
+  f.transport->write(nullptr, "klm", 3);
+  EXPECT_EQ(1, f.socket->writes);
+
+  // Writes that would not fit go straight through, after what is buffered.
+  f.transport->write(nullptr, "nopqrstuvwxyz", 13);
+  EXPECT_EQ(3, f.socket->writes);
+  f.evb.loopOnce(EVLOOP_NONBLOCK);
+  EXPECT_EQ(3, f.socket->writes);
+  EXPECT_EQ("abcdefghijklmnopqrstuvwxyz", readAll(f.pair[1]));
+}
+
+TEST(WriteCoalescingAsyncTransportWrapperTest, MaxDelay) {
+  Wrapper::Options options;
+  options.maxDelay = std::chrono::milliseconds(5);
+  Fixture f(options);
+
+  f.transport->write(nullptr, "abc", 3);
+  f.transport->write(nullptr, "def", 3);
+  EXPECT_EQ(0, f.socket->writes);
+  /* sleep override */
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  f.transport->write(nullptr, "ghi", 3);
+  EXPECT_EQ(1, f.socket->writes);
+  EXPECT_EQ("abcdefghi", readAll(f.pair[1]));
+}
+
+TEST(WriteCoalescingAsyncTransportWrapperTest, FlushBeforeClose) {
+  Fixture f;
+  WriteCallback wcb;
+  f.transport->write(&wcb, "abc", 3);
+  f.transport->shutdownWrite();
+  EXPECT_EQ(1, f.socket->writes);
+  EXPECT_EQ(STATE_SUCCEEDED, wcb.state);
+  EXPECT_EQ("abc", readAll(f.pair[1]));
+}
+
+TEST(WriteCoalescingAsyncTransportWrapperTest, ErrorReachesEveryCallback) {
+  EventBase evb;
+  auto socket = new CountingSocket(&evb);
+  Wrapper::UniquePtr transport(new Wrapper(AsyncSocket::UniquePtr(socket)));
+  WriteCallback wcb1;
+  WriteCallback wcb2;
+
+  transport->write(&wcb1, "abc", 3);
+  transport->write(&wcb2, "def", 3);
+  evb.loopOnce(EVLOOP_NONBLOCK);
+
+  EXPECT_EQ(1, socket->writes);
+  EXPECT_EQ(STATE_FAILED, wcb1.state);
+  EXPECT_EQ(STATE_FAILED, wcb2.state);
+  EXPECT_EQ(0, wcb1.bytesWritten);
+  EXPECT_EQ(0, wcb2.bytesWritten);
+}
+
+TEST(WriteCoalescingAsyncTransportWrapperTest, PartialErrorSkipsNullCallbacks) {
+  EventBase evb;
+  Wrapper::UniquePtr transport(new Wrapper(
+      AsyncSocket::UniquePtr(new PartialFailSocket(&evb, 8))));
+  WriteCallback wcb1;
+  WriteCallback wcb2;
+  WriteCallback wcb3;
+
+  // Bytes 0-3, 3-7, 7-10, 10-12 and 12-15 of the coalesced write
+  transport->write(&wcb1, "abc", 3);
+  transport->write(nullptr, "defg", 4);
+  transport->write(&wcb2, "hij", 3);
+  transport->write(nullptr, "kl", 2);
+  transport->write(&wcb3, "mno", 3);
+  evb.loopOnce(EVLOOP_NONBLOCK);
+
+  EXPECT_EQ(STATE_SUCCEEDED, wcb1.state);
+  EXPECT_EQ(STATE_FAILED, wcb2.state);
+  EXPECT_EQ(1, wcb2.bytesWritten);
+  EXPECT_EQ(STATE_FAILED, wcb3.state);
+  EXPECT_EQ(0, wcb3.bytesWritten);
+}
+
+}} // namespace folly::test
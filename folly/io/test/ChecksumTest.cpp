@@ -0,0 +1,104 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/io/Checksum.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <folly/Checksum.h>
+#include <folly/portability/GTest.h>
+
+using namespace folly;
+
+namespace {
+
+std::string makeData(size_t len) {
+  std::string data;
+  for (size_t i = 0; i < len; ++i) {
+    data.push_back(char(i * 131 + (i >> 8)));
+  }
+  return data;
+}
+
+// Splits data into buffers of the given sizes, repeated as needed, with
+// empty buffers in between.
+std::unique_ptr<IOBuf> makeChain(
+    const std::string& data,
+    const std::vector<size_t>& sizes) {
+  auto chain = IOBuf::create(0);
+  size_t offset = 0;
+  while (offset < data.size()) {
+    for (auto size : sizes) {
+      size = std::min(size, data.size() - offset);
+      chain->prependChain(IOBuf::copyBuffer(data.data() + offset, size));
+      chain->prependChain(IOBuf::create(0));
+      offset += size;
+    }
+  }
+  return chain;
+}
+
+uint32_t flatCrc32c(const std::string& data, uint32_t start = ~0U) {
+  return crc32c(
+      reinterpret_cast<const uint8_t*>(data.data()), data.size(), start);
+}
+
+uint32_t flatCrc32(const std::string& data) {
+  return crc32(reinterpret_cast<const uint8_t*>(data.data()), data.size());
+}
+
+} // namespace
+
+TEST(IOBufChecksum, Chain) {
+  auto data = makeData(100 * 1000);
+  std::vector<std::vector<size_t>> splits = {
+      {1}, {7, 300}, {4096}, {100 * 1000}};
+  for (const auto& sizes : splits) {
+    auto chain = makeChain(data, sizes);
+    EXPECT_EQ(flatCrc32c(data), io::crc32c(*chain));
+    EXPECT_EQ(flatCrc32(data), io::crc32(*chain));
+    EXPECT_EQ(flatCrc32c(data, 12345), io::crc32c(*chain, 12345));
+  }
+  EXPECT_EQ(~0U, io::crc32c(*IOBuf::create(0)));
+}
+
+TEST(IOBufChecksum, Cursor) {
+  auto data = makeData(10 * 1000);
+  auto chain = makeChain(data, {1000, 33});
+  io::Cursor cursor(chain.get());
+  cursor.skip(10);
+  EXPECT_EQ(flatCrc32c(data.substr(10, 5000)), io::crc32c(cursor, 5000));
+  EXPECT_EQ(flatCrc32(data.substr(5010, 100)), io::crc32(cursor, 100));
+  EXPECT_EQ(data.size() - 5110, cursor.totalLength());
+
+  EXPECT_THROW(io::crc32c(cursor, data.size()), std::out_of_range);
+  EXPECT_TRUE(cursor.isAtEnd());
+}
+
+TEST(IOBufChecksum, Combine) {
+  // Checksum the buffers of a chain separately, as different threads would,
+  // and merge the results.
+  auto data = makeData(100 * 1000);
+  auto chain = makeChain(data, {30 * 1000, 1, 999});
+  uint32_t combined = ~0U;
+  for (auto range : *chain) {
+    auto crc = crc32c(range.data(), range.size());
+    combined = crc32c_combine(combined, crc, range.size());
+  }
+  EXPECT_EQ(flatCrc32c(data), combined);
+}
@@ -0,0 +1,199 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/io/CodecPool.h>
+
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <folly/portability/GTest.h>
+
+using namespace folly;
+using namespace folly::io;
+
+namespace {
+
+std::string makeData() {
+  std::string data;
+  for (int i = 0; i < 1000; ++i) {
+    data += "record " + std::to_string(i * 7919 % 1000) + ";";
+  }
+  return data;
+}
+
+std::string toString(const IOBuf& buf) {
+  auto clone = buf.clone();
+  return clone->moveToFbString().toStdString();
+}
+
+std::vector<CodecType> availableCodecs() {
+  std::vector<CodecType> types;
+  for (int i = 0; i < static_cast<int>(CodecType::NUM_CODEC_TYPES); ++i) {
+    auto type = static_cast<CodecType>(i);
+    if (type != CodecType::USER_DEFINED && hasCodec(type)) {
+      types.push_back(type);
+    }
+  }
+  return types;
+}
+
+class CodecPoolTest : public testing::TestWithParam<CodecType> {
+ protected:
+  void SetUp() override {
+    clearPooledCodecs();
+  }
+};
+
+} // namespace
+
+TEST_P(CodecPoolTest, Reuse) {
+  const auto data = makeData();
+  auto input = IOBuf::copyBuffer(data);
+  Codec* first = nullptr;
+  for (int i = 0; i < 3; ++i) {
+    auto codec = getPooledCodec(GetParam());
+    if (first) {
+      EXPECT_EQ(first, codec.get());
+    }
+    first = codec.get();
+    auto compressed = codec->compress(input.get());
+    auto uncompressed = codec->uncompress(
+        compressed.get(),
+        codec->needsUncompressedLength() ? Optional<uint64_t>(data.size())
+                                         : none);
+    EXPECT_EQ(data, toString(*uncompressed));
+  }
+}
+
+TEST_P(CodecPoolTest, ReuseAfterError) {
+  const auto data = makeData();
+  auto input = IOBuf::copyBuffer(data);
+  auto garbage = IOBuf::copyBuffer(std::string(100, 'x'));
+  {
+    auto codec = getPooledCodec(GetParam());
+    if (GetParam() == CodecType::NO_COMPRESSION) {
+      return;
+    }
+    EXPECT_ANY_THROW(codec->uncompress(garbage.get(), data.size()));
+  }
+  auto codec = getPooledCodec(GetParam());
+  auto compressed = codec->compress(input.get());
+  EXPECT_EQ(
+      data, toString(*codec->uncompress(compressed.get(), data.size())));
+}
+
+INSTANTIATE_TEST_CASE_P(
+    CodecPoolTest,
+    CodecPoolTest,
+    testing::ValuesIn(availableCodecs()));
+
+TEST(CodecPool, Keys) {
+  clearPooledCodecs();
+  auto a = getPooledCodec(CodecType::ZLIB, 1).get();
+  auto b = getPooledCodec(CodecType::ZLIB, 9).get();
+  auto c = getPooledStreamCodec(CodecType::ZLIB, 1).get();
+  EXPECT_EQ(a, getPooledCodec(CodecType::ZLIB, 1).get());
+  EXPECT_EQ(b, getPooledCodec(CodecType::ZLIB, 9).get());
+  EXPECT_EQ(c, getPooledStreamCodec(CodecType::ZLIB, 1).get());
+  EXPECT_NE(a, c);
+}
+
+TEST(CodecPool, StreamCodecIsReset) {
+  clearPooledCodecs();
+  const auto data = makeData();
+  StreamCodec* first;
+  {
+    // Given back in the middle of a stream.
+    auto codec = getPooledStreamCodec(CodecType::ZLIB);
+    first = codec.get();
+    std::string out(100, '\0');
+    ByteRange in(StringPiece(data).subpiece(0, 10));
+    MutableByteRange output(
+        reinterpret_cast<uint8_t*>(&out[0]), out.size());
+    codec->compressStream(in, output);
+  }
+  auto codec = getPooledStreamCodec(CodecType::ZLIB);
+  EXPECT_EQ(first, codec.get());
+  auto input = IOBuf::copyBuffer(data);
+  auto compressed = codec->compress(input.get());
+  EXPECT_EQ(data, toString(*getCodec(CodecType::ZLIB)->uncompress(
+                      compressed.get())));
+}
+
+TEST(CodecPool, GivenBackToReleasingThread) {
+  clearPooledCodecs();
+  auto codec = getPooledCodec(CodecType::ZLIB);
+  auto ptr = codec.get();
+  std::thread([&] {
+    codec.reset();
+    EXPECT_EQ(ptr, getPooledCodec(CodecType::ZLIB).get());
+  }).join();
+}
+
+TEST(CodecPool, Bounded) {
+  clearPooledCodecs();
+  std::vector<PooledCodec> codecs;
+  for (size_t i = 0; i <= kMaxPooledCodecs; ++i) {
+    codecs.push_back(getPooledCodec(CodecType::ZLIB));
+  }
+  auto oldest = codecs.front().get();
+  std::set<Codec*> released;
+  for (auto& codec : codecs) {
+    released.insert(codec.get());
+    codec.reset();
+  }
+
+  // The codec given back first was dropped.
+  for (size_t i = 0; i < kMaxPooledCodecs; ++i) {
+    codecs[i] = getPooledCodec(CodecType::ZLIB);
+    EXPECT_NE(oldest, codecs[i].get());
+    EXPECT_EQ(1, released.count(codecs[i].get()));
+  }
+}
+
+#if FOLLY_HAVE_LIBZSTD
+TEST(CodecPool, Dictionary) {
+  clearPooledCodecs();
+  const auto data = makeData();
+  auto dictionary = createCompressionDictionary(
+      CodecType::ZSTD, ByteRange(StringPiece(data).subpiece(0, 2000)));
+  auto other = createCompressionDictionary(
+      CodecType::ZSTD, ByteRange(StringPiece(data).subpiece(2000, 2000)));
+
+  auto input = IOBuf::copyBuffer(data);
+  std::unique_ptr<IOBuf> compressed;
+  Codec* first;
+  {
+    auto codec = getPooledCodec(dictionary);
+    first = codec.get();
+    compressed = codec->compress(input.get());
+  }
+  EXPECT_NE(first, getPooledCodec(other).get());
+  EXPECT_NE(first, getPooledCodec(CodecType::ZSTD).get());
+
+  // The pooled codec keeps the dictionary alive.
+  std::weak_ptr<const CompressionDictionary> weak = dictionary;
+  auto codec = getPooledCodec(std::move(dictionary));
+  EXPECT_EQ(first, codec.get());
+  EXPECT_EQ(data, toString(*codec->uncompress(compressed.get())));
+  codec.reset();
+  EXPECT_FALSE(weak.expired());
+  clearPooledCodecs();
+  EXPECT_TRUE(weak.expired());
+}
+#endif
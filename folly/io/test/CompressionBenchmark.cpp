@@ -0,0 +1,533 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Benchmarks for every available codec and level on a few generated
+ * corpora, for one-shot compression of contiguous and chained input, and
+ * for StreamCodec fed one buffer at a time.
+ *
+ * Every benchmark counts one iteration per KiB of uncompressed data, so
+ * "iters/s" is the throughput in KiB/s.  Before the timings, a table of
+ * the compressed size, ratio, and memory held by the compression and
+ * decompression state of each configuration is printed.  With --json, both
+ * come out as JSON instead.
+ *
+ * Use --codecs, --corpora and --bm_regex to pick what to run, e.g.
+ *   --codecs=zstd,lz4 --corpora=json --bm_regex=compress
+ */
+
+#include <folly/io/Compression.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <folly/Benchmark.h>
+#include <folly/Conv.h>
+#include <folly/MallctlHelper.h>
+#include <folly/Malloc.h>
+#include <folly/Optional.h>
+#include <folly/String.h>
+#include <folly/dynamic.h>
+#include <folly/json.h>
+#include <folly/portability/GFlags.h>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+using namespace folly;
+using namespace folly::io;
+
+DEFINE_int32(corpus_kb, 1024, "Size of each corpus, in KiB");
+DEFINE_int32(chain_buffer_size, 4096, "Size of the IOBufs in chained input");
+DEFINE_string(codecs, "", "Comma-separated codecs to run (default: all)");
+DEFINE_string(corpora, "", "Comma-separated corpora to run (default: all)");
+DEFINE_bool(
+    all_levels,
+    false,
+    "Run every level of each codec, not just the fastest, default and best");
+DEFINE_bool(stats_only, false, "Only print the ratio and memory table");
+
+DECLARE_bool(json);
+
+namespace {
+
+struct Corpus {
+  std::string name;
+  std::string data;
+};
+
+// English-like text: words from a vocabulary with a roughly Zipfian
+// distribution.
+std::string makeText(size_t size) {
+  std::mt19937 rng(1);
+  std::vector<std::string> words(4000);
+  for (auto& word : words) {
+    auto length = 2 + rng() % 9;
+    for (size_t i = 0; i < length; ++i) {
+      word += char('a' + rng() % 26);
+    }
+  }
+  std::uniform_real_distribution<double> uniform(0, 1);
+  std::string data;
+  while (data.size() < size) {
+    auto index = size_t(std::exp(uniform(rng) * std::log(words.size())));
+    data += words[index - 1];
+    auto punctuation = rng() % 16;
+    data += punctuation == 0 ? ".\n" : punctuation == 1 ? ", " : " ";
+  }
+  data.resize(size);
+  return data;
+}
+
+// Log records as JSON objects, one per line.
+std::string makeJson(size_t size) {
+  std::mt19937 rng(2);
+  static const char* const kActions[] = {
+      "login", "logout", "view", "click", "purchase", "search"};
+  std::string data;
+  uint64_t timestamp = 1500000000000;
+  for (uint64_t id = 0; data.size() < size; ++id) {
+    timestamp += rng() % 1000;
+    data += to<std::string>(
+        "{\"id\":",
+        id,
+        ",\"ts\":",
+        timestamp,
+        ",\"user\":\"user_",
+        rng() % 5000,
+        "\",\"action\":\"",
+        kActions[rng() % 6],
+        "\",\"latency_ms\":",
+        (rng() % 100000) / 100.0,
+        ",\"ok\":",
+        rng() % 20 ? "true" : "false",
+        "}\n");
+  }
+  data.resize(size);
+  return data;
+}
+
+// Fixed-size binary rows of a time series: timestamp, sensor id and a
+// random walk, little endian.
+std::string makeBinary(size_t size) {
+  std::mt19937 rng(3);
+  std::string data;
+  uint64_t timestamp = 1500000000;
+  int32_t value = 0;
+  while (data.size() < size) {
+    timestamp += 1 + rng() % 3;
+    uint32_t sensor = rng() % 64;
+    value += int32_t(rng() % 21) - 10;
+    char row[16];
+    std::memcpy(row, &timestamp, 8);
+    std::memcpy(row + 8, &sensor, 4);
+    std::memcpy(row + 12, &value, 4);
+    data.append(row, sizeof(row));
+  }
+  data.resize(size);
+  return data;
+}
+
+// Mostly zeros, like sparse arrays or padded pages.
+std::string makeSparse(size_t size) {
+  std::mt19937 rng(4);
+  std::string data(size, '\0');
+  for (auto& c : data) {
+    if (rng() % 32 == 0) {
+      c = char(rng());
+    }
+  }
+  return data;
+}
+
+// Incompressible.
+std::string makeRandom(size_t size) {
+  std::mt19937 rng(5);
+  std::string data(size, '\0');
+  for (auto& c : data) {
+    c = char(rng());
+  }
+  return data;
+}
+
+bool selected(const std::string& list, StringPiece name) {
+  if (list.empty()) {
+    return true;
+  }
+  std::vector<StringPiece> names;
+  split(',', list, names);
+  return std::find(names.begin(), names.end(), name) != names.end();
+}
+
+std::vector<Corpus> makeCorpora() {
+  const size_t size = size_t(FLAGS_corpus_kb) * 1024;
+  std::vector<Corpus> corpora;
+  auto add = [&](const char* name, std::string (*make)(size_t)) {
+    if (selected(FLAGS_corpora, name)) {
+      corpora.push_back(Corpus{name, make(size)});
+    }
+  };
+  add("text", makeText);
+  add("json", makeJson);
+  add("binary", makeBinary);
+  add("sparse", makeSparse);
+  add("random", makeRandom);
+  return corpora;
+}
+
+const char* codecName(CodecType type) {
+  switch (type) {
+    case CodecType::NO_COMPRESSION:
+      return "none";
+    case CodecType::LZ4:
+      return "lz4";
+    case CodecType::SNAPPY:
+      return "snappy";
+    case CodecType::ZLIB:
+      return "zlib";
+    case CodecType::LZ4_VARINT_SIZE:
+      return "lz4_varint";
+    case CodecType::LZMA2:
+      return "lzma2";
+    case CodecType::LZMA2_VARINT_SIZE:
+      return "lzma2_varint";
+    case CodecType::ZSTD:
+      return "zstd";
+    case CodecType::GZIP:
+      return "gzip";
+    case CodecType::LZ4_FRAME:
+      return "lz4_frame";
+    case CodecType::BZIP2:
+      return "bzip2";
+    default:
+      return "unknown";
+  }
+}
+
+std::vector<CodecType> selectedCodecs() {
+  std::vector<CodecType> types;
+  for (int i = 1; i < int(CodecType::NUM_CODEC_TYPES); ++i) {
+    auto type = CodecType(i);
+    if (hasCodec(type) && selected(FLAGS_codecs, codecName(type))) {
+      types.push_back(type);
+    }
+  }
+  return types;
+}
+
+// Levels that getCodec() accepts for type.
+std::vector<int> levels(CodecType type) {
+  if (type == CodecType::NO_COMPRESSION || type == CodecType::SNAPPY) {
+    return {COMPRESSION_LEVEL_DEFAULT};
+  }
+  if (!FLAGS_all_levels) {
+    return {COMPRESSION_LEVEL_FASTEST,
+            COMPRESSION_LEVEL_DEFAULT,
+            COMPRESSION_LEVEL_BEST};
+  }
+  std::vector<int> result;
+  for (int level = 0; level <= 22; ++level) {
+    try {
+      getCodec(type, level);
+      result.push_back(level);
+    } catch (const std::invalid_argument&) {
+    }
+  }
+  return result;
+}
+
+std::string levelName(int level) {
+  switch (level) {
+    case COMPRESSION_LEVEL_FASTEST:
+      return "fastest";
+    case COMPRESSION_LEVEL_DEFAULT:
+      return "default";
+    case COMPRESSION_LEVEL_BEST:
+      return "best";
+    default:
+      return to<std::string>(level);
+  }
+}
+
+// Bytes currently allocated by the process (by this thread with jemalloc),
+// if the allocator can tell.
+Optional<int64_t> allocatedBytes() {
+  if (usingJEMalloc()) {
+    uint64_t allocated;
+    uint64_t deallocated;
+    mallctlRead("thread.allocated", &allocated);
+    mallctlRead("thread.deallocated", &deallocated);
+    return int64_t(allocated - deallocated);
+  }
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+  auto info = mallinfo2();
+  // Large blocks are mmap()ed separately.
+  return int64_t(info.uordblks + info.hblkhd);
+#elif defined(__GLIBC__)
+  auto info = mallinfo();
+  // Large blocks are mmap()ed separately.
+  return int64_t(size_t(info.uordblks) + size_t(info.hblkhd));
+#else
+  return none;
+#endif
+}
+
+std::unique_ptr<IOBuf> toChain(ByteRange data) {
+  const size_t bufferSize = size_t(FLAGS_chain_buffer_size);
+  auto head = IOBuf::create(0);
+  for (size_t i = 0; i < data.size(); i += bufferSize) {
+    head->prependChain(IOBuf::copyBuffer(
+        data.data() + i, std::min(bufferSize, data.size() - i)));
+  }
+  return head;
+}
+
+Optional<uint64_t> lengthFor(const Codec& codec, size_t length) {
+  if (codec.needsUncompressedLength()) {
+    return length;
+  }
+  return none;
+}
+
+/**
+ * One codec and level on one corpus.  The inputs are prepared on first use,
+ * so benchmarks filtered out by --bm_regex cost nothing.
+ */
+struct Config {
+  Config(const Corpus& c, CodecType t, int l)
+      : corpus(c), type(t), level(l) {}
+
+  void prepare() {
+    if (codec) {
+      return;
+    }
+    codec = getCodec(type, level);
+    if (hasStreamCodec(type)) {
+      streamCodec = getStreamCodec(type, level);
+    }
+    flat = IOBuf::wrapBuffer(corpus.data.data(), corpus.data.size());
+    chain = toChain(ByteRange(StringPiece(corpus.data)));
+    compressedFlat = codec->compress(flat.get());
+    compressedFlat->coalesce();
+    compressedChain = toChain(compressedFlat->coalesce());
+    streamOutput.resize(
+        std::max(codec->maxCompressedLength(corpus.data.size()),
+                 uint64_t(corpus.data.size())));
+  }
+
+  void compressStream() {
+    streamCodec->resetStream(corpus.data.size());
+    MutableByteRange output(
+        reinterpret_cast<uint8_t*>(&streamOutput[0]), streamOutput.size());
+    for (auto& range : *chain) {
+      ByteRange input = range;
+      while (!input.empty()) {
+        streamCodec->compressStream(input, output);
+      }
+    }
+    ByteRange empty;
+    while (!streamCodec->compressStream(
+        empty, output, StreamCodec::FlushOp::END)) {
+    }
+  }
+
+  void uncompressStream() {
+    streamCodec->resetStream(corpus.data.size());
+    MutableByteRange output(
+        reinterpret_cast<uint8_t*>(&streamOutput[0]), streamOutput.size());
+    bool done = false;
+    for (auto& range : *compressedChain) {
+      ByteRange input = range;
+      while (!input.empty() && !done) {
+        done = streamCodec->uncompressStream(input, output);
+      }
+    }
+    ByteRange empty;
+    while (!done) {
+      done = streamCodec->uncompressStream(
+          empty, output, StreamCodec::FlushOp::END);
+    }
+    CHECK_EQ(corpus.data.size(), streamOutput.size() - output.size());
+  }
+
+  const Corpus& corpus;
+  const CodecType type;
+  const int level;
+
+  std::unique_ptr<Codec> codec;
+  std::unique_ptr<StreamCodec> streamCodec;
+  std::unique_ptr<IOBuf> flat;
+  std::unique_ptr<IOBuf> chain;
+  std::unique_ptr<IOBuf> compressedFlat;
+  std::unique_ptr<IOBuf> compressedChain;
+  std::string streamOutput;
+};
+
+void addConfigBenchmark(
+    const std::shared_ptr<Config>& config,
+    const char* operation,
+    const char* variant,
+    void (*run)(Config&)) {
+  auto name = to<std::string>(
+      codecName(config->type),
+      "/",
+      levelName(config->level),
+      " ",
+      config->corpus.name,
+      " ",
+      operation,
+      " ",
+      variant);
+  const unsigned kib = unsigned(config->corpus.data.size() / 1024);
+  addBenchmark(__FILE__, name.c_str(), [=](unsigned iters) {
+    BENCHMARK_SUSPEND {
+      config->prepare();
+    }
+    for (unsigned i = 0; i < iters; ++i) {
+      run(*config);
+    }
+    return iters * kib;
+  });
+}
+
+void addBenchmarks(const std::vector<Corpus>& corpora) {
+  for (auto type : selectedCodecs()) {
+    for (auto level : levels(type)) {
+      for (auto& corpus : corpora) {
+        auto config = std::make_shared<Config>(corpus, type, level);
+        addConfigBenchmark(config, "compress", "flat", [](Config& c) {
+          doNotOptimizeAway(c.codec->compress(c.flat.get()));
+        });
+        addConfigBenchmark(config, "compress", "chain", [](Config& c) {
+          doNotOptimizeAway(c.codec->compress(c.chain.get()));
+        });
+        addConfigBenchmark(config, "uncompress", "flat", [](Config& c) {
+          doNotOptimizeAway(c.codec->uncompress(
+              c.compressedFlat.get(),
+              lengthFor(*c.codec, c.corpus.data.size())));
+        });
+        addConfigBenchmark(config, "uncompress", "chain", [](Config& c) {
+          doNotOptimizeAway(c.codec->uncompress(
+              c.compressedChain.get(),
+              lengthFor(*c.codec, c.corpus.data.size())));
+        });
+        if (hasStreamCodec(type)) {
+          addConfigBenchmark(config, "compress", "stream", [](Config& c) {
+            c.compressStream();
+          });
+          addConfigBenchmark(config, "uncompress", "stream", [](Config& c) {
+            c.uncompressStream();
+          });
+        }
+      }
+      addBenchmark(__FILE__, "-", [] { return 0; });
+    }
+  }
+}
+
+// Memory held by a codec after one use, with its output freed.
+Optional<int64_t> stateBytes(
+    CodecType type,
+    int level,
+    const IOBuf* input,
+    bool uncompress) {
+  auto before = allocatedBytes();
+  auto codec = getCodec(type, level);
+  if (uncompress) {
+    codec->uncompress(input, lengthFor(*codec, FLAGS_corpus_kb * 1024));
+  } else {
+    codec->compress(input);
+  }
+  auto after = allocatedBytes();
+  if (!before || !after) {
+    return none;
+  }
+  return *after - *before;
+}
+
+void printStats(const std::vector<Corpus>& corpora) {
+  dynamic rows = dynamic::array;
+  for (auto type : selectedCodecs()) {
+    for (auto level : levels(type)) {
+      for (auto& corpus : corpora) {
+        auto input = IOBuf::wrapBuffer(corpus.data.data(), corpus.data.size());
+        auto compressed = getCodec(type, level)->compress(input.get());
+        const auto compressedSize = compressed->computeChainDataLength();
+        auto compressMemory = stateBytes(type, level, input.get(), false);
+        auto uncompressMemory =
+            stateBytes(type, level, compressed.get(), true);
+        rows.push_back(dynamic::object("codec", codecName(type))(
+            "level", levelName(level))("corpus", corpus.name)(
+            "size", corpus.data.size())("compressed_size", compressedSize)(
+            "ratio", double(corpus.data.size()) / compressedSize)(
+            "compress_memory",
+            compressMemory ? dynamic(*compressMemory) : dynamic(nullptr))(
+            "uncompress_memory",
+            uncompressMemory ? dynamic(*uncompressMemory) : dynamic(nullptr)));
+      }
+    }
+  }
+
+  if (FLAGS_json) {
+    printf("%s\n", toPrettyJson(rows).c_str());
+    return;
+  }
+  auto memory = [](const dynamic& bytes) {
+    return bytes.isNull() ? std::string("n/a")
+                          : to<std::string>(bytes.asInt() / 1024, "K");
+  };
+  printf(
+      "%-22s %-7s %12s %8s %11s %11s\n",
+      "codec/level",
+      "corpus",
+      "compressed",
+      "ratio",
+      "comp mem",
+      "uncomp mem");
+  for (auto& row : rows) {
+    printf(
+        "%-22s %-7s %12lld %8.2f %11s %11s\n",
+        to<std::string>(row["codec"].asString(), "/", row["level"].asString())
+            .c_str(),
+        row["corpus"].asString().c_str(),
+        (long long)row["compressed_size"].asInt(),
+        row["ratio"].asDouble(),
+        memory(row["compress_memory"]).c_str(),
+        memory(row["uncompress_memory"]).c_str());
+  }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+  CHECK_GT(FLAGS_corpus_kb, 0);
+  CHECK_GT(FLAGS_chain_buffer_size, 0);
+  auto corpora = makeCorpora();
+  printStats(corpora);
+  if (!FLAGS_stats_only) {
+    addBenchmarks(corpora);
+    runBenchmarks();
+  }
+  return 0;
+}
@@ -27,6 +27,7 @@
 #include <glog/logging.h>
 
 #include <folly/Benchmark.h>
+#include <folly/Conv.h>
 #include <folly/Hash.h>
 #include <folly/Memory.h>
 #include <folly/Random.h>
@@ -1128,6 +1129,198 @@ TEST(ZstdTest, BackwardCompatible) {
   }
 }
 
+#endif
+
+namespace {
+// Small, similar records, like serialized RPC payloads or cache values.
+std::string makeRecord(std::mt19937& rng) {
+  return to<std::string>(
+      "{\"user_id\":",
+      rng() % 1000000,
+      ",\"name\":\"user",
+      rng() % 10000,
+      "\",\"email\":\"user",
+      rng() % 10000,
+      "@example.com\",\"status\":\"",
+      rng() % 2 ? "active" : "inactive",
+      "\",\"roles\":[\"reader\",\"writer\"],\"created_at\":\"2017-0",
+      rng() % 9 + 1,
+      "-1",
+      rng() % 9,
+      "T12:00:00Z\",\"preferences\":{\"theme\":\"dark\",",
+      "\"language\":\"en_US\",\"notifications\":true}}");
+}
+
+std::vector<std::unique_ptr<IOBuf>> makeRecords(size_t count, uint32_t seed) {
+  std::mt19937 rng(seed);
+  std::vector<std::unique_ptr<IOBuf>> records;
+  for (size_t i = 0; i < count; ++i) {
+    records.push_back(IOBuf::copyBuffer(makeRecord(rng)));
+  }
+  return records;
+}
+
+std::string trainDictionary(uint32_t seed, size_t maxSize = 4096) {
+  auto samples = makeRecords(2000, seed);
+  std::vector<const IOBuf*> pointers;
+  for (auto& sample : samples) {
+    pointers.push_back(sample.get());
+  }
+  return trainCompressionDictionary(pointers, maxSize);
+}
+
+ByteRange toByteRange(const std::string& s) {
+  return ByteRange(StringPiece(s));
+}
+} // namespace
+
+class DictionaryTest : public testing::TestWithParam<CodecType> {
+ protected:
+  void SetUp() override {
+    // A trained dictionary doubles as raw content for LZ4.
+    if (hasCodec(CodecType::ZSTD)) {
+      dictionaryData_ = trainDictionary(1);
+    } else {
+      for (auto& record : makeRecords(20, 1)) {
+        dictionaryData_ += record->moveToFbString().toStdString();
+      }
+    }
+    dictionary_ =
+        createCompressionDictionary(GetParam(), toByteRange(dictionaryData_));
+    codec_ = getCodec(dictionary_);
+  }
+
+  std::string dictionaryData_;
+  std::shared_ptr<const CompressionDictionary> dictionary_;
+  std::unique_ptr<Codec> codec_;
+};
+
+TEST_P(DictionaryTest, RoundTrip) {
+  EXPECT_EQ(GetParam(), codec_->type());
+  EXPECT_EQ(GetParam(), dictionary_->type());
+  EXPECT_EQ(toByteRange(dictionaryData_), dictionary_->data());
+
+  auto plainCodec = getCodec(GetParam());
+  size_t plainSize = 0;
+  size_t dictionarySize = 0;
+  for (auto& record : makeRecords(100, 2)) {
+    auto compressed = codec_->compress(record.get());
+    dictionarySize += compressed->computeChainDataLength();
+    plainSize += plainCodec->compress(record.get())->computeChainDataLength();
+
+    auto uncompressed =
+        codec_->uncompress(compressed.get(), record->length());
+    EXPECT_EQ(record->moveToFbString(), uncompressed->moveToFbString());
+  }
+  EXPECT_LT(dictionarySize * 2, plainSize);
+}
+
+TEST_P(DictionaryTest, Chained) {
+  auto records = makeRecords(3, 3);
+  auto chain = std::move(records[0]);
+  chain->prependChain(std::move(records[1]));
+  chain->prependChain(std::move(records[2]));
+  auto length = chain->computeChainDataLength();
+
+  auto compressed = codec_->compress(chain.get());
+  auto uncompressed = codec_->uncompress(compressed.get(), length);
+  EXPECT_EQ(chain->moveToFbString(), uncompressed->moveToFbString());
+}
+
+TEST_P(DictionaryTest, SharedBetweenCodecs) {
+  auto other = getCodec(dictionary_);
+  auto record = std::move(makeRecords(1, 4)[0]);
+  auto compressed = codec_->compress(record.get());
+  auto uncompressed = other->uncompress(compressed.get(), record->length());
+  EXPECT_EQ(record->moveToFbString(), uncompressed->moveToFbString());
+}
+
+INSTANTIATE_TEST_CASE_P(
+    DictionaryTest,
+    DictionaryTest,
+    testing::ValuesIn(supportedCodecs({
+        CodecType::ZSTD,
+        CodecType::LZ4,
+        CodecType::LZ4_VARINT_SIZE,
+    })));
+
+TEST(DictionaryTest, Unsupported) {
+  EXPECT_THROW(
+      createCompressionDictionary(
+          CodecType::NO_COMPRESSION, toByteRange("dictionary")),
+      std::invalid_argument);
+}
+
+#if FOLLY_HAVE_LIBZSTD
+
+TEST(ZstdDictionaryTest, Train) {
+  auto data = trainDictionary(1, 2048);
+  EXPECT_LE(data.size(), 2048);
+  auto dictionary =
+      createCompressionDictionary(CodecType::ZSTD, toByteRange(data), 3);
+  EXPECT_NE(0, dictionary->id());
+  EXPECT_EQ(3, dictionary->level());
+
+  // Raw content has no ID.
+  auto const content = makeRecords(1, 1)[0]->moveToFbString().toStdString();
+  auto raw = createCompressionDictionary(CodecType::ZSTD, toByteRange(content));
+  EXPECT_EQ(0, raw->id());
+
+  std::vector<const IOBuf*> tooFew;
+  auto sample = IOBuf::copyBuffer("x");
+  tooFew.push_back(sample.get());
+  EXPECT_THROW(trainCompressionDictionary(tooFew), std::runtime_error);
+}
+
+TEST(ZstdDictionaryTest, WrongDictionary) {
+  auto data1 = trainDictionary(1);
+  auto data2 = trainDictionary(2);
+  auto codec1 = getCodec(
+      createCompressionDictionary(CodecType::ZSTD, toByteRange(data1)));
+  auto codec2 = getCodec(
+      createCompressionDictionary(CodecType::ZSTD, toByteRange(data2)));
+  auto record = std::move(makeRecords(1, 5)[0]);
+  auto compressed = codec1->compress(record.get());
+
+  EXPECT_THROW(codec2->uncompress(compressed.get()), std::runtime_error);
+  EXPECT_THROW(
+      getCodec(CodecType::ZSTD)->uncompress(compressed.get()),
+      std::runtime_error);
+  EXPECT_EQ(
+      record->moveToFbString(),
+      codec1->uncompress(compressed.get())->moveToFbString());
+}
+
+TEST(ZstdDictionaryTest, Stream) {
+  auto dictionary = createCompressionDictionary(
+      CodecType::ZSTD, toByteRange(trainDictionary(1)));
+  auto codec = getStreamCodec(dictionary);
+  auto const record = makeRecords(1, 6)[0]->moveToFbString().toStdString();
+
+  // Without the length up front, so that the streaming path is used.
+  std::string compressed(codec->maxCompressedLength(record.size()), '\0');
+  ByteRange input = toByteRange(record);
+  MutableByteRange output(
+      reinterpret_cast<uint8_t*>(&compressed[0]), compressed.size());
+  while (!codec->compressStream(input, output, StreamCodec::FlushOp::END)) {
+  }
+  compressed.resize(compressed.size() - output.size());
+
+  codec->resetStream();
+  std::string uncompressed(record.size(), '\0');
+  ByteRange compressedInput = toByteRange(compressed);
+  MutableByteRange uncompressedOutput(
+      reinterpret_cast<uint8_t*>(&uncompressed[0]), uncompressed.size());
+  while (!codec->uncompressStream(compressedInput, uncompressedOutput)) {
+  }
+  EXPECT_EQ(record, uncompressed);
+
+  EXPECT_THROW(
+      getStreamCodec(
+          createCompressionDictionary(CodecType::LZ4, toByteRange(record))),
+      std::invalid_argument);
+}
+
 #endif
 } // namespace test
 } // namespace io
@@ -917,6 +917,100 @@ TEST(IOBuf, ReadWhileTrue) {
   }
 }
 
+namespace {
+// "hello\r\nwor" "" "ld\r" "\nbye\r\n", split so delimiters straddle buffers.
+std::unique_ptr<IOBuf> splitChain() {
+  auto chain = IOBuf::copyBuffer("hello\r\nwor");
+  chain->prependChain(IOBuf::create(10));
+  chain->prependChain(IOBuf::copyBuffer("ld\r"));
+  chain->prependChain(IOBuf::copyBuffer("\nbye\r\n"));
+  return chain;
+}
+} // namespace
+
+TEST(IOBuf, Find) {
+  auto chain = splitChain();
+  Cursor curs(chain.get());
+  EXPECT_EQ(0, curs.find('h'));
+  EXPECT_EQ(5, curs.find('\r'));
+  EXPECT_EQ(2, curs.find('l'));
+  EXPECT_EQ(11, curs.find('d'));
+  EXPECT_EQ(14, curs.find('b'));
+  EXPECT_EQ(std::string::npos, curs.find('z'));
+
+  curs.skip(6);
+  EXPECT_EQ(6, curs.find('\r'));
+  EXPECT_EQ(0, curs.find(ByteRange(StringPiece(""))));
+  EXPECT_EQ(std::string::npos, Cursor(curs).find('h'));
+
+  // Cursor at the very end.
+  curs.advanceToEnd();
+  EXPECT_EQ(std::string::npos, curs.find('\n'));
+  EXPECT_EQ(
+      std::string::npos, curs.findFirstOf(ByteRange(StringPiece("\n"))));
+}
+
+TEST(IOBuf, FindDelimiter) {
+  auto chain = splitChain();
+  Cursor curs(chain.get());
+  auto crlf = ByteRange(StringPiece("\r\n"));
+  EXPECT_EQ(5, curs.find(crlf));
+  curs.skip(7);
+  // Split between the third and fourth buffers.
+  EXPECT_EQ(5, curs.find(crlf));
+  EXPECT_EQ(3, curs.find(ByteRange(StringPiece("ld\r\nb"))));
+  EXPECT_EQ(
+      std::string::npos, curs.find(ByteRange(StringPiece("ld\r\nbye\r\n!"))));
+  EXPECT_EQ(std::string::npos, curs.find(ByteRange(StringPiece("\r\r"))));
+  curs.skip(7);
+  EXPECT_EQ(3, curs.find(crlf));
+  curs.skip(4);
+  EXPECT_EQ(std::string::npos, curs.find(crlf));
+}
+
+TEST(IOBuf, FindFirstOf) {
+  auto chain = splitChain();
+  Cursor curs(chain.get());
+  EXPECT_EQ(2, curs.findFirstOf(ByteRange(StringPiece("lo"))));
+  EXPECT_EQ(5, curs.findFirstOf(ByteRange(StringPiece("\n\r"))));
+  EXPECT_EQ(14, curs.findFirstOf(ByteRange(StringPiece("yb"))));
+  EXPECT_EQ(std::string::npos, curs.findFirstOf(ByteRange(StringPiece("xz"))));
+  EXPECT_EQ(std::string::npos, curs.findFirstOf(ByteRange()));
+
+  // More needles than fit in one SSE register.
+  auto many = ByteRange(StringPiece("ABCDEFGHIJKLMNOPQRSTUVWXYZy"));
+  EXPECT_EQ(15, curs.findFirstOf(many));
+}
+
+TEST(IOBuf, CloneUntil) {
+  auto chain = splitChain();
+  Cursor curs(chain.get());
+  auto crlf = ByteRange(StringPiece("\r\n"));
+  std::unique_ptr<IOBuf> line;
+
+  EXPECT_TRUE(curs.cloneUntil(line, crlf));
+  EXPECT_EQ("hello", line->moveToFbString());
+  EXPECT_TRUE(curs.cloneUntil(line, crlf));
+  EXPECT_EQ(3, line->countChainElements());
+  EXPECT_EQ("world", line->moveToFbString());
+  EXPECT_TRUE(curs.cloneUntil(line, crlf));
+  EXPECT_EQ("bye", line->moveToFbString());
+  EXPECT_TRUE(curs.isAtEnd());
+
+  // Not found: nothing changes.
+  Cursor partial(chain.get());
+  partial.skip(16);
+  line = IOBuf::copyBuffer("x");
+  EXPECT_FALSE(partial.cloneUntil(line, ByteRange(StringPiece("\n\n"))));
+  EXPECT_EQ("x", line->moveToFbString());
+  EXPECT_EQ(3, partial.totalLength());
+
+  // The clone shares the chain's buffers.
+  Cursor shared(chain.get());
+  EXPECT_TRUE(shared.cloneUntil(line, crlf));
+  EXPECT_EQ(chain->data(), line->data());
+}
+
 TEST(IOBuf, TestAdvanceToEndSingle) {
   std::unique_ptr<IOBuf> chain(IOBuf::create(10));
   chain->append(10);
@@ -0,0 +1,174 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/io/IOBufPool.h>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <folly/Baton.h>
+#include <folly/io/IOBuf.h>
+#include <folly/io/IOBufQueue.h>
+#include <folly/portability/GTest.h>
+
+using namespace folly;
+
+TEST(IOBufPool, SizeClasses) {
+  size_t blockSize;
+  auto p = IOBufPool::allocate(1, &blockSize);
+  EXPECT_EQ(IOBufPool::kMinBlockSize, blockSize);
+  IOBufPool::deallocate(p);
+
+  p = IOBufPool::allocate(IOBufPool::kMinBlockSize + 1, &blockSize);
+  EXPECT_EQ(2 * IOBufPool::kMinBlockSize, blockSize);
+  memset(p, 0xff, blockSize);
+  IOBufPool::deallocate(p);
+
+  p = IOBufPool::allocate(IOBufPool::kMaxBlockSize, &blockSize);
+  EXPECT_EQ(IOBufPool::kMaxBlockSize, blockSize);
+  IOBufPool::deallocate(p);
+}
+
+TEST(IOBufPool, ReusesOnSameThread) {
+  size_t blockSize;
+  auto p = IOBufPool::allocate(1000, &blockSize);
+  IOBufPool::deallocate(p);
+
+  auto before = IOBufPool::getStats();
+  auto q = IOBufPool::allocate(1000, &blockSize);
+  EXPECT_EQ(p, q);
+  auto after = IOBufPool::getStats();
+  EXPECT_EQ(before.hits + 1, after.hits);
+  EXPECT_EQ(before.misses, after.misses);
+  IOBufPool::deallocate(q);
+}
+
+TEST(IOBufPool, RemoteFreesGoBackToOwner) {
+  // More than one batch, but no more than the owner caches.
+  constexpr size_t kNumBlocks = 50;
+  std::vector<void*> blocks;
+  size_t blockSize;
+  for (size_t i = 0; i < kNumBlocks; ++i) {
+    blocks.push_back(IOBufPool::allocate(4000, &blockSize));
+  }
+
+  auto before = IOBufPool::getStats();
+  std::thread([&] {
+    for (auto p : blocks) {
+      IOBufPool::deallocate(p);
+    }
+  }).join();
+  auto after = IOBufPool::getStats();
+  EXPECT_EQ(before.remoteFrees + kNumBlocks, after.remoteFrees);
+
+  // The freeing thread has exited and handed everything over, so all of
+  // them are hits here.
+  std::vector<void*> again;
+  for (size_t i = 0; i < kNumBlocks; ++i) {
+    again.push_back(IOBufPool::allocate(4000, &blockSize));
+  }
+  EXPECT_EQ(after.hits + kNumBlocks, IOBufPool::getStats().hits);
+  std::sort(blocks.begin(), blocks.end());
+  std::sort(again.begin(), again.end());
+  EXPECT_EQ(blocks, again);
+  for (auto p : again) {
+    IOBufPool::deallocate(p);
+  }
+}
+
+TEST(IOBufPool, FreedAfterOwnerExits) {
+  size_t blockSize;
+  void* p = nullptr;
+  void* q = nullptr;
+  // Keeps its cache, so that the next thread started reuses the exiting
+  // thread's.
+  Baton<> allocated;
+  Baton<> done;
+  std::thread other([&] {
+    q = IOBufPool::allocate(1000, &blockSize);
+    allocated.post();
+    done.wait();
+  });
+  allocated.wait();
+
+  std::thread([&] { p = IOBufPool::allocate(1000, &blockSize); }).join();
+  IOBufPool::deallocate(p);
+  // Hands over the batch p is in.
+  IOBufPool::deallocate(q);
+
+  std::thread([&] {
+    auto before = IOBufPool::getStats();
+    IOBufPool::deallocate(IOBufPool::allocate(1000, &blockSize));
+    auto after = IOBufPool::getStats();
+    EXPECT_EQ(before.hits, after.hits);
+    EXPECT_EQ(before.misses + 1, after.misses);
+  }).join();
+  done.post();
+  other.join();
+}
+
+TEST(IOBufPool, CreatePooled) {
+  auto buf = IOBuf::createPooled(100);
+  EXPECT_GE(buf->capacity(), 100);
+  EXPECT_EQ(0, buf->length());
+  EXPECT_FALSE(buf->isShared());
+  memcpy(buf->writableTail(), "hello", 5);
+  buf->append(5);
+
+  // The storage stays around until the last user is gone.
+  auto clone = buf->clone();
+  buf.reset();
+  EXPECT_EQ(0, memcmp(clone->data(), "hello", 5));
+  clone.reset();
+
+  auto before = IOBufPool::getStats();
+  buf = IOBuf::createPooled(100);
+  EXPECT_EQ(before.hits + 1, IOBufPool::getStats().hits);
+
+  // Too large for the pool.
+  auto large = IOBuf::createPooled(IOBufPool::kMaxBlockSize);
+  EXPECT_GE(large->capacity(), IOBufPool::kMaxBlockSize);
+  EXPECT_EQ(before.hits + 1, IOBufPool::getStats().hits);
+  EXPECT_EQ(before.misses, IOBufPool::getStats().misses);
+}
+
+TEST(IOBufPool, CreatePooledReserve) {
+  auto buf = IOBuf::createPooled(10);
+  memcpy(buf->writableTail(), "abc", 3);
+  buf->append(3);
+  // Moves the data to a separate buffer; the pooled storage is given back
+  // together with the IOBuf.
+  buf->reserve(0, 100 * 1000);
+  EXPECT_GE(buf->tailroom(), 100 * 1000);
+  EXPECT_EQ(0, memcmp(buf->data(), "abc", 3));
+}
+
+TEST(IOBufPool, QueuePreallocate) {
+  IOBufQueue::Options options;
+  options.pooled = true;
+  IOBufQueue queue(options);
+
+  auto before = IOBufPool::getStats();
+  queue.preallocate(100, 1000);
+  auto after = IOBufPool::getStats();
+  EXPECT_EQ(
+      before.hits + before.misses + 1, after.hits + after.misses);
+  queue.postallocate(100);
+  EXPECT_EQ(100, queue.front()->computeChainDataLength());
+}
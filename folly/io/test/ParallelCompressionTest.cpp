@@ -0,0 +1,294 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/io/ParallelCompression.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include <folly/Baton.h>
+#include <folly/Conv.h>
+#include <folly/executors/CPUThreadPoolExecutor.h>
+#include <folly/io/Cursor.h>
+#include <folly/portability/GTest.h>
+
+#if FOLLY_HAVE_LIBLZ4
+#include <lz4frame.h>
+#endif
+
+#if FOLLY_HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+
+using namespace folly;
+using namespace folly::io;
+
+namespace {
+
+// Compressible, but not trivially: lines of words from a small vocabulary.
+std::string makeData(size_t size) {
+  static const char* const kWords[] = {
+      "alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf",
+      "hotel", "india", "juliett", "kilo", "lima", "mike", "november"};
+  std::mt19937 rng(size);
+  std::string data;
+  while (data.size() < size) {
+    data += kWords[rng() % (sizeof(kWords) / sizeof(kWords[0]))];
+    data += rng() % 8 == 0 ? '\n' : ' ';
+    data += to<std::string>(rng() % 1000);
+  }
+  data.resize(size);
+  return data;
+}
+
+// The data in pieces of up to pieceSize bytes.
+std::unique_ptr<IOBuf> makeChain(const std::string& data, size_t pieceSize) {
+  auto head = IOBuf::create(0);
+  for (size_t i = 0; i < data.size(); i += pieceSize) {
+    const auto length = std::min(pieceSize, data.size() - i);
+    head->prependChain(IOBuf::copyBuffer(data.data() + i, length));
+  }
+  return head;
+}
+
+std::string toString(const IOBuf& buf) {
+  std::string result;
+  for (auto range : buf) {
+    result.append(reinterpret_cast<const char*>(range.data()), range.size());
+  }
+  return result;
+}
+
+std::vector<CodecType> parallelCodecs() {
+  std::vector<CodecType> types;
+  for (auto type : {CodecType::ZSTD, CodecType::LZ4_FRAME}) {
+    if (hasParallelCodec(type)) {
+      types.push_back(type);
+    }
+  }
+  return types;
+}
+
+class ParallelCompressionTest : public testing::TestWithParam<CodecType> {
+ protected:
+  CPUThreadPoolExecutor executor_{4};
+};
+
+} // namespace
+
+TEST_P(ParallelCompressionTest, RoundTrip) {
+  const auto type = GetParam();
+  for (size_t size : {size_t(1), size_t(1000), size_t(64 << 10),
+                      size_t(1000 * 1000)}) {
+    SCOPED_TRACE(size);
+    const auto data = makeData(size);
+    auto input = makeChain(data, 10000);
+    auto compressed = compressParallel(
+        type, input.get(), &executor_, COMPRESSION_LEVEL_DEFAULT, 64 << 10);
+    auto uncompressed =
+        uncompressParallel(type, compressed.get(), &executor_, data.size());
+    EXPECT_EQ(data, toString(*uncompressed));
+  }
+}
+
+TEST_P(ParallelCompressionTest, Empty) {
+  const auto type = GetParam();
+  auto empty = IOBuf::create(0);
+  auto compressed = compressParallel(type, empty.get(), &executor_);
+  EXPECT_EQ(0, compressed->computeChainDataLength());
+  auto uncompressed =
+      uncompressParallel(type, compressed.get(), &executor_, 0);
+  EXPECT_EQ(0, uncompressed->computeChainDataLength());
+}
+
+TEST_P(ParallelCompressionTest, SingleFrame) {
+  // Output of the plain codec.
+  const auto type = GetParam();
+  const auto data = makeData(100 * 1000);
+  auto input = IOBuf::copyBuffer(data);
+  auto compressed = getCodec(type)->compress(input.get());
+  auto uncompressed =
+      uncompressParallel(type, compressed.get(), &executor_, data.size());
+  EXPECT_EQ(data, toString(*uncompressed));
+}
+
+TEST_P(ParallelCompressionTest, SkippableFrames) {
+  const auto type = GetParam();
+  const auto data = makeData(200 * 1000);
+  auto input = IOBuf::copyBuffer(data);
+  auto compressed = compressParallel(
+      type, input.get(), &executor_, COMPRESSION_LEVEL_DEFAULT, 50 * 1000);
+
+  auto skippable = [] {
+    auto buf = IOBuf::create(16);
+    Appender appender(buf.get(), 0);
+    appender.writeLE<uint32_t>(0x184D2A5A);
+    appender.writeLE<uint32_t>(5);
+    appender.push(ByteRange(StringPiece("hello")));
+    return buf;
+  };
+  auto withSkippable = skippable();
+  withSkippable->prependChain(std::move(compressed));
+  withSkippable->prependChain(skippable());
+
+  auto uncompressed =
+      uncompressParallel(type, withSkippable.get(), &executor_, data.size());
+  EXPECT_EQ(data, toString(*uncompressed));
+}
+
+TEST_P(ParallelCompressionTest, Truncated) {
+  const auto type = GetParam();
+  const auto data = makeData(200 * 1000);
+  auto input = IOBuf::copyBuffer(data);
+  auto compressed = compressParallel(
+      type, input.get(), &executor_, COMPRESSION_LEVEL_DEFAULT, 50 * 1000);
+  compressed->coalesce();
+  compressed->trimEnd(1);
+  EXPECT_THROW(
+      uncompressParallel(type, compressed.get(), &executor_, data.size()),
+      std::runtime_error);
+
+  auto junk = IOBuf::copyBuffer("not a frame");
+  EXPECT_THROW(
+      uncompressParallel(
+          type, junk.get(), &executor_, Codec::UNLIMITED_UNCOMPRESSED_LENGTH),
+      std::runtime_error);
+}
+
+TEST_P(ParallelCompressionTest, TooLong) {
+  const auto type = GetParam();
+  const auto data = makeData(200 * 1000);
+  auto input = IOBuf::copyBuffer(data);
+  auto compressed = compressParallel(
+      type, input.get(), &executor_, COMPRESSION_LEVEL_DEFAULT, 50 * 1000);
+  EXPECT_THROW(
+      uncompressParallel(type, compressed.get(), &executor_, data.size() - 1),
+      std::runtime_error);
+
+  // Nor does a single frame get past the limit.
+  compressed = getCodec(type)->compress(input.get());
+  EXPECT_THROW(
+      uncompressParallel(type, compressed.get(), &executor_, data.size() - 1),
+      std::runtime_error);
+}
+
+TEST_P(ParallelCompressionTest, FromExecutorThread) {
+  // The executor's only thread is busy calling us, so its tasks don't run
+  // until we're done.
+  const auto type = GetParam();
+  const auto data = makeData(200 * 1000);
+  CPUThreadPoolExecutor executor(1);
+  Baton<> done;
+  executor.add([&] {
+    auto input = IOBuf::copyBuffer(data);
+    auto compressed = compressParallel(
+        type, input.get(), &executor, COMPRESSION_LEVEL_DEFAULT, 50 * 1000);
+    auto uncompressed =
+        uncompressParallel(type, compressed.get(), &executor, data.size());
+    EXPECT_EQ(data, toString(*uncompressed));
+    done.post();
+  });
+  done.wait();
+}
+
+TEST_P(ParallelCompressionTest, InvalidBlockSize) {
+  auto input = IOBuf::copyBuffer("data");
+  EXPECT_THROW(
+      compressParallel(
+          GetParam(), input.get(), &executor_, COMPRESSION_LEVEL_DEFAULT, 0),
+      std::invalid_argument);
+}
+
+INSTANTIATE_TEST_CASE_P(
+    ParallelCompressionTest,
+    ParallelCompressionTest,
+    testing::ValuesIn(parallelCodecs()));
+
+TEST(ParallelCompression, Unsupported) {
+  CPUThreadPoolExecutor executor(1);
+  auto input = IOBuf::copyBuffer("data");
+  EXPECT_FALSE(hasParallelCodec(CodecType::ZLIB));
+  EXPECT_THROW(
+      compressParallel(CodecType::ZLIB, input.get(), &executor),
+      std::invalid_argument);
+  EXPECT_THROW(
+      uncompressParallel(
+          CodecType::ZLIB,
+          input.get(),
+          &executor,
+          Codec::UNLIMITED_UNCOMPRESSED_LENGTH),
+      std::invalid_argument);
+}
+
+#if FOLLY_HAVE_LIBZSTD
+TEST(ParallelCompression, ZstdStandardDecoder) {
+  // libzstd decodes concatenated frames in one call.
+  CPUThreadPoolExecutor executor(4);
+  const auto data = makeData(1000 * 1000);
+  auto input = IOBuf::copyBuffer(data);
+  auto compressed = compressParallel(
+      CodecType::ZSTD,
+      input.get(),
+      &executor,
+      COMPRESSION_LEVEL_DEFAULT,
+      100 * 1000);
+  compressed->coalesce();
+
+  std::string uncompressed(data.size(), '\0');
+  const size_t result = ZSTD_decompress(
+      &uncompressed[0],
+      uncompressed.size(),
+      compressed->data(),
+      compressed->length());
+  ASSERT_FALSE(ZSTD_isError(result)) << ZSTD_getErrorName(result);
+  EXPECT_EQ(data.size(), result);
+  EXPECT_EQ(data, uncompressed);
+}
+#endif
+
+#if FOLLY_HAVE_LIBLZ4
+TEST(ParallelCompression, LZ4FrameStandardDecoder) {
+  // The frame decoder moves on to the next frame when one ends.
+  CPUThreadPoolExecutor executor(4);
+  const auto data = makeData(1000 * 1000);
+  auto input = IOBuf::copyBuffer(data);
+  auto compressed = compressParallel(
+      CodecType::LZ4_FRAME,
+      input.get(),
+      &executor,
+      COMPRESSION_LEVEL_DEFAULT,
+      100 * 1000);
+
+  LZ4F_decompressionContext_t dctx;
+  ASSERT_FALSE(LZ4F_isError(LZ4F_createDecompressionContext(&dctx, 100)));
+  std::string uncompressed(data.size(), '\0');
+  ByteRange in = compressed->coalesce();
+  size_t outPos = 0;
+  while (!in.empty()) {
+    size_t inSize = in.size();
+    size_t outSize = uncompressed.size() - outPos;
+    const size_t result = LZ4F_decompress(
+        dctx, &uncompressed[outPos], &outSize, in.data(), &inSize, nullptr);
+    ASSERT_FALSE(LZ4F_isError(result)) << LZ4F_getErrorName(result);
+    in.advance(inSize);
+    outPos += outSize;
+  }
+  LZ4F_freeDecompressionContext(dctx);
+  EXPECT_EQ(data.size(), outPos);
+  EXPECT_EQ(data, uncompressed);
+}
+#endif
@@ -82,6 +82,15 @@
 #define FOLLY_OPENSSL_HAS_ALPN 0
 #endif
 
+// OpenSSL 1.1.0 and later can suspend a handshake in an async job
+// (SSL_MODE_ASYNC) while a crypto operation completes elsewhere.
+#if !OPENSSL_IS_BORINGSSL && FOLLY_OPENSSL_IS_110 && !defined(OPENSSL_NO_ASYNC)
+#define FOLLY_OPENSSL_HAS_ASYNC 1
+#include <openssl/async.h>
+#else
+#define FOLLY_OPENSSL_HAS_ASYNC 0
+#endif
+
 // This attempts to "unify" the OpenSSL libcrypto/libssl APIs between
 // OpenSSL 1.0.2, 1.1.0 (and some earlier versions) and BoringSSL. The general
 // idea is to provide namespaced wrapper methods for versions which do not
@@ -106,5 +106,8 @@ using BIGNUMUniquePtr = std::unique_ptr<BIGNUM, BIGNUMDeleter>;
 // SSL and SSL_CTX
 using SSLDeleter = folly::static_function_deleter<SSL, &SSL_free>;
 using SSLUniquePtr = std::unique_ptr<SSL, SSLDeleter>;
+using SSLSessionDeleter =
+    folly::static_function_deleter<SSL_SESSION, &SSL_SESSION_free>;
+using SSLSessionUniquePtr = std::unique_ptr<SSL_SESSION, SSLSessionDeleter>;
 }
 }
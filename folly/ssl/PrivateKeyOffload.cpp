@@ -0,0 +1,359 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/ssl/PrivateKeyOffload.h>
+
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include <folly/Function.h>
+#include <folly/Optional.h>
+#include <folly/portability/Fcntl.h>
+#include <folly/portability/Sockets.h>
+#include <folly/portability/Unistd.h>
+#include <folly/ssl/OpenSSLPtrTypes.h>
+
+namespace folly {
+namespace ssl {
+
+#if FOLLY_OPENSSL_HAS_ASYNC
+
+namespace {
+
+// State shared between the paused job and the executor thread.
+struct OffloadedOperation {
+  ~OffloadedOperation() {
+    for (auto fd : fds) {
+      if (fd >= 0) {
+        close(fd);
+      }
+    }
+  }
+
+  // fds[0] is the job's wait fd, written through fds[1] on completion.
+  int fds[2]{-1, -1};
+  std::atomic<bool> done{false};
+  int result{-1};
+  std::vector<unsigned char> output;
+};
+
+// Only its address matters: it keys our fd in the job's ASYNC_WAIT_CTX.
+const char kWaitFdKey = 0;
+
+void cleanupWaitFd(ASYNC_WAIT_CTX*, const void*, OSSL_ASYNC_FD, void* custom) {
+  delete static_cast<std::shared_ptr<OffloadedOperation>*>(custom);
+}
+
+bool makeWaitFds(int fds[2]) {
+  if (pipe(fds) != 0) {
+    return false;
+  }
+  for (int i = 0; i < 2; ++i) {
+    int flags = fcntl(fds[i], F_GETFL, 0);
+    if (flags == -1 || fcntl(fds[i], F_SETFL, flags | O_NONBLOCK) != 0 ||
+        fcntl(fds[i], F_SETFD, FD_CLOEXEC) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * Run op on executor while the current async job is paused, and return its
+ * result with output filled in. Returns none if we are not inside a job,
+ * in which case the caller runs the operation inline.
+ */
+Optional<int> runPaused(
+    Executor* executor,
+    Function<int(std::vector<unsigned char>&)> op,
+    std::vector<unsigned char>& output) {
+  auto job = ASYNC_get_current_job();
+  if (executor == nullptr || job == nullptr) {
+    return none;
+  }
+  auto waitCtx = ASYNC_get_wait_ctx(job);
+  auto operation = std::make_shared<OffloadedOperation>();
+  if (!makeWaitFds(operation->fds)) {
+    return none;
+  }
+  // The wait context holds a reference for as long as it holds the fd, so
+  // that the fd stays valid if the SSL is freed while the job is paused.
+  auto ref = new std::shared_ptr<OffloadedOperation>(operation);
+  if (!ASYNC_WAIT_CTX_set_wait_fd(
+          waitCtx, &kWaitFdKey, operation->fds[0], ref, cleanupWaitFd)) {
+    delete ref;
+    return none;
+  }
+
+  executor->add([operation, op = std::move(op)]() mutable {
+    operation->result = op(operation->output);
+    operation->done.store(true, std::memory_order_release);
+    char c = 0;
+    if (write(operation->fds[1], &c, 1) != 1) {
+      PLOG(ERROR) << "failed to signal offloaded private key operation";
+    }
+  });
+
+  while (!operation->done.load(std::memory_order_acquire)) {
+    if (!ASYNC_pause_job()) {
+      // Cannot suspend; wait for the result on this thread instead.
+      pollfd pfd{operation->fds[0], POLLIN, 0};
+      poll(&pfd, 1, -1);
+    }
+  }
+
+  // Clearing the fd does not run its cleanup callback, so drop the wait
+  // context's reference ourselves.
+  OSSL_ASYNC_FD fd;
+  void* custom = nullptr;
+  if (ASYNC_WAIT_CTX_get_fd(waitCtx, &kWaitFdKey, &fd, &custom)) {
+    ASYNC_WAIT_CTX_clear_fd(waitCtx, &kWaitFdKey);
+    cleanupWaitFd(waitCtx, &kWaitFdKey, fd, custom);
+  }
+  output = std::move(operation->output);
+  return operation->result;
+}
+
+int rsaExDataIndex() {
+  static auto index =
+      RSA_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+  return index;
+}
+
+using RsaOp = int (*)(int, const unsigned char*, unsigned char*, RSA*, int);
+
+int offloadRsaOp(
+    RsaOp defaultOp,
+    int flen,
+    const unsigned char* from,
+    unsigned char* to,
+    RSA* rsa,
+    int padding) {
+  auto executor =
+      static_cast<Executor*>(RSA_get_ex_data(rsa, rsaExDataIndex()));
+  // The job's buffers and the key may be gone by the time the executor runs
+  // the operation if the connection is closed meanwhile; give it its own.
+  std::vector<unsigned char> input(from, from + flen);
+  RSA_up_ref(rsa);
+  RsaUniquePtr key(rsa);
+  std::vector<unsigned char> output;
+  auto result = runPaused(
+      executor,
+      [defaultOp, input = std::move(input), key = std::move(key), padding](
+          std::vector<unsigned char>& out) {
+        out.resize(size_t(RSA_size(key.get())));
+        return defaultOp(
+            int(input.size()), input.data(), out.data(), key.get(), padding);
+      },
+      output);
+  if (!result) {
+    return defaultOp(flen, from, to, rsa, padding);
+  }
+  if (*result > 0) {
+    std::memcpy(to, output.data(), size_t(*result));
+  }
+  return *result;
+}
+
+int offloadedRsaPrivEnc(
+    int flen,
+    const unsigned char* from,
+    unsigned char* to,
+    RSA* rsa,
+    int padding) {
+  return offloadRsaOp(
+      RSA_meth_get_priv_enc(RSA_PKCS1_OpenSSL()), flen, from, to, rsa, padding);
+}
+
+int offloadedRsaPrivDec(
+    int flen,
+    const unsigned char* from,
+    unsigned char* to,
+    RSA* rsa,
+    int padding) {
+  return offloadRsaOp(
+      RSA_meth_get_priv_dec(RSA_PKCS1_OpenSSL()), flen, from, to, rsa, padding);
+}
+
+RSA_METHOD* offloadedRsaMethod() {
+  static auto method = [] {
+    auto m = RSA_meth_dup(RSA_PKCS1_OpenSSL());
+    CHECK(m);
+    RSA_meth_set1_name(m, "folly offloaded RSA");
+    RSA_meth_set_priv_enc(m, offloadedRsaPrivEnc);
+    RSA_meth_set_priv_dec(m, offloadedRsaPrivDec);
+    return m;
+  }();
+  return method;
+}
+
+#ifndef OPENSSL_NO_EC
+int ecKeyExDataIndex() {
+  static auto index =
+      EC_KEY_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+  return index;
+}
+
+using EcSign = int (*)(
+    int,
+    const unsigned char*,
+    int,
+    unsigned char*,
+    unsigned int*,
+    const BIGNUM*,
+    const BIGNUM*,
+    EC_KEY*);
+
+EcSign defaultEcSign() {
+  EcSign sign = nullptr;
+  EC_KEY_METHOD_get_sign(EC_KEY_OpenSSL(), &sign, nullptr, nullptr);
+  return sign;
+}
+
+int offloadedEcSign(
+    int type,
+    const unsigned char* dgst,
+    int dlen,
+    unsigned char* sig,
+    unsigned int* siglen,
+    const BIGNUM* kinv,
+    const BIGNUM* r,
+    EC_KEY* eckey) {
+  auto sign = defaultEcSign();
+  if (kinv != nullptr || r != nullptr) {
+    // Precomputed nonces are owned by the caller; keep those inline.
+    return sign(type, dgst, dlen, sig, siglen, kinv, r, eckey);
+  }
+  auto executor =
+      static_cast<Executor*>(EC_KEY_get_ex_data(eckey, ecKeyExDataIndex()));
+  std::vector<unsigned char> digest(dgst, dgst + dlen);
+  EC_KEY_up_ref(eckey);
+  EcKeyUniquePtr key(eckey);
+  std::vector<unsigned char> output;
+  auto result = runPaused(
+      executor,
+      [sign, type, digest = std::move(digest), key = std::move(key)](
+          std::vector<unsigned char>& out) {
+        out.resize(size_t(ECDSA_size(key.get())));
+        unsigned int len = 0;
+        auto ret = sign(
+            type,
+            digest.data(),
+            int(digest.size()),
+            out.data(),
+            &len,
+            nullptr,
+            nullptr,
+            key.get());
+        out.resize(ret == 1 ? len : 0);
+        return ret;
+      },
+      output);
+  if (!result) {
+    return sign(type, dgst, dlen, sig, siglen, kinv, r, eckey);
+  }
+  if (*result == 1) {
+    std::memcpy(sig, output.data(), output.size());
+    *siglen = static_cast<unsigned int>(output.size());
+  }
+  return *result;
+}
+
+EC_KEY_METHOD* offloadedEcKeyMethod() {
+  static auto method = [] {
+    auto m = EC_KEY_METHOD_new(EC_KEY_OpenSSL());
+    CHECK(m);
+    int (*signSetup)(EC_KEY*, BN_CTX*, BIGNUM**, BIGNUM**) = nullptr;
+    ECDSA_SIG* (*signSig)(
+        const unsigned char*, int, const BIGNUM*, const BIGNUM*, EC_KEY*) =
+        nullptr;
+    EC_KEY_METHOD_get_sign(EC_KEY_OpenSSL(), nullptr, &signSetup, &signSig);
+    EC_KEY_METHOD_set_sign(m, offloadedEcSign, signSetup, signSig);
+    return m;
+  }();
+  return method;
+}
+#endif // OPENSSL_NO_EC
+
+} // namespace
+
+void offloadPrivateKeyOperations(SSL_CTX* ctx, Executor* executor) {
+  auto pkey = SSL_CTX_get0_privatekey(ctx);
+  if (pkey == nullptr) {
+    throw std::runtime_error(
+        "offloadPrivateKeyOperations: no private key loaded");
+  }
+
+  // Build a new EVP_PKEY around a duplicate of the key with the offloading
+  // method set first, so that OpenSSL sees a key with a custom method and
+  // keeps routing operations through it. The EVP_PKEY_get1_*() keys are
+  // shared with whoever else holds pkey, so their method is left alone.
+  EvpPkeyUniquePtr offloaded(EVP_PKEY_new());
+  switch (EVP_PKEY_base_id(pkey)) {
+    case EVP_PKEY_RSA: {
+      RsaUniquePtr shared(EVP_PKEY_get1_RSA(pkey));
+      RsaUniquePtr rsa(shared ? RSAPrivateKey_dup(shared.get()) : nullptr);
+      if (!rsa || RSA_set_method(rsa.get(), offloadedRsaMethod()) != 1 ||
+          RSA_set_ex_data(rsa.get(), rsaExDataIndex(), executor) != 1 ||
+          EVP_PKEY_assign_RSA(offloaded.get(), rsa.get()) != 1) {
+        throw std::runtime_error(
+            "offloadPrivateKeyOperations: cannot wrap RSA key");
+      }
+      rsa.release();
+      break;
+    }
+#ifndef OPENSSL_NO_EC
+    case EVP_PKEY_EC: {
+      EcKeyUniquePtr shared(EVP_PKEY_get1_EC_KEY(pkey));
+      EcKeyUniquePtr ecKey(shared ? EC_KEY_dup(shared.get()) : nullptr);
+      if (!ecKey ||
+          EC_KEY_set_method(ecKey.get(), offloadedEcKeyMethod()) != 1 ||
+          EC_KEY_set_ex_data(ecKey.get(), ecKeyExDataIndex(), executor) != 1 ||
+          EVP_PKEY_assign_EC_KEY(offloaded.get(), ecKey.get()) != 1) {
+        throw std::runtime_error(
+            "offloadPrivateKeyOperations: cannot wrap EC key");
+      }
+      ecKey.release();
+      break;
+    }
+#endif
+    default:
+      throw std::runtime_error(
+          "offloadPrivateKeyOperations: unsupported private key type");
+  }
+
+  if (SSL_CTX_use_PrivateKey(ctx, offloaded.get()) != 1) {
+    throw std::runtime_error(
+        "offloadPrivateKeyOperations: SSL_CTX_use_PrivateKey failed");
+  }
+}
+
+#else // FOLLY_OPENSSL_HAS_ASYNC
+
+void offloadPrivateKeyOperations(SSL_CTX*, Executor*) {
+  throw std::runtime_error(
+      "offloadPrivateKeyOperations: OpenSSL async jobs are not supported");
+}
+
+#endif // FOLLY_OPENSSL_HAS_ASYNC
+
+} // namespace ssl
+} // namespace folly
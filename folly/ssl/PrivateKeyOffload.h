@@ -0,0 +1,58 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <folly/Executor.h>
+#include <folly/portability/OpenSSL.h>
+
+namespace folly {
+namespace ssl {
+
+/**
+ * Whether offloadPrivateKeyOperations() is available with the linked
+ * OpenSSL, which needs async job support (OpenSSL 1.1.0+).
+ */
+constexpr bool isPrivateKeyOffloadSupported() {
+  return FOLLY_OPENSSL_HAS_ASYNC;
+}
+
+/**
+ * Replace the private key of ctx with one whose RSA and ECDSA private key
+ * operations run on executor.
+ *
+ * An operation is only offloaded when it runs inside an OpenSSL async job,
+ * i.e. on an SSL with SSL_MODE_ASYNC set. AsyncSSLSocket sets it on its SSL
+ * for the handshake when the SSLContext has a private key executor, and
+ * clears it once the handshake is done. The job is paused until executor
+ * has produced the result and then signals the job's wait fd;
+ * SSL_accept()/SSL_connect() return SSL_ERROR_WANT_ASYNC meanwhile, and
+ * AsyncSSLSocket resumes the handshake once the fd becomes readable.
+ * Operations outside a job run inline, as before.
+ *
+ * ctx gets a duplicate of its key; the RSA or EC_KEY that was loaded, and
+ * anything else sharing it, keeps its original method.
+ *
+ * ctx must already have its certificate and private key loaded. executor
+ * must outlive every SSL created from ctx.
+ *
+ * Throws std::runtime_error if async jobs are unsupported or the key is
+ * neither RSA nor EC.
+ */
+void offloadPrivateKeyOperations(SSL_CTX* ctx, Executor* executor);
+
+} // namespace ssl
+} // namespace folly
@@ -0,0 +1,231 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/ssl/SSLSessionCache.h>
+
+#include <algorithm>
+
+#include <glog/logging.h>
+
+#include <folly/Hash.h>
+
+namespace folly {
+namespace ssl {
+
+namespace {
+
+std::string sessionKey(ByteRange sessionId) {
+  return std::string(
+      reinterpret_cast<const char*>(sessionId.data()), sessionId.size());
+}
+
+ByteRange sessionIdOf(const SSL_SESSION* session) {
+  unsigned int len = 0;
+  auto id = SSL_SESSION_get_id(session, &len);
+  return ByteRange(id, len);
+}
+
+} // namespace
+
+SSLSessionCache::SSLSessionCache(Options options) : options_(options) {
+  CHECK_GT(options_.numShards, 0u);
+  auto perShard = std::max<size_t>(
+      1,
+      (options_.maxEntries + options_.numShards - 1) / options_.numShards);
+  shards_.reserve(options_.numShards);
+  for (size_t i = 0; i < options_.numShards; ++i) {
+    shards_.emplace_back(
+        std::make_unique<CachelinePadded<Shard>>(perShard));
+  }
+}
+
+SSLSessionCache::~SSLSessionCache() = default;
+
+SSLSessionCache::Shard& SSLSessionCache::shardFor(const std::string& key) {
+  // Session IDs are random, but mix anyway so that the shard index is not
+  // correlated with the bucket index EvictingCacheMap derives from the same
+  // std::hash value.
+  auto h = hash::twang_mix64(std::hash<std::string>()(key));
+  return **shards_[h % shards_.size()];
+}
+
+bool SSLSessionCache::add(SSL_SESSION* session) {
+  auto id = sessionIdOf(session);
+  if (id.empty()) {
+    return false;
+  }
+
+  auto now = Clock::now();
+  auto ttl = std::min<std::chrono::seconds>(
+      options_.timeout, std::chrono::seconds(SSL_SESSION_get_timeout(session)));
+  SSL_SESSION_up_ref(session);
+  Entry entry{SSLSessionUniquePtr(session), now + ttl};
+
+  auto key = sessionKey(id);
+  auto& shard = shardFor(key);
+  std::lock_guard<std::mutex> g(shard.mutex);
+  // Drop expired sessions from the cold end first, so that they are not
+  // what keeps a fresh session from fitting.
+  while (!shard.sessions.empty() &&
+         shard.sessions.rbegin()->second.expiry <= now) {
+    shard.sessions.erase(shard.sessions.rbegin()->first);
+    ++shard.expirations;
+  }
+  shard.sessions.set(
+      key,
+      std::move(entry),
+      true,
+      [&shard](std::string, Entry&&) { ++shard.evictions; });
+  ++shard.stores;
+  return true;
+}
+
+SSLSessionUniquePtr SSLSessionCache::get(ByteRange sessionId) {
+  auto key = sessionKey(sessionId);
+  auto& shard = shardFor(key);
+  std::lock_guard<std::mutex> g(shard.mutex);
+  ++shard.lookups;
+  auto it = shard.sessions.find(key);
+  if (it == shard.sessions.end()) {
+    return nullptr;
+  }
+  if (it->second.expiry <= Clock::now()) {
+    shard.sessions.erase(key);
+    ++shard.expirations;
+    return nullptr;
+  }
+  ++shard.hits;
+  auto session = it->second.session.get();
+  SSL_SESSION_up_ref(session);
+  return SSLSessionUniquePtr(session);
+}
+
+bool SSLSessionCache::remove(ByteRange sessionId) {
+  auto key = sessionKey(sessionId);
+  auto& shard = shardFor(key);
+  std::lock_guard<std::mutex> g(shard.mutex);
+  if (!shard.sessions.erase(key)) {
+    return false;
+  }
+  ++shard.removals;
+  return true;
+}
+
+void SSLSessionCache::clear() {
+  for (auto& shard : shards_) {
+    std::lock_guard<std::mutex> g((*shard)->mutex);
+    (*shard)->sessions.clear();
+  }
+}
+
+size_t SSLSessionCache::size() const {
+  size_t total = 0;
+  for (auto& shard : shards_) {
+    std::lock_guard<std::mutex> g((*shard)->mutex);
+    total += (*shard)->sessions.size();
+  }
+  return total;
+}
+
+SSLSessionCache::Stats SSLSessionCache::getStats() const {
+  Stats stats;
+  for (auto& shard : shards_) {
+    std::lock_guard<std::mutex> g((*shard)->mutex);
+    stats.lookups += (*shard)->lookups;
+    stats.hits += (*shard)->hits;
+    stats.expirations += (*shard)->expirations;
+    stats.stores += (*shard)->stores;
+    stats.evictions += (*shard)->evictions;
+    stats.removals += (*shard)->removals;
+  }
+  stats.misses = stats.lookups - stats.hits;
+  stats.fullHandshakes = fullHandshakes_.load(std::memory_order_relaxed);
+  stats.resumedHandshakes = resumedHandshakes_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+int SSLSessionCache::getExDataIndex() {
+  static auto index =
+      SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+  return index;
+}
+
+void SSLSessionCache::install(SSL_CTX* ctx, SSLSessionCache* cache) {
+  SSL_CTX_set_ex_data(ctx, getExDataIndex(), cache);
+  if (cache == nullptr) {
+    SSL_CTX_sess_set_new_cb(ctx, nullptr);
+    SSL_CTX_sess_set_get_cb(ctx, nullptr);
+    SSL_CTX_sess_set_remove_cb(ctx, nullptr);
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+    return;
+  }
+  SSL_CTX_set_session_cache_mode(
+      ctx, SSL_SESS_CACHE_SERVER | SSL_SESS_CACHE_NO_INTERNAL);
+  SSL_CTX_sess_set_new_cb(ctx, &SSLSessionCache::newSessionCallback);
+  SSL_CTX_sess_set_get_cb(ctx, &SSLSessionCache::getSessionCallback);
+  SSL_CTX_sess_set_remove_cb(ctx, &SSLSessionCache::removeSessionCallback);
+}
+
+SSLSessionCache* SSLSessionCache::fromSSLCtx(const SSL_CTX* ctx) {
+  return static_cast<SSLSessionCache*>(
+      SSL_CTX_get_ex_data(ctx, getExDataIndex()));
+}
+
+int SSLSessionCache::newSessionCallback(SSL* ssl, SSL_SESSION* session) {
+  // OpenSSL invokes the callbacks of the context the handshake started on,
+  // but SSL_get_SSL_CTX() returns the one SNI may have switched to since,
+  // hence the requirement to install the cache on both.
+  auto cache = fromSSLCtx(SSL_get_SSL_CTX(ssl));
+  if (cache != nullptr) {
+    cache->add(session);
+  }
+  // add() took its own reference.
+  return 0;
+}
+
+#if FOLLY_OPENSSL_IS_110
+SSL_SESSION* SSLSessionCache::getSessionCallback(
+    SSL* ssl,
+    const unsigned char* id,
+    int len,
+    int* copy) {
+#else
+SSL_SESSION* SSLSessionCache::getSessionCallback(
+    SSL* ssl,
+    unsigned char* id,
+    int len,
+    int* copy) {
+#endif
+  // The reference returned by get() is handed over to OpenSSL.
+  *copy = 0;
+  auto cache = fromSSLCtx(SSL_get_SSL_CTX(ssl));
+  if (cache == nullptr || len <= 0) {
+    return nullptr;
+  }
+  return cache->get(ByteRange(id, size_t(len))).release();
+}
+
+void SSLSessionCache::removeSessionCallback(
+    SSL_CTX* ctx,
+    SSL_SESSION* session) {
+  auto cache = fromSSLCtx(ctx);
+  if (cache != nullptr) {
+    cache->remove(sessionIdOf(session));
+  }
+}
+
+} // namespace ssl
+} // namespace folly
@@ -0,0 +1,201 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <folly/CachelinePadded.h>
+#include <folly/EvictingCacheMap.h>
+#include <folly/Range.h>
+#include <folly/portability/OpenSSL.h>
+#include <folly/ssl/OpenSSLPtrTypes.h>
+
+namespace folly {
+namespace ssl {
+
+/**
+ * Server-side TLS session cache that can be shared by many SSL_CTXs.
+ *
+ * OpenSSL's built-in cache is private to one SSL_CTX and guarded by a single
+ * global lock, so a server with one context per SNI name neither shares
+ * sessions between them nor scales under reconnect storms. This cache keys
+ * sessions by session ID and splits them across independently locked shards,
+ * each an LRU bounded to maxEntries / numShards sessions. Entries also expire
+ * after the smaller of Options::timeout and the session's own timeout.
+ *
+ * Install it with SSLContext::setSessionCache(), which replaces the internal
+ * cache of that context, on the default context and on every context the
+ * ServerNameCallback may switch to. Sessions are only bound to the context
+ * they were created in through the session ID context (see
+ * SSLContext::setSessionCacheContext()), which OpenSSL checks on resumption.
+ *
+ * Resumption through session tickets does not consult the cache; disable
+ * tickets (SSL_OP_NO_TICKET) to route all resumptions through it.
+ *
+ * All methods are thread-safe.
+ */
+class SSLSessionCache {
+ public:
+  struct Options {
+    // Upper bound on the number of sessions held across all shards.
+    size_t maxEntries{20480};
+    // Number of independently locked shards.
+    size_t numShards{16};
+    // Upper bound on how long a session stays resumable from the cache.
+    std::chrono::seconds timeout{std::chrono::hours(1)};
+  };
+
+  struct Stats {
+    uint64_t lookups{0};
+    uint64_t hits{0};
+    uint64_t misses{0};
+    // Lookups that found a session past its expiry (also counted in misses).
+    uint64_t expirations{0};
+    uint64_t stores{0};
+    // Sessions dropped to keep a shard within its size bound.
+    uint64_t evictions{0};
+    uint64_t removals{0};
+    // Server handshakes reported through recordHandshake().
+    uint64_t fullHandshakes{0};
+    uint64_t resumedHandshakes{0};
+
+    /**
+     * Fraction of lookups that returned a session.
+     */
+    double hitRate() const {
+      return lookups ? double(hits) / double(lookups) : 0.0;
+    }
+
+    /**
+     * Fraction of completed server handshakes that resumed a session,
+     * whether through this cache or through a session ticket.
+     */
+    double resumptionRate() const {
+      auto total = fullHandshakes + resumedHandshakes;
+      return total ? double(resumedHandshakes) / double(total) : 0.0;
+    }
+  };
+
+  SSLSessionCache() : SSLSessionCache(Options()) {}
+  explicit SSLSessionCache(Options options);
+  ~SSLSessionCache();
+
+  SSLSessionCache(const SSLSessionCache&) = delete;
+  SSLSessionCache& operator=(const SSLSessionCache&) = delete;
+
+  /**
+   * Store a session under its session ID, taking a new reference to it.
+   * Returns false if the session has no ID.
+   */
+  bool add(SSL_SESSION* session);
+
+  /**
+   * Look up a session by ID. The returned pointer holds its own reference.
+   */
+  SSLSessionUniquePtr get(ByteRange sessionId);
+
+  /**
+   * Drop the session with the given ID. Returns true if one was present.
+   */
+  bool remove(ByteRange sessionId);
+
+  /**
+   * Drop every session.
+   */
+  void clear();
+
+  /**
+   * Number of sessions currently held, including expired ones that have not
+   * been looked up or pruned yet.
+   */
+  size_t size() const;
+
+  const Options& getOptions() const {
+    return options_;
+  }
+
+  Stats getStats() const;
+
+  /**
+   * Report a completed server handshake, for Stats::resumptionRate().
+   * AsyncSSLSocket calls this for every accepted connection whose SSLContext
+   * has this cache installed.
+   */
+  void recordHandshake(bool resumed) {
+    (resumed ? resumedHandshakes_ : fullHandshakes_)
+        .fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /**
+   * Route the session callbacks of ctx to this cache and turn off ctx's
+   * internal cache. The cache must outlive ctx, or be detached first by
+   * passing nullptr. Used by SSLContext::setSessionCache().
+   */
+  static void install(SSL_CTX* ctx, SSLSessionCache* cache);
+
+  /**
+   * The cache installed on ctx, or nullptr.
+   */
+  static SSLSessionCache* fromSSLCtx(const SSL_CTX* ctx);
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Entry {
+    SSLSessionUniquePtr session;
+    Clock::time_point expiry;
+  };
+
+  struct Shard {
+    explicit Shard(size_t maxSize) : sessions(maxSize) {}
+
+    std::mutex mutex;
+    EvictingCacheMap<std::string, Entry> sessions;
+    uint64_t lookups{0};
+    uint64_t hits{0};
+    uint64_t expirations{0};
+    uint64_t stores{0};
+    uint64_t evictions{0};
+    uint64_t removals{0};
+  };
+
+  Shard& shardFor(const std::string& key);
+
+  static int getExDataIndex();
+  static int newSessionCallback(SSL* ssl, SSL_SESSION* session);
+  static void removeSessionCallback(SSL_CTX* ctx, SSL_SESSION* session);
+#if FOLLY_OPENSSL_IS_110
+  static SSL_SESSION*
+  getSessionCallback(SSL* ssl, const unsigned char* id, int len, int* copy);
+#else
+  static SSL_SESSION*
+  getSessionCallback(SSL* ssl, unsigned char* id, int len, int* copy);
+#endif
+
+  const Options options_;
+  std::vector<std::unique_ptr<CachelinePadded<Shard>>> shards_;
+  std::atomic<uint64_t> fullHandshakes_{0};
+  std::atomic<uint64_t> resumedHandshakes_{0};
+};
+
+} // namespace ssl
+} // namespace folly
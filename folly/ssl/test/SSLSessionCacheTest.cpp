@@ -0,0 +1,218 @@
+/*
+ * Copyright 2017 Facebook, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <folly/ssl/SSLSessionCache.h>
+
+#include <thread>
+#include <vector>
+
+#include <folly/Conv.h>
+#include <folly/portability/GTest.h>
+#include <folly/ssl/Init.h>
+
+using namespace std;
+using namespace folly;
+using namespace folly::ssl;
+
+namespace {
+
+class SSLSessionCacheTest : public testing::Test {
+ public:
+  void SetUp() override {
+    folly::ssl::init();
+  }
+
+  static SSLSessionUniquePtr makeSession(StringPiece id) {
+    SSLSessionUniquePtr session(SSL_SESSION_new());
+    SSL_SESSION_set1_id(
+        session.get(),
+        reinterpret_cast<const unsigned char*>(id.data()),
+        unsigned(id.size()));
+    SSL_SESSION_set_timeout(session.get(), 300);
+    return session;
+  }
+
+  static ByteRange idOf(StringPiece id) {
+    return ByteRange(id);
+  }
+};
+}
+
+TEST_F(SSLSessionCacheTest, AddGetRemove) {
+  SSLSessionCache cache;
+  auto session = makeSession("session-a");
+
+  EXPECT_TRUE(cache.add(session.get()));
+  EXPECT_EQ(1, cache.size());
+
+  auto found = cache.get(idOf("session-a"));
+  EXPECT_EQ(session.get(), found.get());
+  EXPECT_EQ(nullptr, cache.get(idOf("session-b")));
+
+  EXPECT_TRUE(cache.remove(idOf("session-a")));
+  EXPECT_FALSE(cache.remove(idOf("session-a")));
+  EXPECT_EQ(nullptr, cache.get(idOf("session-a")));
+  EXPECT_EQ(0, cache.size());
+
+  auto stats = cache.getStats();
+  EXPECT_EQ(1, stats.stores);
+  EXPECT_EQ(3, stats.lookups);
+  EXPECT_EQ(1, stats.hits);
+  EXPECT_EQ(2, stats.misses);
+  EXPECT_EQ(1, stats.removals);
+}
+
+TEST_F(SSLSessionCacheTest, RejectsSessionWithoutId) {
+  SSLSessionCache cache;
+  SSLSessionUniquePtr session(SSL_SESSION_new());
+  EXPECT_FALSE(cache.add(session.get()));
+  EXPECT_EQ(0, cache.size());
+}
+
+TEST_F(SSLSessionCacheTest, HoldsItsOwnReference) {
+  SSLSessionCache cache;
+  cache.add(makeSession("session-a").get());
+  auto found = cache.get(idOf("session-a"));
+  ASSERT_NE(nullptr, found);
+  unsigned int len = 0;
+  auto id = SSL_SESSION_get_id(found.get(), &len);
+  EXPECT_EQ("session-a", StringPiece(ByteRange(id, len)));
+}
+
+TEST_F(SSLSessionCacheTest, EvictsLeastRecentlyUsed) {
+  SSLSessionCache::Options options;
+  options.numShards = 1;
+  options.maxEntries = 2;
+  SSLSessionCache cache(options);
+
+  cache.add(makeSession("a").get());
+  cache.add(makeSession("b").get());
+  // Touch "a" so that "b" is the least recently used.
+  EXPECT_NE(nullptr, cache.get(idOf("a")));
+  cache.add(makeSession("c").get());
+
+  EXPECT_EQ(2, cache.size());
+  EXPECT_NE(nullptr, cache.get(idOf("a")));
+  EXPECT_EQ(nullptr, cache.get(idOf("b")));
+  EXPECT_NE(nullptr, cache.get(idOf("c")));
+  EXPECT_EQ(1, cache.getStats().evictions);
+}
+
+TEST_F(SSLSessionCacheTest, BoundedAcrossShards) {
+  SSLSessionCache::Options options;
+  options.numShards = 4;
+  options.maxEntries = 64;
+  SSLSessionCache cache(options);
+
+  for (int i = 0; i < 1000; ++i) {
+    cache.add(makeSession(to<std::string>("session-", i)).get());
+  }
+  EXPECT_LE(cache.size(), 64);
+  auto stats = cache.getStats();
+  EXPECT_EQ(1000, stats.stores);
+  EXPECT_EQ(1000 - cache.size(), stats.evictions);
+}
+
+TEST_F(SSLSessionCacheTest, Expiry) {
+  SSLSessionCache::Options options;
+  options.timeout = std::chrono::seconds(0);
+  SSLSessionCache cache(options);
+
+  cache.add(makeSession("session-a").get());
+  EXPECT_EQ(nullptr, cache.get(idOf("session-a")));
+  EXPECT_EQ(0, cache.size());
+  auto stats = cache.getStats();
+  EXPECT_EQ(1, stats.expirations);
+  EXPECT_EQ(1, stats.misses);
+}
+
+TEST_F(SSLSessionCacheTest, SessionTimeoutCapsExpiry) {
+  SSLSessionCache cache;
+  auto session = makeSession("session-a");
+  SSL_SESSION_set_timeout(session.get(), 0);
+  cache.add(session.get());
+  EXPECT_EQ(nullptr, cache.get(idOf("session-a")));
+}
+
+TEST_F(SSLSessionCacheTest, ExpiredSessionsPrunedOnAdd) {
+  SSLSessionCache::Options options;
+  options.numShards = 1;
+  SSLSessionCache cache(options);
+
+  auto stale = makeSession("stale");
+  SSL_SESSION_set_timeout(stale.get(), 0);
+  cache.add(stale.get());
+  cache.add(makeSession("fresh").get());
+  EXPECT_EQ(1, cache.size());
+  EXPECT_EQ(1, cache.getStats().expirations);
+}
+
+TEST_F(SSLSessionCacheTest, ResumptionRate) {
+  SSLSessionCache cache;
+  EXPECT_EQ(0.0, cache.getStats().resumptionRate());
+  cache.recordHandshake(false);
+  cache.recordHandshake(true);
+  cache.recordHandshake(true);
+  cache.recordHandshake(true);
+  auto stats = cache.getStats();
+  EXPECT_EQ(1, stats.fullHandshakes);
+  EXPECT_EQ(3, stats.resumedHandshakes);
+  EXPECT_DOUBLE_EQ(0.75, stats.resumptionRate());
+}
+
+TEST_F(SSLSessionCacheTest, InstallOnContext) {
+  SSLSessionCache cache;
+  auto ctx = SSL_CTX_new(SSLv23_method());
+  EXPECT_EQ(nullptr, SSLSessionCache::fromSSLCtx(ctx));
+
+  SSLSessionCache::install(ctx, &cache);
+  EXPECT_EQ(&cache, SSLSessionCache::fromSSLCtx(ctx));
+  EXPECT_TRUE(
+      SSL_CTX_get_session_cache_mode(ctx) & SSL_SESS_CACHE_NO_INTERNAL);
+
+  SSLSessionCache::install(ctx, nullptr);
+  EXPECT_EQ(nullptr, SSLSessionCache::fromSSLCtx(ctx));
+  EXPECT_FALSE(
+      SSL_CTX_get_session_cache_mode(ctx) & SSL_SESS_CACHE_NO_INTERNAL);
+  SSL_CTX_free(ctx);
+}
+
+TEST_F(SSLSessionCacheTest, ConcurrentAccess) {
+  SSLSessionCache::Options options;
+  options.maxEntries = 128;
+  SSLSessionCache cache(options);
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&cache, t] {
+      for (int i = 0; i < 1000; ++i) {
+        auto id = to<std::string>("session-", t, "-", i % 50);
+        if (!cache.get(idOf(id))) {
+          cache.add(makeSession(id).get());
+        }
+        if (i % 7 == 0) {
+          cache.remove(idOf(id));
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_LE(cache.size(), 128);
+  auto stats = cache.getStats();
+  EXPECT_EQ(4000, stats.lookups);
+}
@@ -199,6 +199,31 @@ TEST(Checksum, crc32_type) {
   testMatchesBoost32Type();
 }
 
+TEST(Checksum, crc32c_combine) {
+  for (auto expected : expectedResults) {
+    size_t partialLength = expected.length / 3;
+    size_t remainingLength = expected.length - partialLength;
+    uint32_t crc1 = folly::crc32c(buffer + expected.offset, partialLength);
+    uint32_t crc2 = folly::crc32c(
+        buffer + expected.offset + partialLength, remainingLength);
+    EXPECT_EQ(
+        expected.crc32c, folly::crc32c_combine(crc1, crc2, remainingLength));
+  }
+}
+
+TEST(Checksum, crc32_combine) {
+  for (auto expected : expectedResults) {
+    size_t partialLength = expected.length / 3;
+    size_t remainingLength = expected.length - partialLength;
+    uint32_t crc1 = folly::crc32(buffer + expected.offset, partialLength);
+    uint32_t crc2 = folly::crc32(
+        buffer + expected.offset + partialLength, remainingLength);
+    EXPECT_EQ(
+        folly::crc32(buffer + expected.offset, expected.length),
+        folly::crc32_combine(crc1, crc2, remainingLength));
+  }
+}
+
 void benchmarkHardwareCRC32C(unsigned long iters, size_t blockSize) {
   if (folly::detail::crc32c_hw_supported()) {
     uint32_t checksum;